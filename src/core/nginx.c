@@ -53,6 +53,14 @@ static ngx_conf_enum_t ngx_debug_points[] = {
         {ngx_null_string, 0}
 };
 
+
+static ngx_conf_enum_t ngx_shm_hugepages[] = {
+        {ngx_string("off"),    NGX_SHM_HUGEPAGES_OFF},
+        {ngx_string("advise"), NGX_SHM_HUGEPAGES_ADVISE},
+        {ngx_string("on"),     NGX_SHM_HUGEPAGES_ON},
+        {ngx_null_string, 0}
+};
+
 /*相关配置见ngx_event_core_commands ngx_http_core_commands ngx_stream_commands ngx_http_core_commands ngx_core_commands  ngx_mail_commands
 对应的存放参数的值的结构体为ngx_core_conf_t*/
 static ngx_command_t ngx_core_commands[] = {
@@ -122,6 +130,25 @@ static ngx_command_t ngx_core_commands[] = {
          offsetof(ngx_core_conf_t, debug_points),
          &ngx_debug_points},
 
+        /*
+         * shared_memory_hugepages off|advise|on 没有带hugepages参数的共享内存区默认的大页方式:
+         * advise为madvise(MADV_HUGEPAGE),on为MAP_HUGETLB,失败时退回到advise
+         */
+        {ngx_string("shared_memory_hugepages"),
+         NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_TAKE1,
+         ngx_conf_set_enum_slot,
+         0,
+         offsetof(ngx_core_conf_t, shm_hugepages),
+         &ngx_shm_hugepages},
+
+        //共享内存slab分配器按obj大小分级加锁,只对新建的共享内存区生效
+        {ngx_string("shared_memory_lock_striping"),
+         NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_FLAG,
+         ngx_conf_set_flag_slot,
+         0,
+         offsetof(ngx_core_conf_t, shm_lock_striping),
+         NULL},
+
         //worker进程运行的用户和用户组  user username [groupname],不设置groupname则group默认为username
         {ngx_string("user"),
          NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_TAKE12,
@@ -162,6 +189,14 @@ static ngx_command_t ngx_core_commands[] = {
          offsetof(ngx_core_conf_t, rlimit_core),
          NULL},
 
+        //每个worker缓存的内存池块总大小上限,0表示不缓存
+        {ngx_string("worker_pool_cache"),
+         NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_TAKE1,
+         ngx_conf_set_size_slot,
+         0,
+         offsetof(ngx_core_conf_t, pool_cache),
+         NULL},
+
         {ngx_string("worker_shutdown_timeout"),
          NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_msec_slot,
@@ -1136,9 +1171,12 @@ ngx_core_module_create_conf(ngx_cycle_t *cycle) {
 
     ccf->worker_processes = NGX_CONF_UNSET;
     ccf->debug_points = NGX_CONF_UNSET;
+    ccf->shm_hugepages = NGX_CONF_UNSET_UINT;
+    ccf->shm_lock_striping = NGX_CONF_UNSET;
 
     ccf->rlimit_nofile = NGX_CONF_UNSET;
     ccf->rlimit_core = NGX_CONF_UNSET;
+    ccf->pool_cache = NGX_CONF_UNSET_SIZE;
 
     ccf->user = (ngx_uid_t) NGX_CONF_UNSET_UINT;
     ccf->group = (ngx_gid_t) NGX_CONF_UNSET_UINT;
@@ -1163,6 +1201,9 @@ ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf) {
 
     ngx_conf_init_value(ccf->worker_processes, 1);
     ngx_conf_init_value(ccf->debug_points, 0);
+    ngx_conf_init_uint_value(ccf->shm_hugepages, NGX_SHM_HUGEPAGES_OFF);
+    ngx_conf_init_value(ccf->shm_lock_striping, 0);
+    ngx_conf_init_size_value(ccf->pool_cache, 512 * 1024);
 
 #if (NGX_HAVE_CPU_AFFINITY)
 
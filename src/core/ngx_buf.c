@@ -10,7 +10,7 @@
 
 
 ngx_buf_t *
-ngx_create_temp_buf(ngx_pool_t *pool, size_t size) {
+ngx_create_temp_buf_from(ngx_pool_t *pool, size_t size, const char *file) {
     ngx_buf_t *b;
 
     b = ngx_calloc_buf(pool); //这里面是为ngx_buf_t头部分配的空间
@@ -18,7 +18,7 @@ ngx_create_temp_buf(ngx_pool_t *pool, size_t size) {
         return NULL;
     }
 
-    b->start = ngx_palloc(pool, size); //这里面才是真正存储数据的空间
+    b->start = ngx_palloc_from(pool, size, file); //这里面才是真正存储数据的空间
     if (b->start == NULL) {
         return NULL;
     }
@@ -65,13 +65,14 @@ ngx_alloc_chain_link(ngx_pool_t *pool) {
 
 
 ngx_chain_t *
-ngx_create_chain_of_bufs(ngx_pool_t *pool, ngx_bufs_t *bufs) {
+ngx_create_chain_of_bufs_from(ngx_pool_t *pool, ngx_bufs_t *bufs,
+                              const char *file) {
     u_char *p;
     ngx_int_t i;
     ngx_buf_t *b;
     ngx_chain_t *chain, *cl, **ll;
 
-    p = ngx_palloc(pool, bufs->num * bufs->size);
+    p = ngx_palloc_from(pool, bufs->num * bufs->size, file);
     if (p == NULL) {
         return NULL;
     }
@@ -312,3 +313,19 @@ ngx_chain_update_sent(ngx_chain_t *in, off_t sent) {
 
     return in; //下次从这个in开始发送in->buf->pos
 }
+
+
+#undef ngx_create_temp_buf
+#undef ngx_create_chain_of_bufs
+
+
+ngx_buf_t *
+ngx_create_temp_buf(ngx_pool_t *pool, size_t size) {
+    return ngx_create_temp_buf_from(pool, size, NULL);
+}
+
+
+ngx_chain_t *
+ngx_create_chain_of_bufs(ngx_pool_t *pool, ngx_bufs_t *bufs) {
+    return ngx_create_chain_of_bufs_from(pool, bufs, NULL);
+}
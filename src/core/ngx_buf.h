@@ -262,6 +262,18 @@ ngx_buf_t *ngx_create_temp_buf(ngx_pool_t *pool, size_t size);
 
 ngx_chain_t *ngx_create_chain_of_bufs(ngx_pool_t *pool, ngx_bufs_t *bufs);
 
+ngx_buf_t *ngx_create_temp_buf_from(ngx_pool_t *pool, size_t size,
+                                    const char *file);
+
+ngx_chain_t *ngx_create_chain_of_bufs_from(ngx_pool_t *pool, ngx_bufs_t *bufs,
+                                           const char *file);
+
+//缓冲区内存记到调用者所在的源文件名下,见ngx_palloc_from
+#define ngx_create_temp_buf(pool, size)                                       \
+    ngx_create_temp_buf_from(pool, size, __FILE__)
+#define ngx_create_chain_of_bufs(pool, bufs)                                  \
+    ngx_create_chain_of_bufs_from(pool, bufs, __FILE__)
+
 
 #define ngx_alloc_buf(pool)  ngx_palloc(pool, sizeof(ngx_buf_t))
 #define ngx_calloc_buf(pool) ngx_pcalloc(pool, sizeof(ngx_buf_t))
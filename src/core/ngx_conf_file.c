@@ -1730,3 +1730,26 @@ ngx_conf_check_num_bounds(ngx_conf_t *cf, void *post, void *data) {
 
     return NGX_CONF_ERROR;
 }
+
+
+/*
+ * *_hash_max_size和*_hash_bucket_size:支持SSE2时hash总是用开放寻址的布局或
+ * 最小完美hash,大小自动决定,这两类指令不再起作用
+ */
+ngx_conf_post_t ngx_conf_hash_size_post = {ngx_conf_hash_size};
+
+
+char *
+ngx_conf_hash_size(ngx_conf_t *cf, void *post, void *data) {
+#if (NGX_HAVE_SSE2)
+    ngx_str_t *value;
+
+    value = cf->args->elts;
+
+    ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                       "the \"%V\" directive has no effect, "
+                       "hashes are sized automatically", &value[0]);
+#endif
+
+    return NGX_CONF_OK;
+}
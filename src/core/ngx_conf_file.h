@@ -238,6 +238,11 @@ char *ngx_conf_deprecated(ngx_conf_t *cf, void *post, void *data);
 
 char *ngx_conf_check_num_bounds(ngx_conf_t *cf, void *post, void *data);
 
+char *ngx_conf_hash_size(ngx_conf_t *cf, void *post, void *data);
+
+
+extern ngx_conf_post_t ngx_conf_hash_size_post;
+
 
 #define ngx_get_conf(conf_ctx, module)  conf_ctx[module.index]
 
@@ -953,6 +953,30 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle) {
 
 #endif /* NGX_HAVE_DEFERRED_ACCEPT */
 
+#if (NGX_HAVE_REUSEPORT_CBPF && defined SO_DETACH_REUSEPORT_BPF)
+
+        /*
+         * incoming_cpu的cBPF程序挂在整个reuseport组上,新配置去掉了incoming_cpu
+         * 时不会有worker再去替换它,由master摘掉,见ngx_event_incoming_cpu
+         */
+
+        if (ls[i].previous && ls[i].previous->incoming_cpu
+            && !ls[i].incoming_cpu && ls[i].worker == 0) {
+            value = 0;
+
+            if (setsockopt(ls[i].fd, SOL_SOCKET, SO_DETACH_REUSEPORT_BPF,
+                           (const void *) &value, sizeof(int))
+                == -1
+                && ngx_socket_errno != NGX_ENOENT) {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                              "setsockopt(SO_DETACH_REUSEPORT_BPF) "
+                              "for %V failed, ignored",
+                              &ls[i].addr_text);
+            }
+        }
+
+#endif
+
 #if (NGX_HAVE_IP_RECVDSTADDR)
 
         if (ls[i].wildcard
@@ -1008,6 +1032,24 @@ ngx_configure_listening_sockets(ngx_cycle_t *cycle) {
             }
         }
 
+#endif
+
+#if (NGX_HAVE_UDP_GRO)
+
+        if (ls[i].gro && ls[i].type == SOCK_DGRAM) {
+            value = 1;
+
+            if (setsockopt(ls[i].fd, SOL_UDP, UDP_GRO,
+                           (const void *) &value, sizeof(int))
+                == -1) {
+                ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                              "setsockopt(UDP_GRO) for %V failed, ignored",
+                              &ls[i].addr_text);
+
+                ls[i].gro = 0;
+            }
+        }
+
 #endif
     }
 
@@ -95,8 +95,12 @@ struct ngx_listening_s { //初始化及赋值见ngx_http_add_listening,热升级
     在子进程运行ngx_event_process_init函数的时候,通过ngx_add_event来控制子进程关注的listen,最终实现只关注master进程中创建的一个listen事件*/
     unsigned reuseport: 1;
     unsigned add_reuseport: 1;
+    unsigned incoming_cpu: 1; //listen ... reuseport incoming_cpu,按SO_INCOMING_CPU选择worker的套接字,见ngx_event_incoming_cpu
     unsigned keepalive: 2;
 
+    unsigned gso: 1; //listen ... udp gso,发送时把大小相同的多个数据报合并为一次UDP_SEGMENT发送
+    unsigned gro: 1; //listen ... udp gro,套接字设置UDP_GRO,接收到的合并数据报在ngx_event_recvmsg中拆分
+
     unsigned deferred_accept: 1; //SO_ACCEPTFILTER(freebsd所用)设置  TCP_DEFER_ACCEPT(LINUX系统所用)
     unsigned delete_deferred: 1;
     unsigned add_deferred: 1; //SO_ACCEPTFILTER(freebsd所用)设置  TCP_DEFER_ACCEPT(LINUX系统所用)
@@ -111,6 +115,9 @@ struct ngx_listening_s { //初始化及赋值见ngx_http_add_listening,热升级
     int fastopen;
 #endif
 
+    /* UDP监听,一次recvmmsg()/sendmmsg()最多处理的数据报个数,0或者1表示不使用批量收发 */
+    ngx_uint_t batch;
+
 };
 
 //本连接记录日志时的级别,它占用了3位,取值范围是0-7,但实际上目前只定义了5个值.见ngx_connection_s->log_error
@@ -360,6 +367,10 @@ struct ngx_connection_s { //cycle->read_events和cycle->write_events这两个数
 #if (NGX_THREADS || NGX_COMPAT)
     ngx_thread_task_t  *sendfile_task;
 #endif
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+    ngx_linux_sendzc_t *sendzc; //sendzc on时分配,见ngx_linux_sendzc_init
+#endif
 };
 
 
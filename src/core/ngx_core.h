@@ -57,6 +57,13 @@ NGX_ERROR:表示错误.这时会调用ngx_http_terminate_request终止请求.如
 #define  NGX_ABORT      -6
 
 
+/* ngx_cpuinfo()检测到的指令集扩展,用于运行时选择CRC32等函数的实现 */
+#define NGX_CPU_SSE42   0x0001
+#define NGX_CPU_PCLMUL  0x0002
+
+extern ngx_uint_t ngx_cpu_features;
+
+
 #include <ngx_errno.h>
 #include <ngx_atomic.h>
 #include <ngx_thread.h>
@@ -9,6 +9,9 @@
 #include <ngx_core.h>
 
 
+ngx_uint_t ngx_cpu_features;
+
+
 #if ((__i386__ || __amd64__) && (__GNUC__ || __INTEL_COMPILER))
 
 
@@ -89,6 +92,16 @@ ngx_cpuinfo(void) {
 
     ngx_cpuid(1, cpu);
 
+    /* CPUID.1:ECX, bit 20 - SSE4.2, bit 19 - SSE4.1, bit 1 - PCLMULQDQ */
+
+    if (cpu[3] & (1 << 20)) {
+        ngx_cpu_features |= NGX_CPU_SSE42;
+    }
+
+    if ((cpu[3] & (1 << 19)) && (cpu[3] & (1 << 1))) {
+        ngx_cpu_features |= NGX_CPU_PCLMUL;
+    }
+
     if (ngx_strcmp(vendor, "GenuineIntel") == 0) {
 
         switch ((cpu[0] & 0xf00) >> 8) {
@@ -13,10 +13,19 @@
 #include <ngx_core.h>
 
 
+/* 不短于该长度的数据在CPU支持PCLMULQDQ时按16字节块折叠计算 */
+#define NGX_CRC32_CLMUL_MIN  64
+
+
 extern uint32_t *ngx_crc32_table_short;
 extern uint32_t ngx_crc32_table256[];
 
 
+#if (NGX_HAVE_PCLMUL)
+uint32_t ngx_crc32_clmul(uint32_t crc, u_char *p, size_t len);
+#endif
+
+
 static ngx_inline uint32_t
 ngx_crc32_short(u_char *p, size_t len) {
     u_char c;
@@ -40,6 +49,14 @@ ngx_crc32_long(u_char *p, size_t len) {
 
     crc = 0xffffffff;
 
+#if (NGX_HAVE_PCLMUL)
+    if (len >= NGX_CRC32_CLMUL_MIN && (ngx_cpu_features & NGX_CPU_PCLMUL)) {
+        crc = ngx_crc32_clmul(crc, p, len & ~((size_t) 15));
+        p += len & ~((size_t) 15);
+        len &= 15;
+    }
+#endif
+
     while (len--) {
         crc = ngx_crc32_table256[(crc ^ *p++) & 0xff] ^ (crc >> 8);
     }
@@ -58,6 +75,14 @@ ngx_crc32_update(uint32_t *crc, u_char *p, size_t len) {
 
     c = *crc;
 
+#if (NGX_HAVE_PCLMUL)
+    if (len >= NGX_CRC32_CLMUL_MIN && (ngx_cpu_features & NGX_CPU_PCLMUL)) {
+        c = ngx_crc32_clmul(c, p, len & ~((size_t) 15));
+        p += len & ~((size_t) 15);
+        len &= 15;
+    }
+#endif
+
     while (len--) {
         c = ngx_crc32_table256[(c ^ *p++) & 0xff] ^ (c >> 8);
     }
@@ -70,6 +95,25 @@ ngx_crc32_update(uint32_t *crc, u_char *p, size_t len) {
     crc ^= 0xffffffff
 
 
+/*
+ * CRC32C(Castagnoli多项式),与ngx_crc32_init()/ngx_crc32_final()配合使用,
+ * CPU支持SSE4.2时使用crc32指令计算
+ */
+void ngx_crc32c_update(uint32_t *crc, u_char *p, size_t len);
+
+
+static ngx_inline uint32_t
+ngx_crc32c(u_char *p, size_t len) {
+    uint32_t crc;
+
+    ngx_crc32_init(crc);
+    ngx_crc32c_update(&crc, p, len);
+    ngx_crc32_final(crc);
+
+    return crc;
+}
+
+
 ngx_int_t ngx_crc32_table_init(void);
 
 
@@ -19,6 +19,8 @@ static ngx_int_t ngx_test_lockfile(u_char *file, ngx_log_t *log);
 
 static void ngx_clean_old_cycles(ngx_event_t *ev);
 
+static void ngx_reuse_free(ngx_cycle_t *cycle, ngx_cycle_t *old_cycle);
+
 static void ngx_shutdown_timer_handler(ngx_event_t *ev);
 
 //初始化参考ngx_init_cycle,最终有一个全局类型的ngx_cycle_s,即ngx_cycle
@@ -287,6 +289,14 @@ ngx_init_cycle(ngx_cycle_t *old_cycle) {
         return NULL;
     }
 
+    n = old_cycle->reuse.nelts ? old_cycle->reuse.nelts : 4;
+
+    if (ngx_array_init(&cycle->reuse, pool, n, sizeof(ngx_reuse_t *))
+        != NGX_OK) {
+        ngx_destroy_pool(pool);
+        return NULL;
+    }
+
     n = old_cycle->listening.nelts ? old_cycle->listening.nelts : 10;
 
     if (ngx_array_init(&cycle->listening, pool, n, sizeof(ngx_listening_t))
@@ -573,6 +583,7 @@ ngx_init_cycle(ngx_cycle_t *old_cycle) {
                 && shm_zone[i].shm.size == oshm_zone[n].shm.size
                 && !shm_zone[i].noreuse) {
                 shm_zone[i].shm.addr = oshm_zone[n].shm.addr;
+                shm_zone[i].shm.hugetlb = oshm_zone[n].shm.hugetlb;
 #if (NGX_WIN32)
                 shm_zone[i].shm.handle = oshm_zone[n].shm.handle;
 #endif
@@ -588,6 +599,10 @@ ngx_init_cycle(ngx_cycle_t *old_cycle) {
             break;
         }
 
+        if (shm_zone[i].shm.hugepages == NGX_SHM_HUGEPAGES_OFF) {
+            shm_zone[i].shm.hugepages = ccf->shm_hugepages;
+        }
+
         if (ngx_shm_alloc(&shm_zone[i].shm) != NGX_OK) {
             goto failed;
         }
@@ -872,6 +887,7 @@ ngx_init_cycle(ngx_cycle_t *old_cycle) {
 
     if (ngx_process == NGX_PROCESS_MASTER || ngx_is_init_cycle(old_cycle)) {
 
+        ngx_reuse_free(old_cycle, NULL);
         ngx_destroy_pool(old_cycle->pool);
         cycle->old_cycle = NULL;
 
@@ -1017,6 +1033,8 @@ ngx_init_cycle(ngx_cycle_t *old_cycle) {
         continue;
     }
 
+    ngx_reuse_free(cycle, old_cycle);
+
     if (ngx_test_config) {
         ngx_destroy_cycle_pools(&conf);
         return NULL;
@@ -1051,6 +1069,7 @@ static ngx_int_t
 ngx_init_zone_pool(ngx_cycle_t *cycle, ngx_shm_zone_t *zn) {
     u_char *file;
     ngx_slab_pool_t *sp;
+    ngx_core_conf_t *ccf;
     //共享内存的起始地址开始的sizeof(ngx_slab_pool_t)字节是用来存储管理共享内存的slab poll的
     sp = (ngx_slab_pool_t *) zn->shm.addr;  //共享内存起始地址
 
@@ -1090,6 +1109,10 @@ ngx_init_zone_pool(ngx_cycle_t *cycle, ngx_shm_zone_t *zn) {
 
     file = NULL;
 
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    sp->striped = ccf->shm_lock_striping ? 1 : 0;
+
 #else
 
     file = ngx_pnalloc(cycle->pool,
@@ -1450,6 +1473,8 @@ ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name, size_t size, void *tag) {
     shm_zone->shm.size = size;
     shm_zone->shm.name = *name;
     shm_zone->shm.exists = 0;
+    shm_zone->shm.hugepages = NGX_SHM_HUGEPAGES_OFF;
+    shm_zone->shm.hugetlb = 0;
     shm_zone->init = NULL;
     shm_zone->tag = tag;
     shm_zone->noreuse = 0;
@@ -1497,6 +1522,7 @@ ngx_clean_old_cycles(ngx_event_t *ev) {
 
         ngx_log_debug1(NGX_LOG_DEBUG_CORE, log, 0, "clean old cycle: %ui", i);
 
+        ngx_reuse_free(cycle[i], NULL);
         ngx_destroy_pool(cycle[i]->pool);
         cycle[i] = NULL;
     }
@@ -1514,6 +1540,128 @@ ngx_clean_old_cycles(ngx_event_t *ev) {
 }
 
 
+/* 从旧cycle接过name和key都相同的数据,没有时返回NULL */
+
+ngx_reuse_t *
+ngx_reuse_get(ngx_conf_t *cf, ngx_str_t *name, uint32_t key) {
+    ngx_uint_t i;
+    ngx_cycle_t *old_cycle;
+    ngx_reuse_t *rs, **prs;
+
+    old_cycle = cf->cycle->old_cycle;
+
+    if (old_cycle == NULL || ngx_is_init_cycle(old_cycle)) {
+        return NULL;
+    }
+
+    prs = old_cycle->reuse.elts;
+
+    for (i = 0; i < old_cycle->reuse.nelts; i++) {
+        rs = prs[i];
+
+        if (rs->key != key
+            || rs->name.len != name->len
+            || ngx_strncmp(rs->name.data, name->data, name->len) != 0) {
+            continue;
+        }
+
+        if (rs->cycle != cf->cycle) {
+            prs = ngx_array_push(&cf->cycle->reuse);
+            if (prs == NULL) {
+                return NULL;
+            }
+
+            *prs = rs;
+            rs->cycle = cf->cycle;
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_CORE, cf->log, 0,
+                       "reuse \"%V\"", name);
+
+        return rs;
+    }
+
+    return NULL;
+}
+
+
+/* 登记在pool中建好的数据,此后pool归ngx_reuse_t所有 */
+
+ngx_reuse_t *
+ngx_reuse_add(ngx_conf_t *cf, ngx_str_t *name, uint32_t key,
+              ngx_pool_t *pool) {
+    ngx_reuse_t *rs, **prs;
+
+    rs = ngx_palloc(pool, sizeof(ngx_reuse_t));
+    if (rs == NULL) {
+        return NULL;
+    }
+
+    rs->name.len = name->len;
+    rs->name.data = ngx_pstrdup(pool, name);
+    if (rs->name.data == NULL) {
+        return NULL;
+    }
+
+    prs = ngx_array_push(&cf->cycle->reuse);
+    if (prs == NULL) {
+        return NULL;
+    }
+
+    *prs = rs;
+
+    rs->key = key;
+    rs->data = NULL;
+    rs->pool = pool;
+    rs->cycle = cf->cycle;
+
+    return rs;
+}
+
+
+/*
+ * cycle不再使用时释放只有它在用的数据;old_cycle不为NULL表示新cycle初始化
+ * 失败,从old_cycle接过来的数据还给old_cycle
+ */
+
+static void
+ngx_reuse_free(ngx_cycle_t *cycle, ngx_cycle_t *old_cycle) {
+    ngx_uint_t i, n;
+    ngx_reuse_t *rs, **prs, **ors;
+
+    prs = cycle->reuse.elts;
+
+    for (i = 0; i < cycle->reuse.nelts; i++) {
+        rs = prs[i];
+
+        if (rs->cycle != cycle) {
+            continue;
+        }
+
+        if (old_cycle) {
+            ors = old_cycle->reuse.elts;
+
+            for (n = 0; n < old_cycle->reuse.nelts; n++) {
+                if (ors[n] == rs) {
+                    break;
+                }
+            }
+
+            if (n < old_cycle->reuse.nelts) {
+                rs->cycle = old_cycle;
+                continue;
+            }
+        }
+
+        ngx_log_debug1(NGX_LOG_DEBUG_CORE, cycle->log, 0,
+                       "free reuse \"%V\"", &rs->name);
+
+        rs->pool->log = cycle->log;
+        ngx_destroy_pool(rs->pool);
+    }
+}
+
+
 void
 ngx_set_shutdown_timer(ngx_cycle_t *cycle) {
     ngx_core_conf_t *ccf;
@@ -29,6 +29,20 @@ typedef ngx_int_t (*ngx_shm_zone_init_pt)(ngx_shm_zone_t *zone, void *data);
 /*在ngx_http_upstream_cache_get中获取zone的时候获取的是fastcgi_cache proxy_cache设置的zone,
 因此必须配置fastcgi_cache (proxy_cache) abc;中的xxx和xxx_cache_path(proxy_cache_path fastcgi_cache_path) xxx keys_zone=abc:10m;一致
 所有的共享内存都通过ngx_http_file_cache_s->shpool进行管理,每个共享内存对应一个ngx_slab_pool_t来管理,见ngx_init_zone_pool*/
+/*
+ * 在自己的内存池中建好、不依赖cycle的配置数据(如二进制map base),以name和
+ * 内容的key标识.reload时新cycle用ngx_reuse_get从旧cycle接过来,不必重建,
+ * 最后一个用到它的cycle销毁时才释放内存池
+ */
+typedef struct {
+    ngx_str_t name;
+    uint32_t key;
+    void *data;
+    ngx_pool_t *pool;
+    ngx_cycle_t *cycle;        //最近用到它的cycle
+} ngx_reuse_t;
+
+
 struct ngx_shm_zone_s {  //初始化见ngx_shared_memory_add,真正的共享内存创建在ngx_init_cycle->ngx_init_cycle
     void *data; //指向ngx_http_file_cache_t,赋值见ngx_http_file_cache_set_slot
     ngx_shm_t shm; //ngx_init_cycle->ngx_shm_alloc->ngx_shm_alloc中创建相应的共享内存空间
@@ -122,6 +136,9 @@ struct ngx_cycle_s {
     //ngx_shared_memory_add把这些信息保存到shared_memory链表,ngx_init_cycle解析完配置文件后进行共享内存真正的统一分配
     ngx_list_t shared_memory; // 单链表容器,元素类型是ngx_shm_zone_t结构体,每个元素表示一块共享内存
 
+    //成员类型ngx_reuse_t *,本cycle用到的可以在reload之间复用的配置数据,见ngx_reuse_get
+    ngx_array_t reuse;
+
     //最开始free_connection_n=connection_n,见ngx_event_process_init
     ngx_uint_t connection_n; // 当前进程中所有链接对象的总数,与成员配合使用
     ngx_uint_t files_n; //每个进程能够打开的最多文件数  赋值见ngx_event_process_init
@@ -169,11 +186,15 @@ typedef struct { //从ngx_cycle_s->conf_ctx[ngx_core_module.index]指向这里
 
     ngx_int_t worker_processes; //创建的worker进程数,通过nginx配置,默认为1  "worker_processes"设置
     ngx_int_t debug_points;
+    ngx_uint_t shm_hugepages; //shared_memory_hugepages,NGX_SHM_HUGEPAGES_*
+    ngx_flag_t shm_lock_striping; //shared_memory_lock_striping on时slab按大小分级加锁
     //修改工作进程的打开文件数的最大值限制(RLIMIT_NOFILE),用于在不重启主进程的情况下增大该限制
     ngx_int_t rlimit_nofile;
     //修改工作进程的core文件尺寸的最大值限制(RLIMIT_CORE),用于在不重启主进程的情况下增大该限制.
     off_t rlimit_core; //worker_rlimit_core 1024k;  coredump文件大小
 
+    size_t pool_cache; //worker_pool_cache 512k; worker中缓存的内存池块总大小上限
+
     int priority;
 
     ngx_uint_t cpu_affinity_auto;
@@ -228,6 +249,11 @@ ngx_shm_zone_t *ngx_shared_memory_add(ngx_conf_t *cf, ngx_str_t *name,
 
 void ngx_set_shutdown_timer(ngx_cycle_t *cycle);
 
+ngx_reuse_t *ngx_reuse_get(ngx_conf_t *cf, ngx_str_t *name, uint32_t key);
+
+ngx_reuse_t *ngx_reuse_add(ngx_conf_t *cf, ngx_str_t *name, uint32_t key,
+    ngx_pool_t *pool);
+
 
 extern volatile ngx_cycle_t *ngx_cycle;
 extern ngx_array_t ngx_old_cycles;
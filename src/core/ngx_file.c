@@ -139,6 +139,15 @@ ngx_write_chain_to_temp_file(ngx_temp_file_t *tf, ngx_chain_t *chain) {
                                               tf->pool);
     }
 
+#endif
+
+#if (NGX_HAVE_FILE_AIO_WRITE)
+
+    if (tf->aio_write) {
+        return ngx_file_aio_write_chain(&tf->file, chain, tf->offset,
+                                        tf->pool);
+    }
+
 #endif
     //写临时文件的时候更新tf->file->offset  tf->file->sys_offset(也就是ngx_file_t中的成员)  tf->offset(这里是ngx_temp_file_t->offset)在该函数外层更新
     return ngx_write_chain_to_file(&tf->file, chain, tf->offset, tf->pool);
@@ -172,6 +172,7 @@ typedef struct { //ngx_http_write_request_body中会创建该结构并赋值,临
     //默认会清除,见ngx_create_temp_file  后端缓存临时文件时会删除的,但是缓存请求包体有"clean"开关控制
     unsigned clean: 1; //文件时临时的,关闭连接会删除文件,ngx_pool_delete_file  request_body_in_clean_file
     unsigned thread_write: 1;
+    unsigned aio_write: 1; //aio on并且aio_write on时,通过io_uring异步写临时文件
 } ngx_temp_file_t;  //这里面的参数使用见ngx_write_chain_to_temp_file创建临时文件
 
 
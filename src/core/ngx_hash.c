@@ -8,6 +8,115 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 
+#if (NGX_HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
+
+#define NGX_HASH_PERFECT_LOAD    4 //最小完美hash平均每个小桶的key数
+#define NGX_HASH_PERFECT_TRIES   65536 //每个小桶最多试这么多个种子
+#define NGX_HASH_PERFECT_NONE    (ngx_uint_t) -1
+
+
+static ngx_int_t ngx_hash_perfect_init(ngx_hash_init_t *hinit,
+                                       ngx_hash_key_t *names, ngx_uint_t nelts);
+
+static ngx_int_t ngx_hash_table_init(ngx_hash_init_t *hinit,
+                                     ngx_hash_key_t *names, ngx_uint_t nelts);
+
+
+/*
+ * 调用方传进来的key是ngx_hash()逐字节累乘31得到的,低位分布不够均匀,
+ * 先打散再分成控制字节(低7位)和组号(其余位)
+ */
+static ngx_inline uint32_t
+ngx_hash_mix(ngx_uint_t key) {
+    uint32_t h;
+
+    h = (uint32_t) key;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+//用小桶的种子重新打散key,再用乘法把32位的值映射到[0, n)
+#define ngx_hash_perfect_slot(key, seed, n)                                   \
+    (ngx_uint_t) (((uint64_t) ngx_hash_mix((key) ^ ((seed) * 0x9e3779b9))      \
+                   * (n)) >> 32)
+
+
+static ngx_inline void *
+ngx_hash_find_perfect(ngx_hash_t *hash, ngx_uint_t key, u_char *name,
+                      size_t len) {
+    uint32_t seed;
+    ngx_hash_elt_t *elt;
+
+    seed = hash->seeds[ngx_hash_mix(key) & hash->pmask];
+
+    elt = hash->buckets[ngx_hash_perfect_slot(key, seed, hash->size)];
+
+    if (len == (size_t) elt->len && ngx_memcmp(name, elt->name, len) == 0) {
+        return elt->value;
+    }
+
+    return NULL;
+}
+
+
+#if (NGX_HAVE_SSE2)
+
+
+void *
+ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len) {
+    uint32_t h;
+    ngx_uint_t g, i, mask;
+    unsigned match, empty;
+    __m128i tag, ctrl;
+    ngx_hash_elt_t *elt;
+
+    if (hash->seeds) {
+        return ngx_hash_find_perfect(hash, key, name, len);
+    }
+
+    h = ngx_hash_mix(key);
+
+    tag = _mm_set1_epi8((char) (h & 0x7f));
+    mask = hash->size - 1;
+
+    for (g = (h >> 7) & mask; /* void */ ; g = (g + 1) & mask) {
+
+        ctrl = _mm_loadu_si128((__m128i *) &hash->ctrl[g * NGX_HASH_GROUP]);
+
+        match = _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, tag));
+
+        while (match) {
+            i = g * NGX_HASH_GROUP + __builtin_ctz(match);
+            match &= match - 1;
+
+            elt = hash->buckets[i];
+
+            if (len == (size_t) elt->len
+                && ngx_memcmp(name, elt->name, len) == 0) {
+                return elt->value;
+            }
+        }
+
+        /* 控制字节只有空槽的最高位是1,组里有空槽说明key不存在 */
+
+        empty = _mm_movemask_epi8(ctrl);
+
+        if (empty) {
+            return NULL;
+        }
+    }
+}
+
+#else
 
 void *
 ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len) {
@@ -18,6 +127,10 @@ ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len) {
     ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0, "hf:\"%*s\"", len, name);
 #endif
 
+    if (hash->seeds) {
+        return ngx_hash_find_perfect(hash, key, name, len);
+    }
+
     elt = hash->buckets[key % hash->size];
 
     if (elt == NULL) {
@@ -47,6 +160,8 @@ ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len) {
     return NULL;
 }
 
+#endif
+
 /*nginx为了处理带有通配符的域名的匹配问题,实现了ngx_hash_wildcard_t这样的hash表.他可以支持两种类型的带有通配符的域名.一种是通配符在前的,
 例如:"*.abc.com",也可以省略掉星号,直接写成".abc.com".这样的key,可以匹配www.abc.com,qqq.www.abc.com之类的.另外一种是通配符在末
 尾的,例如:"mail.xxx.*",请特别注意通配符在末尾的不像位于开始的通配符可以被省略掉.这样的通配符,可以匹配mail.xxx.com、mail.xxx.com.cn、
@@ -279,6 +394,404 @@ ngx_hash_find_combined(ngx_hash_combined_t *hash, ngx_uint_t key, u_char *name,
 #define NGX_HASH_ELT_SIZE(name)                                               \
     (sizeof(void *) + ngx_align((name)->key.len + 2, sizeof(void *)))
 
+
+//使用方法可以参考ngx_http_server_names
+ngx_int_t
+ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts) {
+    ngx_int_t rc;
+
+    if (hinit->perfect) {
+        rc = ngx_hash_perfect_init(hinit, names, nelts);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+    }
+
+    rc = ngx_hash_table_init(hinit, names, nelts);
+
+    if (rc == NGX_OK) {
+        hinit->hash->seeds = NULL;
+    }
+
+    return rc;
+}
+
+
+/*
+ * CHD方式的最小完美hash:n个key按hash分到约n/4个小桶里,从大到小依次给每个小桶
+ * 找一个种子,使桶里的key用这个种子打散后都落到还没被占用的槽上.查找时一次
+ * 定位,只比较一次key.两个不同的key截断后的32位hash相同,或者某个小桶找不到
+ * 种子时返回NGX_DECLINED,由调用方改用普通布局
+ */
+static ngx_int_t
+ngx_hash_perfect_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+                      ngx_uint_t nelts) {
+    u_char *elts;
+    size_t len, size;
+    uint32_t seed, *seeds, *hashes;
+    uint64_t start;
+    ngx_int_t rc;
+    ngx_uint_t i, j, k, m, n, b, r, s, count, max;
+    ngx_uint_t *next, *first, *sizes, *order, *owner;
+    ngx_hash_elt_t *elt, **buckets;
+    struct timeval tv;
+
+    ngx_gettimeofday(&tv);
+    start = (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+
+    count = 0;
+
+    for (n = 0; n < nelts; n++) {
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        if (names[n].key.len > 65535) {
+            return NGX_DECLINED;
+        }
+
+        count++;
+    }
+
+    if (count == 0) {
+        return NGX_DECLINED;
+    }
+
+    for (r = 1; r * NGX_HASH_PERFECT_LOAD < count; r <<= 1) {
+        /* void */
+    }
+
+    /*
+     * 临时空间:hashes[]和next[]按names[]下标,next[]把同一个小桶的key
+     * 按names[]原来的顺序串起来,first[]是链表头,owner[]是每个槽的key
+     */
+
+    size = nelts * (sizeof(uint32_t) + sizeof(ngx_uint_t))
+           + r * 3 * sizeof(ngx_uint_t) + count * sizeof(ngx_uint_t)
+           + sizeof(ngx_uint_t);
+
+    hashes = ngx_alloc(size, hinit->pool->log);
+    if (hashes == NULL) {
+        return NGX_ERROR;
+    }
+
+    next = (ngx_uint_t *) ngx_align_ptr(hashes + nelts, sizeof(ngx_uint_t));
+    first = next + nelts;
+    sizes = first + r;
+    order = sizes + r;
+    owner = order + r;
+
+    for (b = 0; b < r; b++) {
+        first[b] = NGX_HASH_PERFECT_NONE;
+        sizes[b] = 0;
+    }
+
+    for (n = nelts; n--; /* void */) {
+        next[n] = NGX_HASH_PERFECT_NONE;
+
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        hashes[n] = ngx_hash_mix(names[n].key_hash);
+
+        b = hashes[n] & (r - 1);
+
+        next[n] = first[b];
+        first[b] = n;
+    }
+
+    rc = NGX_DECLINED;
+
+    /*
+     * 去掉重复的key,和普通布局一样保留先加入的那个;
+     * hash相同的不同key不论用什么种子都会落到同一个槽
+     */
+
+    m = 0;
+    max = 0;
+
+    for (b = 0; b < r; b++) {
+
+        for (i = first[b]; i != NGX_HASH_PERFECT_NONE; i = next[i]) {
+
+            for (k = i, j = next[i]; j != NGX_HASH_PERFECT_NONE; j = next[k]) {
+
+                if (hashes[j] != hashes[i]) {
+                    k = j;
+                    continue;
+                }
+
+                if (names[j].key.len != names[i].key.len
+                    || ngx_strncasecmp(names[j].key.data, names[i].key.data,
+                                       names[i].key.len)
+                       != 0) {
+                    goto failed;
+                }
+
+                next[k] = next[j];
+            }
+
+            sizes[b]++;
+        }
+
+        m += sizes[b];
+
+        if (sizes[b] > max) {
+            max = sizes[b];
+        }
+    }
+
+    if (max > 8 * NGX_HASH_PERFECT_LOAD) {
+        goto failed;
+    }
+
+    /* 按小桶里key的个数从多到少排,先放难放的小桶 */
+
+    for (k = 0, j = max; j > 0; j--) {
+        for (b = 0; b < r; b++) {
+            if (sizes[b] == j) {
+                order[k++] = b;
+            }
+        }
+    }
+
+    seeds = ngx_pcalloc(hinit->pool, r * sizeof(uint32_t));
+    if (seeds == NULL) {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    for (s = 0; s < m; s++) {
+        owner[s] = NGX_HASH_PERFECT_NONE;
+    }
+
+    for (j = 0; j < k; j++) {
+        b = order[j];
+
+        for (seed = 1; seed < NGX_HASH_PERFECT_TRIES; seed++) {
+
+            for (i = first[b]; i != NGX_HASH_PERFECT_NONE; i = next[i]) {
+                s = ngx_hash_perfect_slot(names[i].key_hash, seed, m);
+
+                if (owner[s] != NGX_HASH_PERFECT_NONE) {
+                    break;
+                }
+
+                owner[s] = i;
+            }
+
+            if (i == NGX_HASH_PERFECT_NONE) {
+                break;
+            }
+
+            /* 撤销这个种子已经占的槽 */
+
+            for (n = first[b]; n != i; n = next[n]) {
+                owner[ngx_hash_perfect_slot(names[n].key_hash, seed, m)] =
+                    NGX_HASH_PERFECT_NONE;
+            }
+        }
+
+        if (seed == NGX_HASH_PERFECT_TRIES) {
+            goto failed;
+        }
+
+        seeds[b] = seed;
+    }
+
+    len = 0;
+
+    for (s = 0; s < m; s++) {
+        len += NGX_HASH_ELT_SIZE(&names[owner[s]]);
+    }
+
+    if (hinit->hash == NULL) {
+        hinit->hash = ngx_pcalloc(hinit->pool, sizeof(ngx_hash_wildcard_t));
+        if (hinit->hash == NULL) {
+            rc = NGX_ERROR;
+            goto failed;
+        }
+    }
+
+    buckets = ngx_palloc(hinit->pool, m * sizeof(ngx_hash_elt_t *));
+    if (buckets == NULL) {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    elts = ngx_palloc(hinit->pool, len + ngx_cacheline_size);
+    if (elts == NULL) {
+        rc = NGX_ERROR;
+        goto failed;
+    }
+
+    elts = ngx_align_ptr(elts, ngx_cacheline_size);
+
+    /* 元素按槽的顺序存放 */
+
+    for (s = 0; s < m; s++) {
+        n = owner[s];
+
+        elt = (ngx_hash_elt_t *) elts;
+        elts += NGX_HASH_ELT_SIZE(&names[n]);
+
+        elt->value = names[n].value;
+        elt->len = (u_short) names[n].key.len;
+
+        ngx_strlow(elt->name, names[n].key.data, names[n].key.len);
+
+        buckets[s] = elt;
+    }
+
+    ngx_free(hashes);
+
+    hinit->hash->buckets = buckets;
+    hinit->hash->size = m;
+    hinit->hash->seeds = seeds;
+    hinit->hash->pmask = r - 1;
+    hinit->hash->ctrl = NULL;
+
+    ngx_gettimeofday(&tv);
+
+    size = m * sizeof(ngx_hash_elt_t *) + r * sizeof(uint32_t) + len;
+
+    if (ngx_dump_config) {
+        ngx_log_stderr(0, "perfect %s: %ui keys, %ui seeds, %uz bytes, %uLus",
+                       hinit->name, m, r, size,
+                       (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec - start);
+
+    } else {
+        ngx_log_debug5(NGX_LOG_DEBUG_CORE, hinit->pool->log, 0,
+                       "perfect %s: %ui keys, %ui seeds, %uz bytes, %uLus",
+                       hinit->name, m, r, size,
+                       (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec - start);
+    }
+
+    return NGX_OK;
+
+failed:
+
+    ngx_free(hashes);
+
+    if (rc == NGX_DECLINED) {
+        ngx_log_debug1(NGX_LOG_DEBUG_CORE, hinit->pool->log, 0,
+                       "could not build perfect %s", hinit->name);
+    }
+
+    return rc;
+}
+
+
+#if (NGX_HAVE_SSE2)
+
+/*
+ * 开放寻址布局的构建:组数取能让装载率不超过7/8的最小的2的幂,保证总有空槽,
+ * 按组线性探测,放进第一个有空槽的组.max_size和bucket_size都不再需要
+ */
+static ngx_int_t
+ngx_hash_table_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+                    ngx_uint_t nelts) {
+    u_char *elts, *ctrl;
+    size_t len;
+    uint32_t h;
+    ngx_uint_t i, n, g, size, count, mask;
+    ngx_hash_elt_t *elt, **buckets;
+
+    len = 0;
+    count = 0;
+
+    for (n = 0; n < nelts; n++) {
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        if (names[n].key.len > 65535) {
+            ngx_log_error(NGX_LOG_EMERG, hinit->pool->log, 0,
+                          "could not build %s, too long key \"%*s...\"",
+                          hinit->name, 32, names[n].key.data);
+            return NGX_ERROR;
+        }
+
+        len += NGX_HASH_ELT_SIZE(&names[n]);
+        count++;
+    }
+
+    for (size = 1; size * NGX_HASH_GROUP * 7 / 8 <= count; size <<= 1) {
+        /* void */
+    }
+
+    if (hinit->hash == NULL) {
+        hinit->hash = ngx_pcalloc(hinit->pool, sizeof(ngx_hash_wildcard_t));
+        if (hinit->hash == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    buckets = ngx_pcalloc(hinit->pool,
+                          size * NGX_HASH_GROUP * sizeof(ngx_hash_elt_t *));
+    if (buckets == NULL) {
+        return NGX_ERROR;
+    }
+
+    ctrl = ngx_pnalloc(hinit->pool, size * NGX_HASH_GROUP);
+    if (ctrl == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memset(ctrl, NGX_HASH_EMPTY, size * NGX_HASH_GROUP);
+
+    elts = ngx_palloc(hinit->pool, len + ngx_cacheline_size);
+    if (elts == NULL) {
+        return NGX_ERROR;
+    }
+
+    elts = ngx_align_ptr(elts, ngx_cacheline_size);
+
+    mask = size - 1;
+
+    for (n = 0; n < nelts; n++) {
+        if (names[n].key.data == NULL) {
+            continue;
+        }
+
+        elt = (ngx_hash_elt_t *) elts;
+        elts += NGX_HASH_ELT_SIZE(&names[n]);
+
+        elt->value = names[n].value;
+        elt->len = (u_short) names[n].key.len;
+
+        ngx_strlow(elt->name, names[n].key.data, names[n].key.len);
+
+        h = ngx_hash_mix(names[n].key_hash);
+
+        /* 重复的key放在后面,查找时总是先找到先加入的那个,和桶布局一致 */
+
+        for (g = (h >> 7) & mask; /* void */ ; g = (g + 1) & mask) {
+
+            for (i = g * NGX_HASH_GROUP; i < (g + 1) * NGX_HASH_GROUP; i++) {
+                if (ctrl[i] == NGX_HASH_EMPTY) {
+                    goto found;
+                }
+            }
+        }
+
+    found:
+
+        ctrl[i] = (u_char) (h & 0x7f);
+        buckets[i] = elt;
+    }
+
+    hinit->hash->buckets = buckets;
+    hinit->hash->size = size;
+    hinit->hash->ctrl = ctrl;
+
+    return NGX_OK;
+}
+
+#else
+
 /*其names参数是ngx_hash_key_t结构的数组,即键-值对<key,value>数组,nelts表示该数组元素的个数
 该函数初始化的结果就是将names数组保存的键-值对<key,value>,通过hash的方式将其存入相应的一个或多个hash桶(即代码中的buckets)中,
 该hash过程用到的hash函数一般为ngx_hash_key_lc等.hash桶里面存放的是ngx_hash_elt_t结构的指针(hash元素指针),该指针指向一个基本
@@ -316,8 +829,9 @@ ngx_hash_find_combined(ngx_hash_combined_t *hash, ngx_uint_t key, u_char *name,
 36.
 37.     */
 //使用方法可以参考ngx_http_server_names
-ngx_int_t
-ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts) { //使用方法可以参考ngx_http_server_names
+static ngx_int_t
+ngx_hash_table_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+                    ngx_uint_t nelts) { //使用方法可以参考ngx_http_server_names
     //参考http://www.oschina.net/question/234345_42065  http://www.bkjia.com/ASPjc/905190.html
     u_char *elts;
     size_t len;
@@ -539,6 +1053,7 @@ ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts) {
 
     hinit->hash->buckets = buckets;
     hinit->hash->size = size;
+    hinit->hash->ctrl = NULL;
 
 #if 0
 
@@ -573,6 +1088,8 @@ ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names, ngx_uint_t nelts) {
     return NGX_OK;
 }
 
+#endif
+
 /*nginx为了处理带有通配符的域名的匹配问题,实现了ngx_hash_wildcard_t这样的hash表.他可以支持两种类型的带有通配符的域名.一种是通配符在前的,
 例如:“*.abc.com",也可以省略掉星号,直接写成".abc.com".这样的key,可以匹配www.abc.com,qqq.www.abc.com之类的.另外一种是通配符在末
 尾的,例如:“mail.xxx.*",请特别注意通配符在末尾的不像位于开始的通配符可以被省略掉.这样的通配符,可以匹配mail.xxx.com、mail.xxx.com.cn、
@@ -754,12 +1271,27 @@ Key[len-1] = ((((data[0]*31 + data[1])*31 + data[2])*31) ... data[len-2])*31 + d
 //对数据字符串data计算出key值
 ngx_uint_t
 ngx_hash_key(u_char *data, size_t len) {
-    ngx_uint_t i, key;
+    ngx_uint_t key;
 
     key = 0;
 
-    for (i = 0; i < len; i++) {
-        key = ngx_hash(key, data[i]);
+    /*
+     * 每次处理4个字节,结果与逐字节ngx_hash()完全相同,
+     * 但乘法依赖链缩短为原来的1/4
+     */
+
+    while (len >= 4) {
+        key = key * (31 * 31 * 31 * 31)
+              + (ngx_uint_t) data[0] * (31 * 31 * 31)
+              + (ngx_uint_t) data[1] * (31 * 31)
+              + (ngx_uint_t) data[2] * 31
+              + data[3];
+        data += 4;
+        len -= 4;
+    }
+
+    while (len--) {
+        key = ngx_hash(key, *data++);
     }
 
     return key;
@@ -768,12 +1300,23 @@ ngx_hash_key(u_char *data, size_t len) {
 
 ngx_uint_t
 ngx_hash_key_lc(u_char *data, size_t len) {
-    ngx_uint_t i, key;
+    ngx_uint_t key;
 
     key = 0;
 
-    for (i = 0; i < len; i++) {
-        key = ngx_hash(key, ngx_tolower(data[i]));
+    while (len >= 4) {
+        key = key * (31 * 31 * 31 * 31)
+              + (ngx_uint_t) ngx_tolower(data[0]) * (31 * 31 * 31)
+              + (ngx_uint_t) ngx_tolower(data[1]) * (31 * 31)
+              + (ngx_uint_t) ngx_tolower(data[2]) * 31
+              + ngx_tolower(data[3]);
+        data += 4;
+        len -= 4;
+    }
+
+    while (len--) {
+        key = ngx_hash(key, ngx_tolower(*data));
+        data++;
     }
 
     return key;
@@ -796,6 +1339,150 @@ ngx_hash_strlow(u_char *dst, u_char *src, size_t n) {
     return key;
 }
 
+
+/*
+ * 64位通用hash(wyhash结构):每轮把16字节与常数异或后做64x64->128位乘法并
+ * 折叠,长数据分三路并行;适合需要在线速下计算散列的模块(如缓存键、一致性
+ * hash),结果与ngx_hash_key()无关,也不保证跨字节序一致
+ */
+
+static const uint64_t ngx_hash64_secret[4] = {
+    0x2d358dccaa6c78a5ULL, 0x8bb84b93962eacc9ULL,
+    0x4b33a62ed433d4a3ULL, 0x4d5a2da51de1aa47ULL
+};
+
+
+static ngx_inline void
+ngx_hash64_mum(uint64_t *a, uint64_t *b) {
+#if (NGX_HAVE_INT128)
+    unsigned __int128 r;
+
+    r = (unsigned __int128) *a * *b;
+
+    *a = (uint64_t) r;
+    *b = (uint64_t) (r >> 64);
+#else
+    uint64_t ha, hb, la, lb, rh, rm0, rm1, rl, t, c, lo;
+
+    ha = *a >> 32;
+    hb = *b >> 32;
+    la = (uint32_t) *a;
+    lb = (uint32_t) *b;
+
+    rh = ha * hb;
+    rm0 = ha * lb;
+    rm1 = hb * la;
+    rl = la * lb;
+
+    t = rl + (rm0 << 32);
+    c = t < rl;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+
+static ngx_inline uint64_t
+ngx_hash64_mix(uint64_t a, uint64_t b) {
+    ngx_hash64_mum(&a, &b);
+
+    return a ^ b;
+}
+
+
+static ngx_inline uint64_t
+ngx_hash64_read8(u_char *p) {
+    uint64_t v;
+
+    ngx_memcpy(&v, p, 8);
+
+    return v;
+}
+
+
+static ngx_inline uint64_t
+ngx_hash64_read4(u_char *p) {
+    uint32_t v;
+
+    ngx_memcpy(&v, p, 4);
+
+    return v;
+}
+
+
+uint64_t
+ngx_hash64(u_char *data, size_t len, uint64_t seed) {
+    size_t i;
+    uint64_t a, b, see1, see2;
+    const uint64_t *s;
+
+    s = ngx_hash64_secret;
+
+    seed ^= ngx_hash64_mix(seed ^ s[0], s[1]);
+
+    if (len <= 16) {
+
+        if (len >= 4) {
+            a = (ngx_hash64_read4(data) << 32)
+                | ngx_hash64_read4(data + ((len >> 3) << 2));
+            b = (ngx_hash64_read4(data + len - 4) << 32)
+                | ngx_hash64_read4(data + len - 4 - ((len >> 3) << 2));
+
+        } else if (len > 0) {
+            a = ((uint64_t) data[0] << 16)
+                | ((uint64_t) data[len >> 1] << 8)
+                | data[len - 1];
+            b = 0;
+
+        } else {
+            a = 0;
+            b = 0;
+        }
+
+    } else {
+        i = len;
+
+        if (i > 48) {
+            see1 = seed;
+            see2 = seed;
+
+            do {
+                seed = ngx_hash64_mix(ngx_hash64_read8(data) ^ s[1],
+                                      ngx_hash64_read8(data + 8) ^ seed);
+                see1 = ngx_hash64_mix(ngx_hash64_read8(data + 16) ^ s[2],
+                                      ngx_hash64_read8(data + 24) ^ see1);
+                see2 = ngx_hash64_mix(ngx_hash64_read8(data + 32) ^ s[3],
+                                      ngx_hash64_read8(data + 40) ^ see2);
+                data += 48;
+                i -= 48;
+
+            } while (i > 48);
+
+            seed ^= see1 ^ see2;
+        }
+
+        while (i > 16) {
+            seed = ngx_hash64_mix(ngx_hash64_read8(data) ^ s[1],
+                                  ngx_hash64_read8(data + 8) ^ seed);
+            data += 16;
+            i -= 16;
+        }
+
+        a = ngx_hash64_read8(data + i - 16);
+        b = ngx_hash64_read8(data + i - 8);
+    }
+
+    a ^= s[1];
+    b ^= seed;
+
+    ngx_hash64_mum(&a, &b);
+
+    return ngx_hash64_mix(a ^ s[0] ^ len, b ^ s[1]);
+}
+
 /*初始化ngx_hash_keys_arrays_t 结构体,type的取值范围只有两个,NGX_HASH_SMALL表示初始化元素较少,NGX_HASH_LARGE表示初始化元素较多,
 在向ha中加入时必须调用此方法.*/
 
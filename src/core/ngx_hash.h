@@ -29,11 +29,31 @@ typedef struct { //实际一个ngx_hash_elt_t暂用的空间为NGX_HASH_ELT_SIZE
 ngx_hash_t->buckets[]中的具体桶中的成员是根据实际成员个数创建的空间*/
 
 //在创建hash桶的时候赋值,见ngx_hash_init
+/*
+ * 支持SSE2时改用开放寻址的布局:每16个槽为一组,每个槽有一个控制字节,
+ * 空槽为NGX_HASH_EMPTY,否则为hash值的低7位.查找时用一条SSE2比较指令
+ * 同时比对一组的16个控制字节,只有控制字节相同的槽才去比较key.
+ * 此时buckets指向各槽的元素指针,size是组数(2的幂),不再需要调bucket_size
+ */
 typedef struct { //hash桶遍历可以参考ngx_hash_find
     ngx_hash_elt_t **buckets; //hash桶(有size个桶)    指向各个桶的头部指针,也就是bucket[]数组,bucket[I]又指向每个桶中的第一个ngx_hash_elt_t成员,见ngx_hash_init
     ngx_uint_t size; //hash桶个数,注意是桶的个数,不是每个桶中的成员个数,见ngx_hash_init
+    u_char *ctrl; //开放寻址布局的size * NGX_HASH_GROUP个控制字节,其他布局为NULL
+    /*
+     * 非NULL时是最小完美hash:先按key分到pmask + 1个小桶里,每个小桶一个种子,
+     * 用种子重新打散key直接得到唯一的槽,此时buckets有size个槽,一个key一个
+     */
+    uint32_t *seeds;
+    ngx_uint_t pmask;
 } ngx_hash_t;
 
+
+#define NGX_HASH_GROUP            16
+#define NGX_HASH_EMPTY            0x80
+
+/* ngx_hash()和ngx_hash_init()建出的布局有变化时加1,二进制map base据此失效 */
+#define NGX_HASH_VERSION          1
+
 /*这个结构主要用于包含通配符的hash的这个结构相比ngx_hash_t结构就是多了一个value指针,value这个字段是用来存放某个已经达到末尾的通配符url对应的value值,
 如果通配符url没有达到末尾,这个字段为NULL.
 ngx_hash_wildcard_t专用于表示牵制或后置通配符的哈希表,如:前置*.test.com,后置:www.test.* ,它只是对ngx_hash_t的简单封装,
@@ -93,6 +113,7 @@ typedef struct {
     ngx_uint_t bucket_size; //表示每个hash桶中(hash->buckets[i->成员[i]])对应的成员所有ngx_hash_elt_t成员暂用空间和的最大值,就是每个桶暂用的所有空间最大值,通过这个值计算需要多少个桶
 
     char *name; //该hash结构的名字(仅在错误日志中使用,用于调试打印等)
+    ngx_uint_t perfect; //为1时尽量构建最小完美hash,构建不出来再用普通的布局
     ngx_pool_t *pool; //该hash结构从pool指向的内存池中分配
     ngx_pool_t *temp_pool; //分配临时数据空间的内存池
 } ngx_hash_init_t; //hash初始化结构
@@ -241,6 +262,8 @@ ngx_uint_t ngx_hash_key_lc(u_char *data, size_t len);
 
 ngx_uint_t ngx_hash_strlow(u_char *dst, u_char *src, size_t n);
 
+uint64_t ngx_hash64(u_char *data, size_t len, uint64_t seed);
+
 
 ngx_int_t ngx_hash_keys_array_init(ngx_hash_keys_arrays_t *ha, ngx_uint_t type);
 
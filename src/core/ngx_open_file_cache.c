@@ -20,6 +20,24 @@
 
 #define NGX_MIN_READ_AHEAD  (128 * 1024)
 
+
+#if (NGX_THREADS)
+
+#include <ngx_thread_pool.h>
+
+//在线程中执行ngx_open_and_stat_file或者ngx_stat_file的参数和结果
+typedef struct {
+    ngx_str_t name;
+    size_t size; //name的空间大小
+    ngx_fd_t fd; //调用时of->fd,用于检查结果是不是这次调用的
+    ngx_file_uniq_t uniq;
+    ngx_uint_t test;
+    ngx_int_t rc;
+    ngx_open_file_info_t of;
+} ngx_open_file_thread_ctx_t;
+
+#endif
+
 static void ngx_open_file_cache_cleanup(void *data);
 
 #if (NGX_HAVE_OPENAT)
@@ -45,6 +63,21 @@ static ngx_int_t ngx_file_info_wrapper(ngx_str_t *name,
 static ngx_int_t ngx_open_and_stat_file(ngx_str_t *name,
                                         ngx_open_file_info_t *of, ngx_log_t *log);
 
+static ngx_int_t ngx_stat_file(ngx_str_t *name, ngx_open_file_info_t *of,
+                               ngx_log_t *log);
+
+static ngx_int_t ngx_open_file_info(ngx_str_t *name, ngx_open_file_info_t *of,
+                                    ngx_uint_t test, ngx_pool_t *pool);
+
+#if (NGX_THREADS)
+static ngx_int_t ngx_thread_open_file_info(ngx_str_t *name,
+                                           ngx_open_file_info_t *of, ngx_uint_t test, ngx_pool_t *pool);
+
+static void ngx_thread_open_file_handler(void *data, ngx_log_t *log);
+
+static void ngx_thread_open_file_cleanup(void *data);
+#endif
+
 static void ngx_open_file_add_event(ngx_open_file_cache_t *cache,
                                     ngx_cached_open_file_t *file, ngx_open_file_info_t *of, ngx_log_t *log);
 
@@ -162,12 +195,18 @@ ngx_open_cached_file(ngx_open_file_cache_t *cache, ngx_str_t *name,
     time_t now;
     uint32_t hash;
     ngx_int_t rc;
-    ngx_file_info_t fi;
     ngx_pool_cleanup_t *cln;
     ngx_cached_open_file_t *file;
     ngx_pool_cleanup_file_t *clnf;
     ngx_open_file_cache_cleanup_t *ofcln;
 
+#if (NGX_THREADS)
+    //上次放到线程池的open()还没有完成
+    if (of->thread_task && of->thread_task->event.active) {
+        return NGX_AGAIN;
+    }
+#endif
+
     of->fd = NGX_INVALID_FILE;
     of->err = 0;
 
@@ -176,22 +215,8 @@ ngx_open_cached_file(ngx_open_file_cache_t *cache, ngx_str_t *name,
         如果有配置open_file_cache,则会把打开的cache缓存文件stat信息按照ngx_crc32_long做hash后添加到ngx_cached_open_file_t->rbtree中,这样下次在请求该
         uri,则就不用再次open文件后在stat获取文件属性了,这样可以提高效率,参考ngx_open_cached_file*/
         if (of->test_only) { //如果只是测试用  例如进入index module的时候,就走这里
-
-            if (ngx_file_info_wrapper(name, of, &fi, pool->log) //对该文件的文件信息进行查询就返回,并不实际打开它
-                == NGX_FILE_ERROR) {
-                return NGX_ERROR;
-            }
-
-            of->uniq = ngx_file_uniq(&fi);
-            of->mtime = ngx_file_mtime(&fi);
-            of->size = ngx_file_size(&fi);
-            of->fs_size = ngx_file_fs_size(&fi);
-            of->is_dir = ngx_is_dir(&fi);
-            of->is_file = ngx_is_file(&fi);
-            of->is_link = ngx_is_link(&fi);
-            of->is_exec = ngx_is_exec(&fi);
-
-            return NGX_OK;
+            //对该文件的文件信息进行查询就返回,并不实际打开它
+            return ngx_open_file_info(name, of, 1, pool);
         }
         //直接打开这个文件并且设置回调,当内存池释放时关闭该文件
         cln = ngx_pool_cleanup_add(pool, sizeof(ngx_pool_cleanup_file_t));
@@ -199,7 +224,7 @@ ngx_open_cached_file(ngx_open_file_cache_t *cache, ngx_str_t *name,
             return NGX_ERROR;
         }
         //获取name文件的相关ngx_open_file_info_t信息,也就是获取文件属性信息
-        rc = ngx_open_and_stat_file(name, of, pool->log);
+        rc = ngx_open_file_info(name, of, 0, pool);
 
         if (rc == NGX_OK && !of->is_dir) {
             cln->handler = ngx_pool_cleanup_file;
@@ -234,7 +259,11 @@ ngx_open_cached_file(ngx_open_file_cache_t *cache, ngx_str_t *name,
 
             /* file was not used often enough to keep open */
 
-            rc = ngx_open_and_stat_file(name, of, pool->log); //打开该文件,保存信息
+            rc = ngx_open_file_info(name, of, 0, pool); //打开该文件,保存信息
+
+            if (rc == NGX_AGAIN) {
+                goto again;
+            }
 
             if (rc != NGX_OK && (of->err == 0 || !of->errors)) {
                 goto failed;
@@ -307,7 +336,11 @@ ngx_open_cached_file(ngx_open_file_cache_t *cache, ngx_str_t *name,
         of->fd = file->fd;
         of->uniq = file->uniq;
 
-        rc = ngx_open_and_stat_file(name, of, pool->log); //获取文件最新的属性,file中是之前存在与红黑树中的属性
+        rc = ngx_open_file_info(name, of, 0, pool); //获取文件最新的属性,file中是之前存在与红黑树中的属性
+
+        if (rc == NGX_AGAIN) {
+            goto again;
+        }
 
         if (rc != NGX_OK && (of->err == 0 || !of->errors)) {
             goto failed;
@@ -377,7 +410,11 @@ ngx_open_cached_file(ngx_open_file_cache_t *cache, ngx_str_t *name,
 
     /* not found */
     //获取name文件对应的stat属性信息
-    rc = ngx_open_and_stat_file(name, of, pool->log);
+    rc = ngx_open_file_info(name, of, 0, pool);
+
+    if (rc == NGX_AGAIN) {
+        goto again;
+    }
 
     if (rc != NGX_OK && (of->err == 0 || !of->errors)) {
         goto failed;
@@ -510,6 +547,16 @@ ngx_open_cached_file(ngx_open_file_cache_t *cache, ngx_str_t *name,
     }
 
     return NGX_ERROR;
+
+    again:
+
+    //open()放到了线程池中,恢复节点的状态,任务完成后再次调用时重新查找
+    if (file) {
+        file->uses--;
+        ngx_queue_insert_head(&cache->expire_queue, &file->queue);
+    }
+
+    return NGX_AGAIN;
 }
 
 
@@ -940,7 +987,7 @@ ngx_open_and_stat_file(ngx_str_t *name, ngx_open_file_info_t *of,
             }
         }
 
-        if (of->is_directio <= ngx_file_size(&fi)) {
+        if (of->directio <= ngx_file_size(&fi)) {
             if (ngx_directio_on(fd) == NGX_FILE_ERROR) {
                 ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
                               ngx_directio_on_n " \"%V\" failed", name);
@@ -966,6 +1013,205 @@ ngx_open_and_stat_file(ngx_str_t *name, ngx_open_file_info_t *of,
 }
 
 
+//只获取文件的stat信息,不打开文件
+static ngx_int_t
+ngx_stat_file(ngx_str_t *name, ngx_open_file_info_t *of, ngx_log_t *log) {
+    ngx_file_info_t fi;
+
+    if (ngx_file_info_wrapper(name, of, &fi, log) == NGX_FILE_ERROR) {
+        return NGX_ERROR;
+    }
+
+    of->uniq = ngx_file_uniq(&fi);
+    of->mtime = ngx_file_mtime(&fi);
+    of->size = ngx_file_size(&fi);
+    of->fs_size = ngx_file_fs_size(&fi);
+    of->is_dir = ngx_is_dir(&fi);
+    of->is_file = ngx_is_file(&fi);
+    of->is_link = ngx_is_link(&fi);
+    of->is_exec = ngx_is_exec(&fi);
+
+    return NGX_OK;
+}
+
+
+//test为1时只stat,否则open并stat;设置了of->thread_handler时放到线程池中执行,返回NGX_AGAIN
+static ngx_int_t
+ngx_open_file_info(ngx_str_t *name, ngx_open_file_info_t *of, ngx_uint_t test,
+                   ngx_pool_t *pool) {
+#if (NGX_THREADS)
+    ngx_int_t rc;
+
+    if (of->thread_handler) {
+        rc = ngx_thread_open_file_info(name, of, test, pool);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+
+        /* the task cannot be posted, fallback to a blocking call */
+    }
+#endif
+
+    if (test) {
+        return ngx_stat_file(name, of, pool->log);
+    }
+
+    return ngx_open_and_stat_file(name, of, pool->log);
+}
+
+
+#if (NGX_THREADS)
+
+static ngx_int_t
+ngx_thread_open_file_info(ngx_str_t *name, ngx_open_file_info_t *of,
+                          ngx_uint_t test, ngx_pool_t *pool) {
+    ngx_thread_task_t *task;
+    ngx_pool_cleanup_t *cln;
+    ngx_open_file_thread_ctx_t *ctx;
+
+    task = of->thread_task;
+
+    if (task == NULL) {
+        task = ngx_thread_task_alloc(pool, sizeof(ngx_open_file_thread_ctx_t));
+        if (task == NULL) {
+            return NGX_ERROR;
+        }
+
+        cln = ngx_pool_cleanup_add(pool, 0);
+        if (cln == NULL) {
+            return NGX_ERROR;
+        }
+
+        cln->handler = ngx_thread_open_file_cleanup;
+        cln->data = task;
+
+        ctx = task->ctx;
+        ctx->of.fd = NGX_INVALID_FILE;
+
+        of->thread_task = task;
+    }
+
+    ctx = task->ctx;
+
+    if (task->event.complete) {
+        task->event.complete = 0;
+
+        /*
+         * the result is used only if it was requested with the same
+         * arguments, the cache could have been changed meanwhile
+         */
+
+        if (ctx->test == test
+            && ctx->fd == of->fd
+            && ctx->uniq == of->uniq
+            && ctx->of.test_dir == of->test_dir
+#if (NGX_HAVE_OPENAT)
+            && ctx->of.disable_symlinks == of->disable_symlinks
+            && ctx->of.disable_symlinks_from == of->disable_symlinks_from
+#endif
+            && ctx->name.len == name->len
+            && ngx_strncmp(ctx->name.data, name->data, name->len) == 0) {
+            ngx_log_debug2(NGX_LOG_DEBUG_CORE, pool->log, 0,
+                           "thread open \"%V\" done: %i", name, ctx->rc);
+
+            of->fd = ctx->of.fd;
+            of->uniq = ctx->of.uniq;
+            of->mtime = ctx->of.mtime;
+            of->size = ctx->of.size;
+            of->fs_size = ctx->of.fs_size;
+            of->err = ctx->of.err;
+            of->failed = ctx->of.failed;
+            of->is_dir = ctx->of.is_dir;
+            of->is_file = ctx->of.is_file;
+            of->is_link = ctx->of.is_link;
+            of->is_exec = ctx->of.is_exec;
+            of->is_directio = ctx->of.is_directio;
+
+            ctx->of.fd = NGX_INVALID_FILE;
+
+            return ctx->rc;
+        }
+
+        if (ctx->of.fd != NGX_INVALID_FILE && ctx->of.fd != ctx->fd) {
+            if (ngx_close_file(ctx->of.fd) == NGX_FILE_ERROR) {
+                ngx_log_error(NGX_LOG_ALERT, pool->log, ngx_errno,
+                              ngx_close_file_n " \"%V\" failed", &ctx->name);
+            }
+        }
+
+        ctx->of.fd = NGX_INVALID_FILE;
+    }
+
+    if (ctx->size < name->len + 1) {
+        ctx->size = name->len + 1;
+
+        ctx->name.data = ngx_pnalloc(pool, ctx->size);
+        if (ctx->name.data == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    ngx_memcpy(ctx->name.data, name->data, name->len);
+    ctx->name.data[name->len] = '\0';
+    ctx->name.len = name->len;
+
+    ctx->fd = of->fd;
+    ctx->uniq = of->uniq;
+    ctx->test = test;
+    ctx->of = *of;
+
+    task->handler = ngx_thread_open_file_handler;
+
+    if (of->thread_handler(task, of) != NGX_OK) {
+        ctx->of.fd = NGX_INVALID_FILE;
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, pool->log, 0,
+                   "thread open \"%V\"", name);
+
+    return NGX_AGAIN;
+}
+
+
+static void
+ngx_thread_open_file_handler(void *data, ngx_log_t *log) {
+    ngx_open_file_thread_ctx_t *ctx = data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, log, 0, "thread open handler");
+
+    if (ctx->test) {
+        ctx->rc = ngx_stat_file(&ctx->name, &ctx->of, log);
+
+    } else {
+        ctx->rc = ngx_open_and_stat_file(&ctx->name, &ctx->of, log);
+    }
+}
+
+
+//请求结束时关闭没有被取走的文件
+static void
+ngx_thread_open_file_cleanup(void *data) {
+    ngx_thread_task_t *task = data;
+
+    ngx_open_file_thread_ctx_t *ctx;
+
+    ctx = task->ctx;
+
+    if (task->event.complete
+        && ctx->of.fd != NGX_INVALID_FILE
+        && ctx->of.fd != ctx->fd) {
+        if (ngx_close_file(ctx->of.fd) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                          ngx_close_file_n " \"%V\" failed", &ctx->name);
+        }
+    }
+}
+
+#endif
+
+
 /*
  * we ignore any possible event setting error and
  * fallback to usual periodic file retests
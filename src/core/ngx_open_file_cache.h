@@ -15,8 +15,10 @@
 
 #define NGX_OPEN_FILE_DIRECTIO_OFF  NGX_MAX_OFF_T_VALUE
 
+typedef struct ngx_open_file_info_s ngx_open_file_info_t;
+
 //可以通过ngx_open_and_stat_file获取文件的相关属性信息
-typedef struct {
+struct ngx_open_file_info_s {
     ngx_fd_t fd;
     ngx_file_uniq_t uniq; //文件inode节点号,同一个设备中的每个文件,这个值都是不同的
     time_t mtime; //文件最后被修改的时间
@@ -24,7 +26,7 @@ typedef struct {
     off_t fs_size;
     /*取值是从ngx_http_core_loc_conf_s->directio,在获取缓存文件内容的时候,只有文件大小大与等于directio的时候才会生效ngx_directio_on
     默认NGX_OPEN_FILE_DIRECTIO_OFF是个超级大的值*/
-    off_t irectio; //生效见ngx_open_and_stat_file  if (of->directio <= ngx_file_size(&fi)) { ngx_directio_on }
+    off_t directio; //生效见ngx_open_and_stat_file  if (of->directio <= ngx_file_size(&fi)) { ngx_directio_on }
     size_t read_ahead;  /* read_ahead配置,默认0 */
 
     /*在ngx_file_info_wrapper中获取文件stat属性信息的时候,如果文件不存在或者open失败,或者stat失败,都会把错误放入这两个字段
@@ -66,7 +68,15 @@ typedef struct {
     //注意这里如果文件大小大于direction设置,则置1,后面会使能direct I/O方式,生效见ngx_directio_on
     unsigned is_directio: 1; //当文件大小大于directio xxx;中的配置时ngx_open_and_stat_file中会置1
     ngx_event_t *event;
-} ngx_open_file_info_t;
+
+#if (NGX_THREADS || NGX_COMPAT)
+    //设置后open()和stat()放到线程池中执行,ngx_open_cached_file返回NGX_AGAIN,任务完成后再次调用取结果
+    ngx_int_t (*thread_handler)(ngx_thread_task_t *task,
+                                ngx_open_file_info_t *of);
+    void *thread_ctx;
+    ngx_thread_task_t *thread_task; //调用者需要在多次调用之间保存这个任务
+#endif
+};
 
 
 typedef struct ngx_cached_open_file_s ngx_cached_open_file_t;
@@ -14,7 +14,68 @@ static ngx_inline void *ngx_palloc_small(ngx_pool_t *pool, size_t size,
 
 static void *ngx_palloc_block(ngx_pool_t *pool, size_t size);
 
-static void *ngx_palloc_large(ngx_pool_t *pool, size_t size);
+static void *ngx_palloc_large(ngx_pool_t *pool, size_t size,
+                              const char *file);
+
+static void ngx_pool_large_link(ngx_pool_t *pool, ngx_pool_large_t *large,
+                                size_t size, const char *file);
+
+static void ngx_pool_large_free(ngx_pool_large_t *large);
+
+static ngx_pool_large_site_t *ngx_pool_large_site(const char *file);
+
+static void *ngx_pool_get_block(size_t size, ngx_log_t *log);
+
+static void ngx_pool_free_block(void *block, size_t size);
+
+
+typedef struct ngx_pool_cached_block_s  ngx_pool_cached_block_t;
+
+struct ngx_pool_cached_block_s {
+    ngx_pool_cached_block_t  *next;
+};
+
+//按块大小区分的空闲链表,同一个pool的所有块大小相同,所以按pool大小分槽即可
+typedef struct {
+    size_t                    size;    //0表示槽位未使用
+    ngx_uint_t                number;
+    ngx_pool_cached_block_t  *block;
+} ngx_pool_cache_slot_t;
+
+
+#define NGX_POOL_CACHE_SLOTS  8
+
+/*
+ * 每个进程各自一份,只在事件循环线程中使用,不加锁;
+ * ngx_pool_cache_max为0(master进程,或worker_pool_cache 0)时不缓存
+ */
+static ngx_pool_cache_slot_t  ngx_pool_cache[NGX_POOL_CACHE_SLOTS];
+static size_t                 ngx_pool_cache_size;
+static size_t                 ngx_pool_cache_max;
+
+
+struct ngx_pool_large_site_s {
+    const char               *file;
+    ngx_uint_t                allocs;
+    size_t                    bytes;
+    size_t                    current;
+};
+
+
+/* 大块内存按2的幂分级:8K,16K,...,1M,同样受worker_pool_cache限制 */
+#define NGX_POOL_LARGE_MIN_SHIFT  13
+#define NGX_POOL_LARGE_SLOTS      8
+
+#define NGX_POOL_LARGE_MIN        ((size_t) 1 << NGX_POOL_LARGE_MIN_SHIFT)
+#define NGX_POOL_LARGE_MAX                                                    \
+    ((size_t) 1 << (NGX_POOL_LARGE_MIN_SHIFT + NGX_POOL_LARGE_SLOTS - 1))
+
+#define NGX_POOL_LARGE_SITES      64
+
+static ngx_pool_cached_block_t  *ngx_pool_large_cache[NGX_POOL_LARGE_SLOTS];
+static ngx_pool_large_site_t     ngx_pool_large_sites[NGX_POOL_LARGE_SITES];
+static ngx_pool_large_site_t     ngx_pool_large_other;
+
 
 /*ngx_create_pool:创建pool
 ngx_destory_pool:销毁 pool
@@ -25,7 +86,7 @@ ngx_pool_t *
 ngx_create_pool(size_t size, ngx_log_t *log) {
     ngx_pool_t *p;
 
-    p = ngx_memalign(NGX_POOL_ALIGNMENT, size, log); // 分配一块 size 大小的内存,内存空间16字节对齐
+    p = ngx_pool_get_block(size, log); // 分配一块 size 大小的内存,内存空间16字节对齐,优先复用缓存的块
     if (p == NULL) {
         return NULL;
     }
@@ -50,8 +111,9 @@ ngx_create_pool(size_t size, ngx_log_t *log) {
 
 void
 ngx_destroy_pool(ngx_pool_t *pool) {
+    size_t size;
     ngx_pool_t *p, *n;
-    ngx_pool_large_t *l;
+    ngx_pool_large_t *l, *next;
     ngx_pool_cleanup_t *c;
 
     // 先回调清理函数
@@ -85,16 +147,17 @@ ngx_destroy_pool(ngx_pool_t *pool) {
 
 #endif
 
-    //再释放大块内存
-    for (l = pool->large; l; l = l->next) {
-        if (l->alloc) {
-            ngx_free(l->alloc);
-        }
+    //再释放大块内存,头部在内存块中,要先取出next
+    for (l = pool->large; l; l = next) {
+        next = l->next;
+        ngx_pool_large_free(l);
     }
 
-    //最后释放整个ngx_pool_t链表结构
+    //最后释放整个ngx_pool_t链表结构,所有块大小都等于首块大小
+    size = (size_t) (pool->d.end - (u_char *) pool);
+
     for (p = pool, n = pool->d.next; /* void */; p = n, n = n->d.next) {
-        ngx_free(p);
+        ngx_pool_free_block(p, size);
 
         if (n == NULL) {
             break;
@@ -106,12 +169,11 @@ ngx_destroy_pool(ngx_pool_t *pool) {
 void
 ngx_reset_pool(ngx_pool_t *pool) {
     ngx_pool_t *p;
-    ngx_pool_large_t *l;
+    ngx_pool_large_t *l, *next;
 
-    for (l = pool->large; l; l = l->next) {
-        if (l->alloc) {
-            ngx_free(l->alloc);
-        }
+    for (l = pool->large; l; l = next) {
+        next = l->next;
+        ngx_pool_large_free(l);
     }
 
     for (p = pool; p; p = p->d.next) {
@@ -129,7 +191,7 @@ ngx_reset_pool(ngx_pool_t *pool) {
 还有一个封装了ngx_palloc的函数ngx_pcalloc,它多做了一件事,就是把ngx_palloc申请到的内存块全部置为0,虽然,多数情况下更适合用ngx_pcalloc来分配内存.*/
 //ngx_palloc和ngx_pnalloc的区别是分片小块内存时是否需要内存对齐
 void *
-ngx_palloc(ngx_pool_t *pool, size_t size) {
+ngx_palloc_from(ngx_pool_t *pool, size_t size, const char *file) {
 #if !(NGX_DEBUG_PALLOC)
     // 判断 size 是否大于 pool 最大可使用内存大小
     if (size <= pool->max) {
@@ -137,19 +199,19 @@ ngx_palloc(ngx_pool_t *pool, size_t size) {
     }
 #endif
 
-    return ngx_palloc_large(pool, size);
+    return ngx_palloc_large(pool, size, file);
 }
 
 
 void *
-ngx_pnalloc(ngx_pool_t *pool, size_t size) {
+ngx_pnalloc_from(ngx_pool_t *pool, size_t size, const char *file) {
 #if !(NGX_DEBUG_PALLOC)
     if (size <= pool->max) {
         return ngx_palloc_small(pool, size, 0);
     }
 #endif
 
-    return ngx_palloc_large(pool, size);
+    return ngx_palloc_large(pool, size, file);
 }
 
 
@@ -189,7 +251,7 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size) {
     // 先前的整个 pool 的大小
     psize = (size_t) (pool->d.end - (u_char *) pool);
     // 在内存对齐了的前提下,新分配一块内存
-    m = ngx_memalign(NGX_POOL_ALIGNMENT, psize, pool->log);
+    m = ngx_pool_get_block(psize, pool->log);
     if (m == NULL) {
         return NULL;
     }
@@ -202,8 +264,10 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size) {
 
     /*新的ngx_pool_t结构体d后面的所有字段值和之前内存池里面的值相同.
      *为了节约内存,这个方法里面,申请挂载的ngx_pool_t结构体的可分配起始位置是在申请内存返回地址的基础上加上的ngx_pool_data_t的大小,
-     *和创建的时候加上ngx_pool_t的大小不一样.*/
-    m += sizeof(ngx_pool_data_t);
+     *和创建的时候加上ngx_pool_t的大小不一样.
+     *可分配的部分前面至少留出一个大块内存头部的大小,ngx_pfree读取p前面的头部时
+     *不会越过块的起始地址;首块前面的ngx_pool_t本身就比头部大*/
+    m += ngx_max(sizeof(ngx_pool_data_t), NGX_POOL_LARGE_HEADER);
     m = ngx_align_ptr(m, NGX_ALIGNMENT);
     new->d.last = m + size;
     // 判断在当前 pool 分配内存的失败次数,即:不能复用当前 pool 的次数,
@@ -222,69 +286,229 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size) {
 
 /*当需要的内存大于pool最大可分配内存大小时,此时首先判断size已经大于pool->max的大小了,所以直接调用ngx_palloc_large进行大内存分配*/
 static void *
-ngx_palloc_large(ngx_pool_t *pool, size_t size) {
-    void *p;
-    ngx_uint_t n;
+ngx_palloc_large(ngx_pool_t *pool, size_t size, const char *file) {
+    u_char *m;
+    size_t bsize;
+    ngx_uint_t slot;
     ngx_pool_large_t *large;
+
+    slot = NGX_POOL_LARGE_NOSLOT;
+    bsize = size;
+
     /*
-     * 重新申请一块大小为 size 的新内存
-     * 注意:此处不使用 ngx_memalign 的原因是,新分配的内存较大,对齐也没太大必要
-     * 而且后面提供了 ngx_pmemalign 函数,专门为用户分配对齐了的内存
-    */
-    p = ngx_alloc(size, pool->log);
-    if (p == NULL) {
-        return NULL;
+     * 开启缓存时,4K到1M之间的大小向上取整到2的幂,
+     * 释放后放回对应的空闲链表,下次同一级别的申请直接复用
+     */
+    if (ngx_pool_cache_max
+        && size > NGX_POOL_LARGE_MIN / 2
+        && size <= NGX_POOL_LARGE_MAX) {
+        slot = 0;
+        bsize = NGX_POOL_LARGE_MIN;
+
+        while (bsize < size) {
+            bsize <<= 1;
+            slot++;
+        }
     }
 
-    n = 0;
-    // 查找large链表上空余的large 指针
-    for (large = pool->large; large; large = large->next) {
-        if (large->alloc == NULL) {
-            large->alloc = p;
-            return p;
-        }
-        /*如果当前 large 后串的 large 内存块数目大于 3 (不等于3),
-          则直接去下一步分配新内存,不再查找了*/
-        if (n++ > 3) { //也就是说如果pool->large头后面连续4个large的alloc指针都被用了,则重新申请一个新的pool_large并放到pool->large头部
-            break; //????? 感觉没啥用,因为后面每次alloc的large对应的alloc都是赋值了的
+    if (slot != NGX_POOL_LARGE_NOSLOT && ngx_pool_large_cache[slot]) {
+        m = (u_char *) ngx_pool_large_cache[slot];
+        ngx_pool_large_cache[slot] = ngx_pool_large_cache[slot]->next;
+        ngx_pool_cache_size -= bsize;
+
+    } else {
+        /*
+         * 注意:此处不使用 ngx_memalign 的原因是,新分配的内存较大,对齐也没太大必要
+         * 而且后面提供了 ngx_pmemalign 函数,专门为用户分配对齐了的内存
+         */
+        m = ngx_alloc(NGX_POOL_LARGE_HEADER + bsize, pool->log);
+        if (m == NULL) {
+            return NULL;
         }
     }
 
-    large = ngx_palloc_small(pool, sizeof(ngx_pool_large_t), 1);
-    if (large == NULL) {
-        ngx_free(p);
+    large = (ngx_pool_large_t *) m;
+
+    large->base = m;
+    large->alloc = m + NGX_POOL_LARGE_HEADER;
+    large->slot = slot;
+
+    ngx_pool_large_link(pool, large, size, file);
+
+    return large->alloc;
+}
+
+
+void *
+ngx_pmemalign_from(ngx_pool_t *pool, size_t size, size_t alignment,
+                   const char *file) {
+    u_char *m;
+    size_t offset;
+    ngx_pool_large_t *large;
+
+    //头部放在对齐后的数据前面,前面多出的部分是填充
+    offset = ngx_align(NGX_POOL_LARGE_HEADER, alignment);
+
+    m = ngx_memalign(alignment, offset + size, pool->log);
+    if (m == NULL) {
         return NULL;
     }
+
+    large = (ngx_pool_large_t *) (m + offset - NGX_POOL_LARGE_HEADER);
+
+    large->base = m;
+    large->alloc = m + offset;
+    large->slot = NGX_POOL_LARGE_NOSLOT;
+
+    ngx_pool_large_link(pool, large, size, file);
+
+    return large->alloc;
+}
+
+
+static void
+ngx_pool_large_link(ngx_pool_t *pool, ngx_pool_large_t *large, size_t size,
+                    const char *file) {
+    ngx_pool_large_site_t *site;
+
+    site = ngx_pool_large_site(file);
+
+    site->allocs++;
+    site->bytes += size;
+    site->current += size;
+
+    large->site = site;
+    large->size = size;
+    large->pool = pool;
+
     // 将新分配的 large 串到链表前面
-    large->alloc = p;
     large->next = pool->large;
+    large->prev = &pool->large;
+
+    if (large->next) {
+        large->next->prev = &large->next;
+    }
+
     pool->large = large;
+}
 
-    return p;
+
+static void
+ngx_pool_large_free(ngx_pool_large_t *large) {
+    size_t bsize;
+    ngx_pool_cached_block_t *b;
+
+    *large->prev = large->next;
+
+    if (large->next) {
+        large->next->prev = large->prev;
+    }
+
+    large->site->current -= large->size;
+
+    //缓存中的块不再属于任何pool,清掉alloc,重复释放时不会被认出来
+    large->alloc = NULL;
+
+    if (large->slot != NGX_POOL_LARGE_NOSLOT) {
+        bsize = NGX_POOL_LARGE_MIN << large->slot;
+
+        if (ngx_pool_cache_size + bsize <= ngx_pool_cache_max) {
+            b = large->base;
+            b->next = ngx_pool_large_cache[large->slot];
+            ngx_pool_large_cache[large->slot] = b;
+
+            ngx_pool_cache_size += bsize;
+            return;
+        }
+    }
+
+    ngx_free(large->base);
 }
 
 
-void *
-ngx_pmemalign(ngx_pool_t *pool, size_t size, size_t alignment) {
-    void *p;
-    ngx_pool_large_t *large;
+static ngx_pool_large_site_t *
+ngx_pool_large_site(const char *file) {
+    ngx_uint_t i, k;
+    ngx_pool_large_site_t *site;
 
-    p = ngx_memalign(alignment, size, pool->log);
-    if (p == NULL) {
-        return NULL;
+    if (file == NULL) {
+        return &ngx_pool_large_other;
     }
 
-    large = ngx_palloc_small(pool, sizeof(ngx_pool_large_t), 1);
-    if (large == NULL) {
-        ngx_free(p);
-        return NULL;
+    //同一个源文件里的__FILE__通常是同一个字符串常量,按地址查找即可
+    k = ((uintptr_t) file >> 3) % NGX_POOL_LARGE_SITES;
+
+    for (i = 0; i < NGX_POOL_LARGE_SITES; i++) {
+        site = &ngx_pool_large_sites[(k + i) % NGX_POOL_LARGE_SITES];
+
+        if (site->file == file) {
+            return site;
+        }
+
+        if (site->file == NULL) {
+            site->file = file;
+            return site;
+        }
     }
 
-    large->alloc = p;
-    large->next = pool->large;
-    pool->large = large;
+    //源文件太多时,其余的都记到一起
+    return &ngx_pool_large_other;
+}
 
-    return p;
+
+ngx_int_t
+ngx_pool_large_stats(ngx_uint_t n, ngx_pool_large_stat_t *st) {
+    u_char *p, *last;
+    ngx_uint_t i;
+    ngx_pool_large_site_t *site;
+
+    site = NULL;
+
+    for (i = 0; i < NGX_POOL_LARGE_SITES; i++) {
+        if (ngx_pool_large_sites[i].file == NULL) {
+            continue;
+        }
+
+        if (n-- == 0) {
+            site = &ngx_pool_large_sites[i];
+            break;
+        }
+    }
+
+    if (site == NULL) {
+        if (n != 0 || ngx_pool_large_other.allocs == 0) {
+            return NGX_DECLINED;
+        }
+
+        site = &ngx_pool_large_other;
+    }
+
+    if (site->file) {
+        //只输出文件名,去掉目录和后缀
+        p = (u_char *) site->file;
+        last = p + ngx_strlen(p);
+
+        st->name.data = p;
+
+        for ( /* void */ ; p < last; p++) {
+            if (*p == '/' || *p == '\\') {
+                st->name.data = p + 1;
+            }
+        }
+
+        p = ngx_strlchr(st->name.data, last, '.');
+
+        st->name.len = (p ? p : last) - st->name.data;
+
+    } else {
+        ngx_str_set(&st->name, "other");
+    }
+
+    st->allocs = site->allocs;
+    st->bytes = site->bytes;
+    st->current = site->current;
+
+    return NGX_OK;
 }
 
 
@@ -292,26 +516,37 @@ ngx_int_t
 ngx_pfree(ngx_pool_t *pool, void *p) {
     ngx_pool_large_t *l;
 
-    for (l = pool->large; l; l = l->next) {
-        if (p == l->alloc) {
-            ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, pool->log, 0,
-                           "free: %p", l->alloc);
-            ngx_free(l->alloc);
-            l->alloc = NULL;
+    /*
+     * p必须是某个pool分配出来的地址,大块或小块都可以.大块内存的头部紧挨在
+     * 数据前面;小块内存前面至少有一个头部大小的块头部或其它小块数据,
+     * 见ngx_palloc_block,所以读取的总是pool自己的内存.头部的alloc等于p、
+     * 属于本pool并且链表前驱确实指向它时才释放,小块内存、其它pool的大块内存
+     * 以及重复释放(缓存中的块alloc已清空)都返回NGX_DECLINED
+     */
 
-            return NGX_OK;
-        }
+    if (p == NULL) {
+        return NGX_DECLINED;
     }
 
-    return NGX_DECLINED;
+    l = (ngx_pool_large_t *) ((u_char *) p - NGX_POOL_LARGE_HEADER);
+
+    if (l->alloc != p || l->pool != pool || *l->prev != l) {
+        return NGX_DECLINED;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, pool->log, 0, "free: %p", p);
+
+    ngx_pool_large_free(l);
+
+    return NGX_OK;
 }
 
 
 void *
-ngx_pcalloc(ngx_pool_t *pool, size_t size) {
+ngx_pcalloc_from(ngx_pool_t *pool, size_t size, const char *file) {
     void *p;
 
-    p = ngx_palloc(pool, size);
+    p = ngx_palloc_from(pool, size, file);
     if (p) {
         ngx_memzero(p, size);
     }
@@ -426,30 +661,111 @@ ngx_pool_delete_file(void *data) {
 }
 
 
-#if 0
+void
+ngx_pool_cache_init(size_t max) {
+    ngx_pool_cache_max = max;
+}
+
 
 static void *
-ngx_get_cached_block(size_t size)
-{
-    void                     *p;
-    ngx_cached_block_slot_t  *slot;
+ngx_pool_get_block(size_t size, ngx_log_t *log) {
+    ngx_uint_t i;
+    ngx_pool_cache_slot_t *slot;
+    ngx_pool_cached_block_t *b;
 
-    if (ngx_cycle->cache == NULL) {
-        return NULL;
-    }
+    for (i = 0; i < NGX_POOL_CACHE_SLOTS; i++) {
+        slot = &ngx_pool_cache[i];
+
+        if (slot->size == 0) {
+            break;
+        }
 
-    slot = &ngx_cycle->cache[(size + ngx_pagesize - 1) / ngx_pagesize];
+        if (slot->size != size) {
+            continue;
+        }
 
-    slot->tries++;
+        if (slot->number == 0) {
+            break;
+        }
 
-    if (slot->number) {
-        p = slot->block;
-        slot->block = slot->block->next;
+        b = slot->block;
+        slot->block = b->next;
         slot->number--;
-        return p;
+
+        ngx_pool_cache_size -= size;
+
+        return b;
     }
 
-    return NULL;
+    return ngx_memalign(NGX_POOL_ALIGNMENT, size, log);
 }
 
-#endif
+
+static void
+ngx_pool_free_block(void *block, size_t size) {
+    ngx_uint_t i;
+    ngx_pool_cache_slot_t *slot;
+    ngx_pool_cached_block_t *b;
+
+    if (ngx_pool_cache_size + size > ngx_pool_cache_max) {
+        ngx_free(block);
+        return;
+    }
+
+    for (i = 0; i < NGX_POOL_CACHE_SLOTS; i++) {
+        slot = &ngx_pool_cache[i];
+
+        if (slot->size == size) {
+            break;
+        }
+
+        if (slot->size == 0) {
+            slot->size = size; //第一次见到这种大小,占用一个空槽
+            break;
+        }
+    }
+
+    if (i == NGX_POOL_CACHE_SLOTS) {
+        ngx_free(block);
+        return;
+    }
+
+    b = block;
+    b->next = slot->block;
+    slot->block = b;
+    slot->number++;
+
+    ngx_pool_cache_size += size;
+}
+
+
+/* 不经过头文件中的宏调用的情况,例如取函数地址,统计记到"other"名下 */
+
+#undef ngx_palloc
+#undef ngx_pnalloc
+#undef ngx_pcalloc
+#undef ngx_pmemalign
+
+
+void *
+ngx_palloc(ngx_pool_t *pool, size_t size) {
+    return ngx_palloc_from(pool, size, NULL);
+}
+
+
+void *
+ngx_pnalloc(ngx_pool_t *pool, size_t size) {
+    return ngx_pnalloc_from(pool, size, NULL);
+}
+
+
+void *
+ngx_pcalloc(ngx_pool_t *pool, size_t size) {
+    return ngx_pcalloc_from(pool, size, NULL);
+}
+
+
+void *
+ngx_pmemalign(ngx_pool_t *pool, size_t size, size_t alignment) {
+    return ngx_pmemalign_from(pool, size, alignment, NULL);
+}
@@ -22,8 +22,9 @@
 #define NGX_DEFAULT_POOL_SIZE    (16 * 1024)
 
 #define NGX_POOL_ALIGNMENT       16
+/* 大块内存的头部已不在pool中分配,这里保持原来的最小值 */
 #define NGX_MIN_POOL_SIZE                                                     \
-    ngx_align((sizeof(ngx_pool_t) + 2 * sizeof(ngx_pool_large_t)),            \
+    ngx_align((sizeof(ngx_pool_t) + 4 * sizeof(void *)),                      \
               NGX_POOL_ALIGNMENT)
 
 
@@ -51,12 +52,38 @@ typedef struct ngx_pool_large_s ngx_pool_large_t;
 内存块数据       ---  ngx_pool_data_t;
 大内存块         --- ngx_pool_large_s; */
 
-//大块内存结构体,链表结构
+typedef struct ngx_pool_large_site_s ngx_pool_large_site_t;
+
+/*
+ * 大块内存结构体,双向链表结构.头部和数据在同一次分配中,紧挨在alloc之前,
+ * 所以ngx_pfree可以由数据地址直接找到头部,校验alloc、pool和prev后O(1)释放
+ */
 struct ngx_pool_large_s { //ngx_pool_s中的大块内存成员
     ngx_pool_large_t *next;
-    void *alloc; //申请的内存块地址
+    ngx_pool_large_t **prev;
+    void *alloc; //申请的内存块地址,即返回给调用者的地址,放入缓存后清空
+    ngx_pool_t *pool; //所属的pool
+    void *base; //实际分配的起始地址,ngx_pmemalign时头部前面还有对齐填充
+    ngx_pool_large_site_t *site; //按源文件统计
+    size_t size; //调用者申请的大小
+    ngx_uint_t slot; //大小分级,NGX_POOL_LARGE_NOSLOT表示没有分级,直接ngx_free
 };
 
+#define NGX_POOL_LARGE_HEADER                                                 \
+    ngx_align(sizeof(ngx_pool_large_t), NGX_POOL_ALIGNMENT)
+
+#define NGX_POOL_LARGE_NOSLOT    (ngx_uint_t) -1
+
+
+//按源文件(模块)汇总的大块内存统计,见ngx_pool_large_stats
+typedef struct {
+    ngx_str_t name; //源文件名去掉目录和后缀,如ngx_http_gzip_filter_module,"other"表示其余调用者的合计
+    ngx_uint_t allocs;
+    size_t bytes; //累计申请的字节数
+    size_t current; //当前还未释放的字节数
+} ngx_pool_large_stat_t;
+
+
 //内存块包含的数据
 typedef struct {
     u_char               *last;//申请过的内存的尾地址,可申请的首地址,pool->d.last ~ pool->d.end 中的内存区便是可用数据区.
@@ -107,8 +134,31 @@ void *ngx_pcalloc(ngx_pool_t *pool, size_t size);
 
 void *ngx_pmemalign(ngx_pool_t *pool, size_t size, size_t alignment);
 
+void *ngx_palloc_from(ngx_pool_t *pool, size_t size, const char *file);
+
+void *ngx_pnalloc_from(ngx_pool_t *pool, size_t size, const char *file);
+
+void *ngx_pcalloc_from(ngx_pool_t *pool, size_t size, const char *file);
+
+void *ngx_pmemalign_from(ngx_pool_t *pool, size_t size, size_t alignment,
+                         const char *file);
+
+/*
+ * 大块内存按调用处所在的源文件统计,源文件名随下面的宏传入;
+ * 同名函数仍然导出,供取函数地址和旧的动态模块使用,统计记到"other"名下
+ */
+#define ngx_palloc(pool, size)     ngx_palloc_from(pool, size, __FILE__)
+#define ngx_pnalloc(pool, size)    ngx_pnalloc_from(pool, size, __FILE__)
+#define ngx_pcalloc(pool, size)    ngx_pcalloc_from(pool, size, __FILE__)
+#define ngx_pmemalign(pool, size, alignment)                                  \
+    ngx_pmemalign_from(pool, size, alignment, __FILE__)
+
 ngx_int_t ngx_pfree(ngx_pool_t *pool, void *p);
 
+void ngx_pool_cache_init(size_t max);
+
+ngx_int_t ngx_pool_large_stats(ngx_uint_t n, ngx_pool_large_stat_t *st);
+
 
 ngx_pool_cleanup_t *ngx_pool_cleanup_add(ngx_pool_t *p, size_t size);
 
@@ -12,7 +12,66 @@
 #include <ngx_core.h>
 
 
+typedef struct {
+    ngx_array_t        nodes;
+    ngx_array_t        leaves;
+    ngx_uint_t         bits;
+} ngx_radix_trie_ctx_t;
+
+
 static ngx_radix_node_t *ngx_radix_alloc(ngx_radix_tree_t *tree);
+static ngx_int_t ngx_radix_trie_compile(ngx_radix_tree_t *tree,
+    ngx_uint_t bits);
+static ngx_int_t ngx_radix_trie_build(ngx_radix_trie_ctx_t *ctx,
+    ngx_radix_node_t *node, ngx_uint_t depth, uintptr_t value,
+    ngx_uint_t index);
+static void ngx_radix_trie_fill(ngx_radix_node_t *node, ngx_uint_t level,
+    ngx_uint_t k, ngx_uint_t slot, uintptr_t value, ngx_radix_node_t **next,
+    uintptr_t *values);
+static ngx_uint_t ngx_radix_trie_has_value(ngx_radix_node_t *node);
+
+
+#if (NGX_HAVE_GCC_POPCOUNT)
+
+#define ngx_radix_popcount(v)  (ngx_uint_t) __builtin_popcountll(v)
+
+#else
+
+static ngx_inline ngx_uint_t
+ngx_radix_popcount(uint64_t v) {
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+
+    return (ngx_uint_t) ((v * 0x0101010101010101ULL) >> 56);
+}
+
+#endif
+
+
+/*
+ * 在编译后的trie中走一层:idx下标在vector中置位则返回子节点,否则按leafvec
+ * 取出叶子值并返回NULL
+ */
+static ngx_inline ngx_radix_trie_node_t *
+ngx_radix_trie_next(ngx_radix_trie_t *trie, ngx_radix_trie_node_t *node,
+    uint64_t idx, uintptr_t *value) {
+    uint64_t bit, mask;
+
+    bit = (uint64_t) 1 << idx;
+    mask = (bit << 1) - 1;
+
+    if (node->vector & bit) {
+        return &trie->nodes[node->base1
+                            + ngx_radix_popcount(node->vector & mask) - 1];
+    }
+
+    *value = trie->leaves[node->base0
+                          + ngx_radix_popcount(node->leafvec & mask) - 1];
+
+    return NULL;
+}
+
 
 /*将预分配节点简单地设置为-1,这样pool内存池中就会只使用1个页面来尽可能地分配基数树节点*/
 ngx_radix_tree_t *
@@ -29,6 +88,7 @@ ngx_radix_tree_create(ngx_pool_t *pool, ngx_int_t preallocate) {
     tree->free = NULL;
     tree->start = NULL;
     tree->size = 0;
+    tree->trie = NULL;
 
     tree->root = ngx_radix_alloc(tree);
     if (tree->root == NULL) {
@@ -112,6 +172,8 @@ ngx_radix32tree_insert(ngx_radix_tree_t *tree, uint32_t key, uint32_t mask,
     uint32_t bit;
     ngx_radix_node_t *node, *next;
 
+    tree->trie = NULL;
+
     bit = 0x80000000;
 
     node = tree->root;
@@ -175,6 +237,8 @@ ngx_radix32tree_delete(ngx_radix_tree_t *tree, uint32_t key, uint32_t mask) {
     uint32_t bit;
     ngx_radix_node_t *node;
 
+    tree->trie = NULL;
+
     bit = 0x80000000;
     node = tree->root;
 
@@ -236,7 +300,30 @@ uintptr_t
 ngx_radix32tree_find(ngx_radix_tree_t *tree, uint32_t key) {
     uint32_t bit;
     uintptr_t value;
+    ngx_uint_t depth, k;
+    ngx_radix_trie_t *trie;
     ngx_radix_node_t *node;
+    ngx_radix_trie_node_t *tn;
+
+    trie = tree->trie;
+
+    if (trie) {
+        tn = trie->nodes;
+        depth = 0;
+        value = NGX_RADIX_NO_VALUE;
+
+        do {
+            k = ngx_min(NGX_RADIX_TRIE_STRIDE, 32 - depth);
+
+            tn = ngx_radix_trie_next(trie, tn, (key << depth) >> (32 - k),
+                                     &value);
+
+            depth += k;
+
+        } while (tn);
+
+        return value;
+    }
 
     bit = 0x80000000;
     value = NGX_RADIX_NO_VALUE;
@@ -270,6 +357,8 @@ ngx_radix128tree_insert(ngx_radix_tree_t *tree, u_char *key, u_char *mask,
     ngx_uint_t i;
     ngx_radix_node_t *node, *next;
 
+    tree->trie = NULL;
+
     i = 0;
     bit = 0x80;
 
@@ -351,6 +440,8 @@ ngx_radix128tree_delete(ngx_radix_tree_t *tree, u_char *key, u_char *mask) {
     ngx_uint_t i;
     ngx_radix_node_t *node;
 
+    tree->trie = NULL;
+
     i = 0;
     bit = 0x80;
     node = tree->root;
@@ -420,9 +511,49 @@ ngx_radix128tree_delete(ngx_radix_tree_t *tree, u_char *key, u_char *mask) {
 uintptr_t
 ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key) {
     u_char bit;
+    uint64_t hi, lo, idx;
     uintptr_t value;
-    ngx_uint_t i;
+    ngx_uint_t i, depth, k;
+    ngx_radix_trie_t *trie;
     ngx_radix_node_t *node;
+    ngx_radix_trie_node_t *tn;
+
+    trie = tree->trie;
+
+    if (trie) {
+        hi = 0;
+        lo = 0;
+
+        for (i = 0; i < 8; i++) {
+            hi = (hi << 8) | key[i];
+            lo = (lo << 8) | key[i + 8];
+        }
+
+        tn = trie->nodes;
+        depth = 0;
+        value = NGX_RADIX_NO_VALUE;
+
+        do {
+            k = ngx_min(NGX_RADIX_TRIE_STRIDE, 128 - depth);
+
+            if (depth >= 64) {
+                idx = (lo << (depth - 64)) >> (64 - k);
+
+            } else if (depth + k <= 64) {
+                idx = (hi << depth) >> (64 - k);
+
+            } else {
+                idx = ((hi << depth) >> (64 - k)) | (lo >> (128 - depth - k));
+            }
+
+            tn = ngx_radix_trie_next(trie, tn, idx, &value);
+
+            depth += k;
+
+        } while (tn);
+
+        return value;
+    }
 
     i = 0;
     bit = 0x80;
@@ -452,9 +583,230 @@ ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key) {
     return value;
 }
 
+
+ngx_int_t
+ngx_radix128tree_compile(ngx_radix_tree_t *tree) {
+    return ngx_radix_trie_compile(tree, 128);
+}
+
 #endif
 
 
+ngx_int_t
+ngx_radix32tree_compile(ngx_radix_tree_t *tree) {
+    return ngx_radix_trie_compile(tree, 32);
+}
+
+
+/*
+ * 把二叉树编译为多比特trie:叶子值在编译时按最长前缀下推,查找时不需要
+ * 回溯,也不再逐位访问二叉树节点;二叉树保留用于后续的insert/delete
+ */
+static ngx_int_t
+ngx_radix_trie_compile(ngx_radix_tree_t *tree, ngx_uint_t bits) {
+    size_t nsize, lsize;
+    ngx_int_t rc;
+    ngx_pool_t *temp_pool;
+    ngx_radix_trie_t *trie;
+    ngx_radix_trie_ctx_t ctx;
+
+    tree->trie = NULL;
+
+    temp_pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, tree->pool->log);
+    if (temp_pool == NULL) {
+        return NGX_ERROR;
+    }
+
+    rc = NGX_ERROR;
+
+    if (ngx_array_init(&ctx.nodes, temp_pool, 64,
+                       sizeof(ngx_radix_trie_node_t))
+        != NGX_OK) {
+        goto done;
+    }
+
+    if (ngx_array_init(&ctx.leaves, temp_pool, 256, sizeof(uintptr_t))
+        != NGX_OK) {
+        goto done;
+    }
+
+    ctx.bits = bits;
+
+    if (ngx_array_push(&ctx.nodes) == NULL) {
+        goto done;
+    }
+
+    if (ngx_radix_trie_build(&ctx, tree->root, 0, tree->root->value, 0)
+        != NGX_OK) {
+        goto done;
+    }
+
+    nsize = ctx.nodes.nelts * sizeof(ngx_radix_trie_node_t);
+    lsize = ctx.leaves.nelts * sizeof(uintptr_t);
+
+    trie = ngx_palloc(tree->pool, sizeof(ngx_radix_trie_t) + nsize + lsize);
+    if (trie == NULL) {
+        goto done;
+    }
+
+    trie->nodes = (ngx_radix_trie_node_t *) (trie + 1);
+    trie->leaves = (uintptr_t *) ((u_char *) trie->nodes + nsize);
+    trie->nnodes = ctx.nodes.nelts;
+    trie->nleaves = ctx.leaves.nelts;
+
+    ngx_memcpy(trie->nodes, ctx.nodes.elts, nsize);
+    ngx_memcpy(trie->leaves, ctx.leaves.elts, lsize);
+
+    ngx_log_debug4(NGX_LOG_DEBUG_CORE, tree->pool->log, 0,
+                   "radix%ui trie: %ui nodes, %ui leaves, %uz bytes",
+                   bits, trie->nnodes, trie->nleaves, nsize + lsize);
+
+    tree->trie = trie;
+    rc = NGX_OK;
+
+done:
+
+    ngx_destroy_pool(temp_pool);
+
+    return rc;
+}
+
+
+/*
+ * 为二叉树节点node(位于第depth位)生成下标为index的trie节点,value为沿路径
+ * 继承下来的最长前缀值;本节点的叶子连续追加到leaves,子节点在nodes中
+ * 预留连续的位置后再递归生成
+ */
+static ngx_int_t
+ngx_radix_trie_build(ngx_radix_trie_ctx_t *ctx, ngx_radix_node_t *node,
+    ngx_uint_t depth, uintptr_t value, ngx_uint_t index) {
+    uint64_t vector, leafvec;
+    uintptr_t last, *leaf, values[1 << NGX_RADIX_TRIE_STRIDE];
+    ngx_uint_t i, k, n, nchild, base0, base1, internal;
+    ngx_radix_node_t *next[1 << NGX_RADIX_TRIE_STRIDE];
+    ngx_radix_trie_node_t *tn;
+
+    k = ngx_min(NGX_RADIX_TRIE_STRIDE, ctx->bits - depth);
+    n = (ngx_uint_t) 1 << k;
+
+    ngx_radix_trie_fill(node, 0, k, 0, value, next, values);
+
+    vector = 0;
+    leafvec = 0;
+    nchild = 0;
+    last = 0;
+    base0 = ctx->leaves.nelts;
+
+    for (i = 0; i < n; i++) {
+
+        internal = (depth + k < ctx->bits
+                    && next[i]
+                    && (ngx_radix_trie_has_value(next[i]->left)
+                        || ngx_radix_trie_has_value(next[i]->right)));
+
+        if (internal) {
+            vector |= (uint64_t) 1 << i;
+            nchild++;
+            continue;
+        }
+
+        if (leafvec == 0 || values[i] != last) {
+            leaf = ngx_array_push(&ctx->leaves);
+            if (leaf == NULL) {
+                return NGX_ERROR;
+            }
+
+            *leaf = values[i];
+            leafvec |= (uint64_t) 1 << i;
+            last = values[i];
+        }
+    }
+
+    base1 = ctx->nodes.nelts;
+
+    if (nchild && ngx_array_push_n(&ctx->nodes, nchild) == NULL) {
+        return NGX_ERROR;
+    }
+
+    tn = (ngx_radix_trie_node_t *) ctx->nodes.elts + index;
+
+    tn->vector = vector;
+    tn->leafvec = leafvec;
+    tn->base0 = (uint32_t) base0;
+    tn->base1 = (uint32_t) base1;
+
+    for (i = 0; i < n; i++) {
+        if (!(vector & ((uint64_t) 1 << i))) {
+            continue;
+        }
+
+        if (ngx_radix_trie_build(ctx, next[i], depth + k, values[i], base1++)
+            != NGX_OK) {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+/* 取node之下第k层的2^k个二叉树节点及各自继承的前缀值,缺失的子树整段填充 */
+static void
+ngx_radix_trie_fill(ngx_radix_node_t *node, ngx_uint_t level, ngx_uint_t k,
+    ngx_uint_t slot, uintptr_t value, ngx_radix_node_t **next,
+    uintptr_t *values) {
+    ngx_uint_t i, n;
+    ngx_radix_node_t *child;
+
+    if (level == k) {
+        next[slot] = node;
+        values[slot] = value;
+        return;
+    }
+
+    if (node == NULL) {
+        n = (ngx_uint_t) 1 << (k - level);
+        slot <<= k - level;
+
+        for (i = 0; i < n; i++) {
+            next[slot + i] = NULL;
+            values[slot + i] = value;
+        }
+
+        return;
+    }
+
+    child = node->left;
+
+    ngx_radix_trie_fill(child, level + 1, k, slot << 1,
+                        (child && child->value != NGX_RADIX_NO_VALUE)
+                        ? child->value : value,
+                        next, values);
+
+    child = node->right;
+
+    ngx_radix_trie_fill(child, level + 1, k, (slot << 1) | 1,
+                        (child && child->value != NGX_RADIX_NO_VALUE)
+                        ? child->value : value,
+                        next, values);
+}
+
+
+static ngx_uint_t
+ngx_radix_trie_has_value(ngx_radix_node_t *node) {
+    if (node == NULL) {
+        return 0;
+    }
+
+    if (node->value != NGX_RADIX_NO_VALUE) {
+        return 1;
+    }
+
+    return ngx_radix_trie_has_value(node->left)
+           || ngx_radix_trie_has_value(node->right);
+}
+
+
 static ngx_radix_node_t *
 ngx_radix_alloc(ngx_radix_tree_t *tree) {
     ngx_radix_node_t *p;
@@ -24,6 +24,27 @@ struct ngx_radix_node_s {
     uintptr_t          value; //value存储的是指针的值,它指向用户定义的数据结构.如果这个节点还未使用,value的值将是NGX_RADIX_NO_VALUE
 };
 
+/*
+ * 编译后的多比特trie(poptrie):每层取6位作为下标,vector标记哪些下标还有子节点,
+ * leafvec标记叶子值发生变化的位置,通过popcount计算子节点/叶子在连续数组中的偏移,
+ * IPv4最多6次访存,IPv6最多22次
+ */
+#define NGX_RADIX_TRIE_STRIDE  6
+
+typedef struct {
+    uint64_t           vector;  //子节点位图
+    uint64_t           leafvec; //叶子段起点位图
+    uint32_t           base0;   //本节点第一个叶子在leaves中的下标
+    uint32_t           base1;   //本节点第一个子节点在nodes中的下标
+} ngx_radix_trie_node_t;
+
+typedef struct {
+    ngx_radix_trie_node_t  *nodes;
+    uintptr_t              *leaves;
+    ngx_uint_t              nnodes;
+    ngx_uint_t              nleaves;
+} ngx_radix_trie_t;
+
 /*每次删除1个节点时,ngx_radix_treej基数树并不会释放这个节点占用的内存,而是把它添加到free单链表中.这样,在添加新的节点时,会首
 先查看free中是否还有节点,如果free中有未使用的节点,则会优先使用,如果没有,就会再从pool内存池中分配新内存存储节点.
 对于ngx_radix_tree-t结构体来说,仅从使用的角度来看,我们不需要了解pool、free、start、size这些成员的意义,仅了解如何使用root根节点即可.*/
@@ -33,6 +54,7 @@ typedef struct {
     ngx_radix_node_t  *free;  //管理已经分配但暂时未使用(不在树中)的节点,free实际上是所有不在树中节点的单链表
     char              *start; //已分配内存中还未使用内存的首地址
     size_t             size;  //已分配内存中还未使用的内存大小
+    ngx_radix_trie_t  *trie;  //编译后的多比特trie,insert/delete后失效,为NULL时查找走二叉树
 } ngx_radix_tree_t;
 
 
@@ -47,6 +69,8 @@ ngx_int_t ngx_radix32tree_delete(ngx_radix_tree_t *tree,
 
 uintptr_t ngx_radix32tree_find(ngx_radix_tree_t *tree, uint32_t key);
 
+ngx_int_t ngx_radix32tree_compile(ngx_radix_tree_t *tree);
+
 #if (NGX_HAVE_INET6)
 
 ngx_int_t ngx_radix128tree_insert(ngx_radix_tree_t *tree,
@@ -57,6 +81,8 @@ ngx_int_t ngx_radix128tree_delete(ngx_radix_tree_t *tree,
 
 uintptr_t ngx_radix128tree_find(ngx_radix_tree_t *tree, u_char *key);
 
+ngx_int_t ngx_radix128tree_compile(ngx_radix_tree_t *tree);
+
 #endif
 
 
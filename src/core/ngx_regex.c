@@ -32,6 +32,10 @@ static void ngx_libc_cdecl ngx_regex_free(void *p);
 
 static void ngx_regex_cleanup(void *data);
 
+static void ngx_regex_literal(ngx_str_t *pattern, ngx_str_t *literal);
+static u_char *ngx_regex_skip_class(u_char *p, u_char *last);
+static u_char *ngx_regex_skip_group(u_char *p, u_char *last);
+
 static ngx_int_t ngx_regex_module_init(ngx_cycle_t *cycle);
 
 static void *ngx_regex_create_conf(ngx_cycle_t *cycle);
@@ -496,6 +500,573 @@ ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log) {
 }
 
 
+ngx_regex_set_t *
+ngx_regex_set_create(ngx_pool_t *pool, ngx_str_t *patterns, ngx_uint_t n) {
+    u_char c;
+    size_t len, nwords;
+    uint32_t *goto_, *fail, *queue, *next, *match, *ids, s, t;
+    ngx_str_t *lit;
+    ngx_uint_t i, j, k, nstates, nclasses, nids, head, tail, size;
+    ngx_regex_set_t *set;
+
+    set = ngx_pcalloc(pool, sizeof(ngx_regex_set_t));
+    if (set == NULL) {
+        return NULL;
+    }
+
+    nwords = (n + 8 * sizeof(uintptr_t) - 1) / (8 * sizeof(uintptr_t));
+
+    set->nelts = n;
+    set->always = ngx_pcalloc(pool, nwords * sizeof(uintptr_t));
+    if (set->always == NULL) {
+        return NULL;
+    }
+
+    lit = ngx_alloc(n * sizeof(ngx_str_t), pool->log);
+    if (lit == NULL) {
+        return NULL;
+    }
+
+    /* 提取字面量,并为字面量中出现的字节分配等价类(忽略大小写) */
+
+    len = 0;
+    nclasses = 1;
+
+    for (i = 0; i < n; i++) {
+        ngx_regex_literal(&patterns[i], &lit[i]);
+
+        if (lit[i].len == 0) {
+            set->always[i / (8 * sizeof(uintptr_t))]
+                |= (uintptr_t) 1 << (i % (8 * sizeof(uintptr_t)));
+            continue;
+        }
+
+        len += lit[i].len;
+
+        for (j = 0; j < lit[i].len; j++) {
+            c = ngx_tolower(lit[i].data[j]);
+
+            if (set->classes[c] == 0) {
+                set->classes[c] = (u_char) nclasses;
+                set->classes[ngx_toupper(c)] = (u_char) nclasses;
+                nclasses++;
+            }
+        }
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_CORE, pool->log, 0,
+                   "regex set: %ui patterns, %uz literal bytes, %ui classes",
+                   n, len, nclasses);
+
+    if (len == 0) {
+        ngx_free(lit);
+        return set;
+    }
+
+    /*
+     * 状态数不超过字面量总长度+1;goto_为trie的转移,
+     * 之后按BFS顺序用失败指针补全为完整的DFA
+     */
+
+    size = (len + 1) * nclasses;
+
+    goto_ = ngx_alloc((size + 3 * (len + 1)) * sizeof(uint32_t), pool->log);
+    if (goto_ == NULL) {
+        ngx_free(lit);
+        return NULL;
+    }
+
+    fail = goto_ + size;
+    queue = fail + len + 1;
+    match = queue + len + 1;
+
+    for (i = 0; i < size; i++) {
+        goto_[i] = NGX_REGEX_SET_NONE;
+    }
+
+    nstates = 1;
+
+    for (i = 0; i < n; i++) {
+        s = 0;
+
+        for (j = 0; j < lit[i].len; j++) {
+            k = s * nclasses + set->classes[lit[i].data[j]];
+
+            if (goto_[k] == NGX_REGEX_SET_NONE) {
+                goto_[k] = (uint32_t) nstates++;
+            }
+
+            s = goto_[k];
+        }
+    }
+
+    /* 每个状态的输出:自身结束的字面量加上失败链上的输出 */
+
+    next = ngx_palloc(pool, nstates * nclasses * sizeof(uint32_t)
+                            + nstates * sizeof(uint32_t));
+    if (next == NULL) {
+        goto failed;
+    }
+
+    set->next = next;
+    set->match = next + nstates * nclasses;
+    set->nclasses = nclasses;
+
+    head = 0;
+    tail = 0;
+    fail[0] = 0;
+
+    for (k = 0; k < nclasses; k++) {
+        t = goto_[k];
+
+        if (t == NGX_REGEX_SET_NONE) {
+            next[k] = 0;
+
+        } else {
+            next[k] = t;
+            fail[t] = 0;
+            queue[tail++] = t;
+        }
+    }
+
+    while (head < tail) {
+        s = queue[head++];
+
+        for (k = 0; k < nclasses; k++) {
+            t = goto_[s * nclasses + k];
+
+            if (t == NGX_REGEX_SET_NONE) {
+                next[s * nclasses + k] = next[fail[s] * nclasses + k];
+                continue;
+            }
+
+            next[s * nclasses + k] = t;
+            fail[t] = next[fail[s] * nclasses + k];
+            queue[tail++] = t;
+        }
+    }
+
+    /* 统计输出列表长度:沿失败链累加,BFS顺序保证失败状态先于当前状态 */
+
+    for (i = 0; i < nstates; i++) {
+        match[i] = 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        s = 0;
+
+        for (j = 0; j < lit[i].len; j++) {
+            s = goto_[s * nclasses + set->classes[lit[i].data[j]]];
+        }
+
+        if (lit[i].len) {
+            match[s]++;
+        }
+    }
+
+    for (i = 0; i < tail; i++) {
+        s = queue[i];
+        match[s] += match[fail[s]];
+    }
+
+    nids = 0;
+
+    for (i = 0; i < nstates; i++) {
+        if (match[i]) {
+            nids += match[i] + 1;
+        }
+    }
+
+    ids = ngx_palloc(pool, (nids ? nids : 1) * sizeof(uint32_t));
+    if (ids == NULL) {
+        goto failed;
+    }
+
+    set->ids = ids;
+
+    /* 分配每个状态的列表起点,先填自身的正则编号 */
+
+    nids = 0;
+
+    for (i = 0; i < nstates; i++) {
+        if (match[i] == 0) {
+            set->match[i] = NGX_REGEX_SET_NONE;
+            continue;
+        }
+
+        set->match[i] = (uint32_t) nids;
+        nids += match[i] + 1;
+        match[i] = 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (lit[i].len == 0) {
+            continue;
+        }
+
+        s = 0;
+
+        for (j = 0; j < lit[i].len; j++) {
+            s = goto_[s * nclasses + set->classes[lit[i].data[j]]];
+        }
+
+        ids[set->match[s] + match[s]++] = (uint32_t) i;
+    }
+
+    /* 再按BFS顺序追加失败状态的列表 */
+
+    for (i = 0; i < tail; i++) {
+        s = queue[i];
+        t = fail[s];
+
+        if (set->match[t] != NGX_REGEX_SET_NONE) {
+            for (j = set->match[t]; ids[j] != NGX_REGEX_SET_NONE; j++) {
+                ids[set->match[s] + match[s]++] = ids[j];
+            }
+        }
+
+        if (set->match[s] != NGX_REGEX_SET_NONE) {
+            ids[set->match[s] + match[s]] = NGX_REGEX_SET_NONE;
+        }
+    }
+
+    ngx_free(goto_);
+    ngx_free(lit);
+
+    return set;
+
+failed:
+
+    ngx_free(goto_);
+    ngx_free(lit);
+
+    return NULL;
+}
+
+
+/*
+ * 返回可能匹配的正则位图:在always的基础上,扫描一遍s,把出现了字面量的
+ * 正则对应的位置1
+ */
+uintptr_t *
+ngx_regex_set_match(ngx_regex_set_t *set, ngx_str_t *s, ngx_pool_t *pool) {
+    u_char *p, *last, *classes;
+    size_t nwords;
+    uint32_t state, *next, *match, *id;
+    uintptr_t *bits;
+    ngx_uint_t nclasses;
+
+    nwords = (set->nelts + 8 * sizeof(uintptr_t) - 1) / (8 * sizeof(uintptr_t));
+
+    bits = ngx_palloc(pool, nwords * sizeof(uintptr_t));
+    if (bits == NULL) {
+        return NULL;
+    }
+
+    ngx_memcpy(bits, set->always, nwords * sizeof(uintptr_t));
+
+    if (set->next == NULL) {
+        return bits;
+    }
+
+    next = set->next;
+    match = set->match;
+    classes = set->classes;
+    nclasses = set->nclasses;
+
+    state = 0;
+    p = s->data;
+    last = p + s->len;
+
+    while (p < last) {
+        state = next[state * nclasses + classes[*p++]];
+
+        if (match[state] == NGX_REGEX_SET_NONE) {
+            continue;
+        }
+
+        for (id = &set->ids[match[state]]; *id != NGX_REGEX_SET_NONE; id++) {
+            bits[*id / (8 * sizeof(uintptr_t))]
+                |= (uintptr_t) 1 << (*id % (8 * sizeof(uintptr_t)));
+        }
+    }
+
+    return bits;
+}
+
+
+/*
+ * 保守地提取正则的必需字面量:只看最外层的顺序部分,遇到分组、字符类、
+ * 元字符或可选量词就结束当前字面量串,取其中最长的一个;顶层有"|"、
+ * 改变语法的选项"(?x)"等、"(*VERB)"、"\Q"、"\c"时放弃
+ */
+static void
+ngx_regex_literal(ngx_str_t *pattern, ngx_str_t *literal) {
+    u_char c, *p, *last, *start, *best;
+    size_t len, blen;
+    ngx_uint_t i;
+
+    literal->len = 0;
+    literal->data = NULL;
+
+    p = pattern->data;
+    last = p + pattern->len;
+
+    for (i = 0; i + 1 < pattern->len; i++) {
+        if (p[i] == '\\' && (p[i + 1] == 'Q' || p[i + 1] == 'c')) {
+            return;
+        }
+
+        if (p[i] == '(' && p[i + 1] == '*') {
+            return;
+        }
+    }
+
+    best = NULL;
+    blen = 0;
+    start = NULL;
+    len = 0;
+
+#define ngx_regex_literal_end()                                               \
+    if (len > blen) {                                                         \
+        best = start;                                                         \
+        blen = len;                                                           \
+    }                                                                         \
+    len = 0
+
+    while (p < last) {
+        c = *p;
+
+        switch (c) {
+
+        case '|':
+            return;
+
+        case '(':
+            ngx_regex_literal_end();
+
+            if (p + 2 < last && p[1] == '?'
+                && ngx_strchr("imnsxJUa^-", p[2]) != NULL)
+            {
+                return;
+            }
+
+            p = ngx_regex_skip_group(p, last);
+            continue;
+
+        case '[':
+            ngx_regex_literal_end();
+            p = ngx_regex_skip_class(p, last);
+            continue;
+
+        case '*':
+        case '?':
+        case '{':
+
+            /* 量词作用于前一个字符,使其可选:从字面量串中去掉它 */
+
+            if (len) {
+                len--;
+            }
+
+            ngx_regex_literal_end();
+
+            if (c == '{') {
+                while (p < last && *p != '}') {
+                    p++;
+                }
+            }
+
+            p++;
+            continue;
+
+        case '+':
+            ngx_regex_literal_end();
+            p++;
+            continue;
+
+        case '^':
+        case '$':
+        case '.':
+        case ')':
+            ngx_regex_literal_end();
+            p++;
+            continue;
+
+        case '\\':
+            if (p + 1 == last) {
+                return;
+            }
+
+            c = p[1];
+
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                || (c >= '0' && c <= '9'))
+            {
+                ngx_regex_literal_end();
+
+                p += 2;
+
+                if (ngx_strchr("dDwWsSbBAzZGhHvVRXK", c) != NULL) {
+                    continue;
+                }
+
+                /* \x{...}、\p{..}、\g<..>、\1等带参数的转义,跳过参数 */
+
+                while (p < last) {
+                    c = *p;
+
+                    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                        || (c >= '0' && c <= '9')
+                        || (c && ngx_strchr("{}<>',-+_^:=", c) != NULL))
+                    {
+                        p++;
+                        continue;
+                    }
+
+                    break;
+                }
+
+                continue;
+            }
+
+            /*
+             * 转义的标点符号是普通字符,但它与前面的字面量在模式中不连续,
+             * 只能作为新字面量串的开始
+             */
+
+            ngx_regex_literal_end();
+
+            start = p + 1;
+            len = 1;
+            p += 2;
+
+            if (p < last && (*p == '*' || *p == '?' || *p == '{')) {
+                len--;
+                ngx_regex_literal_end();
+            }
+
+            continue;
+
+        default:
+            if (len && start + len != p) {
+                ngx_regex_literal_end();
+            }
+
+            if (len == 0) {
+                start = p;
+            }
+
+            len++;
+            p++;
+            continue;
+        }
+    }
+
+    ngx_regex_literal_end();
+
+#undef ngx_regex_literal_end
+
+    if (blen >= 2) {
+        literal->data = best;
+        literal->len = blen;
+    }
+}
+
+
+/* 跳过字符类"[...]",返回其后的位置 */
+
+static u_char *
+ngx_regex_skip_class(u_char *p, u_char *last) {
+    p++;
+
+    if (p < last && *p == '^') {
+        p++;
+    }
+
+    /* 紧跟在"["或"[^"之后的"]"是普通字符 */
+
+    if (p < last && *p == ']') {
+        p++;
+    }
+
+    while (p < last) {
+        if (*p == '\\') {
+            p += 2;
+            continue;
+        }
+
+        if (*p == '[' && p + 1 < last && p[1] == ':') {
+
+            /* POSIX字符类"[:alpha:]" */
+
+            for (p += 2; p + 1 < last; p++) {
+                if (p[0] == ':' && p[1] == ']') {
+                    break;
+                }
+            }
+
+            p += 2;
+            continue;
+        }
+
+        if (*p == ']') {
+            return p + 1;
+        }
+
+        p++;
+    }
+
+    return last;
+}
+
+
+/* 跳过分组"(...)",包括其中嵌套的分组、字符类和注释"(?#...)" */
+
+static u_char *
+ngx_regex_skip_group(u_char *p, u_char *last) {
+    ngx_uint_t depth;
+
+    if (p + 2 < last && p[1] == '?' && p[2] == '#') {
+        while (p < last && *p != ')') {
+            p++;
+        }
+
+        return p < last ? p + 1 : last;
+    }
+
+    depth = 0;
+
+    while (p < last) {
+        switch (*p) {
+
+        case '\\':
+            p += 2;
+            continue;
+
+        case '[':
+            p = ngx_regex_skip_class(p, last);
+            continue;
+
+        case '(':
+            depth++;
+            break;
+
+        case ')':
+            if (--depth == 0) {
+                return p + 1;
+            }
+
+            break;
+        }
+
+        p++;
+    }
+
+    return last;
+}
+
+
 #if (NGX_PCRE2)
 
 static void * ngx_libc_cdecl
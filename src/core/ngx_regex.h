@@ -81,4 +81,32 @@ ngx_int_t ngx_regex_exec(ngx_regex_t *re, ngx_str_t *s, int *captures,
 ngx_int_t ngx_regex_exec_array(ngx_array_t *a, ngx_str_t *s, ngx_log_t *log);
 
 
+/*
+ * 正则集合预过滤:从每个正则中提取出任何匹配都必须包含的字面量,把所有字面量
+ * 编译成一个忽略大小写的Aho-Corasick自动机.对目标串扫描一遍即可得到可能匹配的
+ * 正则位图,调用者再按原顺序只对这些正则执行pcre匹配(以及获取捕获)
+ */
+typedef struct {
+    ngx_uint_t nelts;     //集合中正则的个数
+    ngx_uint_t nclasses;  //字节等价类个数,不出现在任何字面量中的字节都属于类0
+    uint32_t *next;       //状态转移表,nstates * nclasses,没有可用字面量时为NULL
+    uint32_t *match;      //每个状态命中的正则编号列表在ids中的起点
+    uint32_t *ids;        //以NGX_REGEX_SET_NONE结尾的正则编号列表
+    uintptr_t *always;    //没有提取到字面量的正则,总是需要执行
+    u_char classes[256];
+} ngx_regex_set_t;
+
+#define NGX_REGEX_SET_NONE     (uint32_t) -1
+
+#define ngx_regex_set_test(bits, i)                                           \
+    ((bits)[(i) / (8 * sizeof(uintptr_t))]                                    \
+     & ((uintptr_t) 1 << ((i) % (8 * sizeof(uintptr_t)))))
+
+ngx_regex_set_t *ngx_regex_set_create(ngx_pool_t *pool, ngx_str_t *patterns,
+    ngx_uint_t n);
+
+uintptr_t *ngx_regex_set_match(ngx_regex_set_t *set, ngx_str_t *s,
+    ngx_pool_t *pool);
+
+
 #endif /* _NGX_REGEX_H_INCLUDED_ */
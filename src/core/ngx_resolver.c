@@ -54,6 +54,47 @@ typedef struct {
 #define ngx_resolver_node(n)  ngx_rbtree_data(n, ngx_resolver_node_t, node)
 
 
+/*
+ * 共享缓存中的名字节点,data中依次存放naddrs个in_addr_t、naddrs6个
+ * struct in6_addr和名字本身,按字节拷贝,不要求对齐
+ */
+typedef struct {
+    ngx_rbtree_node_t node;
+    ngx_queue_t queue;         //LRU,空间不足时从尾部淘汰
+
+    time_t valid;
+    time_t updating;           //某个worker开始查询的时间,0表示没有查询
+    uint32_t ttl;
+
+    u_short nlen;
+    u_short naddrs;
+    u_short naddrs6;
+    u_char code;               //非0表示缓存的是错误应答,如NXDOMAIN
+
+    u_char data[1];
+} ngx_resolver_shared_node_t;
+
+
+typedef struct {
+    ngx_rbtree_t rbtree;
+    ngx_rbtree_node_t sentinel;
+    ngx_queue_t queue;
+} ngx_resolver_shared_sh_t;
+
+
+typedef struct {
+    ngx_resolver_shared_sh_t *sh;
+    ngx_slab_pool_t *shpool;
+} ngx_resolver_shared_t;
+
+
+/* 等待其他worker查询结果时检查共享缓存的间隔,毫秒 */
+#define NGX_RESOLVER_SHARED_POLL  20
+
+/* 剩余有效期不足1/NGX_RESOLVER_PREFETCH时提前刷新 */
+#define NGX_RESOLVER_PREFETCH     10
+
+
 static ngx_int_t ngx_udp_connect(ngx_resolver_connection_t *rec);
 
 static ngx_int_t ngx_tcp_connect(ngx_resolver_connection_t *rec);
@@ -160,6 +201,31 @@ static void ngx_resolver_srv_names_handler(ngx_resolver_ctx_t *ctx);
 
 static ngx_int_t ngx_resolver_cmp_srvs(const void *one, const void *two);
 
+static ngx_int_t ngx_resolver_shared_zone(ngx_conf_t *cf, ngx_resolver_t *r,
+    ngx_str_t *value);
+static ngx_int_t ngx_resolver_shared_init_zone(ngx_shm_zone_t *shm_zone,
+    void *data);
+static ngx_resolver_shared_node_t *ngx_resolver_shared_find(
+    ngx_resolver_shared_t *shared, ngx_str_t *name, uint32_t hash);
+static ngx_resolver_shared_node_t *ngx_resolver_shared_alloc(
+    ngx_resolver_shared_t *shared, size_t size);
+static ngx_int_t ngx_resolver_shared_lookup(ngx_resolver_t *r,
+    ngx_resolver_ctx_t *ctx, ngx_resolver_node_t *rn, ngx_str_t *name,
+    uint32_t hash);
+static ngx_int_t ngx_resolver_shared_copy(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn, ngx_resolver_shared_node_t *sn);
+static void ngx_resolver_shared_clear(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn);
+static void ngx_resolver_shared_store(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn, ngx_uint_t code);
+static void ngx_resolver_shared_release(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn);
+static void ngx_resolver_shared_prefetch(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn);
+static ngx_int_t ngx_resolver_shared_restore(ngx_resolver_t *r,
+    ngx_resolver_node_t *rn);
+static void ngx_resolver_shared_handler(ngx_event_t *ev);
+
 #if (NGX_HAVE_INET6)
 
 static void ngx_resolver_rbtree_insert_addr6_value(ngx_rbtree_node_t *temp,
@@ -215,6 +281,8 @@ ngx_resolver_create(ngx_conf_t *cf, ngx_str_t *names, ngx_uint_t n) {
     ngx_queue_init(&r->srv_expire_queue);
     ngx_queue_init(&r->addr_expire_queue);
 
+    ngx_queue_init(&r->shared_wait_queue);
+
 #if (NGX_HAVE_INET6)
     r->ipv6 = 1;
 
@@ -264,6 +332,15 @@ ngx_resolver_create(ngx_conf_t *cf, ngx_str_t *names, ngx_uint_t n) {
             continue;
         }
 
+        if (ngx_strncmp(names[i].data, "zone=", 5) == 0) {
+
+            if (ngx_resolver_shared_zone(cf, r, &names[i]) != NGX_OK) {
+                return NULL;
+            }
+
+            continue;
+        }
+
 #if (NGX_HAVE_INET6)
         if (ngx_strncmp(names[i].data, "ipv6=", 5) == 0) {
 
@@ -345,6 +422,10 @@ ngx_resolver_cleanup(void *data) {
         ngx_del_timer(r->event);
     }
 
+    if (r->shared_event && r->shared_event->timer_set) {
+        ngx_del_timer(r->shared_event);
+    }
+
     rec = r->connections.elts;
 
     for (i = 0; i < r->connections.nelts; i++) {
@@ -641,6 +722,16 @@ ngx_resolve_name_locked(ngx_resolver_t *r, ngx_resolver_ctx_t *ctx,
         expire_queue = &r->name_expire_queue;
     }
 
+    if (r->shm_zone && ctx->service.len == 0
+        && (rn == NULL || rn->valid < ngx_time()))
+    {
+        rc = ngx_resolver_shared_lookup(r, ctx, rn, name, hash);
+
+        if (rc != NGX_DECLINED) {
+            return rc;
+        }
+    }
+
     if (rn) {
 
         /* ctx can be a list after NGX_RESOLVE_CNAME */
@@ -699,188 +790,1081 @@ ngx_resolve_name_locked(ngx_resolver_t *r, ngx_resolver_ctx_t *ctx,
 
                     ctx->handler(ctx);
 
-                    ctx = next;
-                } while (ctx);
+                    ctx = next;
+                } while (ctx);
+
+                if (addrs != NULL) {
+                    ngx_resolver_free(r, addrs->sockaddr);
+                    ngx_resolver_free(r, addrs);
+                }
+
+                if (r->shm_zone && tree == &r->name_rbtree) {
+                    ngx_resolver_shared_prefetch(r, rn);
+                }
+
+                return NGX_OK;
+            }
+
+            if (rn->nsrvs) {
+                last->next = rn->waiting;
+                rn->waiting = NULL;
+
+                /* unlock name mutex */
+
+                do {
+                    next = ctx->next;
+
+                    ngx_resolver_resolve_srv_names(ctx, rn);
+
+                    ctx = next;
+                } while (ctx);
+
+                return NGX_OK;
+            }
+
+            /* NGX_RESOLVE_CNAME */
+
+            if (ctx->recursion++ < NGX_RESOLVER_MAX_RECURSION) {
+
+                cname.len = rn->cnlen;
+                cname.data = rn->u.cname;
+
+                return ngx_resolve_name_locked(r, ctx, &cname);
+            }
+
+            last->next = rn->waiting;
+            rn->waiting = NULL;
+
+            /* unlock name mutex */
+
+            do {
+                ctx->state = NGX_RESOLVE_NXDOMAIN;
+                ctx->valid = ngx_time() + (r->valid ? r->valid : 10);
+                next = ctx->next;
+
+                ctx->handler(ctx);
+
+                ctx = next;
+            } while (ctx);
+
+            return NGX_OK;
+        }
+
+        if (rn->waiting) {
+            if (ngx_resolver_set_timeout(r, ctx) != NGX_OK) {
+                return NGX_ERROR;
+            }
+
+            last->next = rn->waiting;
+            rn->waiting = ctx;
+            ctx->state = NGX_AGAIN;
+            ctx->async = 1;
+
+            do {
+                ctx->node = rn;
+                ctx = ctx->next;
+            } while (ctx);
+
+            return NGX_AGAIN;
+        }
+
+        ngx_queue_remove(&rn->queue);
+
+        /* lock alloc mutex */
+
+        if (rn->query) {
+            ngx_resolver_free_locked(r, rn->query);
+            rn->query = NULL;
+#if (NGX_HAVE_INET6)
+            rn->query6 = NULL;
+#endif
+        }
+
+        if (rn->cnlen) {
+            ngx_resolver_free_locked(r, rn->u.cname);
+        }
+
+        if (rn->naddrs > 1 && rn->naddrs != (u_short) -1) {
+            ngx_resolver_free_locked(r, rn->u.addrs);
+        }
+
+#if (NGX_HAVE_INET6)
+        if (rn->naddrs6 > 1 && rn->naddrs6 != (u_short) -1) {
+            ngx_resolver_free_locked(r, rn->u6.addrs6);
+        }
+#endif
+
+        if (rn->nsrvs) {
+            for (i = 0; i < (ngx_uint_t) rn->nsrvs; i++) {
+                if (rn->u.srvs[i].name.data) {
+                    ngx_resolver_free_locked(r, rn->u.srvs[i].name.data);
+                }
+            }
+
+            ngx_resolver_free_locked(r, rn->u.srvs);
+        }
+
+        /* unlock alloc mutex */
+
+    } else {
+
+        rn = ngx_resolver_alloc(r, sizeof(ngx_resolver_node_t));
+        if (rn == NULL) {
+            return NGX_ERROR;
+        }
+
+        rn->name = ngx_resolver_dup(r, name->data, name->len);
+        if (rn->name == NULL) {
+            ngx_resolver_free(r, rn);
+            return NGX_ERROR;
+        }
+
+        rn->node.key = hash;
+        rn->nlen = (u_short) name->len;
+        rn->query = NULL;
+#if (NGX_HAVE_INET6)
+        rn->query6 = NULL;
+#endif
+
+        ngx_rbtree_insert(tree, &rn->node);
+    }
+
+    if (ctx->service.len) {
+        rc = ngx_resolver_create_srv_query(r, rn, name);
+
+    } else {
+        rc = ngx_resolver_create_name_query(r, rn, name);
+    }
+
+    if (rc == NGX_ERROR) {
+        goto failed;
+    }
+
+    if (rc == NGX_DECLINED) {
+        ngx_rbtree_delete(tree, &rn->node);
+
+        ngx_resolver_free(r, rn->query);
+        ngx_resolver_free(r, rn->name);
+        ngx_resolver_free(r, rn);
+
+        do {
+            ctx->state = NGX_RESOLVE_NXDOMAIN;
+            next = ctx->next;
+
+            ctx->handler(ctx);
+
+            ctx = next;
+        } while (ctx);
+
+        return NGX_OK;
+    }
+
+    rn->last_connection = r->last_connection++;
+    if (r->last_connection == r->connections.nelts) {
+        r->last_connection = 0;
+    }
+
+    rn->naddrs = (u_short) -1;
+    rn->tcp = 0;
+#if (NGX_HAVE_INET6)
+    rn->naddrs6 = r->ipv6 ? (u_short) -1 : 0;
+    rn->tcp6 = 0;
+#endif
+    rn->nsrvs = 0;
+
+    if (ngx_resolver_send_query(r, rn) != NGX_OK) {
+
+        /* immediately retry once on failure */
+
+        rn->last_connection++;
+        if (rn->last_connection == r->connections.nelts) {
+            rn->last_connection = 0;
+        }
+
+        (void) ngx_resolver_send_query(r, rn);
+    }
+
+    if (ngx_resolver_set_timeout(r, ctx) != NGX_OK) {
+        goto failed;
+    }
+
+    if (ngx_resolver_resend_empty(r)) {
+        ngx_add_timer(r->event, (ngx_msec_t) (r->resend_timeout * 1000));
+    }
+
+    rn->expire = ngx_time() + r->resend_timeout;
+
+    ngx_queue_insert_head(resend_queue, &rn->queue);
+
+    rn->code = 0;
+    rn->cnlen = 0;
+    rn->valid = 0;
+    rn->ttl = NGX_MAX_UINT32_VALUE;
+    rn->waiting = ctx;
+
+    ctx->state = NGX_AGAIN;
+    ctx->async = 1;
+
+    do {
+        ctx->node = rn;
+        ctx = ctx->next;
+    } while (ctx);
+
+    return NGX_AGAIN;
+
+    failed:
+
+    ngx_rbtree_delete(tree, &rn->node);
+
+    if (rn->query) {
+        ngx_resolver_free(r, rn->query);
+    }
+
+    ngx_resolver_free(r, rn->name);
+
+    ngx_resolver_free(r, rn);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_resolver_shared_zone(ngx_conf_t *cf, ngx_resolver_t *r, ngx_str_t *value) {
+    u_char *p;
+    ssize_t size;
+    ngx_str_t name, s;
+    ngx_resolver_shared_t *shared;
+
+    name.data = value->data + 5;
+
+    p = (u_char *) ngx_strchr(name.data, ':');
+
+    if (p == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone size \"%V\"", value);
+        return NGX_ERROR;
+    }
+
+    name.len = p - name.data;
+
+    s.data = p + 1;
+    s.len = value->data + value->len - s.data;
+
+    size = ngx_parse_size(&s);
+
+    if (size == NGX_ERROR || name.len == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid zone \"%V\"", value);
+        return NGX_ERROR;
+    }
+
+    if (size < (ssize_t) (8 * ngx_pagesize)) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "zone \"%V\" is too small", value);
+        return NGX_ERROR;
+    }
+
+    r->shm_zone = ngx_shared_memory_add(cf, &name, size, &ngx_core_module);
+    if (r->shm_zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    /* 同名zone可以被多个resolver指令共用 */
+
+    if (r->shm_zone->data == NULL) {
+        shared = ngx_pcalloc(cf->pool, sizeof(ngx_resolver_shared_t));
+        if (shared == NULL) {
+            return NGX_ERROR;
+        }
+
+        r->shm_zone->init = ngx_resolver_shared_init_zone;
+        r->shm_zone->data = shared;
+    }
+
+    r->shared_event = ngx_pcalloc(cf->pool, sizeof(ngx_event_t));
+    if (r->shared_event == NULL) {
+        return NGX_ERROR;
+    }
+
+    r->shared_event->handler = ngx_resolver_shared_handler;
+    r->shared_event->data = r;
+    r->shared_event->log = &cf->cycle->new_log;
+    r->shared_event->cancelable = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_resolver_shared_init_zone(ngx_shm_zone_t *shm_zone, void *data) {
+    ngx_resolver_shared_t *oshared = data;
+
+    size_t len;
+    ngx_resolver_shared_t *shared;
+
+    shared = shm_zone->data;
+
+    if (oshared) {
+        shared->sh = oshared->sh;
+        shared->shpool = oshared->shpool;
+        return NGX_OK;
+    }
+
+    shared->shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        shared->sh = shared->shpool->data;
+        return NGX_OK;
+    }
+
+    shared->sh = ngx_slab_alloc(shared->shpool,
+                                sizeof(ngx_resolver_shared_sh_t));
+    if (shared->sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    shared->shpool->data = shared->sh;
+
+    ngx_rbtree_init(&shared->sh->rbtree, &shared->sh->sentinel,
+                    ngx_rbtree_insert_value);
+
+    ngx_queue_init(&shared->sh->queue);
+
+    len = sizeof(" in resolver zone \"\"") + shm_zone->shm.name.len;
+
+    shared->shpool->log_ctx = ngx_slab_alloc(shared->shpool, len);
+    if (shared->shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(shared->shpool->log_ctx, " in resolver zone \"%V\"%Z",
+                &shm_zone->shm.name);
+
+    shared->shpool->log_nomem = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_resolver_shared_node_t *
+ngx_resolver_shared_find(ngx_resolver_shared_t *shared, ngx_str_t *name,
+    uint32_t hash) {
+    u_char *p;
+    ngx_int_t rc;
+    ngx_rbtree_node_t *node, *sentinel;
+    ngx_resolver_shared_node_t *sn;
+
+    node = shared->sh->rbtree.root;
+    sentinel = shared->sh->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (hash < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (hash > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* hash == node->key */
+
+        sn = (ngx_resolver_shared_node_t *) node;
+
+        p = sn->data + sn->naddrs * sizeof(in_addr_t)
+            + sn->naddrs6 * sizeof(struct in6_addr);
+
+        rc = ngx_memn2cmp(name->data, p, name->len, sn->nlen);
+
+        if (rc == 0) {
+            return sn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    return NULL;
+}
+
+
+/* 在共享内存中分配节点,空间不足时淘汰最久未使用的节点,调用者持有锁 */
+
+static ngx_resolver_shared_node_t *
+ngx_resolver_shared_alloc(ngx_resolver_shared_t *shared, size_t size) {
+    ngx_uint_t i;
+    ngx_queue_t *q;
+    ngx_resolver_shared_node_t *sn;
+
+    for (i = 0; i < 8; i++) {
+
+        sn = ngx_slab_alloc_locked(shared->shpool, size);
+        if (sn) {
+            return sn;
+        }
+
+        if (ngx_queue_empty(&shared->sh->queue)) {
+            break;
+        }
+
+        q = ngx_queue_last(&shared->sh->queue);
+        sn = ngx_queue_data(q, ngx_resolver_shared_node_t, queue);
+
+        ngx_queue_remove(q);
+        ngx_rbtree_delete(&shared->sh->rbtree, &sn->node);
+        ngx_slab_free_locked(shared->shpool, sn);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * 本地缓存未命中时查共享缓存:
+ * NGX_OK       - 命中,已回调所有ctx
+ * NGX_AGAIN    - 其他worker正在查询该名字,ctx等待其结果
+ * NGX_DECLINED - 未命中,已登记由本worker查询,调用者发送请求
+ */
+static ngx_int_t
+ngx_resolver_shared_lookup(ngx_resolver_t *r, ngx_resolver_ctx_t *ctx,
+    ngx_resolver_node_t *rn, ngx_str_t *name, uint32_t hash) {
+    time_t now, valid;
+    size_t len;
+    ngx_uint_t naddrs, code;
+    ngx_resolver_ctx_t *next;
+    ngx_resolver_addr_t *addrs;
+    ngx_resolver_node_t tmp;
+    ngx_resolver_shared_t *shared;
+    ngx_resolver_shared_node_t *sn;
+
+    shared = r->shm_zone->data;
+    now = ngx_time();
+
+    ngx_shmtx_lock(&shared->shpool->mutex);
+
+    sn = ngx_resolver_shared_find(shared, name, hash);
+
+    naddrs = 0;
+
+    if (sn && sn->valid >= now) {
+
+        if (sn->code) {
+
+            /* 缓存的错误应答 */
+
+            code = sn->code;
+            valid = sn->valid;
+
+            ngx_shmtx_unlock(&shared->shpool->mutex);
+
+            do {
+                ctx->state = code;
+                ctx->valid = valid;
+                next = ctx->next;
+
+                ctx->handler(ctx);
+
+                ctx = next;
+            } while (ctx);
+
+            return NGX_OK;
+        }
+
+        naddrs = sn->naddrs;
+#if (NGX_HAVE_INET6)
+        naddrs += r->ipv6 ? sn->naddrs6 : 0;
+#endif
+    }
+
+    if (naddrs) {
+
+        ngx_queue_remove(&sn->queue);
+        ngx_queue_insert_head(&shared->sh->queue, &sn->queue);
+
+        if (rn == NULL || (rn->waiting == NULL && rn->query == NULL)) {
+
+            /* 拷贝到本地缓存,再按本地缓存命中处理 */
+
+            if (rn == NULL) {
+                rn = ngx_resolver_calloc(r, sizeof(ngx_resolver_node_t));
+                if (rn == NULL) {
+                    goto failed;
+                }
+
+                rn->name = ngx_resolver_dup(r, name->data, name->len);
+                if (rn->name == NULL) {
+                    ngx_resolver_free(r, rn);
+                    goto failed;
+                }
+
+                rn->node.key = hash;
+                rn->nlen = (u_short) name->len;
+
+                ngx_rbtree_insert(&r->name_rbtree, &rn->node);
+
+            } else {
+                ngx_queue_remove(&rn->queue);
+                ngx_resolver_shared_clear(r, rn);
+            }
+
+            if (ngx_resolver_shared_copy(r, rn, sn) != NGX_OK) {
+                ngx_rbtree_delete(&r->name_rbtree, &rn->node);
+                ngx_resolver_free(r, rn->name);
+                ngx_resolver_free(r, rn);
+                goto failed;
+            }
+
+            ngx_shmtx_unlock(&shared->shpool->mutex);
+
+            rn->expire = now + r->expire;
+
+            ngx_queue_insert_head(&r->name_expire_queue, &rn->queue);
+
+            ngx_log_debug0(NGX_LOG_DEBUG_CORE, r->log, 0,
+                           "resolve shared");
+
+            return ngx_resolve_name_locked(r, ctx, name);
+        }
+
+        /*
+         * 本地节点正在查询(例如提前刷新),直接用共享缓存中仍然有效的
+         * 结果回调,不改动本地节点
+         */
+
+        ngx_memzero(&tmp, sizeof(ngx_resolver_node_t));
+
+        if (ngx_resolver_shared_copy(r, &tmp, sn) != NGX_OK) {
+            goto failed;
+        }
+
+        ngx_shmtx_unlock(&shared->shpool->mutex);
+
+        addrs = ngx_resolver_export(r, &tmp, 1);
+
+        ngx_resolver_shared_clear(r, &tmp);
+
+        if (addrs == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_log_debug0(NGX_LOG_DEBUG_CORE, r->log, 0,
+                       "resolve shared, node is busy");
+
+        do {
+            ctx->state = NGX_OK;
+            ctx->valid = tmp.valid;
+            ctx->naddrs = naddrs;
+            ctx->addrs = addrs;
+
+            next = ctx->next;
+
+            ctx->handler(ctx);
+
+            ctx = next;
+        } while (ctx);
+
+        ngx_resolver_free(r, addrs->sockaddr);
+        ngx_resolver_free(r, addrs);
+
+        return NGX_OK;
+    }
+
+    if (sn && sn->updating && now - sn->updating < r->resend_timeout) {
+
+        ngx_shmtx_unlock(&shared->shpool->mutex);
+
+        if (rn && rn->waiting) {
+            return NGX_DECLINED;
+        }
+
+        /*
+         * 另一个worker正在查询,不重复发送请求,等待其写入共享缓存;
+         * 如果是本worker的提前刷新查询还未返回,则等待该查询
+         */
+
+        if (rn == NULL) {
+            rn = ngx_resolver_calloc(r, sizeof(ngx_resolver_node_t));
+            if (rn == NULL) {
+                return NGX_ERROR;
+            }
+
+            rn->name = ngx_resolver_dup(r, name->data, name->len);
+            if (rn->name == NULL) {
+                ngx_resolver_free(r, rn);
+                return NGX_ERROR;
+            }
+
+            rn->node.key = hash;
+            rn->nlen = (u_short) name->len;
+
+            ngx_rbtree_insert(&r->name_rbtree, &rn->node);
+
+        } else if (rn->query == NULL) {
+            ngx_queue_remove(&rn->queue);
+            ngx_resolver_shared_clear(r, rn);
+
+        } else {
+            goto wait;
+        }
+
+        rn->naddrs = (u_short) -1;
+#if (NGX_HAVE_INET6)
+        rn->naddrs6 = r->ipv6 ? (u_short) -1 : 0;
+#endif
+        rn->valid = 0;
+        rn->ttl = NGX_MAX_UINT32_VALUE;
+
+        ngx_queue_insert_head(&r->shared_wait_queue, &rn->queue);
+
+        if (!r->shared_event->timer_set) {
+            ngx_add_timer(r->shared_event, NGX_RESOLVER_SHARED_POLL);
+        }
+
+    wait:
+
+        if (ngx_resolver_set_timeout(r, ctx) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        rn->waiting = ctx;
+
+        ctx->state = NGX_AGAIN;
+        ctx->async = 1;
+
+        do {
+            ctx->node = rn;
+            ctx = ctx->next;
+        } while (ctx);
+
+        ngx_log_debug1(NGX_LOG_DEBUG_CORE, r->log, 0,
+                       "resolve \"%V\" waits for shared", name);
+
+        return NGX_AGAIN;
+    }
+
+    /* 登记由本worker查询 */
+
+    if (sn == NULL) {
+        len = offsetof(ngx_resolver_shared_node_t, data) + name->len;
+
+        sn = ngx_resolver_shared_alloc(shared, len);
+
+        if (sn) {
+            sn->node.key = hash;
+            sn->valid = 0;
+            sn->ttl = 0;
+            sn->nlen = (u_short) name->len;
+            sn->naddrs = 0;
+            sn->naddrs6 = 0;
+            sn->code = 0;
+            ngx_memcpy(sn->data, name->data, name->len);
+
+            ngx_rbtree_insert(&shared->sh->rbtree, &sn->node);
+            ngx_queue_insert_head(&shared->sh->queue, &sn->queue);
+        }
+    }
+
+    if (sn) {
+        sn->updating = now;
+    }
+
+    ngx_shmtx_unlock(&shared->shpool->mutex);
+
+    return NGX_DECLINED;
+
+    failed:
+
+    ngx_shmtx_unlock(&shared->shpool->mutex);
+
+    return NGX_ERROR;
+}
+
+
+/* 把共享节点中的地址拷贝到本地节点,调用者持有锁 */
+
+static ngx_int_t
+ngx_resolver_shared_copy(ngx_resolver_t *r, ngx_resolver_node_t *rn,
+    ngx_resolver_shared_node_t *sn) {
+    u_char *p;
+    in_addr_t *addrs;
+#if (NGX_HAVE_INET6)
+    struct in6_addr *addrs6;
+#endif
+
+    p = sn->data;
+
+    rn->naddrs = sn->naddrs;
+
+    if (sn->naddrs == 1) {
+        ngx_memcpy(&rn->u.addr, p, sizeof(in_addr_t));
+
+    } else if (sn->naddrs > 1) {
+        addrs = ngx_resolver_alloc(r, sn->naddrs * sizeof(in_addr_t));
+        if (addrs == NULL) {
+            rn->naddrs = 0;
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(addrs, p, sn->naddrs * sizeof(in_addr_t));
+        rn->u.addrs = addrs;
+    }
+
+#if (NGX_HAVE_INET6)
+
+    p += sn->naddrs * sizeof(in_addr_t);
+
+    rn->naddrs6 = r->ipv6 ? sn->naddrs6 : 0;
+
+    if (rn->naddrs6 == 1) {
+        ngx_memcpy(&rn->u6.addr6, p, sizeof(struct in6_addr));
+
+    } else if (rn->naddrs6 > 1) {
+        addrs6 = ngx_resolver_alloc(r,
+                                    sn->naddrs6 * sizeof(struct in6_addr));
+        if (addrs6 == NULL) {
+            rn->naddrs6 = 0;
+            ngx_resolver_shared_clear(r, rn);
+            return NGX_ERROR;
+        }
+
+        ngx_memcpy(addrs6, p, sn->naddrs6 * sizeof(struct in6_addr));
+        rn->u6.addrs6 = addrs6;
+    }
+
+#endif
+
+    rn->valid = sn->valid;
+    rn->ttl = sn->ttl;
+
+    rn->code = 0;
+    rn->cnlen = 0;
+    rn->nsrvs = 0;
+    rn->tcp = 0;
+#if (NGX_HAVE_INET6)
+    rn->tcp6 = 0;
+#endif
+    rn->waiting = NULL;
+
+    return NGX_OK;
+}
+
+
+/* 释放本地名字节点中的查询和解析结果,保留名字 */
+
+static void
+ngx_resolver_shared_clear(ngx_resolver_t *r, ngx_resolver_node_t *rn) {
+    if (rn->query) {
+        ngx_resolver_free(r, rn->query);
+        rn->query = NULL;
+#if (NGX_HAVE_INET6)
+        rn->query6 = NULL;
+#endif
+    }
+
+    if (rn->cnlen) {
+        ngx_resolver_free(r, rn->u.cname);
+        rn->cnlen = 0;
+    }
+
+    if (rn->naddrs > 1 && rn->naddrs != (u_short) -1) {
+        ngx_resolver_free(r, rn->u.addrs);
+    }
+
+    rn->naddrs = 0;
+
+#if (NGX_HAVE_INET6)
+    if (rn->naddrs6 > 1 && rn->naddrs6 != (u_short) -1) {
+        ngx_resolver_free(r, rn->u6.addrs6);
+    }
+
+    rn->naddrs6 = 0;
+#endif
+}
+
+
+/*
+ * 把刚得到的解析结果写入共享缓存,并清除查询标记;NXDOMAIN应答按回调时
+ * 给出的ctx->valid缓存,使等待的worker也能得到结果
+ */
+
+static void
+ngx_resolver_shared_store(ngx_resolver_t *r, ngx_resolver_node_t *rn,
+    ngx_uint_t code) {
+    u_char *p;
+    size_t len;
+    uint32_t hash;
+    ngx_str_t name;
+    ngx_uint_t naddrs, naddrs6;
+    ngx_resolver_shared_t *shared;
+    ngx_resolver_shared_node_t *sn, *old;
+
+    shared = r->shm_zone->data;
+
+    name.len = rn->nlen;
+    name.data = rn->name;
+    hash = rn->node.key;
+
+    naddrs = 0;
+    naddrs6 = 0;
+
+    if (code == 0) {
+        naddrs = rn->naddrs;
+#if (NGX_HAVE_INET6)
+        naddrs6 = rn->naddrs6;
+#endif
+    }
+
+    len = offsetof(ngx_resolver_shared_node_t, data)
+          + naddrs * sizeof(in_addr_t)
+          + naddrs6 * sizeof(struct in6_addr) + name.len;
+
+    ngx_shmtx_lock(&shared->shpool->mutex);
+
+    old = ngx_resolver_shared_find(shared, &name, hash);
+
+    if (old) {
+        ngx_queue_remove(&old->queue);
+        ngx_rbtree_delete(&shared->sh->rbtree, &old->node);
+        ngx_slab_free_locked(shared->shpool, old);
+    }
+
+    sn = ngx_resolver_shared_alloc(shared, len);
+
+    if (sn == NULL) {
+        ngx_shmtx_unlock(&shared->shpool->mutex);
+        return;
+    }
+
+    sn->node.key = hash;
+    sn->updating = 0;
+    sn->ttl = rn->ttl;
+    sn->nlen = rn->nlen;
+    sn->naddrs = (u_short) naddrs;
+    sn->naddrs6 = (u_short) naddrs6;
+    sn->code = (u_char) code;
+
+    p = sn->data;
+
+    if (code) {
+        sn->valid = ngx_time() + (r->valid ? r->valid : 10);
+
+    } else {
+        sn->valid = rn->valid;
+
+        p = ngx_cpymem(p, (naddrs == 1) ? &rn->u.addr : rn->u.addrs,
+                       naddrs * sizeof(in_addr_t));
+
+#if (NGX_HAVE_INET6)
+        p = ngx_cpymem(p, (naddrs6 == 1) ? &rn->u6.addr6 : rn->u6.addrs6,
+                       naddrs6 * sizeof(struct in6_addr));
+#endif
+    }
+
+    ngx_memcpy(p, name.data, name.len);
+
+    ngx_rbtree_insert(&shared->sh->rbtree, &sn->node);
+    ngx_queue_insert_head(&shared->sh->queue, &sn->queue);
+
+    ngx_shmtx_unlock(&shared->shpool->mutex);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, r->log, 0,
+                   "resolver shared store \"%V\" valid:%T", &name, sn->valid);
+}
+
+
+/* 查询结束但没有可共享的结果,清除查询标记让其他worker自行查询 */
+
+static void
+ngx_resolver_shared_release(ngx_resolver_t *r, ngx_resolver_node_t *rn) {
+    ngx_str_t name;
+    ngx_resolver_shared_t *shared;
+    ngx_resolver_shared_node_t *sn;
+
+    shared = r->shm_zone->data;
 
-                if (addrs != NULL) {
-                    ngx_resolver_free(r, addrs->sockaddr);
-                    ngx_resolver_free(r, addrs);
-                }
+    name.len = rn->nlen;
+    name.data = rn->name;
 
-                return NGX_OK;
-            }
+    ngx_shmtx_lock(&shared->shpool->mutex);
 
-            if (rn->nsrvs) {
-                last->next = rn->waiting;
-                rn->waiting = NULL;
+    sn = ngx_resolver_shared_find(shared, &name, rn->node.key);
 
-                /* unlock name mutex */
+    if (sn) {
+        sn->updating = 0;
+    }
 
-                do {
-                    next = ctx->next;
+    ngx_shmtx_unlock(&shared->shpool->mutex);
+}
 
-                    ngx_resolver_resolve_srv_names(ctx, rn);
 
-                    ctx = next;
-                } while (ctx);
+/*
+ * 提前刷新得到错误应答时,如果共享缓存中的结果仍然有效,清除查询标记
+ * 并把结果拷回本地节点(同时释放查询),worker继续用它回答,直到它自然过期
+ */
 
-                return NGX_OK;
-            }
+static ngx_int_t
+ngx_resolver_shared_restore(ngx_resolver_t *r, ngx_resolver_node_t *rn) {
+    ngx_int_t rc;
+    ngx_str_t name;
+    ngx_uint_t naddrs;
+    ngx_resolver_shared_t *shared;
+    ngx_resolver_shared_node_t *sn;
 
-            /* NGX_RESOLVE_CNAME */
+    shared = r->shm_zone->data;
 
-            if (ctx->recursion++ < NGX_RESOLVER_MAX_RECURSION) {
+    name.len = rn->nlen;
+    name.data = rn->name;
 
-                cname.len = rn->cnlen;
-                cname.data = rn->u.cname;
+    rc = NGX_DECLINED;
 
-                return ngx_resolve_name_locked(r, ctx, &cname);
-            }
+    ngx_shmtx_lock(&shared->shpool->mutex);
 
-            last->next = rn->waiting;
-            rn->waiting = NULL;
+    sn = ngx_resolver_shared_find(shared, &name, rn->node.key);
 
-            /* unlock name mutex */
+    if (sn == NULL || sn->code || sn->valid < ngx_time()) {
+        goto done;
+    }
 
-            do {
-                ctx->state = NGX_RESOLVE_NXDOMAIN;
-                ctx->valid = ngx_time() + (r->valid ? r->valid : 10);
-                next = ctx->next;
+    naddrs = sn->naddrs;
+#if (NGX_HAVE_INET6)
+    naddrs += r->ipv6 ? sn->naddrs6 : 0;
+#endif
 
-                ctx->handler(ctx);
+    if (naddrs == 0) {
+        goto done;
+    }
 
-                ctx = next;
-            } while (ctx);
+    sn->updating = 0;
 
-            return NGX_OK;
-        }
+    ngx_resolver_shared_clear(r, rn);
 
-        if (rn->waiting) {
-            if (ngx_resolver_set_timeout(r, ctx) != NGX_OK) {
-                return NGX_ERROR;
-            }
+    if (ngx_resolver_shared_copy(r, rn, sn) == NGX_OK) {
+        rc = NGX_OK;
+    }
 
-            last->next = rn->waiting;
-            rn->waiting = ctx;
-            ctx->state = NGX_AGAIN;
-            ctx->async = 1;
+done:
 
-            do {
-                ctx->node = rn;
-                ctx = ctx->next;
-            } while (ctx);
+    ngx_shmtx_unlock(&shared->shpool->mutex);
 
-            return NGX_AGAIN;
-        }
+    return rc;
+}
 
-        ngx_queue_remove(&rn->queue);
 
-        /* lock alloc mutex */
+/*
+ * 本地缓存命中后检查剩余有效期,快到期时在后台重新查询:本地节点转为
+ * 查询状态,期间的请求由共享缓存中仍然有效的结果回答,请求不会等待DNS
+ */
+static void
+ngx_resolver_shared_prefetch(ngx_resolver_t *r, ngx_resolver_node_t *rn) {
+    time_t now, window;
+    size_t len;
+    ngx_str_t name;
+    ngx_uint_t naddrs;
+    ngx_resolver_shared_t *shared;
+    ngx_resolver_shared_node_t *sn;
 
-        if (rn->query) {
-            ngx_resolver_free_locked(r, rn->query);
-            rn->query = NULL;
-#if (NGX_HAVE_INET6)
-            rn->query6 = NULL;
-#endif
-        }
+    if (rn->query || rn->waiting) {
+        return;
+    }
 
-        if (rn->cnlen) {
-            ngx_resolver_free_locked(r, rn->u.cname);
-        }
+    now = ngx_time();
 
-        if (rn->naddrs > 1 && rn->naddrs != (u_short) -1) {
-            ngx_resolver_free_locked(r, rn->u.addrs);
-        }
+    window = (r->valid ? r->valid : (time_t) rn->ttl) / NGX_RESOLVER_PREFETCH;
 
-#if (NGX_HAVE_INET6)
-        if (rn->naddrs6 > 1 && rn->naddrs6 != (u_short) -1) {
-            ngx_resolver_free_locked(r, rn->u6.addrs6);
-        }
-#endif
+    if (rn->valid - now >= ngx_max(window, 1)) {
+        return;
+    }
 
-        if (rn->nsrvs) {
-            for (i = 0; i < (ngx_uint_t) rn->nsrvs; i++) {
-                if (rn->u.srvs[i].name.data) {
-                    ngx_resolver_free_locked(r, rn->u.srvs[i].name.data);
-                }
-            }
+    shared = r->shm_zone->data;
 
-            ngx_resolver_free_locked(r, rn->u.srvs);
-        }
+    name.len = rn->nlen;
+    name.data = rn->name;
 
-        /* unlock alloc mutex */
+    ngx_shmtx_lock(&shared->shpool->mutex);
 
-    } else {
+    sn = ngx_resolver_shared_find(shared, &name, rn->node.key);
 
-        rn = ngx_resolver_alloc(r, sizeof(ngx_resolver_node_t));
-        if (rn == NULL) {
-            return NGX_ERROR;
-        }
+    if (sn && sn->valid > rn->valid) {
 
-        rn->name = ngx_resolver_dup(r, name->data, name->len);
-        if (rn->name == NULL) {
-            ngx_resolver_free(r, rn);
-            return NGX_ERROR;
-        }
+        /* 其他worker已经刷新过 */
 
-        rn->node.key = hash;
-        rn->nlen = (u_short) name->len;
-        rn->query = NULL;
+        naddrs = sn->naddrs;
 #if (NGX_HAVE_INET6)
-        rn->query6 = NULL;
+        naddrs += r->ipv6 ? sn->naddrs6 : 0;
 #endif
 
-        ngx_rbtree_insert(tree, &rn->node);
-    }
+        if (naddrs) {
+            ngx_resolver_shared_clear(r, rn);
 
-    if (ctx->service.len) {
-        rc = ngx_resolver_create_srv_query(r, rn, name);
+            if (ngx_resolver_shared_copy(r, rn, sn) != NGX_OK) {
+                rn->valid = 0;
+            }
 
-    } else {
-        rc = ngx_resolver_create_name_query(r, rn, name);
+            ngx_shmtx_unlock(&shared->shpool->mutex);
+            return;
+        }
     }
 
-    if (rc == NGX_ERROR) {
-        goto failed;
+    if (sn && sn->updating && now - sn->updating < r->resend_timeout) {
+        ngx_shmtx_unlock(&shared->shpool->mutex);
+        return;
     }
 
-    if (rc == NGX_DECLINED) {
-        ngx_rbtree_delete(tree, &rn->node);
+    if (sn == NULL) {
+        len = offsetof(ngx_resolver_shared_node_t, data) + name.len;
 
-        ngx_resolver_free(r, rn->query);
-        ngx_resolver_free(r, rn->name);
-        ngx_resolver_free(r, rn);
+        sn = ngx_resolver_shared_alloc(shared, len);
+        if (sn == NULL) {
+            ngx_shmtx_unlock(&shared->shpool->mutex);
+            return;
+        }
 
-        do {
-            ctx->state = NGX_RESOLVE_NXDOMAIN;
-            next = ctx->next;
+        sn->node.key = rn->node.key;
+        sn->valid = 0;
+        sn->ttl = 0;
+        sn->nlen = rn->nlen;
+        sn->naddrs = 0;
+        sn->naddrs6 = 0;
+        sn->code = 0;
+        ngx_memcpy(sn->data, name.data, name.len);
 
-            ctx->handler(ctx);
+        ngx_rbtree_insert(&shared->sh->rbtree, &sn->node);
+        ngx_queue_insert_head(&shared->sh->queue, &sn->queue);
+    }
 
-            ctx = next;
-        } while (ctx);
+    sn->updating = now;
 
-        return NGX_OK;
+    ngx_shmtx_unlock(&shared->shpool->mutex);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, r->log, 0,
+                   "resolver prefetch \"%V\"", &name);
+
+    ngx_resolver_shared_clear(r, rn);
+
+    if (ngx_resolver_create_name_query(r, rn, &name) != NGX_OK) {
+        ngx_resolver_shared_release(r, rn);
+        rn->valid = 0;
+        return;
     }
 
+    ngx_queue_remove(&rn->queue);
+
     rn->last_connection = r->last_connection++;
     if (r->last_connection == r->connections.nelts) {
         r->last_connection = 0;
     }
 
     rn->naddrs = (u_short) -1;
-    rn->tcp = 0;
 #if (NGX_HAVE_INET6)
     rn->naddrs6 = r->ipv6 ? (u_short) -1 : 0;
-    rn->tcp6 = 0;
 #endif
-    rn->nsrvs = 0;
+    rn->code = 0;
+    rn->valid = 0;
+    rn->ttl = NGX_MAX_UINT32_VALUE;
 
     if (ngx_resolver_send_query(r, rn) != NGX_OK) {
 
-        /* immediately retry once on failure */
-
         rn->last_connection++;
         if (rn->last_connection == r->connections.nelts) {
             rn->last_connection = 0;
@@ -889,47 +1873,98 @@ ngx_resolve_name_locked(ngx_resolver_t *r, ngx_resolver_ctx_t *ctx,
         (void) ngx_resolver_send_query(r, rn);
     }
 
-    if (ngx_resolver_set_timeout(r, ctx) != NGX_OK) {
-        goto failed;
-    }
-
     if (ngx_resolver_resend_empty(r)) {
         ngx_add_timer(r->event, (ngx_msec_t) (r->resend_timeout * 1000));
     }
 
-    rn->expire = ngx_time() + r->resend_timeout;
+    rn->expire = now + r->resend_timeout;
 
-    ngx_queue_insert_head(resend_queue, &rn->queue);
+    ngx_queue_insert_head(&r->name_resend_queue, &rn->queue);
+}
 
-    rn->code = 0;
-    rn->cnlen = 0;
-    rn->valid = 0;
-    rn->ttl = NGX_MAX_UINT32_VALUE;
-    rn->waiting = ctx;
 
-    ctx->state = NGX_AGAIN;
-    ctx->async = 1;
+/* 检查等待其他worker查询结果的节点,结果已写入或对方放弃时重新处理 */
 
-    do {
-        ctx->node = rn;
-        ctx = ctx->next;
-    } while (ctx);
+static void
+ngx_resolver_shared_handler(ngx_event_t *ev) {
+    time_t now;
+    ngx_str_t name;
+    ngx_uint_t wait;
+    ngx_queue_t *q, pending;
+    ngx_resolver_t *r;
+    ngx_resolver_ctx_t *ctx, *next;
+    ngx_resolver_node_t *rn;
+    ngx_resolver_shared_t *shared;
+    ngx_resolver_shared_node_t *sn;
 
-    return NGX_AGAIN;
+    r = ev->data;
+    shared = r->shm_zone->data;
 
-    failed:
+    ngx_log_debug0(NGX_LOG_DEBUG_CORE, r->log, 0,
+                   "resolver shared handler");
 
-    ngx_rbtree_delete(tree, &rn->node);
+    now = ngx_time();
 
-    if (rn->query) {
-        ngx_resolver_free(r, rn->query);
-    }
+    ngx_queue_init(&pending);
 
-    ngx_resolver_free(r, rn->name);
+    while (!ngx_queue_empty(&r->shared_wait_queue)) {
 
-    ngx_resolver_free(r, rn);
+        q = ngx_queue_last(&r->shared_wait_queue);
+        rn = ngx_queue_data(q, ngx_resolver_node_t, queue);
 
-    return NGX_ERROR;
+        ngx_queue_remove(q);
+
+        if (rn->waiting == NULL) {
+            ngx_rbtree_delete(&r->name_rbtree, &rn->node);
+            ngx_resolver_free_node(r, rn);
+            continue;
+        }
+
+        name.len = rn->nlen;
+        name.data = rn->name;
+
+        ngx_shmtx_lock(&shared->shpool->mutex);
+
+        sn = ngx_resolver_shared_find(shared, &name, rn->node.key);
+
+        wait = sn && sn->valid < now && sn->updating
+               && now - sn->updating < r->resend_timeout;
+
+        ngx_shmtx_unlock(&shared->shpool->mutex);
+
+        if (wait) {
+            ngx_queue_insert_head(&pending, q);
+            continue;
+        }
+
+        rn->expire = now + r->expire;
+
+        ngx_queue_insert_head(&r->name_expire_queue, q);
+
+        ctx = rn->waiting;
+        rn->waiting = NULL;
+
+        for (next = ctx; next; next = next->next) {
+            next->node = NULL;
+        }
+
+        if (ngx_resolve_name_locked(r, ctx, &name) == NGX_ERROR) {
+
+            do {
+                ctx->state = NGX_ERROR;
+                next = ctx->next;
+
+                ctx->handler(ctx);
+
+                ctx = next;
+            } while (ctx);
+        }
+    }
+
+    if (!ngx_queue_empty(&pending)) {
+        ngx_queue_add(&r->shared_wait_queue, &pending);
+        ngx_add_timer(ev, NGX_RESOLVER_SHARED_POLL);
+    }
 }
 
 
@@ -2113,6 +3148,39 @@ ngx_resolver_process_a(ngx_resolver_t *r, u_char *buf, size_t n,
         }
 #endif
 
+        if (r->shm_zone) {
+
+            if (rn->waiting == NULL
+                && ngx_resolver_shared_restore(r, rn) == NGX_OK) {
+
+                /* 提前刷新失败,继续使用仍然有效的旧结果 */
+
+                ngx_log_debug2(NGX_LOG_DEBUG_CORE, r->log, 0,
+                               "resolver prefetch \"%*s\" failed",
+                               (size_t) rn->nlen, rn->name);
+
+                ngx_queue_remove(&rn->queue);
+
+                rn->expire = ngx_time() + r->expire;
+
+                ngx_queue_insert_head(&r->name_expire_queue, &rn->queue);
+
+                return;
+            }
+
+            /*
+             * 只有NXDOMAIN是确定的否定应答,放入共享缓存;SERVFAIL,
+             * REFUSED等可能是暂时的,只清除查询标记,由其他worker自行查询
+             */
+
+            if (code == NGX_RESOLVE_NXDOMAIN) {
+                ngx_resolver_shared_store(r, rn, code);
+
+            } else {
+                ngx_resolver_shared_release(r, rn);
+            }
+        }
+
         next = rn->waiting;
         rn->waiting = NULL;
 
@@ -2431,6 +3499,10 @@ ngx_resolver_process_a(ngx_resolver_t *r, u_char *buf, size_t n,
 
         ngx_queue_insert_head(&r->name_expire_queue, &rn->queue);
 
+        if (r->shm_zone) {
+            ngx_resolver_shared_store(r, rn, 0);
+        }
+
         next = rn->waiting;
         rn->waiting = NULL;
 
@@ -2492,6 +3564,12 @@ ngx_resolver_process_a(ngx_resolver_t *r, u_char *buf, size_t n,
         ngx_log_debug1(NGX_LOG_DEBUG_CORE, r->log, 0,
                        "resolver cname:\"%V\"", &name);
 
+        /* CNAME不放入共享缓存,目标名字的解析结果会单独缓存 */
+
+        if (r->shm_zone) {
+            ngx_resolver_shared_release(r, rn);
+        }
+
         ngx_queue_remove(&rn->queue);
 
         rn->cnlen = (u_short) name.len;
@@ -189,6 +189,11 @@ struct ngx_resolver_s {
     time_t valid;
 
     ngx_uint_t log_level;
+
+    /* zone=name:size,各worker共享的名字解析缓存 */
+    ngx_shm_zone_t *shm_zone;
+    ngx_event_t *shared_event;     //轮询shared_wait_queue的定时器
+    ngx_queue_t shared_wait_queue; //等待其他worker解析结果的节点
 };
 
 
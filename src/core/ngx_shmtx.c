@@ -48,25 +48,50 @@ nginx是原子变量和信号量合作以实现高效互斥锁的.
 #if (NGX_HAVE_ATOMIC_OPS) //支持原子操作,则通过原子操作实现锁
 
 
+/*
+ * 持锁时间每隔这么多次加锁抽样统计一次,避免每次加锁都去取时间;
+ * 自旋了这么多轮锁还在同一个持有者手里,就认为持有者被调度出去了,不再空转
+ */
+#define NGX_SHMTX_HOLD_SAMPLE  64
+#define NGX_SHMTX_SPIN_PROBE   64
+
+
+static void ngx_shmtx_locked(ngx_shmtx_t *mtx, ngx_uint_t spins,
+                             ngx_uint_t sleeps, ngx_uint_t round);
+
 static void ngx_shmtx_wakeup(ngx_shmtx_t *mtx);
 
+static uint64_t ngx_shmtx_usec(void);
+
 
-//addr为共享内存ngx_shm_alloc开辟的空间中的一个128字节首地址,nginx是原子变量和信号量合作以实现高效互斥锁的
 ngx_int_t
 ngx_shmtx_create(ngx_shmtx_t *mtx, ngx_shmtx_sh_t *addr, u_char *name) {
     mtx->lock = &addr->lock; //直接执行共享内存空间addr中的lock区间中
+    mtx->sh = addr;
+    mtx->locked_at = 0;
+
+    addr->acquisitions = 0;
+    addr->contended = 0;
+    addr->spins = 0;
+    addr->sleeps = 0;
+    addr->spin = 0;
+    addr->hold_samples = 0;
+    addr->hold_time = 0;
 
     if (mtx->spin == (ngx_uint_t) -1) { //注意,当spin值为-1时,表示不能使用信号量,这时直接返回成功
         return NGX_OK;
     }
 
     mtx->spin = 2048; //spin值默认为2048
-//同时使用信号量
-#if (NGX_HAVE_POSIX_SEM)
+
+#if (NGX_HAVE_FUTEX)
+
+    mtx->wait = &addr->wait;
+
+#elif (NGX_HAVE_POSIX_SEM)
 
     mtx->wait = &addr->wait;
 
-    //以多进程使用的方式初始化sem信号量,sem初始值为0
     if (sem_init(&mtx->sem, 1, 0) == -1) {
         ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
                       "sem_init() failed");
@@ -82,7 +107,7 @@ ngx_shmtx_create(ngx_shmtx_t *mtx, ngx_shmtx_sh_t *addr, u_char *name) {
 
 void
 ngx_shmtx_destroy(ngx_shmtx_t *mtx) {
-#if (NGX_HAVE_POSIX_SEM) //支持信号量时才有代码需要执行
+#if (NGX_HAVE_POSIX_SEM && !NGX_HAVE_FUTEX) //使用信号量时才有代码需要执行
 
     if (mtx->semaphore) { //当这把锁的spin值不为(ngx_uint_t)-1时,且初始化信号量成功,semaphore标志位才为1
         if (sem_destroy(&mtx->sem) == -1) {
@@ -98,52 +123,120 @@ ngx_shmtx_destroy(ngx_shmtx_t *mtx) {
 它用于比较mtx的lock域,如果等于零,那么设置为当前进程的进程id号,否则返回false */
 ngx_uint_t
 ngx_shmtx_trylock(ngx_shmtx_t *mtx) {
-    return (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid));
-}
+    if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
+        ngx_shmtx_locked(mtx, 0, 0, 0);
+        return 1;
+    }
 
-/*阻塞式获取互斥锁的ngx_shmtx_lock方法较为复杂,在不支持信号量时它与自旋锁几乎完全相同,但在支持了信号量后,它将有可能使进程进入睡眠状态*/
+    return 0;
+}
 
-//这里可以看出支持原子操作的系统,他的信号量其实就是自旋和信号量的结合,nginx是原子变量和信号量合作以实现高效互斥锁的
+/*阻塞式获取互斥锁的ngx_shmtx_lock方法较为复杂,在不支持信号量时它与自旋锁几乎完全相同,但在支持了信号量后,它将有可能使进程进入睡眠状态.
+多核时最多自旋的轮数取mtx->spin和最近拿锁平均轮数两倍中较小的一个;如果自旋了一阵锁一直在同一个持有者手里(没有人拿到过锁),
+说明持有者多半已经被调度出去或者临界区很长,不再空转,直接睡眠*/
 void
 ngx_shmtx_lock(ngx_shmtx_t *mtx) {
-    ngx_uint_t i, n;
+    ngx_uint_t i, n, limit, spins, sleeps, progress;
+#if (NGX_HAVE_FUTEX)
+    uint32_t seq;
+#endif
 
     ngx_log_debug0(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0, "shmtx lock");
-    //一个死循环,不断地去看是否获取了锁,直到获取了之后才退出,所以支持原子变量的
+
+    if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
+        ngx_shmtx_locked(mtx, 0, 0, 0);
+        return;
+    }
+
+    spins = 0;
+    sleeps = 0;
+    n = 0;
+
     for (;;) {
-        //lock值是当前的锁状态.注意,lock一般是在共享内存中的,它可能会时刻变化,而val是当前进程的栈中变量,下面代码的执行中它可能与lock值不一致
-        if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
-            return;
-        }
-        //仅在多处理器状态下spin值才有意义,否则PAUSE指令是不会执行的
+
         if (ngx_ncpu > 1) {
-            //循环执行PAUSE,检查锁是否已经释放
-            for (n = 1; n < mtx->spin; n <<= 1) {
-                //随着长时间没有获得到锁,将会执行更多次PAUSE才会检查锁
+            limit = ngx_min(mtx->spin, 2 * mtx->sh->spin + 16);
+            progress = mtx->sh->acquisitions;
+
+            for (n = 1; n < limit; n <<= 1) {
+
                 for (i = 0; i < n; i++) {
                     ngx_cpu_pause();
                 }
-                //再次由共享内存中获得lock原子变量的值
+
+                spins += n;
+
                 if (*mtx->lock == 0
                     && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
-                    return;
+                    goto locked;
+                }
+
+                if (n >= NGX_SHMTX_SPIN_PROBE) {
+                    if (mtx->sh->acquisitions == progress) {
+                        break;
+                    }
+
+                    progress = mtx->sh->acquisitions;
                 }
             }
         }
 
-#if (NGX_HAVE_POSIX_SEM)  //只有一个核且支持信号量时才继续执行
+#if (NGX_HAVE_FUTEX)
+
+        if (mtx->spin != (ngx_uint_t) -1) {
+            (void) ngx_atomic_fetch_add(mtx->wait, 1);
+
+            seq = *(volatile uint32_t *) &mtx->sh->futex;
+
+            if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
+                (void) ngx_atomic_fetch_add(mtx->wait, -1);
+                goto locked;
+            }
+
+            ngx_log_debug1(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0,
+                           "shmtx wait %uA", *mtx->wait);
+
+            sleeps++;
+
+            /*
+             * 解锁方发现有等待者时会先修改futex字再唤醒,
+             * 所以这里futex字已经变了的话FUTEX_WAIT会立即返回EAGAIN,不会丢失唤醒
+             */
+            if (syscall(SYS_futex, &mtx->sh->futex, FUTEX_WAIT, seq,
+                        NULL, NULL, 0)
+                == -1) {
+                ngx_err_t err;
+
+                err = ngx_errno;
+
+                if (err != NGX_EAGAIN && err != NGX_EINTR) {
+                    ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, err,
+                                  "futex() failed while waiting on shmtx");
+                }
+            }
+
+            (void) ngx_atomic_fetch_add(mtx->wait, -1);
+
+            ngx_log_debug0(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0,
+                           "shmtx awoke");
+
+            continue;
+        }
+
+#elif (NGX_HAVE_POSIX_SEM)  //只有一个核且支持信号量时才继续执行
 
         if (mtx->semaphore) { //semaphore标志位为1才使用信号量
             (void) ngx_atomic_fetch_add(mtx->wait, 1);
 
             if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
                 (void) ngx_atomic_fetch_add(mtx->wait, -1);
-                return;
+                goto locked;
             }
 
             ngx_log_debug1(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0,
                            "shmtx wait %uA", *mtx->wait);
-            //如果没有拿到锁,这时Nginx进程将会睡眠,直到其他进程释放了锁
+
+            sleeps++;
 
             /*检查信号量sem的值,如果sem值为正数,则sem值减1,表示拿到了信号量互斥锁,同时sem_wait方法返回0.如果sem值为0或
                 者负数,则当前进程进入睡眠状态,等待其他进程使用ngx_shmtx_unlock方法释放锁(等待sem信号量变为正数),到时Linux内核
@@ -169,17 +262,32 @@ ngx_shmtx_lock(ngx_shmtx_t *mtx) {
 #endif
 
         ngx_sched_yield(); //在不使用信号量时,调用sched_yield将会使当前进程暂时"让出"处理器
+
+        if (*mtx->lock == 0 && ngx_atomic_cmp_set(mtx->lock, 0, ngx_pid)) {
+            goto locked;
+        }
     }
+
+locked:
+
+    mtx->sh->contended++;
+
+    ngx_shmtx_locked(mtx, spins, sleeps, n);
 }
 
 
-//判断锁的lock域与当前进程的进程id是否相等,如果相等的话,那么就将lock设置为0,然后就相当于释放了锁.
 void
 ngx_shmtx_unlock(ngx_shmtx_t *mtx) {
     if (mtx->spin != (ngx_uint_t) -1) {
         ngx_log_debug0(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0, "shmtx unlock");
     }
 
+    if (mtx->locked_at) {
+        mtx->sh->hold_time += ngx_shmtx_usec() - mtx->locked_at;
+        mtx->sh->hold_samples++;
+        mtx->locked_at = 0;
+    }
+
     if (ngx_atomic_cmp_set(mtx->lock, ngx_pid, 0)) {
         ngx_shmtx_wakeup(mtx);
     }
@@ -191,6 +299,16 @@ ngx_shmtx_force_unlock(ngx_shmtx_t *mtx, ngx_pid_t pid) {
     ngx_log_debug0(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0,
                    "shmtx forced unlock");
 
+    /*
+     * 锁结构在共享内存里时(如slab池的mutex),locked_at是死掉的进程留下的,
+     * 锁还在它名下,趁没人能拿到锁时清掉,否则下一个持锁者解锁时会把这段
+     * 时间算进hold_time
+     */
+
+    if (*mtx->lock == (ngx_atomic_uint_t) pid) {
+        mtx->locked_at = 0;
+    }
+
     if (ngx_atomic_cmp_set(mtx->lock, pid, 0)) {
         ngx_shmtx_wakeup(mtx);
         return 1;
@@ -199,10 +317,64 @@ ngx_shmtx_force_unlock(ngx_shmtx_t *mtx, ngx_pid_t pid) {
     return 0;
 }
 
+//累加到st上,方便把分级锁等多把锁的统计合在一起
+void
+ngx_shmtx_stats(ngx_shmtx_t *mtx, ngx_shmtx_stat_t *st) {
+    st->acquisitions += mtx->sh->acquisitions;
+    st->contended += mtx->sh->contended;
+    st->spins += mtx->sh->spins;
+    st->sleeps += mtx->sh->sleeps;
+    st->hold_samples += mtx->sh->hold_samples;
+    st->hold_time += mtx->sh->hold_time;
+}
+
+//拿到锁以后在锁内更新统计,round是拿到锁时的自旋轮数,用来调整下次自旋的上限
+static void
+ngx_shmtx_locked(ngx_shmtx_t *mtx, ngx_uint_t spins, ngx_uint_t sleeps,
+                 ngx_uint_t round) {
+    ngx_shmtx_sh_t *sh;
+
+    sh = mtx->sh;
+
+    if (sh->acquisitions++ % NGX_SHMTX_HOLD_SAMPLE == 0) {
+        mtx->locked_at = ngx_shmtx_usec();
+    }
+
+    if (spins == 0 && sleeps == 0) {
+        return;
+    }
+
+    sh->spins += spins;
+    sh->sleeps += sleeps;
+
+    if (round) {
+        sh->spin = (ngx_uint_t) ((ngx_int_t) sh->spin
+                                 + ((ngx_int_t) round - (ngx_int_t) sh->spin)
+                                   / 8);
+    }
+}
+
 
 static void
 ngx_shmtx_wakeup(ngx_shmtx_t *mtx) {
-#if (NGX_HAVE_POSIX_SEM)
+#if (NGX_HAVE_FUTEX)
+
+    if (mtx->spin == (ngx_uint_t) -1 || *mtx->wait == 0) {
+        return;
+    }
+
+    (void) __sync_fetch_and_add(&mtx->sh->futex, 1);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0,
+                   "shmtx wake %uA", *mtx->wait);
+
+    if (syscall(SYS_futex, &mtx->sh->futex, FUTEX_WAKE, 1, NULL, NULL, 0)
+        == -1) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      "futex() failed while wake shmtx");
+    }
+
+#elif (NGX_HAVE_POSIX_SEM)
     ngx_atomic_uint_t wait;
 
     if (!mtx->semaphore) {
@@ -223,7 +395,6 @@ ngx_shmtx_wakeup(ngx_shmtx_t *mtx) {
 
     ngx_log_debug1(NGX_LOG_DEBUG_CORE, ngx_cycle->log, 0,
                    "shmtx wake %uA", wait);
-    //释放信号量锁时是不会使进程睡眠的,通过sem_post将信号量sem加1,表示当前进程释放了信号量互斥锁,通知其他进程的sem_wait继续执行
     if (sem_post(&mtx->sem) == -1) {
         ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
                       "sem_post() failed while wake shmtx");
@@ -233,6 +404,26 @@ ngx_shmtx_wakeup(ngx_shmtx_t *mtx) {
 }
 
 
+static uint64_t
+ngx_shmtx_usec(void) {
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000 + 1;
+
+#else
+    struct timeval tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec + 1;
+
+#endif
+}
+
+
 #else //else后的锁是文件锁实现的ngx_shmtx_t锁,不支持原子操作,则通过文件锁实现
 
 
@@ -353,4 +544,11 @@ ngx_shmtx_force_unlock(ngx_shmtx_t *mtx, ngx_pid_t pid)
     return 0;
 }
 
+
+void
+ngx_shmtx_stats(ngx_shmtx_t *mtx, ngx_shmtx_stat_t *st)
+{
+    /* 文件锁没有统计 */
+}
+
 #endif
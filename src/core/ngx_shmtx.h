@@ -15,15 +15,37 @@
 
 typedef struct {
     ngx_atomic_t lock;
-#if (NGX_HAVE_POSIX_SEM)
+#if (NGX_HAVE_POSIX_SEM || NGX_HAVE_FUTEX)
     ngx_atomic_t wait;
 #endif
+#if (NGX_HAVE_FUTEX)
+    uint32_t futex; //每次有等待者时解锁加1,等待者在这个字上futex睡眠
+#endif
+    /* 以下统计都由持锁进程在锁内更新,不需要原子操作 */
+    ngx_uint_t acquisitions;
+    ngx_uint_t contended; //第一次没拿到锁的次数
+    ngx_uint_t spins; //自旋中ngx_cpu_pause的次数
+    ngx_uint_t sleeps; //进入futex或信号量睡眠的次数
+    ngx_uint_t spin; //最近拿到锁时的自旋轮数的平均值,决定下次最多自旋多少
+    ngx_uint_t hold_samples; //持锁时间是抽样统计的
+    uint64_t hold_time; //抽样的持锁时间总和,单位微秒
 } ngx_shmtx_sh_t;
 
+
+typedef struct {
+    ngx_uint_t acquisitions;
+    ngx_uint_t contended;
+    ngx_uint_t spins;
+    ngx_uint_t sleeps;
+    ngx_uint_t hold_samples;
+    uint64_t hold_time;
+} ngx_shmtx_stat_t;
+
 /*ngx_shmtx_t结构体涉及两个宏:NGX_HAVE_ATOMIC_OPS、NGX_HAVE_POSIX_SEM,这两个宏对应着互斥锁的3种不同实现:
     1.当不支持原子操作时,会使用文件锁来实现ngx_shmtx_t互斥锁,这时它仅有fd和name成员(实际上还有spin成员,但这时没有任何意义).这两个成员使用文件锁来提供阻塞、非阻塞的互斥锁
     2.支持原子操作却又不支持信号量
     3.在支持原子操作的同时,操作系统也支持信号量
+    4.Linux上支持futex时,用futex代替信号量睡眠,自旋的上限也会根据最近拿锁的情况自适应调整
     后两种实现的唯一区别是ngx_shmtx_lock方法执行时的效果,也就是说,支持信号量只会影响阻塞进程的ngx_shmtx_lock方法持有锁的方式.
 当不支持信号量时,ngx_shmtx_lock取锁与自旋锁是一致的,而支持信号量后,ngx_shmtx_lock将在spin指定的一段时间内自旋等待其他处理器释放锁,
 如果达到spin上限还没有获取到锁,那么将会使用sem_wait使得当前进程进入睡眠状态,等其他进程释放了锁内核后才会唤醒这个进程.
@@ -37,7 +59,11 @@ typedef struct {
     Nginx是怎样快速判断lock值为"正数"或者"负数"的呢?很简单,因为有符号整型的最高位是用于表示符号的,其中0表示正数,1表示负数,所以,在确
     定整型val是负数或者正数时,可通过判断(val&Ox80000000)==0语句的真假进行*/
     ngx_atomic_t *lock; //如果支持原子锁的话,那么使用它,它指向的是一段共享内存空间,为0表示可以获得锁
-#if (NGX_HAVE_POSIX_SEM)
+    ngx_shmtx_sh_t *sh; //共享内存中的锁结构,统计信息也在里面
+    uint64_t locked_at; //本次持锁被抽中统计时的加锁时间,单位微秒,0表示没被抽中
+#if (NGX_HAVE_FUTEX)
+    ngx_atomic_t *wait; //正在futex上等待锁的进程数量
+#elif (NGX_HAVE_POSIX_SEM)
     ngx_atomic_t *wait;  //正在等待锁的进程数量
     ngx_uint_t semaphore; //信号量的值,这个值大于0表示该新号量可用,默认为1,semaphore为1时表示获取锁将可能使用到的信号量
     sem_t sem; // sem就是信号量锁
@@ -73,5 +99,7 @@ void ngx_shmtx_unlock(ngx_shmtx_t *mtx);
 
 ngx_uint_t ngx_shmtx_force_unlock(ngx_shmtx_t *mtx, ngx_pid_t pid);
 
+void ngx_shmtx_stats(ngx_shmtx_t *mtx, ngx_shmtx_stat_t *st);
+
 
 #endif /* _NGX_SHMTX_H_INCLUDED_ */
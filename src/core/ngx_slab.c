@@ -52,6 +52,10 @@
     ((((page) - (pool)->pages) << ngx_pagesize_shift)                         \
      + (uintptr_t) (pool)->start) //得到实际分配的页的起始地址
 
+//分级锁模式下保护空闲页链表的锁,排在各slot分级的锁后面
+#define ngx_slab_pages_lock(pool)                                             \
+    (ngx_pagesize_shift - (pool)->min_shift)
+
 
 #if (NGX_DEBUG_MALLOC)
 
@@ -74,9 +78,18 @@ static ngx_slab_page_t *ngx_slab_alloc_pages(ngx_slab_pool_t *pool,
 static void ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
                                 ngx_uint_t pages);
 
+static void ngx_slab_free_chunk(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
+                               void *p);
+
 static void ngx_slab_error(ngx_slab_pool_t *pool, ngx_uint_t level,
                            char *text);
 
+static ngx_inline void ngx_slab_pool_lock(ngx_slab_pool_t *pool);
+
+static ngx_inline void ngx_slab_lock(ngx_slab_pool_t *pool, ngx_uint_t n);
+
+static ngx_inline void ngx_slab_unlock(ngx_slab_pool_t *pool, ngx_uint_t n);
+
 //slab页面的大小
 static ngx_uint_t ngx_slab_max_size; //设置ngx_slab_max_size = 2KB.如果一个页要存放多个obj,则obj的size要小于这个数值
 
@@ -146,6 +159,30 @@ ngx_slab_init(ngx_slab_pool_t *pool) { //pool指向的是整个共享内存空
     p += n * sizeof(ngx_slab_stat_t);
 
     size -= n * (sizeof(ngx_slab_page_t) + sizeof(ngx_slab_stat_t));//去除头部空间后的大小
+
+    pool->locks = NULL;
+    pool->contended = 0;
+
+#if (NGX_HAVE_ATOMIC_OPS)
+
+    if (pool->striped) { //分级锁紧跟在stats[]后面,n个slot分级各一把,外加一把页锁
+        pool->locks = (ngx_slab_lock_t *) p;
+        ngx_memzero(pool->locks, (n + 1) * sizeof(ngx_slab_lock_t));
+
+        for (i = 0; i <= n; i++) {
+            (void) ngx_shmtx_create(&pool->locks[i].mutex,
+                                    &pool->locks[i].lock, NULL);
+        }
+
+        p += (n + 1) * sizeof(ngx_slab_lock_t);
+        size -= (n + 1) * sizeof(ngx_slab_lock_t);
+    }
+
+#else
+
+    pool->striped = 0;
+
+#endif
     /*计算这个空间总共可以分配的缓存页(4KB)的数量,每个页的overhead是一个slab page的大小,这儿的overhead还不包括之后给小于64Byte物体分配的bitmap的损耗*/
 
     //这里 + sizeof(ngx_slab_page_t)的原因是每个ngx_pagesize都有对应的ngx_slab_page_t进行管理
@@ -193,7 +230,11 @@ void *
 ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size) {
     void *p;
 
-    ngx_shmtx_lock(&pool->mutex);
+    if (pool->striped) { //分级锁模式下由ngx_slab_alloc_locked内部按slot加锁
+        return ngx_slab_alloc_locked(pool, size);
+    }
+
+    ngx_slab_pool_lock(pool);
 
     p = ngx_slab_alloc_locked(pool, size);
 
@@ -249,9 +290,13 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
 
         ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
                        "slab alloc: %uz", size);
+        ngx_slab_lock(pool, ngx_slab_pages_lock(pool));
         //分配1个或多个内存页
         page = ngx_slab_alloc_pages(pool, (size >> ngx_pagesize_shift)
                                           + ((size % ngx_pagesize) ? 1 : 0));
+
+        ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
+
         if (page) {
             /*获得page向对于page[0]的偏移量,由于m_page和page数组是相互对应的,即m_page[0]管理page[0]页面,m_page[1]管理page[1]页面.
             所以获得page相对于m_page[0]的偏移量就可以根据start得到相应页面的偏移量.*/
@@ -261,7 +306,10 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
             p = 0;
         }
 
-        goto done;
+        ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
+                       "slab alloc: %p", (void *) p);
+
+        return (void *) p;
     }
     /*较小的obj, size <= 2kb根据需要分配的size来确定在slots的位置,每个slot存放一种大小的obj的集合,如slots[0]表示8byte的空间,
     slots[3]表示64byte的空间如果obj过小(<1B),slot的位置是1B空间的位置,即最小分配1B*/
@@ -275,6 +323,8 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
         slot = 0;
     }
 
+    ngx_slab_lock(pool, slot);
+
     pool->stats[slot].reqs++;
     //ngx_slab_pool_t + 9 * sizeof(ngx_slab_page_t) + pages * sizeof(ngx_slab_page_t) +pages*ngx_pagesize(这是实际的数据部分)
     ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
@@ -394,6 +444,11 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
         ngx_slab_error(pool, NGX_LOG_ALERT, "ngx_slab_alloc(): page is busy");
         ngx_debug_point();
     }
+    /*
+     * 分级锁模式下新页的类型要在页锁内设置好,否则其他进程释放相邻页时
+     * 可能把初始化了一半的页当成空闲页合并掉
+     */
+    ngx_slab_lock(pool, ngx_slab_pages_lock(pool));
     //分出一页加入到m_slot数组对应元素中
     page = ngx_slab_alloc_pages(pool, 1);
     /*例如要分配的size为54字节,则在前面计算出的shift对应的字节数应该是64字节,由于一个页面全是64字节obj大小,所以一共有64
@@ -432,6 +487,8 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
 
             slots[slot].next = page;
 
+            ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
+
             pool->stats[slot].total += (ngx_pagesize >> shift) - n;
             //返回对应地址.  例如为64字节obj,则返回的start为第二个开始处obj,下次分配从第二个开始获取地址空间obj
             p = ngx_slab_page_addr(pool, page) + (n << shift);
@@ -451,6 +508,8 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
 
             slots[slot].next = page;
 
+            ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
+
             pool->stats[slot].total += 8 * sizeof(uintptr_t);
             //返回对应地址.
             p = ngx_slab_page_addr(pool, page);
@@ -468,6 +527,8 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
 
             slots[slot].next = page;
 
+            ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
+
             pool->stats[slot].total += ngx_pagesize >> shift;
 
             p = ngx_slab_page_addr(pool, page);
@@ -478,12 +539,16 @@ ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) { //这儿假设page_s
         }
     }
 
+    ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
+
     p = 0;
 
     pool->stats[slot].fails++;
 
     done:
 
+    ngx_slab_unlock(pool, slot);
+
     ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
                    "slab alloc: %p", (void *) p);
 
@@ -495,7 +560,11 @@ void *
 ngx_slab_calloc(ngx_slab_pool_t *pool, size_t size) {
     void *p;
 
-    ngx_shmtx_lock(&pool->mutex);
+    if (pool->striped) {
+        return ngx_slab_calloc_locked(pool, size);
+    }
+
+    ngx_slab_pool_lock(pool);
 
     p = ngx_slab_calloc_locked(pool, size);
 
@@ -520,7 +589,12 @@ ngx_slab_calloc_locked(ngx_slab_pool_t *pool, size_t size) {
 
 void
 ngx_slab_free(ngx_slab_pool_t *pool, void *p) {
-    ngx_shmtx_lock(&pool->mutex);
+    if (pool->striped) {
+        ngx_slab_free_locked(pool, p);
+        return;
+    }
+
+    ngx_slab_pool_lock(pool);
 
     ngx_slab_free_locked(pool, p);
 
@@ -544,20 +618,65 @@ a.设置相应页面块为可用
 b.将页面归入free中*/
 void
 ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
-    size_t size;
-    uintptr_t slab, m, *bitmap;
-    ngx_uint_t i, n, type, slot, shift, map;
-    ngx_slab_page_t *slots, *page;
+    ngx_uint_t n, lock;
+    ngx_slab_page_t *page;
 
     ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0, "slab free: %p", p);
 
     if ((u_char *) p < pool->start || (u_char *) p > pool->end) {
         ngx_slab_error(pool, NGX_LOG_ALERT, "ngx_slab_free(): outside of pool");
-        goto fail;
+        return;
     }
     //根据p找到需要释放的m_page元素
     n = ((u_char *) p - pool->start) >> ngx_pagesize_shift;
     page = &pool->pages[n];
+
+    if (!pool->striped) {
+        ngx_slab_free_chunk(pool, page, p);
+        return;
+    }
+
+    /*
+     * p释放之前它所在页的类型和obj大小都不会变,可以不加锁读出来,
+     * 据此决定加哪一把锁
+     */
+
+    switch (ngx_slab_page_type(page)) {
+
+        case NGX_SLAB_SMALL:
+        case NGX_SLAB_BIG:
+            lock = (page->slab & NGX_SLAB_SHIFT_MASK) - pool->min_shift;
+            break;
+
+        case NGX_SLAB_EXACT:
+            lock = ngx_slab_exact_shift - pool->min_shift;
+            break;
+
+        default: /* NGX_SLAB_PAGE */
+            lock = ngx_slab_pages_lock(pool);
+    }
+
+    if (lock > ngx_slab_pages_lock(pool)) {
+        ngx_slab_error(pool, NGX_LOG_ALERT,
+                       "ngx_slab_free(): pointer to wrong chunk");
+        return;
+    }
+
+    ngx_slab_lock(pool, lock);
+
+    ngx_slab_free_chunk(pool, page, p);
+
+    ngx_slab_unlock(pool, lock);
+}
+
+
+static void
+ngx_slab_free_chunk(ngx_slab_pool_t *pool, ngx_slab_page_t *page, void *p) {
+    size_t size;
+    uintptr_t slab, m, *bitmap;
+    ngx_uint_t i, n, type, slot, shift, map;
+    ngx_slab_page_t *slots;
+
     slab = page->slab; //如果分配的时候一次性分配多个page,则第一个page的slab指定本次一次性分配了多少个页page
     //据pre的低两位来判断该页面中的slot大小和ngx_slab_exact_size的大小关系
     type = ngx_slab_page_type(page);
@@ -616,7 +735,9 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
                     }
                 }
 
+                ngx_slab_lock(pool, ngx_slab_pages_lock(pool));
                 ngx_slab_free_pages(pool, page, 1); //整个页面都没有使用,归还给free
+                ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
 
                 pool->stats[slot].total -= (ngx_pagesize >> shift) - n;
 
@@ -655,7 +776,9 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
                     goto done;
                 }
 
+                ngx_slab_lock(pool, ngx_slab_pages_lock(pool));
                 ngx_slab_free_pages(pool, page, 1); //page页面中所有slab块都没有使用
+                ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
 
                 pool->stats[slot].total -= 8 * sizeof(uintptr_t);
 
@@ -695,7 +818,9 @@ ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
                     goto done;
                 }
                 //如果page页中所有slab块都不在使用就将该页面链入free中
+                ngx_slab_lock(pool, ngx_slab_pages_lock(pool));
                 ngx_slab_free_pages(pool, page, 1);
+                ngx_slab_unlock(pool, ngx_slab_pages_lock(pool));
 
                 pool->stats[slot].total -= ngx_pagesize >> shift;
 
@@ -962,3 +1087,124 @@ static void
 ngx_slab_error(ngx_slab_pool_t *pool, ngx_uint_t level, char *text) {
     ngx_log_error(level, ngx_cycle->log, 0, "%s%s", text, pool->log_ctx);
 }
+
+
+//统计页的使用和碎片情况,碎片用空闲页段数和最大空闲段页数表示
+void
+ngx_slab_stats(ngx_slab_pool_t *pool, ngx_slab_pool_stat_t *st) {
+    ngx_uint_t i, n;
+    ngx_slab_page_t *page;
+
+    n = ngx_slab_pages_lock(pool);
+
+    st->pages = pool->last - pool->pages;
+    st->free_runs = 0;
+    st->largest = 0;
+    st->contended = 0;
+
+    ngx_memzero(&st->lock, sizeof(ngx_shmtx_stat_t));
+
+    ngx_shmtx_stats(&pool->mutex, &st->lock);
+
+    for (i = 0; i < n; i++) {
+        st->contended += pool->stats[i].contended;
+    }
+
+    if (pool->striped) {
+        for (i = 0; i <= n; i++) {
+            ngx_shmtx_stats(&pool->locks[i].mutex, &st->lock);
+        }
+    }
+
+    if (pool->striped) {
+        ngx_slab_lock(pool, n);
+
+    } else {
+        ngx_shmtx_lock(&pool->mutex);
+    }
+
+    st->free = pool->pfree;
+    st->contended += pool->contended;
+
+    for (page = pool->free.next; page != &pool->free; page = page->next) {
+        st->free_runs++;
+
+        if (page->slab > st->largest) {
+            st->largest = page->slab;
+        }
+    }
+
+    if (pool->striped) {
+        ngx_slab_unlock(pool, n);
+
+    } else {
+        ngx_shmtx_unlock(&pool->mutex);
+    }
+}
+
+//进程异常退出时master调用,释放它持有的分级锁,返回释放的锁个数
+ngx_uint_t
+ngx_slab_force_unlock(ngx_slab_pool_t *pool, ngx_pid_t pid) {
+    ngx_uint_t i, n, unlocked;
+
+    unlocked = 0;
+
+    if (!pool->striped) {
+        return unlocked;
+    }
+
+    n = ngx_slab_pages_lock(pool);
+
+    for (i = 0; i <= n; i++) {
+        if (ngx_shmtx_force_unlock(&pool->locks[i].mutex, pid)) {
+            unlocked++;
+        }
+    }
+
+    return unlocked;
+}
+
+
+static ngx_inline void
+ngx_slab_pool_lock(ngx_slab_pool_t *pool) {
+    if (ngx_shmtx_trylock(&pool->mutex)) {
+        return;
+    }
+
+    ngx_shmtx_lock(&pool->mutex);
+
+    pool->contended++;
+}
+
+//加锁顺序固定为先slot锁再页锁,没拿到锁就记一次争用
+static ngx_inline void
+ngx_slab_lock(ngx_slab_pool_t *pool, ngx_uint_t n) {
+    ngx_shmtx_t *mtx;
+
+    if (!pool->striped) {
+        return;
+    }
+
+    mtx = &pool->locks[n].mutex;
+
+    if (ngx_shmtx_trylock(mtx)) {
+        return;
+    }
+
+    ngx_shmtx_lock(mtx);
+
+    if (n == ngx_slab_pages_lock(pool)) {
+        pool->contended++;
+
+    } else {
+        pool->stats[n].contended++;
+    }
+}
+
+
+static ngx_inline void
+ngx_slab_unlock(ngx_slab_pool_t *pool, ngx_uint_t n) {
+    if (pool->striped) {
+        ngx_shmtx_unlock(&pool->locks[n].mutex);
+    }
+}
@@ -45,8 +45,28 @@ typedef struct {
 
     ngx_uint_t reqs;
     ngx_uint_t fails;
+
+    ngx_uint_t contended; //分级锁模式下,取该分级的锁时需要等待的次数
 } ngx_slab_stat_t;
 
+
+//分级锁模式下每个slot大小分级一把锁,最后一把保护空闲页链表,见ngx_slab_init
+typedef struct {
+    ngx_shmtx_sh_t lock;
+    ngx_shmtx_t mutex;
+} ngx_slab_lock_t;
+
+
+//整个slab pool的统计,见ngx_slab_stats
+typedef struct {
+    ngx_uint_t pages; //总页数
+    ngx_uint_t free; //空闲页数
+    ngx_uint_t free_runs; //空闲页分成了多少段连续的页,越多说明碎片越多
+    ngx_uint_t largest; //最长的一段连续空闲页的页数,能分配的最大内存
+    ngx_uint_t contended; //分配释放时等待锁的次数,包括各分级锁
+    ngx_shmtx_stat_t lock; //zone锁和各分级锁的加锁统计之和,模块自己加zone锁也算在内
+} ngx_slab_pool_stat_t;
+
 /*共享内存的其实地址开始处数据:ngx_slab_pool_t + 9 * sizeof(ngx_slab_page_t)(slots_m[]) + pages * sizeof(ngx_slab_page_t)(pages_m[]) +pages*ngx_pagesize
 (这是实际的数据部分,每个ngx_pagesize都由前面的一个ngx_slab_page_t进行管理,并且每个ngx_pagesize最前端第一个obj存放的是一个或者多个int类型bitmap,用于管理每块分配出去的内存)
 m_slot[0]:链接page页面,并且page页面划分的slot块大小为2^3
@@ -84,10 +104,18 @@ typedef struct { //初始化赋值在ngx_slab_init,slab结构是配合共享内
 
     ngx_shmtx_t mutex;  //ngx_init_zone_pool->ngx_shmtx_create->sem_init进行初始化
 
+    /*
+     * 分级锁模式(shared_memory_lock_striping on)下,分配释放不再使用mutex,
+     * 而是按slot分级各自加锁,mutex只留给使用slab的模块保护它们自己的数据
+     */
+    ngx_slab_lock_t *locks;
+    ngx_uint_t contended; //页锁(非分级锁模式下为mutex)需要等待的次数
+
     u_char *log_ctx; //操作失败时会记录日志,为区别是哪个slab共享内存出错,可以在slab中分配一段内存存放描述的字符串,然后再用log_ctx指向这个字符串；
     u_char zero; //实际就是'\0',当log_ctx没有赋值时,将直接指向zero,表示空字符串防止出错；
 
     unsigned log_nomem: 1;  //ngx_slab_init中默认为1
+    unsigned striped: 1; //ngx_slab_init前设置,见ngx_init_zone_pool
     //ngx_http_file_cache_init中cache->shpool->data = cache->sh;
     void *data; //由各个使用slab的模块自由使用,slab管理内存时不会用到它
     void *addr; //指向所属的ngx_shm_zone_t里的ngx_shm_t成员的addr成员,一般用于指示一段共享内存块的起始位置
@@ -110,5 +138,9 @@ void ngx_slab_free(ngx_slab_pool_t *pool, void *p);
 
 void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p);
 
+void ngx_slab_stats(ngx_slab_pool_t *pool, ngx_slab_pool_stat_t *st);
+
+ngx_uint_t ngx_slab_force_unlock(ngx_slab_pool_t *pool, ngx_pid_t pid);
+
 
 #endif /* _NGX_SLAB_H_INCLUDED_ */
@@ -8,7 +8,17 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 
+#if (NGX_HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
 
+static ngx_inline size_t ngx_str_span_not2(u_char *p, size_t size, u_char a,
+    u_char b);
+static ngx_inline size_t ngx_str_span_uri(u_char *p, size_t size,
+    ngx_uint_t slash);
+static ngx_inline size_t ngx_str_span_html(u_char *p, size_t size);
+static ngx_inline size_t ngx_str_span_json(u_char *p, size_t size);
 static u_char *ngx_sprintf_num(u_char *buf, u_char *last, uint64_t ui64,
                                u_char zero, ngx_uint_t hexadecimal, ngx_uint_t width);
 
@@ -21,9 +31,315 @@ static void ngx_encode_base64_internal(ngx_str_t *dst, ngx_str_t *src,
 static ngx_int_t ngx_decode_base64_internal(ngx_str_t *dst, ngx_str_t *src,
                                             const u_char *basis);
 
+/*
+ * 下面的ngx_str_span_*()返回p开头不需要特殊处理的字节数,转义/反转义等函数用它
+ * 成块跳过普通字符,只对命中的字节走原来的逐字节逻辑.有SSE2时每次检查16字节,
+ * 否则用SWAR每次检查8字节(对整个字判断是否有命中,命中后逐字节定位)
+ */
+
+#define ngx_swar_ones        0x0101010101010101ULL
+#define ngx_swar_high        0x8080808080808080ULL
+
+/* v中有为0的字节时非0 */
+#define ngx_swar_zero(v)     (((v) - ngx_swar_ones) & ~(v) & ngx_swar_high)
+
+/* v中有等于c的字节时非0 */
+#define ngx_swar_eq(v, c)    ngx_swar_zero((v) ^ (ngx_swar_ones * (c)))
+
+/* v中有小于c(c <= 0x80)的字节时非0 */
+#define ngx_swar_lt(v, c)                                                     \
+    (((v) - ngx_swar_ones * (c)) & ~(v) & ngx_swar_high)
+
+/* 各字节不超过0x7f的v中,字节值在[lo, hi]内的字节最高位置1 */
+#define ngx_swar_range(v, lo, hi)                                             \
+    (((v) + ngx_swar_ones * (0x80 - (lo)))                                    \
+     & ~((v) + ngx_swar_ones * (0x7f - (hi))) & ngx_swar_high)
+
+
+/* 不等于a也不等于b的字节 */
+static ngx_inline size_t
+ngx_str_span_not2(u_char *p, size_t size, u_char a, u_char b) {
+    u_char *s, *end;
+#if (NGX_HAVE_SSE2)
+    int m;
+    __m128i x, va, vb;
+
+    va = _mm_set1_epi8((char) a);
+    vb = _mm_set1_epi8((char) b);
+#else
+    uint64_t v;
+#endif
+
+    s = p;
+    end = p + size;
+
+#if (NGX_HAVE_SSE2)
+
+    while (end - s >= 16) {
+        x = _mm_loadu_si128((__m128i *) s);
+        m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va),
+                                           _mm_cmpeq_epi8(x, vb)));
+        if (m) {
+            return s - p + __builtin_ctz(m);
+        }
+
+        s += 16;
+    }
+
+#else
+
+    while (end - s >= 8) {
+        ngx_memcpy(&v, s, 8);
+
+        if (ngx_swar_eq(v, a) | ngx_swar_eq(v, b)) {
+            break;
+        }
+
+        s += 8;
+    }
+
+#endif
+
+    while (s < end && *s != a && *s != b) {
+        s++;
+    }
+
+    return s - p;
+}
+
+
+/*
+ * 所有转义表中都不转义的字符:字母、数字、"-"、"."、"_",以及除
+ * NGX_ESCAPE_URI_COMPONENT外都不转义的"/"
+ */
+static ngx_inline size_t
+ngx_str_span_uri(u_char *p, size_t size, ngx_uint_t slash) {
+    u_char c, *s, *end;
+#if (NGX_HAVE_SSE2)
+    int m;
+    __m128i x, l, ok;
+#else
+    uint64_t v, t, ok;
+#endif
+
+    s = p;
+    end = p + size;
+
+#if (NGX_HAVE_SSE2)
+
+    while (end - s >= 16) {
+        x = _mm_loadu_si128((__m128i *) s);
+        l = _mm_or_si128(x, _mm_set1_epi8(0x20));
+
+        /* 有符号比较,0x80以上的字节为负数,不会落入这些区间 */
+
+        ok = _mm_or_si128(
+                _mm_and_si128(_mm_cmpgt_epi8(l, _mm_set1_epi8('a' - 1)),
+                              _mm_cmplt_epi8(l, _mm_set1_epi8('z' + 1))),
+                _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('-' - 1)),
+                              _mm_cmplt_epi8(x, _mm_set1_epi8('9' + 1))));
+
+        ok = _mm_or_si128(ok, _mm_cmpeq_epi8(x, _mm_set1_epi8('_')));
+
+        if (!slash) {
+            ok = _mm_andnot_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('/')), ok);
+        }
+
+        m = _mm_movemask_epi8(ok) ^ 0xffff;
+
+        if (m) {
+            return s - p + __builtin_ctz(m);
+        }
+
+        s += 16;
+    }
+
+#else
+
+    while (end - s >= 8) {
+        ngx_memcpy(&v, s, 8);
+
+        t = v | (ngx_swar_ones * 0x20);
+
+        ok = ngx_swar_range(t & ~ngx_swar_high, 'a', 'z')
+             | ngx_swar_range(v & ~ngx_swar_high, '-', '9')
+             | ngx_swar_range(v & ~ngx_swar_high, '_', '_');
+
+        if (!slash) {
+            ok &= ~ngx_swar_range(v & ~ngx_swar_high, '/', '/');
+        }
+
+        if ((ok & ~v) != ngx_swar_high) {
+            break;
+        }
+
+        s += 8;
+    }
+
+#endif
+
+    while (s < end) {
+        c = *s | 0x20;
+
+        if (!((c >= 'a' && c <= 'z')
+              || (*s >= '-' && *s <= '9' && (slash || *s != '/'))
+              || *s == '_')) {
+            break;
+        }
+
+        s++;
+    }
+
+    return s - p;
+}
+
+
+/* 不需要HTML转义的字符:除"<"、">"、"&"、"""以外 */
+static ngx_inline size_t
+ngx_str_span_html(u_char *p, size_t size) {
+    u_char *s, *end;
+#if (NGX_HAVE_SSE2)
+    int m;
+    __m128i x, r;
+#else
+    uint64_t v;
+#endif
+
+    s = p;
+    end = p + size;
+
+#if (NGX_HAVE_SSE2)
+
+    while (end - s >= 16) {
+        x = _mm_loadu_si128((__m128i *) s);
+
+        r = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('<')),
+                         _mm_cmpeq_epi8(x, _mm_set1_epi8('>')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(x, _mm_set1_epi8('&')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(x, _mm_set1_epi8('"')));
+
+        m = _mm_movemask_epi8(r);
+
+        if (m) {
+            return s - p + __builtin_ctz(m);
+        }
+
+        s += 16;
+    }
+
+#else
+
+    while (end - s >= 8) {
+        ngx_memcpy(&v, s, 8);
+
+        if (ngx_swar_eq(v, '<') | ngx_swar_eq(v, '>')
+            | ngx_swar_eq(v, '&') | ngx_swar_eq(v, '"')) {
+            break;
+        }
+
+        s += 8;
+    }
+
+#endif
+
+    while (s < end && *s != '<' && *s != '>' && *s != '&' && *s != '"') {
+        s++;
+    }
+
+    return s - p;
+}
+
+
+/* 不需要JSON转义的字符:除"""、"\"和控制字符以外 */
+static ngx_inline size_t
+ngx_str_span_json(u_char *p, size_t size) {
+    u_char *s, *end;
+#if (NGX_HAVE_SSE2)
+    int m;
+    __m128i x, r;
+#else
+    uint64_t v;
+#endif
+
+    s = p;
+    end = p + size;
+
+#if (NGX_HAVE_SSE2)
+
+    while (end - s >= 16) {
+        x = _mm_loadu_si128((__m128i *) s);
+
+        /* x <= 0x1f(无符号)等价于min(x, 0x1f) == x */
+
+        r = _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(0x1f)), x);
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(x, _mm_set1_epi8('"')));
+        r = _mm_or_si128(r, _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+
+        m = _mm_movemask_epi8(r);
+
+        if (m) {
+            return s - p + __builtin_ctz(m);
+        }
+
+        s += 16;
+    }
+
+#else
+
+    while (end - s >= 8) {
+        ngx_memcpy(&v, s, 8);
+
+        if (ngx_swar_lt(v, 0x20) | ngx_swar_eq(v, '"')
+            | ngx_swar_eq(v, '\\')) {
+            break;
+        }
+
+        s += 8;
+    }
+
+#endif
+
+    while (s < end && *s > 0x1f && *s != '"' && *s != '\\') {
+        s++;
+    }
+
+    return s - p;
+}
+
+
 //大写字母转换为小写字母
 void
 ngx_strlow(u_char *dst, u_char *src, size_t n) {
+    uint64_t v;
+#if (NGX_HAVE_SSE2)
+    __m128i x, m;
+
+    /* 有符号比较,0x80以上的字节为负数,保持不变 */
+
+    while (n >= 16) {
+        x = _mm_loadu_si128((__m128i *) src);
+        m = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)),
+                          _mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+        x = _mm_or_si128(x, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+        _mm_storeu_si128((__m128i *) dst, x);
+
+        dst += 16;
+        src += 16;
+        n -= 16;
+    }
+
+#endif
+
+    while (n >= 8) {
+        ngx_memcpy(&v, src, 8);
+        v |= (ngx_swar_range(v & ~ngx_swar_high, 'A', 'Z') & ~v) >> 2;
+        ngx_memcpy(dst, &v, 8);
+
+        dst += 8;
+        src += 8;
+        n -= 8;
+    }
+
     while (n) {
         *dst = ngx_tolower(*src);
         dst++;
@@ -776,13 +1092,17 @@ ngx_strncasecmp(u_char *s1, u_char *s2, size_t n) {
 u_char *
 ngx_strnstr(u_char *s1, char *s2, size_t len) {
     u_char c1, c2;
-    size_t n;
+    size_t n, skip;
 
     c2 = *(u_char *) s2++;
 
     n = ngx_strlen(s2);
 
     do {
+        skip = ngx_str_span_not2(s1, len, c2, '\0');
+        s1 += skip;
+        len -= skip;
+
         do {
             if (len-- == 0) {
                 return NULL;
@@ -1555,7 +1875,8 @@ ngx_utf8_cpystrn(u_char *dst, u_char *src, size_t n, size_t len) {
 
 uintptr_t
 ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type) { //如果dst为空,则返回需要转义的字符有多少个.否则将字符串转义了,存放在dst里面.
-    ngx_uint_t n;
+    size_t skip;
+    ngx_uint_t n, slash;
     uint32_t *escape;
     static u_char hex[] = "0123456789ABCDEF";
 
@@ -1699,6 +2020,7 @@ ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type) { //如
 
 
     escape = map[type];
+    slash = (type != NGX_ESCAPE_URI_COMPONENT);
 
     if (dst == NULL) {
 
@@ -1707,6 +2029,14 @@ ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type) { //如
         n = 0;
 
         while (size) {
+            skip = ngx_str_span_uri(src, size, slash);
+            src += skip;
+            size -= skip;
+
+            if (size == 0) {
+                break;
+            }
+
             if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
                 n++;
             }
@@ -1718,6 +2048,15 @@ ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type) { //如
     }
 
     while (size) {
+        skip = ngx_str_span_uri(src, size, slash);
+        dst = ngx_cpymem(dst, src, skip);
+        src += skip;
+        size -= skip;
+
+        if (size == 0) {
+            break;
+        }
+
         if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
             *dst++ = '%';
             *dst++ = hex[*src >> 4];
@@ -1741,6 +2080,7 @@ ngx_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type) { //如
 void
 ngx_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type) {
     u_char *d, *s, ch, c, decoded;
+    size_t skip;
     enum {
         sw_usual = 0,
         sw_quoted,
@@ -1753,7 +2093,21 @@ ngx_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type) {
     state = 0;
     decoded = 0;
 
-    while (size--) {
+    while (size) {
+
+        if (state == sw_usual) {
+            skip = ngx_str_span_not2(s, size, '%', '?');
+
+            if (skip) {
+                ngx_memmove(d, s, skip);
+                d += skip;
+                s += skip;
+                size -= skip;
+                continue;
+            }
+        }
+
+        size--;
 
         ch = *s++;
 
@@ -1873,6 +2227,7 @@ ngx_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type) {
 uintptr_t
 ngx_escape_html(u_char *dst, u_char *src, size_t size) {
     u_char ch;
+    size_t skip;
     ngx_uint_t len;
 
     if (dst == NULL) {
@@ -1880,6 +2235,14 @@ ngx_escape_html(u_char *dst, u_char *src, size_t size) {
         len = 0;
 
         while (size) {
+            skip = ngx_str_span_html(src, size);
+            src += skip;
+            size -= skip;
+
+            if (size == 0) {
+                break;
+            }
+
             switch (*src++) {
 
                 case '<':
@@ -1908,6 +2271,15 @@ ngx_escape_html(u_char *dst, u_char *src, size_t size) {
     }
 
     while (size) {
+        skip = ngx_str_span_html(src, size);
+        dst = ngx_cpymem(dst, src, skip);
+        src += skip;
+        size -= skip;
+
+        if (size == 0) {
+            break;
+        }
+
         ch = *src++;
 
         switch (ch) {
@@ -1957,12 +2329,21 @@ ngx_escape_html(u_char *dst, u_char *src, size_t size) {
 uintptr_t
 ngx_escape_json(u_char *dst, u_char *src, size_t size) {
     u_char ch;
+    size_t skip;
     ngx_uint_t len;
 
     if (dst == NULL) {
         len = 0;
 
         while (size) {
+            skip = ngx_str_span_json(src, size);
+            src += skip;
+            size -= skip;
+
+            if (size == 0) {
+                break;
+            }
+
             ch = *src++;
 
             if (ch == '\\' || ch == '"') {
@@ -1991,6 +2372,15 @@ ngx_escape_json(u_char *dst, u_char *src, size_t size) {
     }
 
     while (size) {
+        skip = ngx_str_span_json(src, size);
+        dst = ngx_cpymem(dst, src, skip);
+        src += skip;
+        size -= skip;
+
+        if (size == 0) {
+            break;
+        }
+
         ch = *src++;
 
         if (ch > 0x1f) {
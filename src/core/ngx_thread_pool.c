@@ -18,28 +18,39 @@ typedef struct {
 } ngx_thread_pool_conf_t; //创建空间在ngx_thread_pool_create_conf
 
 
-typedef struct { //见ngx_thread_pool_done
-    ngx_thread_task_t *first;
-    /*
-     *ngx_thread_pool_t->queue.last = task;  新添加的任务通过last连接在一起
-     ngx_thread_pool_t->queue.last = &task->next;  下次在添加新任务就让task->next指向新任务了
-     */
-    ngx_thread_task_t **last;
-} ngx_thread_pool_queue_t; //线程池队列  初始化在ngx_thread_pool_queue_init
+/*
+每个线程一个有界的任务环,只有worker主线程(ngx_thread_task_post)往环里放任务,线程从自己的环取任务,
+自己的环空了再从其他线程的环里偷任务,取任务只用CAS推进head,不需要加锁
+*/
+typedef struct {
+    ngx_atomic_t head; //下一个要取的任务,线程通过CAS推进
+    u_char pad0[NGX_CPU_CACHE_LINE];
+
+    ngx_atomic_t tail; //下一个放任务的位置,只由worker主线程推进
+    ngx_thread_task_t **tasks;
+    ngx_uint_t mask;
+    u_char pad1[NGX_CPU_CACHE_LINE];
 
-#define ngx_thread_pool_queue_init(q)                                         \
-    (q)->first = NULL;                                                        \
-    (q)->last = &(q)->first
+    ngx_thread_pool_t *tp;
+    ngx_uint_t index;
+
+    /* 统计,只由本线程修改 */
+    ngx_uint_t ntasks; //执行完的任务数
+    ngx_uint_t steals; //从其他线程的环里偷到的任务数
+    uint64_t wait_time; //任务从添加到开始执行的时间,微秒
+    uint64_t run_time; //任务执行的时间,微秒
+} ngx_thread_pool_thread_t;
 
 //一个该结构对应一个threads_pool配置
 struct ngx_thread_pool_s { //该结构式存放在ngx_thread_pool_conf_t->pool数组中的,见ngx_thread_pool_init_worker
+    ngx_thread_pool_thread_t **queues; //每个线程一个任务环  ngx_thread_pool_init中创建
+    ngx_uint_t next; //下一个放任务的环,轮流放
+    ngx_uint_t capacity; //每个环最多排队的任务数,所有环加起来为max_queue
+
+    //线程没有任务可取时在条件变量上睡眠,只有sleeping不为0时ngx_thread_task_post才需要加锁唤醒
     ngx_thread_mutex_t mtx; //线程锁  ngx_thread_pool_init中初始化
-    //ngx_thread_task_post中添加的任务被添加到该队列中
-    ngx_thread_pool_queue_t queue; //ngx_thread_pool_init  ngx_thread_pool_queue_init中初始化
-    //在该线程池poll中每添加一个线程,waiting子减,当线程全部正在执行任务后,waiting会恢复到0
-    //如果所有线程都已经在执行任务(也就是waiting>-0),又来了任务,那么任务就只能等待.所以waiting表示等待被执行的任务数
-    ngx_int_t waiting; //等待的任务数   ngx_thread_task_post加1   ngx_thread_pool_cycle减1
     ngx_thread_cond_t cond; //条件变量  ngx_thread_pool_init中初始化
+    ngx_atomic_t sleeping; //在条件变量上睡眠的线程数
 
     ngx_log_t *log; //ngx_thread_pool_init中初始化
 
@@ -64,6 +75,14 @@ static void ngx_thread_pool_exit_handler(void *data, ngx_log_t *log);
 
 static void *ngx_thread_pool_cycle(void *data);
 
+static ngx_thread_task_t *ngx_thread_pool_pop(ngx_thread_pool_thread_t *t);
+
+static ngx_thread_task_t *ngx_thread_pool_steal(ngx_thread_pool_thread_t *t);
+
+static ngx_uint_t ngx_thread_pool_pending(ngx_thread_pool_t *tp);
+
+static uint64_t ngx_thread_pool_usec(void);
+
 static void ngx_thread_pool_handler(ngx_event_t *ev);
 
 static char *ngx_thread_pool(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
@@ -125,16 +144,17 @@ ngx_module_t ngx_thread_pool_module = {
 static ngx_str_t ngx_thread_pool_default = ngx_string("default");
 
 static ngx_uint_t ngx_thread_pool_task_id;
-static ngx_atomic_t ngx_thread_pool_done_lock; //为0,可以获取锁,不为0,则不能获取到该锁
-static ngx_thread_pool_queue_t ngx_thread_pool_done; //所有的
+//所有线程池执行完的任务,线程用CAS压栈,ngx_thread_pool_handler一次全部取走
+static ngx_atomic_t ngx_thread_pool_done;
 
 //根据thread_pool name threads=number [max_queue=number];中的number来创建这么多个线程
 static ngx_int_t
 ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log, ngx_pool_t *pool) {
     int err;
     pthread_t tid;
-    ngx_uint_t n;
+    ngx_uint_t n, size;
     pthread_attr_t attr;
+    ngx_thread_pool_thread_t *t;
 
     if (ngx_notify == NULL) {
         ngx_log_error(NGX_LOG_ALERT, log, 0,
@@ -142,7 +162,39 @@ ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log, ngx_pool_t *pool) {
         return NGX_ERROR;
     }
 
-    ngx_thread_pool_queue_init(&tp->queue);
+    tp->capacity = (tp->max_queue + tp->threads - 1) / tp->threads;
+
+    if (tp->capacity == 0) {
+        tp->capacity = 1;
+    }
+
+    for (size = 1; size < tp->capacity; size <<= 1) { /* void */ }
+
+    tp->queues = ngx_palloc(pool, tp->threads * sizeof(ngx_thread_pool_thread_t *));
+    if (tp->queues == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (n = 0; n < tp->threads; n++) {
+        t = ngx_pcalloc(pool, sizeof(ngx_thread_pool_thread_t));
+        if (t == NULL) {
+            return NGX_ERROR;
+        }
+
+        t->tasks = ngx_palloc(pool, size * sizeof(ngx_thread_task_t *));
+        if (t->tasks == NULL) {
+            return NGX_ERROR;
+        }
+
+        t->mask = size - 1;
+        t->tp = tp;
+        t->index = n;
+
+        tp->queues[n] = t;
+    }
+
+    tp->next = 0;
+    tp->sleeping = 0;
 
     if (ngx_thread_mutex_create(&tp->mtx, log) != NGX_OK) {
         return NGX_ERROR;
@@ -183,7 +235,7 @@ ngx_thread_pool_init(ngx_thread_pool_t *tp, ngx_log_t *log, ngx_pool_t *pool) {
        线程原语:pthread_create(),pthread_self(),pthread_exit(),pthread_join(),pthread_cancel(),pthread_detach( .
        好的线程理解大全参考(有图解例子,很好):http://blog.csdn.net/tototuzuoquan/article/details/39553427
         */
-        err = pthread_create(&tid, &attr, ngx_thread_pool_cycle, tp);
+        err = pthread_create(&tid, &attr, ngx_thread_pool_cycle, tp->queues[n]);
         if (err) {
             ngx_log_error(NGX_LOG_ALERT, log, err,
                           "pthread_create() failed");
@@ -260,41 +312,61 @@ ngx_thread_task_alloc(ngx_pool_t *pool, size_t size) {
 //任务添加到对应的线程池任务队列中
 ngx_int_t
 ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task) { //ngx_thread_pool_cycle和ngx_thread_task_post配合阅读
+    ngx_uint_t n;
+    ngx_atomic_uint_t tail;
+    ngx_thread_pool_thread_t *t;
+
     if (task->event.active) {
         ngx_log_error(NGX_LOG_ALERT, tp->log, 0,
                       "task #%ui already active", task->id);
         return NGX_ERROR;
     }
 
-    if (ngx_thread_mutex_lock(&tp->mtx, tp->log) != NGX_OK) {
-        return NGX_ERROR;
-    }
+    task->id = ngx_thread_pool_task_id++;
+    task->posted = ngx_thread_pool_usec();
 
-    if (tp->waiting >= tp->max_queue) {
-        (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+    //从tp->next开始找一个没有满的环,所有环都满了说明已经有max_queue个任务在排队
+    for (n = 0; n < tp->threads; n++) {
+        t = tp->queues[tp->next];
+
+        if (++tp->next == tp->threads) {
+            tp->next = 0;
+        }
 
+        tail = t->tail;
+
+        if (tail - t->head < tp->capacity) {
+            break;
+        }
+    }
+
+    if (n == tp->threads) {
         ngx_log_error(NGX_LOG_ERR, tp->log, 0,
                       "thread pool \"%V\" queue overflow: %i tasks waiting",
-                      &tp->name, tp->waiting);
+                      &tp->name, tp->max_queue);
         return NGX_ERROR;
     }
 
     task->event.active = 1;
 
-    task->id = ngx_thread_pool_task_id++;
-    task->next = NULL;
+    t->tasks[tail & t->mask] = task;
 
-    if (ngx_thread_cond_signal(&tp->cond, tp->log) != NGX_OK) {
-        (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
-        return NGX_ERROR;
-    }
-    //添加到任务队列
-    *tp->queue.last = task;
-    tp->queue.last = &task->next;
+    /* 原子加是完整的内存屏障,先发布任务,再检查是否有睡眠的线程 */
+
+    (void) ngx_atomic_fetch_add(&t->tail, 1);
+
+    if (tp->sleeping) {
+        if (ngx_thread_mutex_lock(&tp->mtx, tp->log) != NGX_OK) {
+            return NGX_ERROR;
+        }
 
-    tp->waiting++;
+        if (ngx_thread_cond_signal(&tp->cond, tp->log) != NGX_OK) {
+            (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+            return NGX_ERROR;
+        }
 
-    (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+        (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+    }
 
     ngx_log_debug2(NGX_LOG_DEBUG_CORE, tp->log, 0,
                    "task #%ui added to thread pool \"%V\"",
@@ -306,12 +378,17 @@ ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task) { //ngx_thr
 //ngx_thread_pool_cycle和ngx_thread_task_post配合阅读
 static void *
 ngx_thread_pool_cycle(void *data) {
-    ngx_thread_pool_t *tp = data; //一个该结构对应一个threads_pool配置
+    ngx_thread_pool_thread_t *t = data;
 
     int err;
     sigset_t set;
+    uint64_t start, now;
+    ngx_thread_pool_t *tp; //一个该结构对应一个threads_pool配置
+    ngx_atomic_uint_t last;
     ngx_thread_task_t *task;
 
+    tp = t->tp;
+
 #if 0
     ngx_time_update();
 #endif
@@ -337,37 +414,47 @@ ngx_thread_pool_cycle(void *data) {
     20090#20090前面是进程号,后面是主线程号,他们相同
     */
     for (;;) { //一次任务执行完后又会走到这里,循环
-        if (ngx_thread_mutex_lock(&tp->mtx, tp->log) != NGX_OK) {
-            return NULL;
+        task = ngx_thread_pool_pop(t);
+
+        if (task == NULL) {
+            task = ngx_thread_pool_steal(t);
         }
 
-        /* the number may become negative */
-        tp->waiting--;
-        //如果队列中有任务,则直接执行任务,不会在while中等待conf signal
-        while (tp->queue.first == NULL) {  //此时任务队列为空,在条件变量上等待  配合ngx_thread_task_post阅读
-            //在添加任务的时候唤醒ngx_thread_task_post -> ngx_thread_cond_signal
-            if (ngx_thread_cond_wait(&tp->cond, &tp->mtx, tp->log)
-                != NGX_OK) { //等待ngx_thread_cond_signal后才会返回
-                (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+        if (task == NULL) {
+            if (ngx_thread_mutex_lock(&tp->mtx, tp->log) != NGX_OK) {
                 return NULL;
             }
-        }
-        //取出队首任务,然后执行
-        task = tp->queue.first;
-        tp->queue.first = task->next;
 
-        if (tp->queue.first == NULL) {
-            tp->queue.last = &tp->queue.first;
-        }
-        //这一段加锁是因为线程池是共享资源,多个线程都从队列中取线程,并且主线程会添加任务到队列中
-        if (ngx_thread_mutex_unlock(&tp->mtx, tp->log) != NGX_OK) {
-            return NULL;
+            /* 先增加sleeping再检查所有的环,与ngx_thread_task_post配合不会丢失唤醒 */
+
+            (void) ngx_atomic_fetch_add(&tp->sleeping, 1);
+
+            while (!ngx_thread_pool_pending(tp)) {
+                //在添加任务的时候唤醒ngx_thread_task_post -> ngx_thread_cond_signal
+                if (ngx_thread_cond_wait(&tp->cond, &tp->mtx, tp->log)
+                    != NGX_OK) {
+                    (void) ngx_atomic_fetch_add(&tp->sleeping, -1);
+                    (void) ngx_thread_mutex_unlock(&tp->mtx, tp->log);
+                    return NULL;
+                }
+            }
+
+            (void) ngx_atomic_fetch_add(&tp->sleeping, -1);
+
+            if (ngx_thread_mutex_unlock(&tp->mtx, tp->log) != NGX_OK) {
+                return NULL;
+            }
+
+            continue;
         }
 
 #if 0
             ngx_time_update();
 #endif
 
+        start = ngx_thread_pool_usec();
+        t->wait_time += start - task->posted;
+
         ngx_log_debug2(NGX_LOG_DEBUG_CORE, tp->log, 0,
                        "run task #%ui in thread pool \"%V\"",
                        task->id, &tp->name);
@@ -378,45 +465,150 @@ ngx_thread_pool_cycle(void *data) {
                        "complete task #%ui in thread pool \"%V\"",
                        task->id, &tp->name);
 
-        task->next = NULL;
+        now = ngx_thread_pool_usec();
+        t->run_time += now - start;
+        t->ntasks++;
+
+        do {
+            last = ngx_thread_pool_done;
+            task->next = (ngx_thread_task_t *) last;
 
-        ngx_spinlock(&ngx_thread_pool_done_lock, 1, 2048);
+        } while (!ngx_atomic_cmp_set(&ngx_thread_pool_done, last,
+                                     (ngx_atomic_uint_t) task));
 
-        *ngx_thread_pool_done.last = task; //task添加到队列尾部,同时可以保证多次添加的时候,让新task和以前的task形成一个还,first执行第一个task,last指向最后一个task
-        ngx_thread_pool_done.last = &task->next;
+        //ngx_notify通告主线程,该任务处理完毕,ngx_thread_pool_handler由主线程执行,也就是进程cycle{}通过epoll_wait返回执行,而不是由线程池中的线程执行
+        //栈原来不为空时通知已经发出过,主线程会把这个任务一起取走
+        if (last == 0) {
+            (void) ngx_notify(ngx_thread_pool_handler);
+        }
+    }
+}
+
+
+//从t的环中取一个任务,环空时返回NULL
+static ngx_thread_task_t *
+ngx_thread_pool_pop(ngx_thread_pool_thread_t *t) {
+    ngx_atomic_uint_t head;
+    ngx_thread_task_t *task;
+
+    for (;;) {
+        head = t->head;
 
         ngx_memory_barrier();
 
-        ngx_unlock(&ngx_thread_pool_done_lock);
-        //ngx_notify通告主线程,该任务处理完毕,ngx_thread_pool_handler由主线程执行,也就是进程cycle{}通过epoll_wait返回执行,而不是由线程池中的线程执行
-        (void) ngx_notify(ngx_thread_pool_handler);
+        if (head == t->tail) {
+            return NULL;
+        }
+
+        ngx_memory_barrier();
+
+        task = t->tasks[head & t->mask];
+
+        /*
+         * the slot may be reused by the producer only after the head
+         * is moved, and then the cmp_set() below fails
+         */
+
+        if (ngx_atomic_cmp_set(&t->head, head, head + 1)) {
+            return task;
+        }
     }
 }
 
+
+//自己的环空了,从其他线程的环里偷任务
+static ngx_thread_task_t *
+ngx_thread_pool_steal(ngx_thread_pool_thread_t *t) {
+    ngx_uint_t i, n;
+    ngx_thread_pool_t *tp;
+    ngx_thread_task_t *task;
+
+    tp = t->tp;
+    n = t->index;
+
+    for (i = 1; i < tp->threads; i++) {
+
+        if (++n == tp->threads) {
+            n = 0;
+        }
+
+        task = ngx_thread_pool_pop(tp->queues[n]);
+
+        if (task) {
+            t->steals++;
+            return task;
+        }
+    }
+
+    return NULL;
+}
+
+
+//是否有环中还有任务
+static ngx_uint_t
+ngx_thread_pool_pending(ngx_thread_pool_t *tp) {
+    ngx_uint_t i;
+
+    for (i = 0; i < tp->threads; i++) {
+        if (tp->queues[i]->head != tp->queues[i]->tail) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+//单调时间,微秒,线程中不能用ngx_current_msec
+static uint64_t
+ngx_thread_pool_usec(void) {
+#if (NGX_HAVE_CLOCK_MONOTONIC)
+    struct timespec ts;
+
+#if defined(CLOCK_MONOTONIC_FAST)
+    clock_gettime(CLOCK_MONOTONIC_FAST, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+#else
+    struct timeval tv;
+
+    ngx_gettimeofday(&tv);
+
+    return (uint64_t) tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+
 //任务处理完后,epoll的通知读事件会调用该函数
 //ngx_notify通告主线程,该任务处理完毕,ngx_thread_pool_handler由主线程执行,也就是进程cycle{}通过epoll_wait返回执行,而不是由线程池中的线程执行
 static void
 ngx_thread_pool_handler(ngx_event_t *ev) {
     ngx_event_t *event;
-    ngx_thread_task_t *task;
+    ngx_atomic_uint_t last;
+    ngx_thread_task_t *task, *next, *prev;
 
     ngx_log_debug0(NGX_LOG_DEBUG_CORE, ev->log, 0, "thread pool handler");
 
-    ngx_spinlock(&ngx_thread_pool_done_lock, 1, 2048);
-    /* 这里是不是有问题?
-       如果线程池中的线程执行任务比较快,而主进程在执行epoll_wait过程中有点阻塞,那么就检测不到ngx_notify中的epoll事件,有可能下次检测到该事件的时候
-       ngx_thread_pool_done上已经积累了很多执行完的任务事件,见ngx_thread_pool_cycle.
-       单这里好像只取了队列首部的任务啊?????? 队首外的任务丢弃了???????????不对吧
-       答案是,这里面所有的任务都在下面的while{}中得到了执行
-    */
-    task = ngx_thread_pool_done.first;
-    ngx_thread_pool_done.first = NULL;
-    //尾部指向头,但是头已经变为空,即不执行任务
-    ngx_thread_pool_done.last = &ngx_thread_pool_done.first;
+    do {
+        last = ngx_thread_pool_done;
+
+    } while (!ngx_atomic_cmp_set(&ngx_thread_pool_done, last, 0));
 
-    ngx_memory_barrier();
+    /* 栈中的任务是后完成的在前,反转后按完成的顺序执行 */
 
-    ngx_unlock(&ngx_thread_pool_done_lock);
+    task = NULL;
+    next = (ngx_thread_task_t *) last;
+
+    while (next) {
+        prev = next->next;
+        next->next = task;
+        task = next;
+        next = prev;
+    }
 
     while (task) { //遍历执行前面队列ngx_thread_pool_done中的每一个任务
         ngx_log_debug1(NGX_LOG_DEBUG_CORE, ev->log, 0,
@@ -615,6 +807,51 @@ ngx_thread_pool_get(ngx_cycle_t *cycle, ngx_str_t *name) {
     return NULL;
 }
 
+//取第n个线程池的统计,没有这个线程池或者线程池还没有创建返回NGX_DECLINED
+ngx_int_t
+ngx_thread_pool_stats(ngx_cycle_t *cycle, ngx_uint_t n,
+                      ngx_thread_pool_stats_t *stats) {
+    ngx_uint_t i;
+    ngx_atomic_uint_t head;
+    ngx_thread_pool_t *tp, **tpp;
+    ngx_thread_pool_conf_t *tcf;
+    ngx_thread_pool_thread_t *t;
+
+    tcf = (ngx_thread_pool_conf_t *) ngx_get_conf(cycle->conf_ctx,
+                                                  ngx_thread_pool_module);
+
+    if (tcf == NULL || n >= tcf->pools.nelts) {
+        return NGX_DECLINED;
+    }
+
+    tpp = tcf->pools.elts;
+    tp = tpp[n];
+
+    if (tp->queues == NULL) {
+        return NGX_DECLINED;
+    }
+
+    ngx_memzero(stats, sizeof(ngx_thread_pool_stats_t));
+
+    stats->name = tp->name;
+    stats->threads = tp->threads;
+
+    for (i = 0; i < tp->threads; i++) {
+        t = tp->queues[i];
+
+        head = t->head;
+        stats->queued += t->tail - head;
+
+        stats->tasks += t->ntasks;
+        stats->steals += t->steals;
+        stats->wait_time += t->wait_time;
+        stats->run_time += t->run_time;
+    }
+
+    return NGX_OK;
+}
+
+
 //在ngx_thread_pool_init_worker和 ngx_thread_pool_exit_worker分别会创建每一个线程池和销毁每一个线程池;
 static ngx_int_t
 ngx_thread_pool_init_worker(ngx_cycle_t *cycle) {
@@ -634,7 +871,7 @@ ngx_thread_pool_init_worker(ngx_cycle_t *cycle) {
         return NGX_OK;
     }
 
-    ngx_thread_pool_queue_init(&ngx_thread_pool_done);
+    ngx_thread_pool_done = 0;
 
     tpp = tcf->pools.elts;
 
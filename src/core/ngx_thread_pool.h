@@ -17,6 +17,7 @@
 struct ngx_thread_task_s {
     ngx_thread_task_t *next; //指向下一个提交的任务
     ngx_uint_t id; //任务id  没添加一个任务就自增加,见ngx_thread_pool_task_id
+    uint64_t posted; //添加任务的单调时间,微秒,用于统计任务的等待时间
     void *ctx; //执行回调函数的参数
     //ngx_thread_pool_cycle中执行
     void (*handler)(void *data, ngx_log_t *log); //回调函数   执行完handler后会通过ngx_notify执行event->handler
@@ -28,6 +29,18 @@ struct ngx_thread_task_s {
 typedef struct ngx_thread_pool_s ngx_thread_pool_t; //一个该结构对应一个threads_pool线程池配置
 
 
+//线程池的统计,只是当前worker进程的,见ngx_thread_pool_stats
+typedef struct {
+    ngx_str_t name;
+    ngx_uint_t threads;
+    ngx_uint_t queued; //正在排队的任务数
+    ngx_uint_t tasks; //执行完的任务数
+    ngx_uint_t steals; //被其他线程偷走执行的任务数
+    uint64_t wait_time; //任务的等待时间总和,微秒
+    uint64_t run_time; //任务的执行时间总和,微秒
+} ngx_thread_pool_stats_t;
+
+
 ngx_thread_pool_t *ngx_thread_pool_add(ngx_conf_t *cf, ngx_str_t *name);
 
 ngx_thread_pool_t *ngx_thread_pool_get(ngx_cycle_t *cycle, ngx_str_t *name);
@@ -36,5 +49,8 @@ ngx_thread_task_t *ngx_thread_task_alloc(ngx_pool_t *pool, size_t size);
 
 ngx_int_t ngx_thread_task_post(ngx_thread_pool_t *tp, ngx_thread_task_t *task);
 
+ngx_int_t ngx_thread_pool_stats(ngx_cycle_t *cycle, ngx_uint_t n,
+                                ngx_thread_pool_stats_t *stats);
+
 
 #endif /* _NGX_THREAD_POOL_H_INCLUDED_ */
@@ -9,6 +9,10 @@
 #include <ngx_core.h>
 #include <ngx_event.h>
 
+#if (NGX_HAVE_IO_URING_AIO)
+#include <ngx_linux_io_uring.h>
+#endif
+
 /*Epoll在LT和ET模式下的读写方式
 在一个非阻塞的socket上调用read/write函数, 返回EAGAIN或者EWOULDBLOCK(注: EAGAIN就是EWOULDBLOCK)
 从字面上看, 意思是:EAGAIN: 再试一次,EWOULDBLOCK: 如果这是一个阻塞socket, 操作将被block,perror输出: Resource temporarily unavailable
@@ -366,8 +370,12 @@ static ngx_connection_t notify_conn;
 #if (NGX_HAVE_FILE_AIO)
 //用于通知异步I/O事件的描述符,它与iocb结构体中的aio_resfd成员是一致的,通过该fd添加到epoll事件中,从而可以检测异步io事件
 int                         ngx_eventfd = -1;
+#if (NGX_HAVE_IO_URING_AIO)
+static ngx_io_uring_t       ngx_aio_ring; //ngx_epoll_aio_init创建,完成事件通过ngx_eventfd通知
+#else
 //异步I/O的上下文,全局唯一,必须经过io_setup初始化才能使用
 aio_context_t               ngx_aio_ctx = 0; //ngx_epoll_aio_init->io_setup创建
+#endif
 //异步I/O事件完成后进行通知的描述符,也就是ngx_eventfd所对应的ngx_event_t事件
 static ngx_event_t          ngx_eventfd_event;  //读事件
 //异步I/O事件完成后进行通知的描述符ngx_eventfd所对应的ngx_connectiont连接
@@ -444,6 +452,92 @@ ngx_module_t ngx_epoll_module = {
 
 #if (NGX_HAVE_FILE_AIO)
 
+#if (NGX_HAVE_IO_URING_AIO)
+
+/*
+使用io_uring实现文件异步I/O时,epoll只负责通知:ngx_eventfd通过IORING_REGISTER_EVENTFD
+注册到io_uring中,每产生一个完成事件内核都会写一次ngx_eventfd,epoll_wait返回后由
+ngx_epoll_eventfd_handler从完成队列中取出完成事件.worker_aio_requests为提交队列的大小
+*/
+static void
+ngx_epoll_aio_init(ngx_cycle_t *cycle, ngx_epoll_conf_t *epcf)
+{
+    int                 fd;
+    struct epoll_event  ee;
+
+    ngx_eventfd = eventfd(0, EFD_NONBLOCK);
+
+    if (ngx_eventfd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "eventfd() failed");
+        ngx_file_aio = 0;
+        return;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "eventfd: %d", ngx_eventfd);
+
+    if (ngx_io_uring_setup(&ngx_aio_ring, epcf->aio_requests,
+                           epcf->aio_requests * 4, cycle->log)
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    /* IORING_OP_READ和IORING_OP_WRITEV与该标志都是在Linux 5.6中出现的 */
+
+    if (!(ngx_aio_ring.features & IORING_FEAT_RW_CUR_POS)) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                      "io_uring does not support file reads and writes");
+        goto destroy;
+    }
+
+    fd = ngx_eventfd;
+
+    if (ngx_io_uring_register(&ngx_aio_ring, IORING_REGISTER_EVENTFD, &fd, 1)
+        != NGX_OK)
+    {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "io_uring_register(IORING_REGISTER_EVENTFD) failed");
+        goto destroy;
+    }
+
+    ngx_eventfd_event.data = &ngx_eventfd_conn;
+    ngx_eventfd_event.handler = ngx_epoll_eventfd_handler;
+    ngx_eventfd_event.log = cycle->log;
+    ngx_eventfd_event.active = 1;
+    ngx_eventfd_conn.fd = ngx_eventfd;
+    ngx_eventfd_conn.read = &ngx_eventfd_event;
+    ngx_eventfd_conn.log = cycle->log;
+
+    ee.events = EPOLLIN|EPOLLET;
+    ee.data.ptr = &ngx_eventfd_conn;
+
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, ngx_eventfd, &ee) != -1) {
+        ngx_io_uring_aio = &ngx_aio_ring;
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                  "epoll_ctl(EPOLL_CTL_ADD, eventfd) failed");
+
+destroy:
+
+    ngx_io_uring_destroy(&ngx_aio_ring, cycle->log);
+
+failed:
+
+    if (close(ngx_eventfd) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "eventfd close() failed");
+    }
+
+    ngx_eventfd = -1;
+    ngx_file_aio = 0;
+}
+
+#else
+
 /*
  * We call io_setup(), io_destroy() io_submit(), and io_getevents() directly
  * as syscalls instead of libaio usage, because the library header file
@@ -554,6 +648,8 @@ failed:
 
 #endif
 
+#endif
+
 
 static ngx_int_t
 ngx_epoll_init(ngx_cycle_t *cycle, ngx_msec_t timer) {
@@ -792,10 +888,15 @@ ngx_epoll_done(ngx_cycle_t *cycle) {
 
     if (ngx_eventfd != -1) {
 
+#if (NGX_HAVE_IO_URING_AIO)
+        ngx_io_uring_destroy(&ngx_aio_ring, cycle->log);
+        ngx_io_uring_aio = NULL;
+#else
         if (io_destroy(ngx_aio_ctx) == -1) {
             ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
                           "io_destroy() failed");
         }
+#endif
 
         if (close(ngx_eventfd) == -1) {
             ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
@@ -805,7 +906,9 @@ ngx_epoll_done(ngx_cycle_t *cycle) {
         ngx_eventfd = -1;
     }
 
+#if !(NGX_HAVE_IO_URING_AIO)
     ngx_aio_ctx = 0;
+#endif
 
 #endif
 
@@ -1107,6 +1210,19 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
     对已经建立连接的fd读写事件的添加在ngx_event_accept->ngx_http_init_connection->ngx_handle_read_event*/
 
     /*ngx_notify->ngx_epoll_notify只会触发epoll_in,不会同时引发epoll_out,如果是网络读事件epoll_in,则会同时引起epoll_out*/
+#if (NGX_HAVE_IO_URING_AIO)
+
+    /* 提交上一轮循环中积累的文件异步I/O请求 */
+
+    if (ngx_io_uring_aio && ngx_io_uring_sq_pending(ngx_io_uring_aio)) {
+        if (ngx_io_uring_enter(ngx_io_uring_aio, 0, 0) != NGX_OK) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "io_uring_enter() failed");
+        }
+    }
+
+#endif
+
     events = epoll_wait(ep, event_list, (int) nevents, timer); //timer为-1表示无限等待, nevents表示最多监听多少个事件,必须大于0
     //EPOLL_WAIT如果没有读写事件或者定时器超时事件发生,则会进入睡眠,这个过程会让出CPU
     err = (events == -1) ? ngx_errno : 0;
@@ -1269,6 +1385,76 @@ ngx_epoll_eventfd_handler->ngx_file_aio_event_handler
 nginx file aio只提供了read接口,不提供write接口,因为异步aio只从磁盘读和写,而非aio方式一般写会落到
 磁盘缓存,所以不提供该接口,如果异步io写可能会更慢*/
 
+#if (NGX_HAVE_IO_URING_AIO)
+
+static void
+ngx_epoll_eventfd_handler(ngx_event_t *ev)
+{
+    int                   n;
+    uint32_t              head, tail;
+    uint64_t              ready;
+    ngx_event_t          *e;
+    ngx_event_aio_t      *aio;
+    struct io_uring_cqe  *cqe;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0, "eventfd handler");
+
+    n = read(ngx_eventfd, &ready, 8);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ev->log, 0, "eventfd: %d", n);
+
+    if (n == -1 && ngx_errno != NGX_EAGAIN) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
+                      "read(eventfd) failed");
+    }
+
+    for ( ;; ) {
+        head = *ngx_aio_ring.cq_head;
+        tail = *ngx_aio_ring.cq_tail;
+
+        ngx_memory_barrier();
+
+        for ( /* void */ ; head != tail; head++) {
+            cqe = &ngx_aio_ring.cqes[head & ngx_aio_ring.cq_mask];
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                           "io_uring aio: %XL %d", cqe->user_data, cqe->res);
+
+            if (!(cqe->user_data & NGX_IO_URING_AIO)) {
+                continue;
+            }
+
+            e = (ngx_event_t *) (uintptr_t)
+                                (cqe->user_data & ~NGX_IO_URING_AIO);
+
+            e->complete = 1;
+            e->active = 0;
+            e->ready = 1;
+
+            aio = e->data;
+            aio->res = cqe->res;
+
+            ngx_post_event(e, &ngx_posted_events);
+        }
+
+        ngx_memory_barrier();
+
+        *ngx_aio_ring.cq_head = tail;
+
+        if (!ngx_io_uring_cq_overflow(&ngx_aio_ring)) {
+            return;
+        }
+
+        if (ngx_io_uring_enter(&ngx_aio_ring, 0, 0) != NGX_OK) {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
+                          "io_uring_enter() failed");
+            return;
+        }
+    }
+}
+
+#else
+
 //该函数在ngx_process_events_and_timers中执行
 static void
 ngx_epoll_eventfd_handler(ngx_event_t *ev) //从epoll_wait中检测到aio读成功事件,则走到这里
@@ -1357,6 +1543,8 @@ ngx_epoll_eventfd_handler(ngx_event_t *ev) //从epoll_wait中检测到aio读成
 
 #endif
 
+#endif
+
 
 static void *
 ngx_epoll_create_conf(ngx_cycle_t *cycle) {
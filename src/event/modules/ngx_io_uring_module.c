@@ -0,0 +1,623 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+#include <ngx_linux_io_uring.h>
+
+
+/*
+ * ngx_io_uring_module通过io_uring的IORING_OP_POLL_ADD实现就绪通知:每个读/写事件
+ * 对应一个单次触发的poll请求,事件触发后请求自动失效,语义与Solaris的event ports
+ * 相同(NGX_USE_EVENTPORT_EVENT).所有poll的添加/删除请求先放入提交队列,在
+ * ngx_io_uring_process_events中与等待完成事件一起,通过一次io_uring_enter()提交,
+ * 从而省去了epoll_ctl()以及epoll_wait()的系统调用.
+ *
+ * user_data中保存ngx_event_t指针,最低位为instance,第48-62位为该事件poll请求的
+ * 序号(保存在ev->index中),用来识别已经被删除或者被替换的poll请求产生的过期事件;
+ * 最高位留给文件异步I/O请求(NGX_IO_URING_AIO),它们与poll请求共用同一个io_uring.
+ */
+
+#define NGX_IO_URING_GEN_SHIFT  48
+#define NGX_IO_URING_GEN_MASK   0x7fff
+#define NGX_IO_URING_PTR_MASK   (((uint64_t) 1 << NGX_IO_URING_GEN_SHIFT) - 2)
+
+/*
+ * 每个连接最多有读、写两个poll请求和它们的删除请求,以及一个文件异步I/O请求,
+ * 另外还有notify的poll请求和老内核上用于超时的IORING_OP_TIMEOUT请求
+ */
+#define NGX_IO_URING_CQ_PER_CONNECTION  5
+#define NGX_IO_URING_CQ_EXTRA           2
+
+#define ngx_io_uring_user_data(ev)                                            \
+    ((uint64_t) (uintptr_t) (ev) | (ev)->instance                             \
+     | ((uint64_t) ((ev)->index & NGX_IO_URING_GEN_MASK)                      \
+        << NGX_IO_URING_GEN_SHIFT))
+
+
+typedef struct {
+    ngx_uint_t entries; // "io_uring_entries"参数设置,提交队列的大小,默认512
+} ngx_io_uring_conf_t;
+
+
+static ngx_int_t ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer);
+
+static ngx_int_t ngx_io_uring_notify_init(ngx_log_t *log);
+
+static void ngx_io_uring_notify_handler(ngx_event_t *ev);
+
+static void ngx_io_uring_done(ngx_cycle_t *cycle);
+
+static ngx_int_t ngx_io_uring_poll_add(ngx_event_t *ev, ngx_fd_t fd,
+                                       uint32_t events);
+
+static ngx_int_t ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event,
+                                        ngx_uint_t flags);
+
+static ngx_int_t ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event,
+                                        ngx_uint_t flags);
+
+static ngx_int_t ngx_io_uring_notify(ngx_event_handler_pt handler);
+
+static ngx_int_t ngx_io_uring_process_events(ngx_cycle_t *cycle,
+                                             ngx_msec_t timer, ngx_uint_t flags);
+
+static void *ngx_io_uring_create_conf(ngx_cycle_t *cycle);
+
+static char *ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf);
+
+
+static ngx_io_uring_t ring; //每个worker进程一个,ngx_io_uring_init中创建
+
+static int notify_fd = -1;
+static ngx_event_t notify_event;
+
+static ngx_str_t io_uring_name = ngx_string("io_uring");
+
+#if (NGX_HAVE_EPOLL)
+extern ngx_module_t ngx_epoll_module;
+#endif
+
+
+static ngx_command_t ngx_io_uring_commands[] = {
+
+        {ngx_string("io_uring_entries"),
+         NGX_EVENT_CONF | NGX_CONF_TAKE1,
+         ngx_conf_set_num_slot,
+         0,
+         offsetof(ngx_io_uring_conf_t, entries),
+         NULL},
+
+        ngx_null_command
+};
+
+
+static ngx_event_module_t ngx_io_uring_module_ctx = {
+        &io_uring_name,
+        ngx_io_uring_create_conf,             /* create configuration */
+        ngx_io_uring_init_conf,               /* init configuration */
+
+        {
+                ngx_io_uring_add_event,           /* add an event */
+                ngx_io_uring_del_event,           /* delete an event */
+                ngx_io_uring_add_event,           /* enable an event */
+                ngx_io_uring_del_event,           /* disable an event */
+                NULL,                             /* add an connection */
+                NULL,                             /* delete an connection */
+                ngx_io_uring_notify,              /* trigger a notify */
+                ngx_io_uring_process_events,      /* process the events */
+                ngx_io_uring_init,                /* init the events */
+                ngx_io_uring_done,                /* done the events */
+        }
+};
+
+ngx_module_t ngx_io_uring_module = {
+        NGX_MODULE_V1,
+        &ngx_io_uring_module_ctx,             /* module context */
+        ngx_io_uring_commands,                /* module directives */
+        NGX_EVENT_MODULE,                     /* module type */
+        NULL,                                 /* init master */
+        NULL,                                 /* init module */
+        NULL,                                 /* init process */
+        NULL,                                 /* init thread */
+        NULL,                                 /* exit thread */
+        NULL,                                 /* exit process */
+        NULL,                                 /* exit master */
+        NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_int_t
+ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer) {
+    ngx_uint_t cq_entries;
+    ngx_io_uring_conf_t *urcf;
+#if (NGX_HAVE_EPOLL)
+    ngx_event_module_t *module;
+#endif
+
+    urcf = ngx_event_get_conf(cycle->conf_ctx, ngx_io_uring_module);
+
+    if (ring.cqes == NULL) {
+
+        /*
+         * 完成队列按连接数设置,而不是按提交队列:提交队列只限制一轮循环中
+         * 积累的请求数,而同时未完成的poll请求数取决于连接数
+         */
+
+        cq_entries = cycle->connection_n * NGX_IO_URING_CQ_PER_CONNECTION
+                     + NGX_IO_URING_CQ_EXTRA;
+
+        if (ngx_io_uring_setup(&ring, urcf->entries, cq_entries, cycle->log)
+            != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        if (ring.cq_entries < cq_entries) {
+            ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                          "io_uring completion queue is limited to %uD "
+                          "entries, %ui connections may need %ui",
+                          ring.cq_entries, cycle->connection_n, cq_entries);
+        }
+
+#if (NGX_HAVE_EPOLL)
+
+        /*
+         * 没有IORING_FEAT_NODROP(Linux 5.5)的内核在完成队列溢出时直接丢弃
+         * 完成事件,对应的poll请求再也不会触发,此时改用epoll
+         */
+
+#ifdef IORING_FEAT_NODROP
+        if (!(ring.features & IORING_FEAT_NODROP))
+#endif
+        {
+            ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                          "io_uring may drop completions on overflow, "
+                          "using epoll");
+
+            ngx_io_uring_destroy(&ring, cycle->log);
+
+            module = ngx_epoll_module.ctx;
+
+            return module->actions.init(cycle, timer);
+        }
+
+#endif
+
+        if (ngx_io_uring_notify_init(cycle->log) != NGX_OK) {
+            ngx_io_uring_module_ctx.actions.notify = NULL;
+        }
+
+#if (NGX_HAVE_IO_URING_AIO)
+
+        /* IORING_OP_READ和IORING_OP_WRITEV与该标志都是在Linux 5.6中出现的 */
+
+        if (ring.features & IORING_FEAT_RW_CUR_POS) {
+            ngx_io_uring_aio = &ring;
+
+        } else {
+            ngx_file_aio = 0;
+        }
+
+#endif
+    }
+
+    ngx_io = ngx_os_io;
+
+    ngx_event_actions = ngx_io_uring_module_ctx.actions;
+
+    ngx_event_flags = NGX_USE_EVENTPORT_EVENT;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_notify_init(ngx_log_t *log) {
+    notify_fd = eventfd(0, EFD_NONBLOCK);
+
+    if (notify_fd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno, "eventfd() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "notify eventfd: %d", notify_fd);
+
+    notify_event.handler = ngx_io_uring_notify_handler;
+    notify_event.log = log;
+
+    if (ngx_io_uring_poll_add(&notify_event, notify_fd, POLLIN) != NGX_OK) {
+
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+/*ngx_io_uring_notify写eventfd后,poll请求完成,在ngx_io_uring_process_events中调用该函数,
+读出计数后重新添加poll请求,然后执行ngx_notify传入的handler*/
+static void
+ngx_io_uring_notify_handler(ngx_event_t *ev) {
+    ssize_t n;
+    uint64_t count;
+    ngx_event_handler_pt handler;
+
+    n = read(notify_fd, &count, sizeof(uint64_t));
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "read() eventfd %d: %z count:%uL", notify_fd, n, count);
+
+    if (n == -1 && ngx_errno != NGX_EAGAIN) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
+                      "read() eventfd %d failed", notify_fd);
+    }
+
+    if (ngx_io_uring_poll_add(ev, notify_fd, POLLIN) != NGX_OK) {
+        return;
+    }
+
+    handler = ev->data;
+
+    if (handler) {
+        handler(ev);
+    }
+}
+
+
+static void
+ngx_io_uring_done(ngx_cycle_t *cycle) {
+    if (notify_fd != -1) {
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+    }
+
+    if (ring.cqes) {
+        ngx_io_uring_destroy(&ring, cycle->log);
+    }
+
+#if (NGX_HAVE_IO_URING_AIO)
+    ngx_io_uring_aio = NULL;
+#endif
+}
+
+/*添加一个单次触发的poll请求,请求序号加1后保存在ev->index中,旧的序号对应的完成事件都将被视为过期事件*/
+static ngx_int_t
+ngx_io_uring_poll_add(ngx_event_t *ev, ngx_fd_t fd, uint32_t events) {
+    struct io_uring_sqe *sqe;
+
+    sqe = ngx_io_uring_get_sqe(&ring, ev->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    ev->index = (ev->index + 1) & NGX_IO_URING_GEN_MASK;
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = events;
+    sqe->user_data = ngx_io_uring_user_data(ev);
+
+    ev->active = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags) {
+    uint32_t events;
+    ngx_connection_t *c;
+
+    if (ev->active) {
+        return NGX_OK;
+    }
+
+    c = ev->data;
+
+    events = (event == NGX_READ_EVENT) ? POLLIN : POLLOUT;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring add event: fd:%d ev:%04XD gen:%ui",
+                   c->fd, events, (ev->index + 1) & NGX_IO_URING_GEN_MASK);
+
+    if (ngx_io_uring_poll_add(ev, c->fd, events) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    ev->oneshot = 1;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags) {
+    ngx_connection_t *c;
+    struct io_uring_sqe *sqe;
+
+    /*
+     * 与epoll不同,未完成的poll请求持有文件的引用,即使描述符马上
+     * 就要被关闭,也必须显式地删除poll请求
+     */
+
+    if (ev->active) {
+        c = ev->data;
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "io_uring del event: fd:%d gen:%ui",
+                       c->fd, ev->index & NGX_IO_URING_GEN_MASK);
+
+        sqe = ngx_io_uring_get_sqe(&ring, ev->log);
+        if (sqe == NULL) {
+            return NGX_ERROR;
+        }
+
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->fd = -1;
+        sqe->addr = ngx_io_uring_user_data(ev);
+        sqe->user_data = 0;
+
+        ev->index = (ev->index + 1) & NGX_IO_URING_GEN_MASK;
+    }
+
+    ev->active = 0;
+    ev->oneshot = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_notify(ngx_event_handler_pt handler) {
+    static uint64_t inc = 1;
+
+    notify_event.data = handler;
+
+    if ((size_t) write(notify_fd, &inc, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        ngx_log_error(NGX_LOG_ALERT, notify_event.log, ngx_errno,
+                      "write() to eventfd %d failed", notify_fd);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
+                            ngx_uint_t flags) {
+    int32_t res;
+    uint32_t head, tail;
+    uint64_t data;
+    ngx_int_t instance;
+    ngx_uint_t level, gen;
+    ngx_err_t err;
+    ngx_event_t *ev;
+    ngx_queue_t *queue;
+    struct io_uring_cqe *cqe;
+#if (NGX_HAVE_IO_URING_AIO)
+    ngx_event_aio_t *aio;
+#endif
+
+    /* NGX_TIMER_INFINITE == INFTIM */
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring timer: %M", timer);
+
+    /*
+     * 提交本轮循环中积累的所有poll添加/删除请求,同时等待至少一个完成事件,
+     * 整个过程只需要一次io_uring_enter()系统调用
+     */
+
+    /* 内核暂存的溢出完成事件在下一次io_uring_enter()时放回完成队列 */
+
+    if (ngx_io_uring_cq_ready(&ring) || ngx_io_uring_cq_overflow(&ring)) {
+        timer = 0;
+    }
+
+    err = (ngx_io_uring_enter(&ring, 1, timer) == NGX_ERROR)
+          ? ngx_errno : 0;
+
+    if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm) {
+        ngx_time_update();
+    }
+
+    if (err) {
+        if (err == NGX_EINTR) {
+
+            if (ngx_event_timer_alarm) {
+                ngx_event_timer_alarm = 0;
+                return NGX_OK;
+            }
+
+            level = NGX_LOG_INFO;
+
+        } else {
+            level = NGX_LOG_ALERT;
+        }
+
+        ngx_log_error(level, cycle->log, err, "io_uring_enter() failed");
+        return NGX_ERROR;
+    }
+
+    head = *ring.cq_head;
+    tail = *ring.cq_tail;
+
+    ngx_memory_barrier();
+
+    if (head == tail) {
+        if (timer != NGX_TIMER_INFINITE) {
+            return NGX_OK;
+        }
+
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, 0,
+                      "io_uring_enter() returned no events without timeout");
+        return NGX_ERROR;
+    }
+
+    for ( /* void */ ; head != tail; head++) {
+
+        cqe = &ring.cqes[head & ring.cq_mask];
+
+        data = cqe->user_data;
+        res = cqe->res;
+
+        if (data == 0) {
+            /* poll删除请求或者超时请求的完成事件 */
+            continue;
+        }
+
+#if (NGX_HAVE_IO_URING_AIO)
+
+        if (data & NGX_IO_URING_AIO) {
+
+            /* 文件异步I/O完成,延后执行ngx_file_aio_event_handler */
+
+            ev = (ngx_event_t *) (uintptr_t) (data & ~NGX_IO_URING_AIO);
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring: aio ev:%p res:%d", ev, res);
+
+            ev->complete = 1;
+            ev->active = 0;
+            ev->ready = 1;
+
+            aio = ev->data;
+            aio->res = res;
+
+            ngx_post_event(ev, &ngx_posted_events);
+            continue;
+        }
+
+#endif
+
+        instance = (ngx_int_t) (data & 1);
+        gen = (ngx_uint_t) (data >> NGX_IO_URING_GEN_SHIFT);
+        ev = (ngx_event_t *) (uintptr_t) (data & NGX_IO_URING_PTR_MASK);
+
+        if (ev->closed || ev->instance != instance || !ev->active
+            || (ev->index & NGX_IO_URING_GEN_MASK) != gen) {
+
+            /*
+             * 过期事件:描述符已在本轮循环中被关闭,
+             * 或者poll请求已经被删除或替换
+             */
+
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring: stale event %p", ev);
+            continue;
+        }
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "io_uring: ev:%p res:%d gen:%ui", ev, res, gen);
+
+        ev->active = 0;
+
+        if (ev == &notify_event) {
+            ev->handler(ev);
+            continue;
+        }
+
+        if (res < 0) {
+
+            /*
+             * poll请求失败时,仍然调用事件的handler,
+             * 由其中的读写操作得到具体的错误
+             */
+
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, -res,
+                           "io_uring poll failed, ev:%p", ev);
+        }
+
+        ev->ready = 1;
+
+        if (!ev->write) {
+            ev->available = -1;
+        }
+
+#if (NGX_THREADS)
+        else {
+            ev->complete = 1;
+        }
+#endif
+
+        if (flags & NGX_POST_EVENTS) {
+            queue = ev->accept ? &ngx_posted_accept_events
+                               : &ngx_posted_events;
+
+            ngx_post_event(ev, queue);
+
+        } else {
+            ev->handler(ev);
+
+            if (ev->closed || ev->instance != instance) {
+                continue;
+            }
+        }
+
+        if (ev->accept) {
+            if (ngx_use_accept_mutex) {
+                ngx_accept_events = 1;
+                continue;
+            }
+
+            if (ngx_io_uring_add_event(ev, NGX_READ_EVENT, 0) == NGX_ERROR) {
+                ngx_memory_barrier();
+                *ring.cq_head = head + 1;
+                return NGX_ERROR;
+            }
+        }
+    }
+
+    ngx_memory_barrier();
+
+    *ring.cq_head = tail;
+
+    if (ngx_io_uring_cq_overflow(&ring)) {
+        ngx_log_error(NGX_LOG_WARN, cycle->log, 0,
+                      "io_uring completion queue of %uD entries overflowed",
+                      ring.cq_entries);
+    }
+
+    return NGX_OK;
+}
+
+
+static void *
+ngx_io_uring_create_conf(ngx_cycle_t *cycle) {
+    ngx_io_uring_conf_t *urcf;
+
+    urcf = ngx_palloc(cycle->pool, sizeof(ngx_io_uring_conf_t));
+    if (urcf == NULL) {
+        return NULL;
+    }
+
+    urcf->entries = NGX_CONF_UNSET;
+
+    return urcf;
+}
+
+
+static char *
+ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf) {
+    ngx_io_uring_conf_t *urcf = conf;
+
+    ngx_conf_init_uint_value(urcf->entries, 512);
+
+    return NGX_CONF_OK;
+}
@@ -26,6 +26,12 @@ static ngx_int_t ngx_event_module_init(ngx_cycle_t *cycle);
 
 static ngx_int_t ngx_event_process_init(ngx_cycle_t *cycle);
 
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+static void ngx_event_incoming_cpu(ngx_cycle_t *cycle, ngx_listening_t *ls);
+
+static ngx_int_t ngx_event_worker_cpu(ngx_uint_t worker);
+#endif
+
 static char *ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
 static char *ngx_event_connections(ngx_conf_t *cf, ngx_command_t *cmd,
@@ -208,6 +214,14 @@ static ngx_command_t ngx_event_core_commands[] = {
          0,
          offsetof(ngx_event_conf_t, accept_mutex_delay),
          NULL},
+        /*timer_wheel on|off,定时器较多时用分层时间轮代替红黑树,添加和删除定时器都是O(1)的,
+        超时事件在ngx_event_expire_timers中惰性地处理*/
+        {ngx_string("timer_wheel"),
+         NGX_EVENT_CONF | NGX_CONF_FLAG,
+         ngx_conf_set_flag_slot,
+         0,
+         offsetof(ngx_event_conf_t, timer_wheel),
+         NULL},
         /*debug_connection 1.2.2.2则在收到该IP地址请求的时候,使用debug级别打印.其他的还是沿用error_log中的设置
         需要对来自指定IP的TCP连接打印debug级别的调斌日志*/
         {ngx_string("debug_connection"),
@@ -707,6 +721,7 @@ ngx_event_module_init(ngx_cycle_t *cycle) {
     shm.size = size;
     ngx_str_set(&shm.name, "nginx_shared_zone");
     shm.log = cycle->log;
+    shm.hugepages = NGX_SHM_HUGEPAGES_OFF;
     //开辟一块共享内存,共享内存的大小为shm.size
     if (ngx_shm_alloc(&shm) != NGX_OK) {
         return NGX_ERROR;
@@ -814,6 +829,7 @@ ngx_event_process_init(ngx_cycle_t *cycle) {
     ngx_queue_init(&ngx_posted_accept_events);
     ngx_queue_init(&ngx_posted_next_events);
     ngx_queue_init(&ngx_posted_events);
+    ngx_event_timer_wheel = ecf->timer_wheel;
     //初始化红黑树实现的定时器.
     if (ngx_event_timer_init(cycle->log) == NGX_ERROR) {
         return NGX_ERROR;
@@ -963,6 +979,13 @@ ngx_event_process_init(ngx_cycle_t *cycle) {
         }
 #endif
 
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+        if (ls[i].incoming_cpu && ls[i].reuseport
+            && ngx_process == NGX_PROCESS_WORKER) {
+            ngx_event_incoming_cpu(cycle, &ls[i]);
+        }
+#endif
+
         c = ngx_get_connection(ls[i].fd, cycle->log); //从连接池中获取一个ngx_connection_t
 
         if (c == NULL) {
@@ -1127,6 +1150,144 @@ ngx_send_lowat(ngx_connection_t *c, size_t lowat) {
 }
 
 
+
+#if (NGX_HAVE_REUSEPORT_CBPF && NGX_HAVE_CPU_AFFINITY)
+
+/*
+listen ... reuseport incoming_cpu:当前worker的套接字设置SO_INCOMING_CPU,worker 0再给整个reuseport组
+挂上cBPF程序,按处理软中断的CPU选择绑定在这个CPU上的worker的套接字,使网卡队列、软中断和worker在同一个核上.
+
+cBPF返回的是组内套接字的下标,这里假定下标就是worker的序号:
+  - 内核按listen()的顺序把套接字加入组,ngx_open_listening_sockets按worker的顺序打开ngx_clone_listening
+    复制出的套接字;
+  - reload时ngx_init_cycle按顺序把旧套接字配给同一序号的worker,worker_processes变多时新套接字排在
+    组的末尾,变少时关掉的也是末尾的套接字,内核把最后一个套接字移到空位,不影响前面的顺序;
+  - 每次reload新的worker 0都按新的worker数重新挂程序,去掉incoming_cpu时master摘掉程序,
+    见ngx_configure_listening_sockets.
+这个假定不成立的情况:其他进程(例如另一个nginx实例)也用SO_REUSEPORT监听了同一个地址,它的
+套接字混在同一个组里,下标和worker不再对应,连接可能被分给那个进程.incoming_cpu只用于本实例独占的地址
+*/
+static void
+ngx_event_incoming_cpu(ngx_cycle_t *cycle, ngx_listening_t *ls) {
+    int cpu;
+    ngx_int_t n;
+    ngx_uint_t i, k, nworkers;
+    ngx_core_conf_t *ccf;
+    struct sock_fprog prog;
+    struct sock_filter *code;
+
+    n = ngx_event_worker_cpu(ngx_worker);
+
+    if (n != NGX_ERROR) {
+        cpu = (int) n;
+
+        if (setsockopt(ls->fd, SOL_SOCKET, SO_INCOMING_CPU,
+                       (const void *) &cpu, sizeof(int)) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                          "setsockopt(SO_INCOMING_CPU, %d) %V failed, ignored",
+                          cpu, &ls->addr_text);
+        }
+    }
+
+    if (ngx_worker != 0) {
+        return;
+    }
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    nworkers = ccf->worker_processes;
+
+    code = ngx_alloc((2 * nworkers + 2) * sizeof(struct sock_filter),
+                     cycle->log);
+    if (code == NULL) {
+        return;
+    }
+
+    k = 0;
+
+    code[k++] = (struct sock_filter)
+                BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_CPU);
+
+    /* 每个worker都只绑定一个CPU时按CPU查表,跳转偏移只有8位 */
+
+    i = 0;
+
+    if (nworkers <= 255) {
+        for ( /* void */ ; i < nworkers; i++) {
+            n = ngx_event_worker_cpu(i);
+
+            if (n == NGX_ERROR) {
+                break;
+            }
+
+            code[k++] = (struct sock_filter)
+                        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, n, nworkers, 0);
+        }
+    }
+
+    if (i == nworkers) {
+
+        /* 没有worker绑定在这个CPU上,返回无效的下标,由内核按哈希选择 */
+
+        code[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, 0xffffffff);
+
+        for (i = 0; i < nworkers; i++) {
+            code[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_K, i);
+        }
+
+    } else {
+
+        /* 没有配置worker_cpu_affinity,按CPU编号对worker数量取模 */
+
+        k = 1;
+
+        code[k++] = (struct sock_filter)
+                    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, nworkers);
+        code[k++] = (struct sock_filter) BPF_STMT(BPF_RET | BPF_A, 0);
+    }
+
+    prog.len = (unsigned short) k;
+    prog.filter = code;
+
+    if (setsockopt(ls->fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                   (const void *) &prog, sizeof(struct sock_fprog)) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                      "setsockopt(SO_ATTACH_REUSEPORT_CBPF) %V failed, ignored",
+                      &ls->addr_text);
+
+    } else {
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "incoming_cpu %V: %s, %ui workers", &ls->addr_text,
+                       k > 3 ? "cpu table" : "cpu modulo", nworkers);
+    }
+
+    ngx_free(code);
+}
+
+
+/* worker只绑定在一个CPU上时返回这个CPU */
+static ngx_int_t
+ngx_event_worker_cpu(ngx_uint_t worker) {
+    ngx_int_t cpu;
+    ngx_cpuset_t *mask;
+
+    mask = ngx_get_cpu_affinity(worker);
+
+    if (mask == NULL || CPU_COUNT(mask) != 1) {
+        return NGX_ERROR;
+    }
+
+    for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, mask)) {
+            return cpu;
+        }
+    }
+
+    return NGX_ERROR;
+}
+
+#endif
+
 static char *
 ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     char *rv;
@@ -1408,6 +1569,7 @@ ngx_event_core_create_conf(ngx_cycle_t *cycle) {
     ecf->multi_accept = NGX_CONF_UNSET;
     ecf->accept_mutex = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
+    ecf->timer_wheel = NGX_CONF_UNSET;
     ecf->name = (void *) NGX_CONF_UNSET;
 
 #if (NGX_DEBUG)
@@ -1505,6 +1667,7 @@ ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf) {
     ngx_conf_init_value(ecf->multi_accept, 0);
     ngx_conf_init_value(ecf->accept_mutex, 0);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
+    ngx_conf_init_value(ecf->timer_wheel, 0);
 
     return NGX_CONF_OK;
 }
@@ -245,7 +245,11 @@ struct ngx_event_aio_s { //ngx_file_aio_init中初始化,创建空间和赋值
     size_t                     nbytes;
 #endif
 
+#if (NGX_HAVE_IO_URING_AIO)
+    ngx_iovec_t                vec; //io_uring写文件时的iovec数组,见ngx_file_aio_write_chain
+#else
     ngx_aiocb_t                aiocb;
+#endif
     //如果是文件异步i/o中的ngx_event_aio_t,则它来自ngx_event_aio_t->ngx_event_t(只有读),如果是网络事件中的event,则为ngx_connection_s中的event(包括读和写)
     ngx_event_t                event; //只是异步i/o读事件
 };
@@ -365,7 +369,7 @@ extern ngx_uint_t ngx_use_epoll_rdhup;
 
 /*
  * All event filters on file descriptor are deleted after a notification:
- * Solaris 10's event ports.
+ * Solaris 10's event ports, Linux io_uring poll requests.
  */
 #define NGX_USE_EVENTPORT_EVENT  0x00001000
 
@@ -564,6 +568,8 @@ typedef struct {
 
     u_char       *name;//所选用事件模块的名字,它与use成员是匹配的:如epoll select
 
+    ngx_flag_t    timer_wheel; //timer_wheel on,用分层时间轮代替红黑树保存定时器
+
 /*在-with-debug编译模式下,可以仅针对某些客户端建立的连接输出调试级别的日志,而debug_connection数组用于保存这些客户端的地址信息*/
 
 #if (NGX_DEBUG)
@@ -636,6 +642,9 @@ void ngx_event_accept(ngx_event_t *ev);
 
 #if !(NGX_WIN32)
 
+/* listen ... udp batch=N中N的最大值,也是一次sendmmsg()发送的最大数据报个数 */
+#define NGX_UDP_BATCH_MAX  64
+
 void ngx_event_recvmsg(ngx_event_t *ev);
 
 void ngx_udp_rbtree_insert_value(ngx_rbtree_node_t *temp,
@@ -21,6 +21,9 @@ static ngx_inline void ngx_event_pipe_remove_shadow_links(ngx_buf_t *buf);
 
 static ngx_int_t ngx_event_pipe_drain_chains(ngx_event_pipe_t *p);
 
+static ssize_t ngx_event_pipe_write_temp_file(ngx_event_pipe_t *p,
+                                              ngx_chain_t *out);
+
 /*在有buffering的时候,使用event_pipe进行数据的转发,调用ngx_event_pipe_write_to_downstream函数读取数据,或者发送数据给客户端.
 ngx_event_pipe将upstream响应发送回客户端.do_write代表是否要往客户端发送,写数据.
 如果设置了,那么会先发给客户端,再读upstream数据,当然,如果读取了数据,也会调用这里的*/
@@ -132,7 +135,7 @@ ngx_event_pipe_read_upstream(ngx_event_pipe_t *p) { //ngx_event_pipe_write_to_do
         return NGX_OK;
     }
 
-#if (NGX_THREADS)
+#if (NGX_THREADS || NGX_HAVE_FILE_AIO_WRITE)
 
         if (p->aio) {
             ngx_log_debug0(NGX_LOG_DEBUG_EVENT, p->log, 0,
@@ -569,7 +572,7 @@ ngx_event_pipe_write_to_downstream(ngx_event_pipe_t *p) { //ngx_event_pipe调用
     ngx_log_debug1(NGX_LOG_DEBUG_EVENT, p->log, 0,
                    "pipe write downstream: %d", downstream->write->ready);
 
-#if (NGX_THREADS)
+#if (NGX_THREADS || NGX_HAVE_FILE_AIO_WRITE)
 
     if (p->writing) {
         rc = ngx_event_pipe_write_chain_to_temp_file(p);
@@ -965,7 +968,7 @@ ngx_event_pipe_write_chain_to_temp_file(ngx_event_pipe_t *p) {
     ngx_uint_t prev_last_shadow;
     ngx_chain_t *cl, *tl, *next, *out, **ll, **last_out, **last_free;
 
-#if (NGX_THREADS)
+#if (NGX_THREADS || NGX_HAVE_FILE_AIO_WRITE)
 
     if (p->writing) {
 
@@ -976,7 +979,7 @@ ngx_event_pipe_write_chain_to_temp_file(ngx_event_pipe_t *p) {
         out = p->writing;
         p->writing = NULL;
 
-        n = ngx_write_chain_to_temp_file(p->temp_file, NULL);
+        n = ngx_event_pipe_write_temp_file(p, NULL);
 
         if (n == NGX_ERROR) {
             return NGX_ABORT;
@@ -1061,18 +1064,23 @@ ngx_event_pipe_write_chain_to_temp_file(ngx_event_pipe_t *p) {
         p->temp_file->file.thread_ctx = p->thread_ctx;
     }
 #endif
+
     //创建临时文件并写入
-    n = ngx_write_chain_to_temp_file(p->temp_file, out);
+    n = ngx_event_pipe_write_temp_file(p, out);
 
     if (n == NGX_ERROR) {
         return NGX_ABORT;
     }
 
-#if (NGX_THREADS)
+#if (NGX_THREADS || NGX_HAVE_FILE_AIO_WRITE)
 
     if (n == NGX_AGAIN) {
         p->writing = out;
+
+#if (NGX_THREADS)
         p->thread_task = p->temp_file->file.thread_task;
+#endif
+
         return NGX_AGAIN;
     }
 
@@ -1173,6 +1181,41 @@ done:
 }
 
 
+static ssize_t
+ngx_event_pipe_write_temp_file(ngx_event_pipe_t *p, ngx_chain_t *out) {
+#if (NGX_HAVE_FILE_AIO_WRITE)
+    ssize_t n;
+    ngx_event_aio_t *aio;
+
+    if (p->aio_handler) {
+
+        /*
+         * 临时文件同时会被ngx_output_chain通过aio读取并发送给客户端,
+         * 读写各自使用一个ngx_event_aio_t,类似ngx_output_chain中thread_task的处理
+         */
+
+        p->temp_file->aio_write = 1;
+
+        aio = p->temp_file->file.aio;
+        p->temp_file->file.aio = p->write_aio;
+
+        n = ngx_write_chain_to_temp_file(p->temp_file, out);
+
+        p->write_aio = p->temp_file->file.aio;
+        p->temp_file->file.aio = aio;
+
+        if (n == NGX_AGAIN) {
+            p->aio_handler(p, p->write_aio);
+        }
+
+        return n;
+    }
+#endif
+
+    return ngx_write_chain_to_temp_file(p->temp_file, out);
+}
+
+
 /* the copy input filter */
 
 ngx_int_t
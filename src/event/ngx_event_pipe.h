@@ -101,6 +101,13 @@ struct ngx_event_pipe_s { //ngx_http_XXX_handler(ngx_http_fastcgi_handler)中创
     ngx_thread_task_t                *thread_task;
 #endif
 
+#if (NGX_HAVE_FILE_AIO_WRITE || NGX_COMPAT)
+    //aio on时异步写临时文件,提交后调用,如ngx_http_upstream_aio_handler
+    void                            (*aio_handler)(ngx_event_pipe_t *p,
+                                                   ngx_event_aio_t *aio);
+    ngx_event_aio_t                  *write_aio;
+#endif
+
     // 1:表示当前已读取到上游的响应  也就是有读到后端服务器的包体
     unsigned           read:1; //只要从n = p->upstream->recv_chain()有读到数据,也就是n大于0,则read=1;
     unsigned           cacheable:1; // 1:启用文件缓存 p->cacheable = u->cacheable || u->store;
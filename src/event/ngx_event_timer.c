@@ -57,18 +57,90 @@ ngx_rbtree_t ngx_event_timer_rbtree;
 static ngx_rbtree_node_t ngx_event_timer_sentinel;
 //哨兵节点是所有最下层的叶子节点都指向一个NULL空节点,图形化参考:http://blog.csdn.net/xzongyuan/article/details/22389185
 
+ngx_uint_t ngx_event_timer_wheel; //赋值见ngx_event_process_init
+
 /*
  * the event timer rbtree may contain the duplicate keys, however,
  * it should not be a problem, because we use the rbtree to find
  * a minimum timer value only
  */
 
+/*
+ * 分层时间轮(timer_wheel on):共NGX_TIMER_WHEEL_LEVELS层,每层64个槽,第0层每个槽
+ * 对应1ms,第n层每个槽对应64^n ms.定时器按超时时间与curr的差值放入对应的层,
+ * 添加和删除都是O(1)的双向链表操作.较高层的槽在到期时才整体下移到低层(cascade),
+ * 即超时事件被惰性地处理,只有第0层的槽中保存的是真正需要触发的定时器.
+ *
+ * 复用ngx_event_t中的timer节点:left/right为链表的前后节点,parent指向所在的槽
+ */
+
+#define NGX_TIMER_WHEEL_BITS    6
+#define NGX_TIMER_WHEEL_SLOTS   (1 << NGX_TIMER_WHEEL_BITS)
+#define NGX_TIMER_WHEEL_MASK    (NGX_TIMER_WHEEL_SLOTS - 1)
+#define NGX_TIMER_WHEEL_LEVELS  6
+
+/* 时间轮能够直接表示的最大时长,约795天,更远的定时器先放在最高层 */
+#define NGX_TIMER_WHEEL_RANGE                                                 \
+    ((uint64_t) 1 << (NGX_TIMER_WHEEL_BITS * NGX_TIMER_WHEEL_LEVELS))
+
+
+typedef struct {
+    ngx_msec_t curr; //下一个还没有处理过的时刻,在它之前的槽都已经处理完毕
+    ngx_uint_t count; //时间轮中定时器的总数
+    uint64_t bitmap[NGX_TIMER_WHEEL_LEVELS]; //每层中非空的槽
+    ngx_rbtree_node_t expired; //添加时已经超时的定时器
+    ngx_rbtree_node_t slots[NGX_TIMER_WHEEL_LEVELS][NGX_TIMER_WHEEL_SLOTS];
+} ngx_event_timer_wheel_t;
+
+
+static ngx_event_timer_wheel_t ngx_timer_wheel;
+
+
+static void ngx_event_timer_wheel_link(ngx_rbtree_node_t *node);
+
+static void ngx_event_timer_wheel_unlink(ngx_rbtree_node_t *node);
+
+static void ngx_event_timer_wheel_splice(ngx_rbtree_node_t *head,
+                                         ngx_rbtree_node_t *list);
+
+static void ngx_event_timer_wheel_cascade(ngx_msec_t tick);
+
+static ngx_msec_t ngx_event_timer_wheel_next(void);
+
+static void ngx_event_timer_wheel_expire(ngx_rbtree_node_t *list);
+
+
 //初始化红黑树实现的定时器.
 ngx_int_t
 ngx_event_timer_init(ngx_log_t *log) {
+    ngx_uint_t i, n;
+    ngx_rbtree_node_t *head;
+
     ngx_rbtree_init(&ngx_event_timer_rbtree, &ngx_event_timer_sentinel,
                     ngx_rbtree_insert_timer_value);
 
+    if (!ngx_event_timer_wheel) {
+        return NGX_OK;
+    }
+
+    ngx_memzero(&ngx_timer_wheel, sizeof(ngx_event_timer_wheel_t));
+
+    ngx_timer_wheel.curr = ngx_current_msec;
+
+    ngx_timer_wheel.expired.left = &ngx_timer_wheel.expired;
+    ngx_timer_wheel.expired.right = &ngx_timer_wheel.expired;
+
+    for (i = 0; i < NGX_TIMER_WHEEL_LEVELS; i++) {
+        for (n = 0; n < NGX_TIMER_WHEEL_SLOTS; n++) {
+            head = &ngx_timer_wheel.slots[i][n];
+            head->left = head;
+            head->right = head;
+        }
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "event timer wheel, levels:%d", NGX_TIMER_WHEEL_LEVELS);
+
     return NGX_OK;
 }
 
@@ -78,6 +150,23 @@ ngx_event_find_timer(void) {
     ngx_msec_int_t timer;
     ngx_rbtree_node_t *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        if (ngx_timer_wheel.count == 0) {
+            return NGX_TIMER_INFINITE;
+        }
+
+        if (ngx_timer_wheel.expired.right != &ngx_timer_wheel.expired) {
+            return 0;
+        }
+
+        /* 对于高层的槽返回的是cascade的时刻,它不会晚于其中任何一个定时器的超时时间 */
+
+        timer = (ngx_msec_int_t) (ngx_event_timer_wheel_next()
+                                  - ngx_current_msec);
+
+        return (ngx_msec_t) (timer > 0 ? timer : 0);
+    }
+
     if (ngx_event_timer_rbtree.root == &ngx_event_timer_sentinel) {
         return NGX_TIMER_INFINITE;
     }
@@ -95,8 +184,46 @@ ngx_event_find_timer(void) {
 
 void
 ngx_event_expire_timers(void) {
+    ngx_msec_t tick;
     ngx_event_t *ev;
-    ngx_rbtree_node_t *node, *root, *sentinel;
+    ngx_rbtree_node_t *node, *root, *sentinel, list;
+
+    if (ngx_event_timer_wheel) {
+
+        for (;;) {
+            ngx_event_timer_wheel_expire(&ngx_timer_wheel.expired);
+
+            if (ngx_timer_wheel.count == 0) {
+                return;
+            }
+
+            /* 直接跳到下一个有定时器需要处理的时刻,中间的槽都是空的 */
+
+            tick = ngx_event_timer_wheel_next();
+
+            if ((ngx_msec_int_t) (tick - ngx_current_msec) > 0) {
+                return;
+            }
+
+            ngx_timer_wheel.curr = tick;
+
+            if ((tick & NGX_TIMER_WHEEL_MASK) == 0) {
+                ngx_event_timer_wheel_cascade(tick);
+            }
+
+            /*
+             * 先把槽中的定时器整体取出再推进curr,handler中新添加的定时器
+             * 不会进入正在处理的链表
+             */
+
+            ngx_event_timer_wheel_splice(
+                &ngx_timer_wheel.slots[0][tick & NGX_TIMER_WHEEL_MASK], &list);
+
+            ngx_timer_wheel.curr = tick + 1;
+
+            ngx_event_timer_wheel_expire(&list);
+        }
+    }
 
     sentinel = ngx_event_timer_rbtree.sentinel;
 
@@ -140,8 +267,40 @@ ngx_event_expire_timers(void) {
 
 ngx_int_t
 ngx_event_no_timers_left(void) {
+    uint64_t bits;
+    ngx_uint_t i, n;
     ngx_event_t *ev;
-    ngx_rbtree_node_t *node, *root, *sentinel;
+    ngx_rbtree_node_t *node, *root, *sentinel, *head;
+
+    if (ngx_event_timer_wheel) {
+
+        for (i = 0; i <= NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SLOTS; i++) {
+
+            if (i == NGX_TIMER_WHEEL_LEVELS * NGX_TIMER_WHEEL_SLOTS) {
+                head = &ngx_timer_wheel.expired;
+
+            } else {
+                bits = ngx_timer_wheel.bitmap[i / NGX_TIMER_WHEEL_SLOTS];
+                n = i % NGX_TIMER_WHEEL_SLOTS;
+
+                if (!(bits & ((uint64_t) 1 << n))) {
+                    continue;
+                }
+
+                head = &ngx_timer_wheel.slots[i / NGX_TIMER_WHEEL_SLOTS][n];
+            }
+
+            for (node = head->right; node != head; node = node->right) {
+                ev = ngx_rbtree_data(node, ngx_event_t, timer);
+
+                if (!ev->cancelable) {
+                    return NGX_AGAIN;
+                }
+            }
+        }
+
+        return NGX_OK;
+    }
 
     sentinel = ngx_event_timer_rbtree.sentinel;
     root = ngx_event_timer_rbtree.root;
@@ -164,3 +323,235 @@ ngx_event_no_timers_left(void) {
 
     return NGX_OK;
 }
+
+
+void
+ngx_event_timer_wheel_add(ngx_rbtree_node_t *node) {
+    /* 时间轮为空时curr可能已经落后很多,直接移到当前时间 */
+
+    if (ngx_timer_wheel.count == 0
+        && (ngx_msec_int_t) (ngx_current_msec - ngx_timer_wheel.curr) > 0) {
+        ngx_timer_wheel.curr = ngx_current_msec;
+    }
+
+    ngx_timer_wheel.count++;
+
+    ngx_event_timer_wheel_link(node);
+}
+
+
+void
+ngx_event_timer_wheel_del(ngx_rbtree_node_t *node) {
+    ngx_event_timer_wheel_unlink(node);
+
+    ngx_timer_wheel.count--;
+}
+
+
+static void
+ngx_event_timer_wheel_link(ngx_rbtree_node_t *node) {
+    ngx_msec_t key;
+    ngx_uint_t level, slot;
+    ngx_msec_int_t delta;
+    ngx_rbtree_node_t *head;
+
+    key = node->key;
+    delta = (ngx_msec_int_t) (key - ngx_timer_wheel.curr);
+
+    if (delta < 0) {
+        head = &ngx_timer_wheel.expired;
+
+    } else {
+        if ((uint64_t) delta >= NGX_TIMER_WHEEL_RANGE) {
+            key = ngx_timer_wheel.curr
+                  + (ngx_msec_t) (NGX_TIMER_WHEEL_RANGE - 1);
+            delta = (ngx_msec_int_t) (NGX_TIMER_WHEEL_RANGE - 1);
+        }
+
+        for (level = 0; level < NGX_TIMER_WHEEL_LEVELS - 1; level++) {
+            if ((uint64_t) delta
+                < ((uint64_t) 1 << (NGX_TIMER_WHEEL_BITS * (level + 1)))) {
+                break;
+            }
+        }
+
+        slot = (key >> (NGX_TIMER_WHEEL_BITS * level)) & NGX_TIMER_WHEEL_MASK;
+
+        head = &ngx_timer_wheel.slots[level][slot];
+
+        ngx_timer_wheel.bitmap[level] |= (uint64_t) 1 << slot;
+    }
+
+    /* 插入到链表尾部,同一个槽中的定时器按添加的顺序触发 */
+
+    node->parent = head;
+    node->right = head;
+    node->left = head->left;
+    head->left->right = node;
+    head->left = node;
+}
+
+
+static void
+ngx_event_timer_wheel_unlink(ngx_rbtree_node_t *node) {
+    ngx_uint_t n;
+    ngx_rbtree_node_t *head;
+
+    head = node->parent;
+
+    node->left->right = node->right;
+    node->right->left = node->left;
+
+    if (head->right == head && head != &ngx_timer_wheel.expired) {
+        n = head - &ngx_timer_wheel.slots[0][0];
+
+        ngx_timer_wheel.bitmap[n / NGX_TIMER_WHEEL_SLOTS] &=
+                ~((uint64_t) 1 << (n % NGX_TIMER_WHEEL_SLOTS));
+    }
+}
+
+/*
+把槽中的所有定时器移到list链表中,槽变为空.list中节点的parent仍指向原来的槽,
+这时删除其中的定时器只会修改list中的指针
+*/
+static void
+ngx_event_timer_wheel_splice(ngx_rbtree_node_t *head, ngx_rbtree_node_t *list) {
+    ngx_uint_t n;
+
+    if (head->right == head) {
+        list->left = list;
+        list->right = list;
+        return;
+    }
+
+    list->left = head->left;
+    list->right = head->right;
+    list->left->right = list;
+    list->right->left = list;
+
+    head->left = head;
+    head->right = head;
+
+    if (head != &ngx_timer_wheel.expired) {
+        n = head - &ngx_timer_wheel.slots[0][0];
+
+        ngx_timer_wheel.bitmap[n / NGX_TIMER_WHEEL_SLOTS] &=
+                ~((uint64_t) 1 << (n % NGX_TIMER_WHEEL_SLOTS));
+    }
+}
+
+/*
+tick为64的整数倍时,把第1层对应槽中的定时器按超时时间重新放入低层;如果该槽的序号为0,
+说明高一层也转过了一格,继续处理上一层
+*/
+static void
+ngx_event_timer_wheel_cascade(ngx_msec_t tick) {
+    ngx_uint_t level, slot;
+    ngx_rbtree_node_t *node, list;
+
+    for (level = 1; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+        slot = (tick >> (NGX_TIMER_WHEEL_BITS * level)) & NGX_TIMER_WHEEL_MASK;
+
+        ngx_event_timer_wheel_splice(&ngx_timer_wheel.slots[level][slot],
+                                     &list);
+
+        while (list.right != &list) {
+            node = list.right;
+
+            list.right = node->right;
+            node->right->left = &list;
+
+            ngx_event_timer_wheel_link(node);
+        }
+
+        if (slot != 0) {
+            break;
+        }
+    }
+}
+
+/*
+返回下一个需要处理的时刻:第0层为最近的非空槽对应的时刻,高层为最近的非空槽需要
+cascade的时刻,取其中最早的一个
+*/
+static ngx_msec_t
+ngx_event_timer_wheel_next(void) {
+    uint64_t bits;
+    ngx_uint_t level, shift, slot, n;
+    ngx_msec_t unit, base, tick, next, min;
+
+    next = ngx_timer_wheel.curr;
+    min = NGX_TIMER_INFINITE;
+
+    for (level = 0; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+        bits = ngx_timer_wheel.bitmap[level];
+
+        if (bits == 0) {
+            continue;
+        }
+
+        shift = NGX_TIMER_WHEEL_BITS * level;
+        unit = (ngx_msec_t) 1 << shift;
+
+        /* 第一个还没有转过的槽的起始时刻 */
+
+        base = (ngx_timer_wheel.curr + unit - 1) & ~(unit - 1);
+        slot = (base >> shift) & NGX_TIMER_WHEEL_MASK;
+
+        if (slot) {
+            bits = (bits >> slot) | (bits << (NGX_TIMER_WHEEL_SLOTS - slot));
+        }
+
+#if (NGX_HAVE_GCC_CTZ64)
+        n = __builtin_ctzll(bits);
+#else
+        for (n = 0; !(bits & 1); n++) {
+            bits >>= 1;
+        }
+#endif
+
+        tick = base + (ngx_msec_t) n * unit;
+
+        if (tick - ngx_timer_wheel.curr < min) {
+            min = tick - ngx_timer_wheel.curr;
+            next = tick;
+        }
+
+        if (min == 0) {
+            break;
+        }
+    }
+
+    return next;
+}
+
+
+static void
+ngx_event_timer_wheel_expire(ngx_rbtree_node_t *list) {
+    ngx_event_t *ev;
+    ngx_rbtree_node_t *node;
+
+    while (list->right != list) {
+        node = list->right;
+
+        ev = ngx_rbtree_data(node, ngx_event_t, timer);
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "event timer del: %d: %M",
+                       ngx_event_ident(ev->data), ev->timer.key);
+
+        ngx_event_timer_wheel_del(node);
+
+#if (NGX_DEBUG)
+        ev->timer.left = NULL;
+        ev->timer.right = NULL;
+        ev->timer.parent = NULL;
+#endif
+
+        ev->timer_set = 0;
+
+        ev->timedout = 1;
+
+        ev->handler(ev);
+    }
+}
@@ -27,8 +27,13 @@ void ngx_event_expire_timers(void);
 
 ngx_int_t ngx_event_no_timers_left(void);
 
+void ngx_event_timer_wheel_add(ngx_rbtree_node_t *node);
+
+void ngx_event_timer_wheel_del(ngx_rbtree_node_t *node);
+
 
 extern ngx_rbtree_t ngx_event_timer_rbtree;
+extern ngx_uint_t ngx_event_timer_wheel; //timer_wheel on时为1,定时器改用时间轮保存
 
 
 static ngx_inline void
@@ -37,7 +42,12 @@ ngx_event_del_timer(ngx_event_t *ev) {
                    "event timer del: %d: %M",
                    ngx_event_ident(ev->data), ev->timer.key);
 
-    ngx_rbtree_delete(&ngx_event_timer_rbtree, &ev->timer);
+    if (ngx_event_timer_wheel) {
+        ngx_event_timer_wheel_del(&ev->timer);
+
+    } else {
+        ngx_rbtree_delete(&ngx_event_timer_rbtree, &ev->timer);
+    }
 
 #if (NGX_DEBUG)
     ev->timer.left = NULL;
@@ -92,7 +102,12 @@ ngx_event_add_timer(ngx_event_t *ev, ngx_msec_t timer) {
                    "event timer add: %d: %M:%M",
                    ngx_event_ident(ev->data), timer, ev->timer.key);
 
-    ngx_rbtree_insert(&ngx_event_timer_rbtree, &ev->timer);
+    if (ngx_event_timer_wheel) {
+        ngx_event_timer_wheel_add(&ev->timer);
+
+    } else {
+        ngx_rbtree_insert(&ngx_event_timer_rbtree, &ev->timer);
+    }
 
     ev->timer_set = 1;
 }
@@ -19,6 +19,26 @@ struct ngx_udp_connection_s {
 };
 
 
+#define NGX_UDP_DATAGRAM_SIZE  65535
+
+/* 控制消息中除了目的地址外,还可能有UDP_GRO的段大小 */
+#if (NGX_HAVE_UDP_GRO)
+#define NGX_UDP_GRO_CMSG_SPACE  CMSG_SPACE(sizeof(int))
+#else
+#define NGX_UDP_GRO_CMSG_SPACE  0
+#endif
+
+
+#if (NGX_HAVE_MMSG)
+static void ngx_event_recvmmsg(ngx_event_t *ev);
+#endif
+
+static ngx_int_t ngx_event_udp_receive(ngx_event_t *ev, struct msghdr *msg,
+                                       u_char *buffer, ssize_t n);
+
+static ngx_int_t ngx_event_udp_dispatch(ngx_event_t *ev, struct msghdr *msg,
+                                        u_char *buffer, ssize_t n);
+
 static void ngx_close_accepted_udp_connection(ngx_connection_t *c);
 
 static ssize_t ngx_udp_shared_recv(ngx_connection_t *c, u_char *buf,
@@ -34,30 +54,27 @@ static ngx_connection_t *ngx_lookup_udp_connection(ngx_listening_t *ls,
 void
 ngx_event_recvmsg(ngx_event_t *ev) {
     ssize_t n;
-    ngx_buf_t buf;
-    ngx_log_t *log;
     ngx_err_t err;
-    socklen_t socklen, local_socklen;
-    ngx_event_t *rev, *wev;
     struct iovec iov[1];
     struct msghdr msg;
-    ngx_sockaddr_t sa, lsa;
-    struct sockaddr *sockaddr, *local_sockaddr;
+    ngx_sockaddr_t sa;
     ngx_listening_t *ls;
     ngx_event_conf_t *ecf;
-    ngx_connection_t *c, *lc;
-    static u_char buffer[65535];
+    ngx_connection_t *lc;
+    static u_char buffer[NGX_UDP_DATAGRAM_SIZE];
 
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
 
 #if (NGX_HAVE_IP_RECVDSTADDR)
     u_char             msg_control[CMSG_SPACE(sizeof(struct in_addr))];
 #elif (NGX_HAVE_IP_PKTINFO)
-    u_char msg_control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    u_char msg_control[CMSG_SPACE(sizeof(struct in_pktinfo))
+                       + NGX_UDP_GRO_CMSG_SPACE];
 #endif
 
 #if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
-    u_char msg_control6[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+    u_char msg_control6[CMSG_SPACE(sizeof(struct in6_pktinfo))
+                        + NGX_UDP_GRO_CMSG_SPACE];
 #endif
 
 #endif
@@ -83,6 +100,15 @@ ngx_event_recvmsg(ngx_event_t *ev) {
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "recvmsg on %V, ready: %d", &ls->addr_text, ev->available);
 
+#if (NGX_HAVE_MMSG)
+
+    if (ls->batch > 1) {
+        ngx_event_recvmmsg(ev);
+        return;
+    }
+
+#endif
+
     do {
         ngx_memzero(&msg, sizeof(struct msghdr));
 
@@ -96,7 +122,7 @@ ngx_event_recvmsg(ngx_event_t *ev) {
 
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
 
-        if (ls->wildcard) {
+        if (ls->wildcard || ls->gro) {
 
 #if (NGX_HAVE_IP_RECVDSTADDR || NGX_HAVE_IP_PKTINFO)
             if (ls->sockaddr->sa_family == AF_INET) {
@@ -131,296 +157,533 @@ ngx_event_recvmsg(ngx_event_t *ev) {
             return;
         }
 
-#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
-        if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
-            ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
-                          "recvmsg() truncated data");
+        switch (ngx_event_udp_receive(ev, &msg, buffer, n)) {
+
+        case NGX_ERROR:
+            return;
+
+        case NGX_DECLINED:
             continue;
         }
+
+        if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+            ev->available -= n;
+        }
+
+    } while (ev->available);
+}
+
+
+#if (NGX_HAVE_MMSG)
+
+/*
+listen ... udp batch=N时使用,一次recvmmsg()最多读取N个数据报,然后逐个按ngx_event_recvmsg
+的方式分发给对应的连接.multi_accept打开时一直读到套接字中没有数据为止
+*/
+static void
+ngx_event_recvmmsg(ngx_event_t *ev) {
+    int i, n;
+    ngx_int_t rc;
+    ngx_err_t err;
+    ngx_uint_t batch;
+    struct iovec iov[NGX_UDP_BATCH_MAX];
+    struct mmsghdr msgs[NGX_UDP_BATCH_MAX];
+    ngx_sockaddr_t sa[NGX_UDP_BATCH_MAX];
+    ngx_listening_t *ls;
+    ngx_connection_t *lc;
+    static u_char *buffers;
+    static ngx_uint_t nbuffers;
+
+#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
+
+#if (NGX_HAVE_IP_RECVDSTADDR)
+    u_char             msg_control[NGX_UDP_BATCH_MAX]
+                                  [CMSG_SPACE(sizeof(struct in_addr))];
+#elif (NGX_HAVE_IP_PKTINFO)
+    u_char msg_control[NGX_UDP_BATCH_MAX]
+                      [CMSG_SPACE(sizeof(struct in_pktinfo))
+                       + NGX_UDP_GRO_CMSG_SPACE];
 #endif
 
-        sockaddr = msg.msg_name;
-        socklen = msg.msg_namelen;
+#if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
+    u_char msg_control6[NGX_UDP_BATCH_MAX]
+                       [CMSG_SPACE(sizeof(struct in6_pktinfo))
+                        + NGX_UDP_GRO_CMSG_SPACE];
+#endif
+
+#endif
+
+    lc = ev->data;
+    ls = lc->listening;
+    batch = ls->batch;
+
+    /* 所有监听套接字共用接收缓冲区,数据报在下一次recvmmsg()之前都已经处理完毕 */
+
+    if (batch > nbuffers) {
+        if (buffers) {
+            ngx_free(buffers);
+        }
+
+        buffers = ngx_alloc(batch * NGX_UDP_DATAGRAM_SIZE, ev->log);
+        if (buffers == NULL) {
+            nbuffers = 0;
+            return;
+        }
+
+        nbuffers = batch;
+    }
+
+    do {
+        ngx_memzero(msgs, batch * sizeof(struct mmsghdr));
+
+        for (i = 0; i < (int) batch; i++) {
+            iov[i].iov_base = (void *) (buffers + i * NGX_UDP_DATAGRAM_SIZE);
+            iov[i].iov_len = NGX_UDP_DATAGRAM_SIZE;
+
+            msgs[i].msg_hdr.msg_name = &sa[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(ngx_sockaddr_t);
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+
+#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
+
+            if (ls->wildcard || ls->gro) {
+
+#if (NGX_HAVE_IP_RECVDSTADDR || NGX_HAVE_IP_PKTINFO)
+                if (ls->sockaddr->sa_family == AF_INET) {
+                    msgs[i].msg_hdr.msg_control = msg_control[i];
+                    msgs[i].msg_hdr.msg_controllen = sizeof(msg_control[i]);
+                }
+#endif
+
+#if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
+                if (ls->sockaddr->sa_family == AF_INET6) {
+                    msgs[i].msg_hdr.msg_control = msg_control6[i];
+                    msgs[i].msg_hdr.msg_controllen = sizeof(msg_control6[i]);
+                }
+#endif
+            }
+
+#endif
+        }
+
+        n = recvmmsg(lc->fd, msgs, batch, 0, NULL);
+
+        if (n == -1) {
+            err = ngx_socket_errno;
+
+            if (err == NGX_EAGAIN) {
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, err,
+                               "recvmmsg() not ready");
+                return;
+            }
+
+            ngx_log_error(NGX_LOG_ALERT, ev->log, err, "recvmmsg() failed");
+
+            return;
+        }
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "recvmmsg: %d of %ui", n, batch);
+
+        /*
+         * 这一批数据报已经从套接字中读出,其中一个处理失败时仍然继续处理后面的,
+         * 否则它们会被直接丢弃;全部处理完之后再像ngx_event_recvmsg一样停止读取
+         */
+
+        rc = NGX_OK;
+
+        for (i = 0; i < n; i++) {
+            if (ngx_event_udp_receive(ev, &msgs[i].msg_hdr,
+                                      iov[i].iov_base, msgs[i].msg_len)
+                == NGX_ERROR) {
+                rc = NGX_ERROR;
+                continue;
+            }
+
+            if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
+                ev->available -= msgs[i].msg_len;
+            }
+        }
+
+        if (rc == NGX_ERROR) {
+            return;
+        }
+
+        /* 没有读满说明套接字中已经没有数据了 */
+
+        if (n < (int) batch) {
+            return;
+        }
+
+    } while (ev->available);
+}
+
+#endif
+
+/*
+listen ... udp gro时内核会把同一个流的多个数据报合并后一次返回,控制消息UDP_GRO中
+是每个数据报的大小(最后一个可能更小),需要拆分后逐个处理
+*/
+static ngx_int_t
+ngx_event_udp_receive(ngx_event_t *ev, struct msghdr *msg, u_char *buffer,
+                      ssize_t n) {
+#if (NGX_HAVE_UDP_GRO)
+    ssize_t size;
+    ngx_int_t rc;
+    ngx_connection_t *lc;
+    struct cmsghdr *cmsg;
+
+    lc = ev->data;
+
+    if (lc->listening->gro) {
+        size = 0;
 
-        if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
-            socklen = sizeof(ngx_sockaddr_t);
+        for (cmsg = CMSG_FIRSTHDR(msg);
+             cmsg != NULL;
+             cmsg = CMSG_NXTHDR(msg, cmsg)) {
+
+            if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                size = *(int *) CMSG_DATA(cmsg);
+                break;
+            }
         }
 
-        if (socklen == 0) {
+        if (size > 0 && n > size) {
 
-            /*
-             * on Linux recvmsg() returns zero msg_namelen
-             * when receiving packets from unbound AF_UNIX sockets
-             */
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                           "recvmsg: gro %z of %z", size, n);
+
+            rc = NGX_OK;
+
+            while (n > 0) {
+                rc = ngx_event_udp_dispatch(ev, msg, buffer,
+                                            ngx_min(n, size));
+
+                if (rc == NGX_ERROR) {
+                    return NGX_ERROR;
+                }
 
-            socklen = sizeof(struct sockaddr);
-            ngx_memzero(&sa, sizeof(struct sockaddr));
-            sa.sockaddr.sa_family = ls->sockaddr->sa_family;
+                buffer += size;
+                n -= size;
+            }
+
+            return rc;
         }
+    }
+
+#endif
+
+    return ngx_event_udp_dispatch(ev, msg, buffer, n);
+}
+
+/*
+把一个已经读取的数据报交给对应的连接:已有连接直接调用其读事件handler,否则创建新连接并
+调用ls->handler.返回NGX_DECLINED表示丢弃了该数据报,NGX_ERROR表示该数据报处理失败,
+调用者不再从套接字中继续读取(recvmmsg()已经读出的数据报仍然逐个处理)
+*/
+static ngx_int_t
+ngx_event_udp_dispatch(ngx_event_t *ev, struct msghdr *msg, u_char *buffer,
+                       ssize_t n) {
+    ngx_buf_t buf;
+    ngx_log_t *log;
+    socklen_t socklen, local_socklen;
+    ngx_event_t *rev, *wev;
+    ngx_sockaddr_t lsa;
+    struct sockaddr *sockaddr, *local_sockaddr;
+    ngx_listening_t *ls;
+    ngx_connection_t *c, *lc;
+
+    lc = ev->data;
+    ls = lc->listening;
+
+#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
+    if (msg->msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
+                      "recvmsg() truncated data");
+        return NGX_DECLINED;
+    }
+#endif
+
+    sockaddr = msg->msg_name;
+    socklen = msg->msg_namelen;
+
+    if (socklen > (socklen_t) sizeof(ngx_sockaddr_t)) {
+        socklen = sizeof(ngx_sockaddr_t);
+    }
+
+    if (socklen == 0) {
 
-        local_sockaddr = ls->sockaddr;
-        local_socklen = ls->socklen;
+        /*
+         * on Linux recvmsg() returns zero msg_namelen
+         * when receiving packets from unbound AF_UNIX sockets
+         */
+
+        socklen = sizeof(struct sockaddr);
+        ngx_memzero(sockaddr, sizeof(struct sockaddr));
+        sockaddr->sa_family = ls->sockaddr->sa_family;
+    }
+
+    local_sockaddr = ls->sockaddr;
+    local_socklen = ls->socklen;
 
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
 
-        if (ls->wildcard) {
-            struct cmsghdr *cmsg;
+    if (ls->wildcard) {
+        struct cmsghdr *cmsg;
 
-            ngx_memcpy(&lsa, local_sockaddr, local_socklen);
-            local_sockaddr = &lsa.sockaddr;
+        ngx_memcpy(&lsa, local_sockaddr, local_socklen);
+        local_sockaddr = &lsa.sockaddr;
 
-            for (cmsg = CMSG_FIRSTHDR(&msg);
-                 cmsg != NULL;
-                 cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        for (cmsg = CMSG_FIRSTHDR(msg);
+             cmsg != NULL;
+             cmsg = CMSG_NXTHDR(msg, cmsg)) {
 
 #if (NGX_HAVE_IP_RECVDSTADDR)
 
-                if (cmsg->cmsg_level == IPPROTO_IP
-                    && cmsg->cmsg_type == IP_RECVDSTADDR
-                    && local_sockaddr->sa_family == AF_INET)
-                {
-                    struct in_addr      *addr;
-                    struct sockaddr_in  *sin;
+            if (cmsg->cmsg_level == IPPROTO_IP
+                && cmsg->cmsg_type == IP_RECVDSTADDR
+                && local_sockaddr->sa_family == AF_INET)
+            {
+                struct in_addr      *addr;
+                struct sockaddr_in  *sin;
 
-                    addr = (struct in_addr *) CMSG_DATA(cmsg);
-                    sin = (struct sockaddr_in *) local_sockaddr;
-                    sin->sin_addr = *addr;
+                addr = (struct in_addr *) CMSG_DATA(cmsg);
+                sin = (struct sockaddr_in *) local_sockaddr;
+                sin->sin_addr = *addr;
 
-                    break;
-                }
+                break;
+            }
 
 #elif (NGX_HAVE_IP_PKTINFO)
 
-                if (cmsg->cmsg_level == IPPROTO_IP
-                    && cmsg->cmsg_type == IP_PKTINFO
-                    && local_sockaddr->sa_family == AF_INET) {
-                    struct in_pktinfo *pkt;
-                    struct sockaddr_in *sin;
+            if (cmsg->cmsg_level == IPPROTO_IP
+                && cmsg->cmsg_type == IP_PKTINFO
+                && local_sockaddr->sa_family == AF_INET) {
+                struct in_pktinfo *pkt;
+                struct sockaddr_in *sin;
 
-                    pkt = (struct in_pktinfo *) CMSG_DATA(cmsg);
-                    sin = (struct sockaddr_in *) local_sockaddr;
-                    sin->sin_addr = pkt->ipi_addr;
+                pkt = (struct in_pktinfo *) CMSG_DATA(cmsg);
+                sin = (struct sockaddr_in *) local_sockaddr;
+                sin->sin_addr = pkt->ipi_addr;
 
-                    break;
-                }
+                break;
+            }
 
 #endif
 
 #if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
 
-                if (cmsg->cmsg_level == IPPROTO_IPV6
-                    && cmsg->cmsg_type == IPV6_PKTINFO
-                    && local_sockaddr->sa_family == AF_INET6) {
-                    struct in6_pktinfo *pkt6;
-                    struct sockaddr_in6 *sin6;
+            if (cmsg->cmsg_level == IPPROTO_IPV6
+                && cmsg->cmsg_type == IPV6_PKTINFO
+                && local_sockaddr->sa_family == AF_INET6) {
+                struct in6_pktinfo *pkt6;
+                struct sockaddr_in6 *sin6;
 
-                    pkt6 = (struct in6_pktinfo *) CMSG_DATA(cmsg);
-                    sin6 = (struct sockaddr_in6 *) local_sockaddr;
-                    sin6->sin6_addr = pkt6->ipi6_addr;
+                pkt6 = (struct in6_pktinfo *) CMSG_DATA(cmsg);
+                sin6 = (struct sockaddr_in6 *) local_sockaddr;
+                sin6->sin6_addr = pkt6->ipi6_addr;
 
-                    break;
-                }
+                break;
+            }
 
 #endif
 
-            }
         }
+    }
 
 #endif
 
-        c = ngx_lookup_udp_connection(ls, sockaddr, socklen, local_sockaddr,
-                                      local_socklen);
+    c = ngx_lookup_udp_connection(ls, sockaddr, socklen, local_sockaddr,
+                                  local_socklen);
 
-        if (c) {
+    if (c) {
 
 #if (NGX_DEBUG)
-            if (c->log->log_level & NGX_LOG_DEBUG_EVENT) {
-                ngx_log_handler_pt  handler;
+        if (c->log->log_level & NGX_LOG_DEBUG_EVENT) {
+            ngx_log_handler_pt  handler;
 
-                handler = c->log->handler;
-                c->log->handler = NULL;
+            handler = c->log->handler;
+            c->log->handler = NULL;
 
-                ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
-                               "recvmsg: fd:%d n:%z", c->fd, n);
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                           "recvmsg: fd:%d n:%z", c->fd, n);
 
-                c->log->handler = handler;
-            }
+            c->log->handler = handler;
+        }
 #endif
 
-            ngx_memzero(&buf, sizeof(ngx_buf_t));
+        ngx_memzero(&buf, sizeof(ngx_buf_t));
 
-            buf.pos = buffer;
-            buf.last = buffer + n;
+        buf.pos = buffer;
+        buf.last = buffer + n;
 
-            rev = c->read;
+        rev = c->read;
 
-            c->udp->buffer = &buf;
+        c->udp->buffer = &buf;
 
-            rev->ready = 1;
-            rev->active = 0;
+        rev->ready = 1;
+        rev->active = 0;
 
-            rev->handler(rev);
+        rev->handler(rev);
 
-            if (c->udp) {
-                c->udp->buffer = NULL;
-            }
+        if (c->udp) {
+            c->udp->buffer = NULL;
+        }
 
-            rev->ready = 0;
-            rev->active = 1;
+        rev->ready = 0;
+        rev->active = 1;
 
-            goto next;
-        }
+        return NGX_OK;
+    }
 
 #if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
 #endif
 
-        ngx_accept_disabled = ngx_cycle->connection_n / 8
-                              - ngx_cycle->free_connection_n;
+    ngx_accept_disabled = ngx_cycle->connection_n / 8
+                          - ngx_cycle->free_connection_n;
 
-        c = ngx_get_connection(lc->fd, ev->log);
-        if (c == NULL) {
-            return;
-        }
+    c = ngx_get_connection(lc->fd, ev->log);
+    if (c == NULL) {
+        return NGX_ERROR;
+    }
 
-        c->shared = 1;
-        c->type = SOCK_DGRAM;
-        c->socklen = socklen;
+    c->shared = 1;
+    c->type = SOCK_DGRAM;
+    c->socklen = socklen;
 
 #if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_active, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_active, 1);
 #endif
 
-        c->pool = ngx_create_pool(ls->pool_size, ev->log);
-        if (c->pool == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
-
-        c->sockaddr = ngx_palloc(c->pool, socklen);
-        if (c->sockaddr == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+    c->pool = ngx_create_pool(ls->pool_size, ev->log);
+    if (c->pool == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        ngx_memcpy(c->sockaddr, sockaddr, socklen);
+    c->sockaddr = ngx_palloc(c->pool, socklen);
+    if (c->sockaddr == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        log = ngx_palloc(c->pool, sizeof(ngx_log_t));
-        if (log == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+    ngx_memcpy(c->sockaddr, sockaddr, socklen);
 
-        *log = ls->log;
+    log = ngx_palloc(c->pool, sizeof(ngx_log_t));
+    if (log == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        c->recv = ngx_udp_shared_recv;
-        c->send = ngx_udp_send;
-        c->send_chain = ngx_udp_send_chain;
+    *log = ls->log;
 
-        c->log = log;
-        c->pool->log = log;
-        c->listening = ls;
+    c->recv = ngx_udp_shared_recv;
+    c->send = ngx_udp_send;
+    c->send_chain = ngx_udp_send_chain;
 
-        if (local_sockaddr == &lsa.sockaddr) {
-            local_sockaddr = ngx_palloc(c->pool, local_socklen);
-            if (local_sockaddr == NULL) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+    c->log = log;
+    c->pool->log = log;
+    c->listening = ls;
 
-            ngx_memcpy(local_sockaddr, &lsa, local_socklen);
+    if (local_sockaddr == &lsa.sockaddr) {
+        local_sockaddr = ngx_palloc(c->pool, local_socklen);
+        if (local_sockaddr == NULL) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
         }
 
-        c->local_sockaddr = local_sockaddr;
-        c->local_socklen = local_socklen;
+        ngx_memcpy(local_sockaddr, &lsa, local_socklen);
+    }
 
-        c->buffer = ngx_create_temp_buf(c->pool, n);
-        if (c->buffer == NULL) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+    c->local_sockaddr = local_sockaddr;
+    c->local_socklen = local_socklen;
 
-        c->buffer->last = ngx_cpymem(c->buffer->last, buffer, n);
+    c->buffer = ngx_create_temp_buf(c->pool, n);
+    if (c->buffer == NULL) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        rev = c->read;
-        wev = c->write;
+    c->buffer->last = ngx_cpymem(c->buffer->last, buffer, n);
 
-        rev->active = 1;
-        wev->ready = 1;
+    rev = c->read;
+    wev = c->write;
 
-        rev->log = log;
-        wev->log = log;
+    rev->active = 1;
+    wev->ready = 1;
 
-        /*
-         * TODO: MT: - ngx_atomic_fetch_add()
-         *             or protection by critical section or light mutex
-         *
-         * TODO: MP: - allocated in a shared memory
-         *           - ngx_atomic_fetch_add()
-         *             or protection by critical section or light mutex
-         */
+    rev->log = log;
+    wev->log = log;
 
-        c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+    /*
+     * TODO: MT: - ngx_atomic_fetch_add()
+     *             or protection by critical section or light mutex
+     *
+     * TODO: MP: - allocated in a shared memory
+     *           - ngx_atomic_fetch_add()
+     *             or protection by critical section or light mutex
+     */
 
-        c->start_time = ngx_current_msec;
+    c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+
+    c->start_time = ngx_current_msec;
 
 #if (NGX_STAT_STUB)
-        (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
+    (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
 #endif
 
-        if (ls->addr_ntop) {
-            c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
-            if (c->addr_text.data == NULL) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+    if (ls->addr_ntop) {
+        c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
+        if (c->addr_text.data == NULL) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
+        }
 
-            c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
-                                             c->addr_text.data,
-                                             ls->addr_text_max_len, 0);
-            if (c->addr_text.len == 0) {
-                ngx_close_accepted_udp_connection(c);
-                return;
-            }
+        c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->socklen,
+                                         c->addr_text.data,
+                                         ls->addr_text_max_len, 0);
+        if (c->addr_text.len == 0) {
+            ngx_close_accepted_udp_connection(c);
+            return NGX_ERROR;
         }
+    }
 
 #if (NGX_DEBUG)
-        {
-        ngx_str_t  addr;
-        u_char     text[NGX_SOCKADDR_STRLEN];
+    {
+    ngx_str_t          addr;
+    u_char             text[NGX_SOCKADDR_STRLEN];
+    ngx_event_conf_t  *ecf;
 
-        ngx_debug_accepted_connection(ecf, c);
+    ecf = ngx_event_get_conf(ngx_cycle->conf_ctx, ngx_event_core_module);
 
-        if (log->log_level & NGX_LOG_DEBUG_EVENT) {
-            addr.data = text;
-            addr.len = ngx_sock_ntop(c->sockaddr, c->socklen, text,
-                                     NGX_SOCKADDR_STRLEN, 1);
+    ngx_debug_accepted_connection(ecf, c);
 
-            ngx_log_debug4(NGX_LOG_DEBUG_EVENT, log, 0,
-                           "*%uA recvmsg: %V fd:%d n:%z",
-                           c->number, &addr, c->fd, n);
-        }
+    if (log->log_level & NGX_LOG_DEBUG_EVENT) {
+        addr.data = text;
+        addr.len = ngx_sock_ntop(c->sockaddr, c->socklen, text,
+                                 NGX_SOCKADDR_STRLEN, 1);
 
-        }
-#endif
-
-        if (ngx_insert_udp_connection(c) != NGX_OK) {
-            ngx_close_accepted_udp_connection(c);
-            return;
-        }
+        ngx_log_debug4(NGX_LOG_DEBUG_EVENT, log, 0,
+                       "*%uA recvmsg: %V fd:%d n:%z",
+                       c->number, &addr, c->fd, n);
+    }
 
-        log->data = NULL;
-        log->handler = NULL;
+    }
+#endif
 
-        ls->handler(c);
+    if (ngx_insert_udp_connection(c) != NGX_OK) {
+        ngx_close_accepted_udp_connection(c);
+        return NGX_ERROR;
+    }
 
-        next:
+    log->data = NULL;
+    log->handler = NULL;
 
-        if (ngx_event_flags & NGX_USE_KQUEUE_EVENT) {
-            ev->available -= n;
-        }
+    ls->handler(c);
 
-    } while (ev->available);
+    return NGX_OK;
 }
 
 
@@ -3693,6 +3693,7 @@ ngx_http_fastcgi_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
     hash.max_size = 512;
     hash.bucket_size = ngx_align(64, ngx_cacheline_size);
     hash.name = "fastcgi_hide_headers_hash";
+    hash.perfect = 0;
 
     if (ngx_http_upstream_hide_headers_hash(cf, &conf->upstream,
                                             &prev->upstream, ngx_http_fastcgi_hide_headers, &hash)
@@ -3958,6 +3959,7 @@ ngx_http_fastcgi_init_params(ngx_conf_t *cf, ngx_http_fastcgi_loc_conf_t *conf,
     hash.max_size = 512;
     hash.bucket_size = 64;
     hash.name = "fastcgi_params_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
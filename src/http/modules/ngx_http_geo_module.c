@@ -612,7 +612,15 @@ ngx_http_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             == NGX_ERROR) {
             goto failed;
         }
+
+        if (ngx_radix128tree_compile(ctx.tree6) != NGX_OK) {
+            goto failed;
+        }
 #endif
+
+        if (ngx_radix32tree_compile(ctx.tree) != NGX_OK) {
+            goto failed;
+        }
     }
 
     ngx_destroy_pool(ctx.temp_pool);
@@ -1440,9 +1448,11 @@ ngx_http_geo_include_binary_base(ngx_conf_t *cf, ngx_http_geo_conf_ctx_t *ctx,
     ngx_int_t rc;
     ngx_uint_t i;
     ngx_file_t file;
+    ngx_pool_t *pool;
+    ngx_reuse_t *rs;
     ngx_file_info_t fi;
     ngx_http_geo_range_t *range, **ranges;
-    ngx_http_geo_header_t *header;
+    ngx_http_geo_header_t *header, h;
     ngx_http_variable_value_t *vv;
 
     ngx_memzero(&file, sizeof(ngx_file_t));
@@ -1460,6 +1470,8 @@ ngx_http_geo_include_binary_base(ngx_conf_t *cf, ngx_http_geo_conf_ctx_t *ctx,
         return NGX_DECLINED;
     }
 
+    pool = NULL;
+
     if (ctx->outside_entries) {
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "binary geo range base \"%s\" cannot be mixed with usual entries",
@@ -1502,7 +1514,37 @@ ngx_http_geo_include_binary_base(ngx_conf_t *cf, ngx_http_geo_conf_ctx_t *ctx,
         goto failed;
     }
 
-    base = ngx_palloc(ctx->pool, size);
+    /* reload时base没变,直接接过旧配置中已经读入的ranges */
+
+    n = ngx_read_file(&file, (u_char *) &h, sizeof(ngx_http_geo_header_t), 0);
+
+    if (n == NGX_ERROR) {
+        ngx_conf_log_error(NGX_LOG_CRIT, cf, ngx_errno,
+                           ngx_read_file_n " \"%s\" failed", name->data);
+        goto failed;
+    }
+
+    if ((size_t) n == sizeof(ngx_http_geo_header_t)
+        && ngx_memcmp(&ngx_http_geo_header, &h, 12) == 0) {
+
+        rs = ngx_reuse_get(cf, name, h.crc32);
+
+        if (rs) {
+            ngx_conf_log_error(NGX_LOG_NOTICE, cf, 0,
+                               "reusing binary geo range base \"%s\"",
+                               name->data);
+
+            ranges = rs->data;
+            goto found;
+        }
+    }
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, cf->log);
+    if (pool == NULL) {
+        goto failed;
+    }
+
+    base = ngx_palloc(pool, size);
     if (base == NULL) {
         goto failed;
     }
@@ -1576,9 +1618,19 @@ ngx_http_geo_include_binary_base(ngx_conf_t *cf, ngx_http_geo_conf_ctx_t *ctx,
         goto failed;
     }
 
+    rs = ngx_reuse_add(cf, name, crc32, pool);
+    if (rs == NULL) {
+        goto failed;
+    }
+
+    rs->data = ranges;
+    pool = NULL;
+
     ngx_conf_log_error(NGX_LOG_NOTICE, cf, 0,
                        "using binary geo range base \"%s\"", name->data);
 
+    found:
+
     ctx->include_name = *name;
     ctx->binary_include = 1;
     ctx->high.low = ranges;
@@ -1592,6 +1644,10 @@ ngx_http_geo_include_binary_base(ngx_conf_t *cf, ngx_http_geo_conf_ctx_t *ctx,
 
     done:
 
+    if (pool) {
+        ngx_destroy_pool(pool);
+    }
+
     if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
         ngx_log_error(NGX_LOG_ALERT, cf->log, ngx_errno,
                       ngx_close_file_n " \"%s\" failed", name->data);
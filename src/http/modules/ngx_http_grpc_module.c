@@ -4471,6 +4471,7 @@ ngx_http_grpc_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
     hash.max_size = 512;
     hash.bucket_size = ngx_align(64, ngx_cacheline_size);
     hash.name = "grpc_headers_hash";
+    hash.perfect = 0;
 
     if (ngx_http_upstream_hide_headers_hash(cf, &conf->upstream,
                                             &prev->upstream, ngx_http_grpc_hide_headers, &hash)
@@ -4688,6 +4689,7 @@ ngx_http_grpc_init_headers(ngx_conf_t *cf, ngx_http_grpc_loc_conf_t *conf,
     hash.max_size = 512;
     hash.bucket_size = 64;
     hash.name = "grpc_headers_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
@@ -24,6 +24,13 @@ typedef struct { //空间创建和赋值见ngx_http_index_set_index
 } ngx_http_index_loc_conf_t;
 
 
+//aio_open时open()在线程池中执行,记录检查到了第几个index文件,完成后从这里继续
+typedef struct {
+    ngx_uint_t index;
+    ngx_uint_t dir_tested;
+} ngx_http_index_ctx_t;
+
+
 
 #define NGX_HTTP_DEFAULT_INDEX   "index.html"
 
@@ -174,6 +181,7 @@ ngx_http_index_handler(ngx_http_request_t *r)
     ngx_uint_t i, dir_tested;
     ngx_http_index_t *index;
     ngx_open_file_info_t of;
+    ngx_http_index_ctx_t *ctx;
     ngx_http_script_code_pt code;
     ngx_http_script_engine_t e;
     ngx_http_core_loc_conf_t *clcf;
@@ -221,16 +229,18 @@ ngx_http_index_handler(ngx_http_request_t *r)
     ilcf = ngx_http_get_module_loc_conf(r, ngx_http_index_module);
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
+    ctx = ngx_http_get_module_ctx(r, ngx_http_index_module);
+
     allocated = 0;
     root = 0;
-    dir_tested = 0;
+    dir_tested = ctx ? ctx->dir_tested : 0;
     name = NULL;
     /* suppress MSVC warning */
     path.data = NULL;
 
     index = ilcf->indices->elts;
     //indices上默认有一个NGX_HTTP_DEFAULT_INDEX
-    for (i = 0; i < ilcf->indices->nelts; i++) { //循环遍历index配置的文件,如果有该文件,则进行内部重定向,从新走NGX_HTTP_SERVER_REWRITE_PHASE
+    for (i = ctx ? ctx->index : 0; i < ilcf->indices->nelts; i++) { //循环遍历index配置的文件,如果有该文件,则进行内部重定向,从新走NGX_HTTP_SERVER_REWRITE_PHASE
 
         if (index[i].lengths == NULL) {
 
@@ -305,7 +315,7 @@ ngx_http_index_handler(ngx_http_request_t *r)
         ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
         of.read_ahead = clcf->read_ahead;
-        of.is_directio = clcf->directio;
+        of.directio = clcf->directio;
         of.valid = clcf->open_file_cache_valid;
         of.min_uses = clcf->open_file_cache_min_uses;
         of.test_only = 1;
@@ -316,8 +326,26 @@ ngx_http_index_handler(ngx_http_request_t *r)
             return NGX_HTTP_INTERNAL_SERVER_ERROR;
         }
 
-        if (ngx_open_cached_file(clcf->open_file_cache, &path, &of, r->pool)
-            != NGX_OK) {
+        rc = ngx_http_open_cached_file(r, clcf, &path, &of);
+
+        if (rc == NGX_AGAIN) {
+            if (ctx == NULL) {
+                ctx = ngx_palloc(r->pool, sizeof(ngx_http_index_ctx_t));
+                if (ctx == NULL) {
+                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
+                }
+
+                ngx_http_set_ctx(r, ctx, ngx_http_index_module);
+            }
+
+            ctx->index = i;
+            ctx->dir_tested = dir_tested;
+
+            r->main->count++;
+            return NGX_DONE;
+        }
+
+        if (rc != NGX_OK) {
             if (of.err == 0) {
                 return NGX_HTTP_INTERNAL_SERVER_ERROR;
             }
@@ -402,6 +430,7 @@ ngx_http_index_test_dir(ngx_http_request_t *r, ngx_http_core_loc_conf_t *clcf,
 
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
+    of.directio = NGX_OPEN_FILE_DIRECTIO_OFF;
     of.test_dir = 1;
     of.test_only = 1;
     of.valid = clcf->open_file_cache_valid;
@@ -110,7 +110,7 @@ limit_conn_zone $binary_remote_addr zone=addr:10m;
 服务器将会对后续所有的请求返回 503 (Service Temporarily Unavailable) 错误.
 */
         {ngx_string("limit_conn_zone"),
-         NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE2,
+         NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE23,
          ngx_http_limit_conn_zone,
          0,
          0,
@@ -602,7 +602,7 @@ ngx_http_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     u_char *p;
     ssize_t size;
     ngx_str_t *value, name, s;
-    ngx_uint_t i;
+    ngx_uint_t i, hugepages;
     ngx_shm_zone_t *shm_zone;
     ngx_http_limit_conn_ctx_t *ctx;
     ngx_http_compile_complex_value_t ccv;
@@ -626,6 +626,7 @@ ngx_http_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 
     size = 0;
     name.len = 0;
+    hugepages = 0;
 
     for (i = 2; i < cf->args->nelts; i++) {
 
@@ -663,6 +664,11 @@ ngx_http_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             continue;
         }
 
+        if (ngx_strcmp(value[i].data, "hugepages") == 0) {
+            hugepages = 1;
+            continue;
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
@@ -693,6 +699,10 @@ ngx_http_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     shm_zone->init = ngx_http_limit_conn_init_zone;
     shm_zone->data = ctx;
 
+    if (hugepages) {
+        shm_zone->shm.hugepages = NGX_SHM_HUGEPAGES_ON;
+    }
+
     return NGX_CONF_OK;
 }
 
@@ -134,7 +134,7 @@ limit_req_zone $binary_remote_addr zone=one:10m rate=1r/s;
 请求频率可以设置为每秒几次(r/s).如果请求的频率不到每秒一次, 你可以设置每分钟几次(r/m).比如每秒半次就是30r/m.
 */
         {ngx_string("limit_req_zone"),
-         NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE3,
+         NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE3 | NGX_CONF_TAKE4,
          ngx_http_limit_req_zone,
          0,
          0,
@@ -906,7 +906,7 @@ ngx_http_limit_req_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     ssize_t size;
     ngx_str_t *value, name, s;
     ngx_int_t rate, scale;
-    ngx_uint_t i;
+    ngx_uint_t i, hugepages;
     ngx_shm_zone_t *shm_zone;
     ngx_http_limit_req_ctx_t *ctx;
     ngx_http_compile_complex_value_t ccv;
@@ -932,6 +932,7 @@ ngx_http_limit_req_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     rate = 1;
     scale = 1;
     name.len = 0;
+    hugepages = 0;
 
     for (i = 2; i < cf->args->nelts; i++) {
 
@@ -993,6 +994,11 @@ ngx_http_limit_req_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             continue;
         }
 
+        if (ngx_strcmp(value[i].data, "hugepages") == 0) {
+            hugepages = 1;
+            continue;
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
@@ -1025,6 +1031,10 @@ ngx_http_limit_req_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     shm_zone->init = ngx_http_limit_req_init_zone;
     shm_zone->data = ctx;
 
+    if (hugepages) {
+        shm_zone->shm.hugepages = NGX_SHM_HUGEPAGES_ON;
+    }
+
     return NGX_CONF_OK;
 }
 
@@ -51,6 +51,52 @@ typedef struct {
 } ngx_http_log_main_conf_t;
 
 
+#if (NGX_THREADS)
+
+/*
+ * access_log ... async=pool:缓冲区满了以后不在worker中写文件,而是和一个
+ * 空闲的缓冲区交换,把写满的交给线程池压缩和写入,worker只管往缓冲区里追加.
+ * 最多同时有NGX_HTTP_LOG_ASYNC_BUFS个缓冲区在线程中,都没写完时按overflow=
+ * 的设置,block在worker中同步写,drop丢弃新的日志并计数.线程池有多个线程时
+ * 不同缓冲区之间的日志可能乱序
+ */
+
+#define NGX_HTTP_LOG_ASYNC_BUFS  4
+
+
+typedef struct ngx_http_log_async_s ngx_http_log_async_t;
+
+typedef struct {
+    ngx_http_log_async_t       *async;
+    ngx_fd_t                    fd;
+    u_char                     *buf;
+    size_t                      len;
+    ssize_t                     n;
+    ngx_err_t                   err;
+    ngx_int_t                   gzip;
+    u_char                     *out; //gzip时的输出缓冲区,线程中不能分配内存
+} ngx_http_log_async_ctx_t;
+
+
+struct ngx_http_log_async_s {
+    ngx_thread_pool_t          *thread_pool;
+    ngx_open_file_t            *file;
+
+    ngx_thread_task_t          *free[NGX_HTTP_LOG_ASYNC_BUFS];
+    ngx_uint_t                  nfree;
+
+    ngx_atomic_t                busy; //已经交给线程池还没写完的缓冲区个数
+
+    ngx_uint_t                  dropped; //上次报告以来丢弃的日志条数
+    time_t                      drop_log_time;
+    time_t                      error_log_time;
+
+    unsigned                    drop:1; //overflow=drop
+};
+
+#endif
+
+
 //access_log /path buffer=xx的时候创建空间和赋值,见ngx_http_log_set_log
 typedef struct {
     u_char                     *start;
@@ -60,6 +106,9 @@ typedef struct {
     ngx_event_t                *event; //如果配置带有fluash,则启动定时器 见ngx_http_log_set_log
     ngx_msec_t                  flush; //flush接入日志到磁盘的时间  在ngx_http_log_handler中通过定时器生效
     ngx_int_t                   gzip; //access_log /path buffer=xxx gzip=xx
+#if (NGX_THREADS)
+    ngx_http_log_async_t       *async; //access_log /path async=pool
+#endif
 } ngx_http_log_buf_t;
 
 /*
@@ -124,8 +173,16 @@ static ssize_t ngx_http_log_script_write(ngx_http_request_t *r,
 
 #if (NGX_ZLIB)
 
+/*
+ * This is a formula from deflateBound() for conservative upper bound of
+ * compressed data plus 18 bytes of gzip wrapper.
+ */
+
+#define ngx_http_log_gzip_bound(len)                                          \
+    ((len) + (((len) + 7) >> 3) + (((len) + 63) >> 6) + 5 + 18)
+
 static ssize_t ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len,
-                                 ngx_int_t level, ngx_log_t *log);
+                                 ngx_int_t level, u_char *out, ngx_log_t *log);
 
 static void *ngx_http_log_gzip_alloc(void *opaque, u_int items, u_int size);
 
@@ -137,6 +194,18 @@ static void ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log);
 
 static void ngx_http_log_flush_handler(ngx_event_t *ev);
 
+#if (NGX_THREADS)
+static ngx_int_t ngx_http_log_async_post(ngx_open_file_t *file,
+                                         ngx_log_t *log);
+
+static void ngx_http_log_async_thread(void *data, ngx_log_t *log);
+
+static void ngx_http_log_async_done(ngx_event_t *ev);
+
+static char *ngx_http_log_async_init(ngx_conf_t *cf, ngx_http_log_buf_t *buffer,
+                                     ngx_open_file_t *file, ngx_str_t *name, ngx_uint_t drop);
+#endif
+
 static u_char *ngx_http_log_pipe(ngx_http_request_t *r, u_char *buf,
                                  ngx_http_log_op_t *op);
 
@@ -399,6 +468,9 @@ ngx_http_log_handler(ngx_http_request_t *r){ //ngx_http_log_request中执行
     ngx_http_log_op_t *op;
     ngx_http_log_buf_t *buffer;
     ngx_http_log_loc_conf_t *lcf;
+#if (NGX_THREADS)
+    ngx_int_t rc;
+#endif
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http log handler");
@@ -464,10 +536,27 @@ ngx_http_log_handler(ngx_http_request_t *r){ //ngx_http_log_request中执行
 
             if (len > (size_t) (buffer->last - buffer->pos)) {
 
-                ngx_http_log_write(r, &log[l], buffer->start,
-                                   buffer->pos - buffer->start);
+#if (NGX_THREADS)
+                rc = NGX_DECLINED;
 
-                buffer->pos = buffer->start;
+                if (buffer->async) {
+                    rc = ngx_http_log_async_post(log[l].file,
+                                                 r->connection->log);
+
+                    if (rc == NGX_BUSY) {
+                        buffer->async->dropped++;
+                        continue;
+                    }
+                }
+
+                if (rc != NGX_OK)
+#endif
+                {
+                    ngx_http_log_write(r, &log[l], buffer->start,
+                                       buffer->pos - buffer->start);
+
+                    buffer->pos = buffer->start;
+                }
             }
 
             if (len <= (size_t) (buffer->last - buffer->pos)) {
@@ -558,7 +647,7 @@ ngx_http_log_write(ngx_http_request_t *r, ngx_http_log_t *log, u_char *buf,
 
         if (buffer && buffer->gzip) {
             n = ngx_http_log_gzip(log->file->fd, buf, len, buffer->gzip,
-                                  r->connection->log);
+                                  NULL, r->connection->log);
         } else {
             n = ngx_write_fd(log->file->fd, buf, len);
         }
@@ -629,6 +718,7 @@ ngx_http_log_script_write(ngx_http_request_t *r, ngx_http_log_script_t *script,
 
         ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
+        of.directio = NGX_OPEN_FILE_DIRECTIO_OFF;
         of.valid = clcf->open_file_cache_valid;
         of.min_uses = clcf->open_file_cache_min_uses;
         of.test_dir = 1;
@@ -684,7 +774,7 @@ ngx_http_log_script_write(ngx_http_request_t *r, ngx_http_log_script_t *script,
     of.log = 1;
     of.valid = llcf->open_file_cache_valid;
     of.min_uses = llcf->open_file_cache_min_uses;
-    of.is_directio = NGX_OPEN_FILE_DIRECTIO_OFF;
+    of.directio = NGX_OPEN_FILE_DIRECTIO_OFF;
 
     if (ngx_http_set_disable_symlinks(r, clcf, &log, &of) != NGX_OK) {
         /* simulate successful logging */
@@ -715,16 +805,20 @@ ngx_http_log_script_write(ngx_http_request_t *r, ngx_http_log_script_t *script,
 
 #if (NGX_ZLIB)
 
+/*
+异步写日志时在线程池的线程中执行,不能使用内存池:内存池的块缓存和大块内存统计
+只在事件循环线程中使用,不加锁.因此zlib的内存直接用malloc()分配;out为NULL时
+输出缓冲区也临时分配,否则调用者保证其大小不小于ngx_http_log_gzip_bound(len)
+*/
 static ssize_t
 ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
-                  ngx_log_t *log) {
+                  u_char *out, ngx_log_t *log) {
     int rc, wbits, memlevel;
-    u_char *out;
+    u_char *p;
     size_t size;
     ssize_t n;
     z_stream zstream;
     ngx_err_t err;
-    ngx_pool_t *pool;
 
     wbits = MAX_WBITS;
     memlevel = MAX_MEM_LEVEL - 1;
@@ -734,37 +828,34 @@ ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
         memlevel--;
     }
 
-    /*
-     * This is a formula from deflateBound() for conservative upper bound of
-     * compressed data plus 18 bytes of gzip wrapper.
-     */
+    size = ngx_http_log_gzip_bound(len);
 
-    size = len + ((len + 7) >> 3) + ((len + 63) >> 6) + 5 + 18;
+    p = out;
 
-    ngx_memzero(&zstream, sizeof(z_stream));
-
-    pool = ngx_create_pool(256, log);
-    if (pool == NULL) {
-        /* simulate successful logging */
-        return len;
+    if (p == NULL) {
+        p = ngx_alloc(size, log);
+        if (p == NULL) {
+            /* simulate successful logging */
+            return len;
+        }
     }
 
-    pool->log = log;
+    ngx_memzero(&zstream, sizeof(z_stream));
 
     zstream.zalloc = ngx_http_log_gzip_alloc;
     zstream.zfree = ngx_http_log_gzip_free;
-    zstream.opaque = pool;
-
-    out = ngx_pnalloc(pool, size);
-    if (out == NULL) {
-        goto done;
-    }
+    zstream.opaque = log;
 
     zstream.next_in = buf;
     zstream.avail_in = len;
-    zstream.next_out = out;
+    zstream.next_out = p;
     zstream.avail_out = size;
 
+    /* 压缩失败时simulate successful logging */
+
+    n = len;
+    err = 0;
+
     rc = deflateInit2(&zstream, (int) level, Z_DEFLATED, wbits + 16, memlevel,
                       Z_DEFAULT_STRATEGY);
 
@@ -783,6 +874,7 @@ ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
     if (rc != Z_STREAM_END) {
         ngx_log_error(NGX_LOG_ALERT, log, 0,
                       "deflate(Z_FINISH) failed: %d", rc);
+        (void) deflateEnd(&zstream);
         goto done;
     }
 
@@ -801,44 +893,39 @@ ngx_http_log_gzip(ngx_fd_t fd, u_char *buf, size_t len, ngx_int_t level,
         goto done;
     }
 
-    n = ngx_write_fd(fd, out, size);
+    if (ngx_write_fd(fd, p, size) != (ssize_t) size) {
+        err = ngx_errno;
+        n = -1;
+    }
 
-    if (n != (ssize_t) size) {
-        err = (n == -1) ? ngx_errno : 0;
+done:
 
-        ngx_destroy_pool(pool);
+    if (out == NULL) {
+        ngx_free(p);
+    }
 
+    if (n == -1) {
         ngx_set_errno(err);
-        return -1;
     }
 
-    done:
-
-    ngx_destroy_pool(pool);
-
-    /* simulate successful logging */
-    return len;
+    return n;
 }
 
 
 static void *
 ngx_http_log_gzip_alloc(void *opaque, u_int items, u_int size) {
-    ngx_pool_t *pool = opaque;
+    ngx_log_t *log = opaque;
 
-    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, pool->log, 0,
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, log, 0,
                    "gzip alloc: n:%ud s:%ud", items, size);
 
-    return ngx_palloc(pool, items * size);
+    return ngx_alloc(items * size, log);
 }
 
 
 static void
 ngx_http_log_gzip_free(void *opaque, void *address) {
-#if 0
-    ngx_pool_t *pool = opaque;
-
-    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pool->log, 0, "gzip free: %p", address);
-#endif
+    ngx_free(address);
 }
 
 #endif
@@ -852,6 +939,21 @@ ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log) {
 
     buffer = file->data;
 
+#if (NGX_THREADS)
+
+    /*
+     * 重新打开日志文件和进程退出时调用,先等线程写完已经交出去的缓冲区,
+     * 它们用的还是旧的描述符
+     */
+
+    if (buffer->async) {
+        while (buffer->async->busy) {
+            ngx_msleep(1);
+        }
+    }
+
+#endif
+
     len = buffer->pos - buffer->start;
 
     if (len == 0) {
@@ -860,7 +962,8 @@ ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log) {
 
 #if (NGX_ZLIB)
     if (buffer->gzip) {
-        n = ngx_http_log_gzip(file->fd, buffer->start, len, buffer->gzip, log);
+        n = ngx_http_log_gzip(file->fd, buffer->start, len, buffer->gzip,
+                              NULL, log);
     } else {
         n = ngx_write_fd(file->fd, buffer->start, len);
     }
@@ -889,13 +992,239 @@ ngx_http_log_flush(ngx_open_file_t *file, ngx_log_t *log) {
 
 static void
 ngx_http_log_flush_handler(ngx_event_t *ev) {
+#if (NGX_THREADS)
+    ngx_open_file_t *file;
+    ngx_http_log_buf_t *buffer;
+#endif
+
     ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "http log buffer flush handler");
 
+#if (NGX_THREADS)
+    file = ev->data;
+    buffer = file->data;
+
+    if (buffer->async) {
+
+        switch (ngx_http_log_async_post(file, ev->log)) {
+
+        case NGX_OK:
+            if (ev->timer_set) {
+                ngx_del_timer(ev);
+            }
+            return;
+
+        case NGX_BUSY:
+            /* 缓冲区都在线程中,稍后再试 */
+            ngx_add_timer(ev, buffer->flush);
+            return;
+
+        default:
+            break;
+        }
+    }
+#endif
+
     ngx_http_log_flush(ev->data, ev->log);
 }
 
 
+#if (NGX_THREADS)
+
+/*
+ * 把写满的缓冲区和一个空闲的交换后交给线程池.没有空闲的缓冲区时,
+ * overflow=drop返回NGX_BUSY,否则返回NGX_DECLINED由调用方同步写
+ */
+
+static ngx_int_t
+ngx_http_log_async_post(ngx_open_file_t *file, ngx_log_t *log) {
+    u_char *p;
+    size_t len;
+    ngx_thread_task_t *task;
+    ngx_http_log_buf_t *buffer;
+    ngx_http_log_async_t *async;
+    ngx_http_log_async_ctx_t *ctx;
+
+    buffer = file->data;
+    async = buffer->async;
+
+    len = buffer->pos - buffer->start;
+
+    if (len == 0) {
+        return NGX_OK;
+    }
+
+    if (async->nfree == 0) {
+        return async->drop ? NGX_BUSY : NGX_DECLINED;
+    }
+
+    task = async->free[--async->nfree];
+    ctx = task->ctx;
+
+    p = ctx->buf;
+
+    ctx->fd = file->fd;
+    ctx->buf = buffer->start;
+    ctx->len = len;
+
+    (void) ngx_atomic_fetch_add(&async->busy, 1);
+
+    if (ngx_thread_task_post(async->thread_pool, task) != NGX_OK) {
+        (void) ngx_atomic_fetch_add(&async->busy, -1);
+
+        ctx->buf = p;
+        async->free[async->nfree++] = task;
+
+        return async->drop ? NGX_BUSY : NGX_DECLINED;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, log, 0,
+                   "http log async post: %uz, free: %ui", len, async->nfree);
+
+    buffer->start = p;
+    buffer->pos = p;
+    buffer->last = p + (buffer->last - ctx->buf);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_log_async_thread(void *data, ngx_log_t *log) {
+    ngx_http_log_async_ctx_t *ctx = data;
+
+    ssize_t n;
+
+#if (NGX_ZLIB)
+    if (ctx->gzip) {
+        n = ngx_http_log_gzip(ctx->fd, ctx->buf, ctx->len, ctx->gzip,
+                              ctx->out, log);
+    } else {
+        n = ngx_write_fd(ctx->fd, ctx->buf, ctx->len);
+    }
+#else
+    n = ngx_write_fd(ctx->fd, ctx->buf, ctx->len);
+#endif
+
+    ctx->n = n;
+    ctx->err = (n == -1) ? ngx_errno : 0;
+
+    (void) ngx_atomic_fetch_add(&ctx->async->busy, -1);
+}
+
+
+static void
+ngx_http_log_async_done(ngx_event_t *ev) {
+    time_t now;
+    ngx_thread_task_t *task;
+    ngx_http_log_async_t *async;
+    ngx_http_log_async_ctx_t *ctx;
+
+    task = ev->data;
+    ctx = task->ctx;
+    async = ctx->async;
+
+    ev->complete = 0;
+
+    async->free[async->nfree++] = task;
+
+    now = ngx_time();
+
+    if (ctx->n != (ssize_t) ctx->len && now - async->error_log_time > 59) {
+
+        if (ctx->n == -1) {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, ctx->err,
+                          ngx_write_fd_n " to \"%s\" failed",
+                          async->file->name.data);
+
+        } else {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, 0,
+                          ngx_write_fd_n " to \"%s\" was incomplete: %z of %uz",
+                          async->file->name.data, ctx->n, ctx->len);
+        }
+
+        async->error_log_time = now;
+    }
+
+    if (async->dropped && now - async->drop_log_time > 59) {
+        ngx_log_error(NGX_LOG_WARN, ev->log, 0,
+                      "%ui entries dropped from access log \"%s\"",
+                      async->dropped, async->file->name.data);
+
+        async->dropped = 0;
+        async->drop_log_time = now;
+    }
+}
+
+
+static char *
+ngx_http_log_async_init(ngx_conf_t *cf, ngx_http_log_buf_t *buffer,
+                        ngx_open_file_t *file, ngx_str_t *name, ngx_uint_t drop) {
+    size_t size;
+    ngx_uint_t i;
+    ngx_thread_task_t *task;
+    ngx_http_log_async_t *async;
+    ngx_http_log_async_ctx_t *ctx;
+
+    async = ngx_pcalloc(cf->pool, sizeof(ngx_http_log_async_t));
+    if (async == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    async->thread_pool = ngx_thread_pool_add(cf, name);
+    if (async->thread_pool == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    async->file = file;
+    async->drop = drop;
+
+    size = buffer->last - buffer->start;
+
+    for (i = 0; i < NGX_HTTP_LOG_ASYNC_BUFS; i++) {
+        task = ngx_thread_task_alloc(cf->pool,
+                                     sizeof(ngx_http_log_async_ctx_t));
+        if (task == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ctx = task->ctx;
+
+        ctx->async = async;
+        ctx->gzip = buffer->gzip;
+
+        ctx->buf = ngx_pnalloc(cf->pool, size);
+        if (ctx->buf == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+#if (NGX_ZLIB)
+        if (ctx->gzip) {
+            ctx->out = ngx_pnalloc(cf->pool, ngx_http_log_gzip_bound(size));
+            if (ctx->out == NULL) {
+                return NGX_CONF_ERROR;
+            }
+        }
+#endif
+
+        task->handler = ngx_http_log_async_thread;
+        task->event.handler = ngx_http_log_async_done;
+        task->event.data = task;
+        task->event.log = &cf->cycle->new_log;
+
+        async->free[i] = task;
+    }
+
+    async->nfree = NGX_HTTP_LOG_ASYNC_BUFS;
+
+    buffer->async = async;
+
+    return NGX_CONF_OK;
+}
+
+#endif
+
+
 static u_char *
 ngx_http_log_copy_short(ngx_http_request_t *r, u_char *buf,
                         ngx_http_log_op_t *op) {
@@ -1352,6 +1681,10 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     ngx_http_log_buf_t *buffer;
     ngx_http_log_fmt_t *fmt;
     ngx_http_log_main_conf_t *lmcf;
+#if (NGX_THREADS)
+    ngx_uint_t drop;
+    ngx_str_t async;
+#endif
     ngx_http_script_compile_t sc;
     ngx_http_compile_complex_value_t ccv;
 
@@ -1466,6 +1799,10 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     size = 0;
     flush = 0;
     gzip = 0;
+#if (NGX_THREADS)
+    drop = 0;
+    ngx_str_null(&async);
+#endif
 
     for (i = 3; i < cf->args->nelts; i++) {
 
@@ -1531,6 +1868,54 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 #endif
         }
 
+        if (ngx_strncmp(value[i].data, "async=", 6) == 0) {
+#if (NGX_THREADS)
+            async.len = value[i].len - 6;
+            async.data = value[i].data + 6;
+
+            if (async.len == 0) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid thread pool name \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            if (size == 0) {
+                size = 64 * 1024;
+            }
+
+            continue;
+
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "nginx was built without threads support");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
+        if (ngx_strncmp(value[i].data, "overflow=", 9) == 0) {
+#if (NGX_THREADS)
+            if (ngx_strcmp(&value[i].data[9], "drop") == 0) {
+                drop = 1;
+                continue;
+            }
+
+            if (ngx_strcmp(&value[i].data[9], "block") == 0) {
+                drop = 0;
+                continue;
+            }
+
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid overflow \"%V\"", &value[i]);
+            return NGX_CONF_ERROR;
+
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "nginx was built without threads support");
+            return NGX_CONF_ERROR;
+#endif
+        }
+
         if (ngx_strncmp(value[i].data, "if=", 3) == 0) {
             s.len = value[i].len - 3;
             s.data = value[i].data + 3;
@@ -1566,6 +1951,15 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
         return NGX_CONF_ERROR;
     }
 
+#if (NGX_THREADS)
+    if (drop && async.len == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "no thread pool is defined for access_log \"%V\"",
+                           &value[1]);
+        return NGX_CONF_ERROR;
+    }
+#endif
+
     if (size) {
 
         if (log->script) {
@@ -1585,7 +1979,15 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 
             if (buffer->last - buffer->start != size
                 || buffer->flush != flush
-                || buffer->gzip != gzip) {
+                || buffer->gzip != gzip
+#if (NGX_THREADS)
+                || (buffer->async == NULL) != (async.len == 0)
+                || (buffer->async
+                    && (buffer->async->drop != drop
+                        || buffer->async->thread_pool
+                           != ngx_thread_pool_add(cf, &async)))
+#endif
+                ) {
                 ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                                    "access_log \"%V\" already defined "
                                    "with conflicting parameters",
@@ -1625,6 +2027,15 @@ ngx_http_log_set_log(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 
         buffer->gzip = gzip;
 
+#if (NGX_THREADS)
+        if (async.len
+            && ngx_http_log_async_init(cf, buffer, log->file, &async, drop)
+               != NGX_CONF_OK)
+        {
+            return NGX_CONF_ERROR;
+        }
+#endif
+
         log->file->flush = ngx_http_log_flush;
         log->file->data = buffer;
     }
@@ -8,6 +8,7 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 #include <ngx_http.h>
+#include <nginx.h>
 
 
 typedef struct {
@@ -26,11 +27,53 @@ typedef struct {
 
     ngx_http_variable_value_t *default_value;
     ngx_conf_t *cf;
+
+    ngx_hash_t hash;           //从二进制base中读入的完全匹配hash
+    ngx_str_t include_name;
+    ngx_str_t binary_name;     //include对应的.bin
+    ngx_uint_t binary_flags;   //include时影响key处理的参数,NGX_HTTP_MAP_BINARY_*
+    ngx_uint_t includes;
+    ngx_uint_t entries;
+
     unsigned hostnames: 1;
     unsigned no_cacheable: 1;
+    unsigned include: 1;       //正在解析include的文件
+    unsigned outside_entries: 1;
+    unsigned allow_binary_include: 1;
+    unsigned binary_include: 1;
 } ngx_http_map_conf_ctx_t;
 
 
+/*
+ * 二进制map base:include的文件中只有大量普通key时,把建好的hash(最小完美
+ * hash或者SSE2的开放寻址布局)连同value一起写到"文件名.bin",其中的指针
+ * 都保存为相对文件头的偏移.下次解析时如果文本文件内容的CRC32没变,
+ * 直接读入.bin并修正指针,跳过逐行解析和hash的构建.
+ * hostnames改变key的处理方式,带hostnames时写到"文件名.hostnames.bin",
+ * 两个参数不同的map共用一个include时各用各的.bin.
+ * nginx -t不写.bin;写时先写临时文件再rename(),配置目录不可写时只记一次notice
+ */
+
+#define NGX_HTTP_MAP_BINARY_HOSTNAMES  0x01
+
+
+typedef struct {
+    u_char MAPHSH[6];
+    u_char version;
+    u_char ptr_size;
+    uint32_t endianness;
+    uint32_t nginx;            //nginx_version
+    uint32_t hash;             //NGX_HASH_VERSION
+    uint32_t flags;            //NGX_HTTP_MAP_BINARY_*
+    uint32_t crc32;            //文件头之后所有内容的CRC32
+    uint32_t source;           //文本文件内容的CRC32
+    uint32_t values;           //value区的字节数
+    uint32_t slots;            //buckets[]的槽数
+    uint32_t seeds;            //完美hash的种子个数,0表示SSE2的开放寻址布局
+    uint32_t reserved;         //文件头保持8字节对齐,其后的value区含指针
+} ngx_http_map_header_t;
+
+
 typedef struct {
     ngx_http_map_t map;
     ngx_http_complex_value_t value;
@@ -48,6 +91,21 @@ static char *ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
 static char *ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf);
 
+static char *ngx_http_map_include(ngx_conf_t *cf, ngx_command_t *dummy,
+    void *conf, ngx_http_map_conf_ctx_t *ctx, ngx_str_t *name);
+
+static ngx_int_t ngx_http_map_include_binary_base(ngx_conf_t *cf,
+    ngx_http_map_conf_ctx_t *ctx, ngx_str_t *source_name, ngx_str_t *name);
+
+static ngx_int_t ngx_http_map_binary_keys(ngx_conf_t *cf,
+    ngx_http_map_conf_ctx_t *ctx);
+
+static void ngx_http_map_create_binary_base(ngx_http_map_conf_ctx_t *ctx,
+    ngx_hash_t *hash, ngx_log_t *log);
+
+static ngx_int_t ngx_http_map_source_crc32(ngx_str_t *name, ngx_log_t *log,
+    uint32_t *crc32);
+
 
 static ngx_command_t ngx_http_map_commands[] = {
         /*
@@ -91,14 +149,14 @@ default value如果源变量值没有匹配到任何变量,则设置一个默认
          ngx_conf_set_num_slot,
          NGX_HTTP_MAIN_CONF_OFFSET,
          offsetof(ngx_http_map_conf_t, hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("map_hash_bucket_size"),
          NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_num_slot,
          NGX_HTTP_MAIN_CONF_OFFSET,
          offsetof(ngx_http_map_conf_t, hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         ngx_null_command
 };
@@ -150,6 +208,15 @@ ngx_module_t ngx_http_map_module = {
 };
 
 
+static ngx_http_map_header_t ngx_http_map_header = {
+        {'M', 'A', 'P', 'H', 'S', 'H'}, 2, sizeof(void *), 0x12345678,
+        nginx_version, NGX_HASH_VERSION, 0, 0, 0, 0, 0, 0, 0
+};
+
+
+static ngx_uint_t ngx_http_map_binary_unwritable;
+
+
 static ngx_int_t
 ngx_http_map_variable(ngx_http_request_t *r, ngx_http_variable_value_t *v,
                       uintptr_t data) {
@@ -229,6 +296,10 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     ngx_http_variable_t *var;
     ngx_http_map_conf_ctx_t ctx;
     ngx_http_compile_complex_value_t ccv;
+#if (NGX_PCRE)
+    ngx_uint_t i;
+    ngx_str_t *patterns;
+#endif
 
     if (mcf->hash_max_size == NGX_CONF_UNSET_UINT) {
         mcf->hash_max_size = 2048;
@@ -307,8 +378,16 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 
     ctx.default_value = NULL;
     ctx.cf = &save;
+    ngx_memzero(&ctx.hash, sizeof(ngx_hash_t));
+    ngx_str_null(&ctx.include_name);
+    ctx.includes = 0;
+    ctx.entries = 0;
     ctx.hostnames = 0;
     ctx.no_cacheable = 0;
+    ctx.include = 0;
+    ctx.outside_entries = 0;
+    ctx.allow_binary_include = 1;
+    ctx.binary_include = 0;
 
     save = *cf;
     cf->pool = pool;
@@ -338,9 +417,13 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     hash.max_size = mcf->hash_max_size;
     hash.bucket_size = mcf->hash_bucket_size;
     hash.name = "map_hash";
+    hash.perfect = 1;
     hash.pool = cf->pool;
 
-    if (ctx.keys.keys.nelts) {
+    if (ctx.binary_include) {
+        map->map.hash.hash = ctx.hash;
+
+    } else if (ctx.keys.keys.nelts) {
         hash.hash = &map->map.hash.hash;
         hash.temp_pool = NULL;
 
@@ -349,6 +432,20 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             ngx_destroy_pool(pool);
             return NGX_CONF_ERROR;
         }
+
+        if (ctx.allow_binary_include
+            && !ctx.outside_entries
+            && ctx.entries > 10000
+            && ctx.includes == 1
+            && ctx.keys.dns_wc_head.nelts == 0
+            && ctx.keys.dns_wc_tail.nelts == 0
+#if (NGX_PCRE)
+            && ctx.regexes.nelts == 0
+#endif
+            ) {
+            ngx_http_map_create_binary_base(&ctx, &map->map.hash.hash,
+                                            cf->log);
+        }
     }
 
     if (ctx.keys.dns_wc_head.nelts) {
@@ -394,6 +491,23 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     if (ctx.regexes.nelts) {
         map->map.regex = ctx.regexes.elts;
         map->map.nregex = ctx.regexes.nelts;
+
+        patterns = ngx_palloc(pool, ctx.regexes.nelts * sizeof(ngx_str_t));
+        if (patterns == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
+
+        for (i = 0; i < ctx.regexes.nelts; i++) {
+            patterns[i] = map->map.regex[i].regex->name;
+        }
+
+        map->map.regex_set = ngx_regex_set_create(cf->pool, patterns,
+                                                  ctx.regexes.nelts);
+        if (map->map.regex_set == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
     }
 
 #endif
@@ -450,7 +564,7 @@ ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf) {
     }
 
     if (ngx_strcmp(value[0].data, "include") == 0) {
-        return ngx_conf_include(cf, dummy, conf);
+        return ngx_http_map_include(cf, dummy, conf, ctx, &value[1]);
     }
 
     key = 0;
@@ -516,6 +630,8 @@ ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf) {
     }
 
     if (cv.lengths != NULL) {
+        ctx->allow_binary_include = 0;
+
         cvp = ngx_palloc(ctx->keys.pool, sizeof(ngx_http_complex_value_t));
         if (cvp == NULL) {
             return NGX_CONF_ERROR;
@@ -555,9 +671,20 @@ ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf) {
 
         ctx->default_value = var;
 
+        if (ctx->include) {
+            ctx->allow_binary_include = 0;
+        }
+
         return NGX_CONF_OK;
     }
 
+    if (ctx->binary_include && ngx_http_map_binary_keys(cf, ctx) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    ctx->entries++;
+    ctx->outside_entries = 1;
+
 #if (NGX_PCRE)
 
     if (value[0].len && value[0].data[0] == '~') {
@@ -621,3 +748,674 @@ ngx_http_map(ngx_conf_t *cf, ngx_command_t *dummy, void *conf) {
 
     return NGX_CONF_ERROR;
 }
+
+
+static char *
+ngx_http_map_include(ngx_conf_t *cf, ngx_command_t *dummy, void *conf,
+                     ngx_http_map_conf_ctx_t *ctx, ngx_str_t *name) {
+    char *rv;
+    unsigned include;
+    ngx_str_t file, bin, suffix;
+
+    if (ctx->include || strpbrk((char *) name->data, "*?[") != NULL) {
+        ctx->allow_binary_include = 0;
+        return ngx_conf_include(cf, dummy, conf);
+    }
+
+    file.len = name->len;
+    file.data = ngx_pnalloc(ctx->keys.temp_pool, name->len + 1);
+    if (file.data == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_cpystrn(file.data, name->data, name->len + 1);
+
+    if (ngx_conf_full_name(cf->cycle, &file, 1) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (ctx->hostnames) {
+        ngx_str_set(&suffix, ".hostnames.bin");
+
+    } else {
+        ngx_str_set(&suffix, ".bin");
+    }
+
+    bin.len = file.len + suffix.len;
+    bin.data = ngx_pnalloc(ctx->keys.temp_pool, bin.len + 1);
+    if (bin.data == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_sprintf(bin.data, "%V%V%Z", &file, &suffix);
+
+    /* 已经读入的base要按读入时的参数放回keys,见ngx_http_map_binary_keys */
+
+    if (!ctx->binary_include) {
+        ctx->binary_flags = ctx->hostnames ? NGX_HTTP_MAP_BINARY_HOSTNAMES : 0;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, cf->log, 0, "include %s", bin.data);
+
+    switch (ngx_http_map_include_binary_base(cf, ctx, &file, &bin)) {
+        case NGX_OK:
+            return NGX_CONF_OK;
+        case NGX_ERROR:
+            return NGX_CONF_ERROR;
+        default:
+            break;
+    }
+
+    ctx->include_name = file;
+    ctx->binary_name = bin;
+
+    if (ctx->outside_entries) {
+        ctx->allow_binary_include = 0;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_CORE, cf->log, 0, "include %s", file.data);
+
+    include = ctx->include;
+    ctx->include = 1;
+
+    rv = ngx_conf_parse(cf, &file);
+
+    ctx->include = include;
+    ctx->includes++;
+    ctx->outside_entries = 0;
+
+    return rv;
+}
+
+
+static ngx_int_t
+ngx_http_map_include_binary_base(ngx_conf_t *cf, ngx_http_map_conf_ctx_t *ctx,
+                                 ngx_str_t *source_name, ngx_str_t *name) {
+    u_char *base, *last;
+    size_t size, len;
+    ssize_t n;
+    uint32_t source;
+    ngx_err_t err;
+    ngx_int_t rc;
+    ngx_uint_t i, slots;
+    ngx_file_t file;
+    ngx_pool_t *pool;
+    ngx_hash_t *hash;
+    ngx_reuse_t *rs;
+    ngx_file_info_t fi;
+    ngx_hash_elt_t *elt, **buckets;
+    ngx_http_map_header_t *header;
+    ngx_http_variable_value_t *vv;
+
+    if (ctx->outside_entries || ctx->binary_include) {
+        return NGX_DECLINED;
+    }
+
+    /* .bin只对应生成它时的文本内容,与修改时间无关 */
+
+    if (ngx_http_map_source_crc32(source_name, cf->log, &source) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    /* reload时文本没变,直接接过旧配置中已经读入的hash */
+
+    rs = ngx_reuse_get(cf, name, source);
+
+    if (rs) {
+        ngx_conf_log_error(NGX_LOG_NOTICE, cf, 0,
+                           "reusing binary map base \"%s\"", name->data);
+
+        ctx->hash = *(ngx_hash_t *) rs->data;
+        ctx->include_name = *source_name;
+        ctx->binary_name = *name;
+        ctx->binary_include = 1;
+        ctx->includes++;
+
+        return NGX_OK;
+    }
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+    file.name = *name;
+    file.log = cf->log;
+
+    file.fd = ngx_open_file(name->data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        err = ngx_errno;
+        if (err != NGX_ENOENT) {
+            ngx_conf_log_error(NGX_LOG_CRIT, cf, err,
+                               ngx_open_file_n " \"%s\" failed", name->data);
+        }
+        return NGX_DECLINED;
+    }
+
+    pool = NULL;
+
+    if (ngx_fd_info(file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_conf_log_error(NGX_LOG_CRIT, cf, ngx_errno,
+                           ngx_fd_info_n " \"%s\" failed", name->data);
+        goto failed;
+    }
+
+    size = (size_t) ngx_file_size(&fi);
+
+    if (size < sizeof(ngx_http_map_header_t)) {
+        goto incompatible;
+    }
+
+    /* 读入的base不属于cycle,reload时可以复用,见ngx_reuse_get */
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, cf->log);
+    if (pool == NULL) {
+        goto failed;
+    }
+
+    base = ngx_palloc(pool, size);
+    if (base == NULL) {
+        goto failed;
+    }
+
+    n = ngx_read_file(&file, base, size, 0);
+
+    if (n == NGX_ERROR) {
+        ngx_conf_log_error(NGX_LOG_CRIT, cf, ngx_errno,
+                           ngx_read_file_n " \"%s\" failed", name->data);
+        goto failed;
+    }
+
+    if ((size_t) n != size) {
+        ngx_conf_log_error(NGX_LOG_CRIT, cf, 0,
+                           ngx_read_file_n " \"%s\" returned only %z bytes instead of %z",
+                           name->data, n, size);
+        goto failed;
+    }
+
+    header = (ngx_http_map_header_t *) base;
+
+    if (ngx_memcmp(&ngx_http_map_header, header,
+                   offsetof(ngx_http_map_header_t, flags))
+        != 0
+        || header->flags != ctx->binary_flags) {
+        goto incompatible;
+    }
+
+    if (header->source != source) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "stale binary map base \"%s\"", name->data);
+        goto failed;
+    }
+
+    if (header->crc32 != ngx_crc32_long(base + sizeof(ngx_http_map_header_t),
+                                        size - sizeof(ngx_http_map_header_t))) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "CRC32 mismatch in binary map base \"%s\"", name->data);
+        goto failed;
+    }
+
+    slots = header->slots;
+
+    if (header->seeds) {
+        len = header->seeds * sizeof(uint32_t);
+
+        if (header->seeds & (header->seeds - 1)) {
+            goto incompatible;
+        }
+
+    } else {
+#if (NGX_HAVE_SSE2)
+        len = slots;
+
+        if (slots % NGX_HASH_GROUP
+            || ((slots / NGX_HASH_GROUP) & (slots / NGX_HASH_GROUP - 1))) {
+            goto incompatible;
+        }
+#else
+        goto incompatible;
+#endif
+    }
+
+    len = ngx_align(sizeof(ngx_http_map_header_t) + header->values + len,
+                    sizeof(void *));
+
+    if (slots == 0 || len + slots * sizeof(ngx_hash_elt_t *) > size) {
+        goto incompatible;
+    }
+
+    /* 把偏移修正为指针 */
+
+    vv = (ngx_http_variable_value_t *) (base + sizeof(ngx_http_map_header_t));
+    last = (u_char *) vv + header->values;
+
+    while ((u_char *) vv < last) {
+        vv->data += (size_t) base;
+        vv = (ngx_http_variable_value_t *)
+                ((u_char *) vv + ngx_align(sizeof(ngx_http_variable_value_t)
+                                           + vv->len, sizeof(void *)));
+    }
+
+    buckets = (ngx_hash_elt_t **) (base + len);
+
+    for (i = 0; i < slots; i++) {
+        if (buckets[i] == NULL) {
+            continue;
+        }
+
+        if ((size_t) buckets[i] >= size) {
+            goto incompatible;
+        }
+
+        elt = (ngx_hash_elt_t *) (base + (size_t) buckets[i]);
+
+        if ((size_t) elt->value >= size) {
+            goto incompatible;
+        }
+
+        elt->value = base + (size_t) elt->value;
+        buckets[i] = elt;
+    }
+
+    hash = ngx_palloc(pool, sizeof(ngx_hash_t));
+    if (hash == NULL) {
+        goto failed;
+    }
+
+    hash->buckets = buckets;
+
+    if (header->seeds) {
+        hash->size = slots;
+        hash->seeds = (uint32_t *) last;
+        hash->pmask = header->seeds - 1;
+        hash->ctrl = NULL;
+
+    } else {
+        hash->size = slots / NGX_HASH_GROUP;
+        hash->ctrl = last;
+        hash->seeds = NULL;
+    }
+
+    rs = ngx_reuse_add(cf, name, source, pool);
+    if (rs == NULL) {
+        goto failed;
+    }
+
+    rs->data = hash;
+    pool = NULL;
+
+    ngx_conf_log_error(NGX_LOG_NOTICE, cf, 0,
+                       "using binary map base \"%s\"", name->data);
+
+    ctx->hash = *hash;
+    ctx->include_name = *source_name;
+    ctx->binary_name = *name;
+    ctx->binary_include = 1;
+    ctx->includes++;
+    rc = NGX_OK;
+
+    goto done;
+
+    incompatible:
+
+    ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                       "incompatible binary map base \"%s\"", name->data);
+
+    failed:
+
+    rc = NGX_DECLINED;
+
+    done:
+
+    if (pool) {
+        ngx_destroy_pool(pool);
+    }
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, cf->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", name->data);
+    }
+
+    return rc;
+}
+
+
+/* 二进制base之后还有普通条目时,把base中的key放回keys数组,按文本方式建hash */
+
+static ngx_int_t
+ngx_http_map_binary_keys(ngx_conf_t *cf, ngx_http_map_conf_ctx_t *ctx) {
+    ngx_int_t rc;
+    ngx_str_t key;
+    ngx_uint_t i, n;
+    ngx_hash_elt_t *elt;
+
+    n = ctx->hash.size;
+
+    if (ctx->hash.ctrl) {
+        n *= NGX_HASH_GROUP;
+    }
+
+    for (i = 0; i < n; i++) {
+        elt = ctx->hash.buckets[i];
+
+        if (elt == NULL) {
+            continue;
+        }
+
+        key.len = elt->len;
+        key.data = elt->name;
+
+        rc = ngx_hash_add_key(&ctx->keys, &key, elt->value,
+                              (ctx->binary_flags
+                               & NGX_HTTP_MAP_BINARY_HOSTNAMES)
+                              ? NGX_HASH_WILDCARD_KEY : 0);
+
+        if (rc != NGX_OK) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "binary map base \"%s\" cannot be mixed with usual entries",
+                               ctx->binary_name.data);
+            return NGX_ERROR;
+        }
+
+        ctx->entries++;
+    }
+
+    ngx_memzero(&ctx->hash, sizeof(ngx_hash_t));
+
+    ctx->binary_include = 0;
+    ctx->allow_binary_include = 0;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_map_create_binary_base(ngx_http_map_conf_ctx_t *ctx,
+                                ngx_hash_t *hash, ngx_log_t *log) {
+    u_char *p, *values, *base, *temp;
+    size_t len, size, total;
+    ssize_t written;
+    uint32_t source;
+    ngx_fd_t fd;
+    ngx_err_t err;
+    ngx_uint_t i, j, k, n, slots, *first, *offsets;
+    ngx_hash_elt_t *elt, *e, **buckets;
+    ngx_http_map_header_t *header;
+    ngx_http_variable_value_t *vv, **vp;
+
+    /* nginx -t只检查配置,不改动配置目录 */
+
+    if (ngx_test_config) {
+        return;
+    }
+
+    if (hash->seeds) {
+        slots = hash->size;
+        size = (hash->pmask + 1) * sizeof(uint32_t);
+
+    } else if (hash->ctrl) {
+        slots = hash->size * NGX_HASH_GROUP;
+        size = slots;
+
+    } else {
+        return;
+    }
+
+    if (ngx_http_map_source_crc32(&ctx->include_name, log, &source) != NGX_OK) {
+        return;
+    }
+
+    /* 每个value在offsets[]中的下标是first[桶] + 在桶中的序号 */
+
+    first = ngx_palloc(ctx->keys.temp_pool,
+                       ctx->keys.hsize * sizeof(ngx_uint_t));
+    if (first == NULL) {
+        return;
+    }
+
+    n = 0;
+    len = 0;
+
+    for (k = 0; k < ctx->keys.hsize; k++) {
+        first[k] = n;
+
+        vp = ctx->values_hash[k].elts;
+
+        for (i = 0; i < ctx->values_hash[k].nelts; i++) {
+            len += ngx_align(sizeof(ngx_http_variable_value_t) + vp[i]->len,
+                             sizeof(void *));
+        }
+
+        n += ctx->values_hash[k].nelts;
+    }
+
+    offsets = ngx_palloc(ctx->keys.temp_pool, n * sizeof(ngx_uint_t));
+    if (offsets == NULL) {
+        return;
+    }
+
+    temp = ngx_pnalloc(ctx->keys.temp_pool,
+                       ctx->binary_name.len + 1 + NGX_INT64_LEN + 1);
+    if (temp == NULL) {
+        return;
+    }
+
+    ngx_sprintf(temp, "%V.%P%Z", &ctx->binary_name, ngx_pid);
+
+    total = ngx_align(sizeof(ngx_http_map_header_t) + len + size,
+                      sizeof(void *))
+            + slots * sizeof(ngx_hash_elt_t *);
+
+    for (i = 0; i < slots; i++) {
+        if (hash->buckets[i]) {
+            total += sizeof(void *)
+                       + ngx_align(hash->buckets[i]->len + 2, sizeof(void *));
+        }
+    }
+
+    base = ngx_calloc(total, log);
+    if (base == NULL) {
+        return;
+    }
+
+    p = ngx_cpymem(base, &ngx_http_map_header, sizeof(ngx_http_map_header_t));
+
+    values = p;
+
+    for (k = 0, n = 0; k < ctx->keys.hsize; k++) {
+        vp = ctx->values_hash[k].elts;
+
+        for (i = 0; i < ctx->values_hash[k].nelts; i++) {
+            offsets[n++] = p - base;
+
+            vv = (ngx_http_variable_value_t *) p;
+            *vv = *vp[i];
+            p += sizeof(ngx_http_variable_value_t);
+            vv->data = (u_char *) (p - base);
+
+            p = ngx_cpymem(p, vp[i]->data, vp[i]->len);
+            p = ngx_align_ptr(p, sizeof(void *));
+        }
+    }
+
+    header = (ngx_http_map_header_t *) base;
+    header->flags = (uint32_t) ctx->binary_flags;
+    header->source = source;
+    header->values = (uint32_t) (p - values);
+    header->slots = (uint32_t) slots;
+
+    if (hash->seeds) {
+        header->seeds = (uint32_t) (hash->pmask + 1);
+        p = ngx_cpymem(p, hash->seeds, size);
+
+    } else {
+        header->seeds = 0;
+        p = ngx_cpymem(p, hash->ctrl, size);
+    }
+
+    p = ngx_align_ptr(p, sizeof(void *));
+
+    buckets = (ngx_hash_elt_t **) p;
+    p += slots * sizeof(ngx_hash_elt_t *);
+
+    for (i = 0; i < slots; i++) {
+        e = hash->buckets[i];
+
+        if (e == NULL) {
+            buckets[i] = NULL;
+            continue;
+        }
+
+        vv = e->value;
+
+        for (k = 0, j = 0; j < vv->len; j++) {
+            k = ngx_hash(k, vv->data[j]);
+        }
+
+        k %= ctx->keys.hsize;
+
+        vp = ctx->values_hash[k].elts;
+
+        for (j = 0; vp[j] != vv; j++) {
+            /* void */
+        }
+
+        elt = (ngx_hash_elt_t *) p;
+        elt->value = (void *) offsets[first[k] + j];
+        elt->len = e->len;
+        ngx_memcpy(elt->name, e->name, e->len);
+
+        buckets[i] = (ngx_hash_elt_t *) (p - base);
+
+        p += sizeof(void *) + ngx_align(e->len + 2, sizeof(void *));
+    }
+
+    header->crc32 = ngx_crc32_long(base + sizeof(ngx_http_map_header_t),
+                                   total - sizeof(ngx_http_map_header_t));
+
+    /* 先写临时文件再rename(),正在读.bin的进程不会看到写了一半的内容 */
+
+    fd = ngx_open_file(temp, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                       NGX_FILE_DEFAULT_ACCESS);
+
+    if (fd == NGX_INVALID_FILE) {
+        err = ngx_errno;
+
+        if (err == NGX_EACCES || err == NGX_EPERM || err == NGX_EROFS) {
+            if (!ngx_http_map_binary_unwritable) {
+                ngx_http_map_binary_unwritable = 1;
+                ngx_log_error(NGX_LOG_NOTICE, log, err,
+                              "binary map base \"%s\" is not written",
+                              ctx->binary_name.data);
+            }
+
+        } else {
+            ngx_log_error(NGX_LOG_CRIT, log, err,
+                          ngx_open_file_n " \"%s\" failed", temp);
+        }
+
+        ngx_free(base);
+        return;
+    }
+
+    written = ngx_write_fd(fd, base, total);
+
+    if (written == -1) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_write_fd_n " \"%s\" failed", temp);
+
+    } else if ((size_t) written != total) {
+        ngx_log_error(NGX_LOG_CRIT, log, 0,
+                      ngx_write_fd_n " \"%s\" has written only %z of %uz",
+                      temp, written, total);
+        written = -1;
+    }
+
+    ngx_free(base);
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", temp);
+        written = -1;
+    }
+
+    if (written != -1) {
+        if (ngx_rename_file(temp, ctx->binary_name.data) != NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_NOTICE, log, 0,
+                          "created binary map base \"%s\"",
+                          ctx->binary_name.data);
+            return;
+        }
+
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_rename_file_n " \"%s\" to \"%s\" failed",
+                      temp, ctx->binary_name.data);
+    }
+
+    if (ngx_delete_file(temp) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed", temp);
+    }
+}
+
+
+static ngx_int_t
+ngx_http_map_source_crc32(ngx_str_t *name, ngx_log_t *log, uint32_t *crc32) {
+    u_char *buf;
+    size_t size;
+    ssize_t n;
+    ngx_int_t rc;
+    ngx_file_t file;
+    ngx_file_info_t fi;
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+    file.name = *name;
+    file.log = log;
+
+    file.fd = ngx_open_file(name->data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed", name->data);
+        return NGX_ERROR;
+    }
+
+    rc = NGX_ERROR;
+
+    if (ngx_fd_info(file.fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", name->data);
+        goto done;
+    }
+
+    size = (size_t) ngx_file_size(&fi);
+
+    buf = ngx_alloc(size + 1, log);
+    if (buf == NULL) {
+        goto done;
+    }
+
+    n = ngx_read_file(&file, buf, size, 0);
+
+    if (n == NGX_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_read_file_n " \"%s\" failed", name->data);
+
+    } else if ((size_t) n != size) {
+        ngx_log_error(NGX_LOG_CRIT, log, 0,
+                      ngx_read_file_n " \"%s\" returned only %z bytes instead of %z",
+                      name->data, n, size);
+
+    } else {
+        *crc32 = ngx_crc32_long(buf, size);
+        rc = NGX_OK;
+    }
+
+    ngx_free(buf);
+
+    done:
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", name->data);
+    }
+
+    return rc;
+}
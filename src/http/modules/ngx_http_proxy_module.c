@@ -724,14 +724,14 @@ nginx忽略被代理服务器的应答数目和所有应答的大小,接受proxy
          ngx_conf_set_num_slot,
          NGX_HTTP_LOC_CONF_OFFSET,
          offsetof(ngx_http_proxy_loc_conf_t, headers_hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("proxy_headers_hash_bucket_size"),
          NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_num_slot,
          NGX_HTTP_LOC_CONF_OFFSET,
          offsetof(ngx_http_proxy_loc_conf_t, headers_hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
         /*
 Allows redefining the request body passed to the proxied server. The value can contain text, variables, and their combination.
 */ //设置通过后端的body的值,这个值可以包含变量.
@@ -4427,6 +4427,7 @@ ngx_http_proxy_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
     hash.max_size = conf->headers_hash_max_size;
     hash.bucket_size = conf->headers_hash_bucket_size;
     hash.name = "proxy_headers_hash";
+    hash.perfect = 0;
 
     if (ngx_http_upstream_hide_headers_hash(cf, &conf->upstream,
                                             &prev->upstream, ngx_http_proxy_hide_headers, &hash)
@@ -4680,6 +4681,7 @@ ngx_http_proxy_init_headers(ngx_conf_t *cf, ngx_http_proxy_loc_conf_t *conf,
     hash.max_size = conf->headers_hash_max_size;
     hash.bucket_size = conf->headers_hash_bucket_size;
     hash.name = "proxy_headers_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
@@ -193,14 +193,14 @@ referer_hash_max_size配置  默认2048  并不是表示实际需要2048个桶,
          ngx_conf_set_num_slot,
          NGX_HTTP_LOC_CONF_OFFSET,
          offsetof(ngx_http_referer_conf_t, referer_hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("referer_hash_bucket_size"),
          NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_num_slot,
          NGX_HTTP_LOC_CONF_OFFSET,
          offsetof(ngx_http_referer_conf_t, referer_hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         ngx_null_command
 };
@@ -517,6 +517,7 @@ ngx_http_referer_merge_conf(ngx_conf_t *cf, void *parent, void *child) {
     hash.max_size = conf->referer_hash_max_size;
     hash.bucket_size = conf->referer_hash_bucket_size;
     hash.name = "referer_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
 
     if (conf->keys->keys.nelts) {
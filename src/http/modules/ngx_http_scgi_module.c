@@ -1575,6 +1575,7 @@ ngx_http_scgi_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
     hash.max_size = 512;
     hash.bucket_size = ngx_align(64, ngx_cacheline_size);
     hash.name = "scgi_hide_headers_hash";
+    hash.perfect = 0;
 
     if (ngx_http_upstream_hide_headers_hash(cf, &conf->upstream,
                                             &prev->upstream, ngx_http_scgi_hide_headers, &hash)
@@ -1832,6 +1833,7 @@ ngx_http_scgi_init_params(ngx_conf_t *cf, ngx_http_scgi_loc_conf_t *conf,
     hash.max_size = 512;
     hash.bucket_size = 64;
     hash.name = "scgi_params_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
@@ -2830,6 +2830,7 @@ ngx_http_ssi_init_main_conf(ngx_conf_t *cf, void *conf) {
     hash.max_size = 1024;
     hash.bucket_size = ngx_cacheline_size;
     hash.name = "ssi_command_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
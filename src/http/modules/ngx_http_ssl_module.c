@@ -198,7 +198,7 @@ static ngx_command_t ngx_http_ssl_commands[] = {
          NULL},
 
         {ngx_string("ssl_session_cache"),
-         NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_CONF_TAKE12,
+         NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_CONF_TAKE123,
          ngx_http_ssl_session_cache,
          NGX_HTTP_SRV_CONF_OFFSET,
          0,
@@ -1030,10 +1030,12 @@ ngx_http_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     size_t len;
     ngx_str_t *value, name, size;
     ngx_int_t n;
-    ngx_uint_t i, j;
+    ngx_uint_t i, j, hugepages;
 
     value = cf->args->elts;
 
+    hugepages = 0;
+
     for (i = 1; i < cf->args->nelts; i++) {
 
         if (ngx_strcmp(value[i].data, "off") == 0) {
@@ -1046,6 +1048,11 @@ ngx_http_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             continue;
         }
 
+        if (ngx_strcmp(value[i].data, "hugepages") == 0) {
+            hugepages = 1;
+            continue;
+        }
+
         if (ngx_strcmp(value[i].data, "builtin") == 0) {
             sscf->builtin_session_cache = NGX_SSL_DFLT_BUILTIN_SCACHE;
             continue;
@@ -1117,6 +1124,16 @@ ngx_http_ssl_session_cache(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
         goto invalid;
     }
 
+    if (hugepages) {
+        if (sscf->shm_zone == NULL) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "\"hugepages\" requires shared session cache");
+            return NGX_CONF_ERROR;
+        }
+
+        sscf->shm_zone->shm.hugepages = NGX_SHM_HUGEPAGES_ON;
+    }
+
     if (sscf->shm_zone && sscf->builtin_session_cache == NGX_CONF_UNSET) {
         sscf->builtin_session_cache = NGX_SSL_NO_BUILTIN_SCACHE;
     }
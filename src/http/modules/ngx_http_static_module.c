@@ -111,7 +111,7 @@ ngx_http_static_handler(ngx_http_request_t *r) { //注意:ngx_http_static_handle
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
     of.read_ahead = clcf->read_ahead;
-    of.is_directio = clcf->directio;
+    of.directio = clcf->directio;
     of.valid = clcf->open_file_cache_valid;
     of.min_uses = clcf->open_file_cache_min_uses;
     of.errors = clcf->open_file_cache_errors;
@@ -121,8 +121,15 @@ ngx_http_static_handler(ngx_http_request_t *r) { //注意:ngx_http_static_handle
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    if (ngx_open_cached_file(clcf->open_file_cache, &path, &of, r->pool)
-        != NGX_OK) {
+    rc = ngx_http_open_cached_file(r, clcf, &path, &of);
+
+    if (rc == NGX_AGAIN) {
+        //open()在线程池中执行,完成后重新进入该函数
+        r->main->count++;
+        return NGX_DONE;
+    }
+
+    if (rc != NGX_OK) {
         switch (of.err) {
 
             case 0:
@@ -10,13 +10,28 @@
 #include <ngx_http.h>
 
 
+typedef struct {
+    ngx_uint_t large_allocs; /* unsigned large_allocs:1 */ //"stub_status large_allocs;"时输出大块内存统计
+    ngx_uint_t zones;        /* unsigned zones:1 */ //"stub_status zones;"时输出每个共享内存区的统计
+    ngx_uint_t threads;      /* unsigned threads:1 */ //"stub_status threads;"时输出线程池的统计
+    ngx_uint_t locks;        /* unsigned locks:1 */ //"stub_status locks;"时输出accept锁的统计
+} ngx_http_stub_status_loc_conf_t;
+
+
 static ngx_int_t ngx_http_stub_status_handler(ngx_http_request_t *r);
 
+static size_t ngx_http_stub_status_large_len(ngx_pool_large_stat_t *ls);
+
+static u_char *ngx_http_stub_status_lock(ngx_buf_t *b, char *prefix,
+                                         ngx_str_t *name, ngx_shmtx_stat_t *st);
+
 static ngx_int_t ngx_http_stub_status_variable(ngx_http_request_t *r,
                                                ngx_http_variable_value_t *v, uintptr_t data);
 
 static ngx_int_t ngx_http_stub_status_add_variables(ngx_conf_t *cf);
 
+static void *ngx_http_stub_status_create_loc_conf(ngx_conf_t *cf);
+
 static char *ngx_http_set_stub_status(ngx_conf_t *cf, ngx_command_t *cmd,
                                       void *conf);
 
@@ -24,9 +39,9 @@ static char *ngx_http_set_stub_status(ngx_conf_t *cf, ngx_command_t *cmd,
 static ngx_command_t ngx_http_status_commands[] = {
 
         {ngx_string("stub_status"),
-         NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_NOARGS | NGX_CONF_TAKE1,
+         NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_ANY,
          ngx_http_set_stub_status,
-         0,
+         NGX_HTTP_LOC_CONF_OFFSET,
          0,
          NULL},
 
@@ -44,7 +59,7 @@ static ngx_http_module_t ngx_http_stub_status_module_ctx = {
         NULL,                                  /* create server configuration */
         NULL,                                  /* merge server configuration */
 
-        NULL,                                  /* create location configuration */
+        ngx_http_stub_status_create_loc_conf,  /* create location configuration */
         NULL                                   /* merge location configuration */
 };
 
@@ -89,7 +104,17 @@ ngx_http_stub_status_handler(ngx_http_request_t *r) {
     ngx_int_t rc;
     ngx_buf_t *b;
     ngx_chain_t out;
+    ngx_uint_t n;
     ngx_atomic_int_t ap, hn, ac, rq, rd, wr, wa;
+    ngx_pool_large_stat_t ls;
+    ngx_slab_pool_stat_t ss;
+    ngx_shmtx_stat_t ms;
+    ngx_shm_zone_t *zone;
+    ngx_list_part_t *part;
+    ngx_http_stub_status_loc_conf_t *sscf;
+#if (NGX_THREADS)
+    ngx_thread_pool_stats_t st;
+#endif
 
     if (!(r->method & (NGX_HTTP_GET | NGX_HTTP_HEAD))) {
         return NGX_HTTP_NOT_ALLOWED;
@@ -110,6 +135,69 @@ ngx_http_stub_status_handler(ngx_http_request_t *r) {
            + 6 + 3 * NGX_ATOMIC_T_LEN
            + sizeof("Reading:  Writing:  Waiting:  \n") + 3 * NGX_ATOMIC_T_LEN;
 
+    sscf = ngx_http_get_module_loc_conf(r, ngx_http_stub_status_module);
+
+#if (NGX_THREADS)
+
+    /* 线程池的统计只是处理这个请求的worker进程的 */
+
+    for (n = 0; sscf->threads; n++) {
+        if (ngx_thread_pool_stats((ngx_cycle_t *) ngx_cycle, n, &st) != NGX_OK) {
+            break;
+        }
+
+        size += sizeof("Thread pool : threads  queued  tasks  steals "
+                       " wait ms run ms \n") - 1
+                + st.name.len + 6 * NGX_INT64_LEN;
+    }
+
+#endif
+
+    /*
+     * 大块内存统计同样只是本worker进程的,多留一行,
+     * 因为下面分配输出缓冲区本身也可能产生一个新的源文件
+     */
+
+    if (sscf->large_allocs) {
+
+        for (n = 0; /* void */ ; n++) {
+            if (ngx_pool_large_stats(n, &ls) != NGX_OK) {
+                break;
+            }
+
+            size += ngx_http_stub_status_large_len(&ls);
+        }
+
+        size += ngx_http_stub_status_large_len(NULL);
+    }
+
+    part = &((ngx_cycle_t *) ngx_cycle)->shared_memory.part;
+    zone = part->elts;
+
+    for (n = 0; sscf->zones; n++) {
+
+        if (n >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            zone = part->elts;
+            n = 0;
+        }
+
+        size += sizeof("Zone : pages  free  runs  largest  contended \n") - 1
+                + sizeof("Zone  lock: acquisitions  contended  spins  sleeps "
+                         " hold us/ \n") - 1
+                + 2 * zone[n].shm.name.len + 10 * NGX_INT_T_LEN
+                + NGX_INT64_LEN;
+    }
+
+    if (sscf->locks) {
+        size += sizeof("Accept mutex: acquisitions  contended  spins  sleeps "
+                       " hold us/ \n") - 1
+                + 5 * NGX_INT_T_LEN + NGX_INT64_LEN;
+    }
+
     b = ngx_create_temp_buf(r->pool, size);
     if (b == NULL) {
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
@@ -136,6 +224,71 @@ ngx_http_stub_status_handler(ngx_http_request_t *r) {
     b->last = ngx_sprintf(b->last, "Reading: %uA Writing: %uA Waiting: %uA \n",
                           rd, wr, wa);
 
+#if (NGX_THREADS)
+
+    for (n = 0; sscf->threads; n++) {
+        if (ngx_thread_pool_stats((ngx_cycle_t *) ngx_cycle, n, &st) != NGX_OK) {
+            break;
+        }
+
+        b->last = ngx_sprintf(b->last, "Thread pool %V: threads %ui queued %ui "
+                              "tasks %ui steals %ui wait %uLms run %uLms \n",
+                              &st.name, st.threads, st.queued, st.tasks,
+                              st.steals, st.wait_time / 1000,
+                              st.run_time / 1000);
+    }
+
+#endif
+
+    for (n = 0; sscf->large_allocs; n++) {
+        if (ngx_pool_large_stats(n, &ls) != NGX_OK) {
+            break;
+        }
+
+        b->last = ngx_slprintf(b->last, b->end,
+                               "Large alloc %V: allocs %ui bytes %uz "
+                               "current %uz \n",
+                               &ls.name, ls.allocs, ls.bytes, ls.current);
+    }
+
+    /*
+     * 共享内存区是所有worker共用的,碎片用空闲页段数和最大空闲段表示.
+     * 遍历空闲页要拿每个区的锁,所以只在显式打开时输出
+     */
+
+    part = &((ngx_cycle_t *) ngx_cycle)->shared_memory.part;
+    zone = part->elts;
+
+    for (n = 0; sscf->zones; n++) {
+
+        if (n >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+            part = part->next;
+            zone = part->elts;
+            n = 0;
+        }
+
+        ngx_slab_stats((ngx_slab_pool_t *) zone[n].shm.addr, &ss);
+
+        b->last = ngx_slprintf(b->last, b->end,
+                               "Zone %V: pages %ui free %ui runs %ui "
+                               "largest %ui contended %ui \n",
+                               &zone[n].shm.name, ss.pages, ss.free,
+                               ss.free_runs, ss.largest, ss.contended);
+
+        b->last = ngx_http_stub_status_lock(b, "Zone ", &zone[n].shm.name,
+                                            &ss.lock);
+    }
+
+    if (sscf->locks && ngx_accept_mutex_ptr) {
+        ngx_memzero(&ms, sizeof(ngx_shmtx_stat_t));
+        ngx_shmtx_stats(&ngx_accept_mutex, &ms);
+
+        b->last = ngx_http_stub_status_lock(b, "Accept mutex", NULL, &ms);
+    }
+
     r->headers_out.status = NGX_HTTP_OK;
     r->headers_out.content_length_n = b->last - b->pos;
 
@@ -152,6 +305,37 @@ ngx_http_stub_status_handler(ngx_http_request_t *r) {
 }
 
 
+//ls为NULL时按最长的源文件名预留
+static size_t
+ngx_http_stub_status_large_len(ngx_pool_large_stat_t *ls) {
+    return sizeof("Large alloc : allocs  bytes  current  \n") - 1
+           + (ls ? ls->name.len : NGX_MAX_PATH) + 3 * NGX_INT64_LEN;
+}
+
+
+//持锁时间是抽样统计的,输出抽样的平均值和样本数
+static u_char *
+ngx_http_stub_status_lock(ngx_buf_t *b, char *prefix, ngx_str_t *name,
+                          ngx_shmtx_stat_t *st) {
+    u_char *p;
+
+    p = ngx_slprintf(b->last, b->end, "%s", prefix);
+
+    if (name) {
+        p = ngx_slprintf(p, b->end, "%V lock", name);
+    }
+
+    return ngx_slprintf(p, b->end,
+                        ": acquisitions %ui contended %ui spins %ui sleeps %ui"
+                        " hold %uLus/%ui \n",
+                        st->acquisitions, st->contended, st->spins,
+                        st->sleeps,
+                        st->hold_samples ? st->hold_time / st->hold_samples
+                                         : (uint64_t) 0,
+                        st->hold_samples);
+}
+
+
 static ngx_int_t
 ngx_http_stub_status_variable(ngx_http_request_t *r,
                               ngx_http_variable_value_t *v, uintptr_t data) {
@@ -214,10 +398,75 @@ ngx_http_stub_status_add_variables(ngx_conf_t *cf) {
 }
 
 
+static void *
+ngx_http_stub_status_create_loc_conf(ngx_conf_t *cf) {
+    ngx_http_stub_status_loc_conf_t *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_stub_status_loc_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->large_allocs = 0;
+     *     conf->zones = 0;
+     *     conf->threads = 0;
+     *     conf->locks = 0;
+     */
+
+    return conf;
+}
+
+
+/*
+ * stub_status [large_allocs] [zones] [threads] [locks];
+ * 默认只输出基本的连接统计和不用加锁就能读到的计数,额外的统计要显式打开;
+ * 兼容旧的"stub_status on;"写法
+ */
 static char *
 ngx_http_set_stub_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
+    ngx_http_stub_status_loc_conf_t *sscf = conf;
+
+    ngx_str_t *value;
+    ngx_uint_t i;
     ngx_http_core_loc_conf_t *clcf;
 
+    value = cf->args->elts;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        if (ngx_strcmp(value[i].data, "large_allocs") == 0) {
+            sscf->large_allocs = 1;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "zones") == 0) {
+            sscf->zones = 1;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "threads") == 0) {
+            sscf->threads = 1;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "locks") == 0) {
+            sscf->locks = 1;
+            continue;
+        }
+
+        if (i == 1 && cf->args->nelts == 2
+            && ngx_strcmp(value[i].data, "on") == 0) {
+            continue;
+        }
+
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid parameter \"%V\"", &value[i]);
+        return NGX_CONF_ERROR;
+    }
+
     clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
     clcf->handler = ngx_http_stub_status_handler;
 
@@ -25,6 +25,12 @@ typedef struct {
 } ngx_http_try_files_loc_conf_t;
 
 
+//aio_open时open()在线程池中执行,记录正在检查的文件,完成后从这里继续
+typedef struct {
+    ngx_http_try_file_t *current;
+} ngx_http_try_files_ctx_t;
+
+
 static ngx_int_t ngx_http_try_files_handler(ngx_http_request_t *r);
 
 static char *ngx_http_try_files(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
@@ -84,8 +90,10 @@ ngx_http_try_files_handler(ngx_http_request_t *r) {
     u_char *p, *name;
     ngx_str_t path, args;
     ngx_uint_t test_dir;
-    ngx_http_try_file_t *tf;
+    ngx_int_t rc;
+    ngx_http_try_file_t *tf, *current;
     ngx_open_file_info_t of;
+    ngx_http_try_files_ctx_t *ctx;
     ngx_http_script_code_pt code;
     ngx_http_script_engine_t e;
     ngx_http_core_loc_conf_t *clcf;
@@ -107,7 +115,9 @@ ngx_http_try_files_handler(ngx_http_request_t *r) {
     /* suppress MSVC warning */
     path.data = NULL;
 
-    tf = tlcf->try_files;
+    ctx = ngx_http_get_module_ctx(r, ngx_http_try_files_module);
+
+    tf = ctx ? ctx->current : tlcf->try_files;
 
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
@@ -186,6 +196,8 @@ ngx_http_try_files_handler(ngx_http_request_t *r) {
 
         test_dir = tf->test_dir;
 
+        current = tf;
+
         tf++;
 
         ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
@@ -217,7 +229,7 @@ ngx_http_try_files_handler(ngx_http_request_t *r) {
         ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
         of.read_ahead = clcf->read_ahead;
-        of.is_directio = clcf->directio;
+        of.directio = clcf->directio;
         of.valid = clcf->open_file_cache_valid;
         of.min_uses = clcf->open_file_cache_min_uses;
         of.test_only = 1;
@@ -228,8 +240,24 @@ ngx_http_try_files_handler(ngx_http_request_t *r) {
             return NGX_HTTP_INTERNAL_SERVER_ERROR;
         }
 
-        if (ngx_open_cached_file(clcf->open_file_cache, &path, &of, r->pool)
-            != NGX_OK) {
+        rc = ngx_http_open_cached_file(r, clcf, &path, &of);
+
+        if (rc == NGX_AGAIN) {
+            if (ctx == NULL) {
+                ctx = ngx_palloc(r->pool, sizeof(ngx_http_try_files_ctx_t));
+                if (ctx == NULL) {
+                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
+                }
+
+                ngx_http_set_ctx(r, ctx, ngx_http_try_files_module);
+            }
+
+            ctx->current = current;
+
+            return NGX_AGAIN;
+        }
+
+        if (rc != NGX_OK) {
             if (of.err == 0) {
                 return NGX_HTTP_INTERNAL_SERVER_ERROR;
             }
@@ -514,6 +514,7 @@ ngx_http_init_headers_in_hash(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
     hash.max_size = 512;
     hash.bucket_size = ngx_align(64, ngx_cacheline_size);
     hash.name = "headers_in_hash";
+    hash.perfect = 1;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
@@ -857,7 +858,8 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
     ngx_http_location_queue_t   *lq;
     ngx_http_core_loc_conf_t   **clcfp;
 #if (NGX_PCRE)
-    ngx_uint_t                   r;
+    ngx_uint_t                   r, i;
+    ngx_str_t                   *patterns;
     ngx_queue_t                 *regex;
 #endif
     //这是合并过的loc配置项
@@ -1016,6 +1018,22 @@ ngx_http_init_locations(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
 
         *clcfp = NULL;
 
+        /* 匹配时先用各正则的必需字面量一次扫描uri,只对可能匹配的location执行正则 */
+
+        patterns = ngx_palloc(cf->temp_pool, r * sizeof(ngx_str_t));
+        if (patterns == NULL) {
+            return NGX_ERROR;
+        }
+
+        for (i = 0; i < r; i++) {
+            patterns[i] = pclcf->regex_locations[i]->name;
+        }
+
+        pclcf->regex_set = ngx_regex_set_create(cf->pool, patterns, r);
+        if (pclcf->regex_set == NULL) {
+            return NGX_ERROR;
+        }
+
         //拆分到tail中的节点pclcf->regex_locations 数组会指向他们,从而保证了pclcf->regex_locations和 cscf->named_locations中的所有location通过ngx_http_location_queue_t是连接在一起的
         ngx_queue_split(locations, regex, &tail); //按照regex拆分
     }
@@ -1652,6 +1670,7 @@ ngx_http_add_address(ngx_conf_t *cf, ngx_http_core_srv_conf_t *cscf,
 #if (NGX_PCRE)
     addr->nregex = 0;
     addr->regex = NULL;
+    addr->regex_set = NULL;
 #endif
     addr->default_server = cscf;
     addr->servers.elts = NULL;
@@ -1768,6 +1787,7 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
     ngx_http_core_srv_conf_t  **cscfp;
 #if (NGX_PCRE)
     ngx_uint_t                  regex, i;
+    ngx_str_t                  *patterns;
 
     regex = 0;
 #endif
@@ -1826,6 +1846,7 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
     hash.max_size = cmcf->server_names_hash_max_size;
     hash.bucket_size = cmcf->server_names_hash_bucket_size;
     hash.name = "server_names_hash";
+    hash.perfect = 1;
     hash.pool = cf->pool;
 
     if (ha.keys.nelts) { //完全匹配
@@ -1900,6 +1921,20 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
         }
     }
 
+    patterns = ngx_palloc(cf->temp_pool, regex * sizeof(ngx_str_t));
+    if (patterns == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < regex; i++) {
+        patterns[i] = addr->regex[i].regex->name;
+    }
+
+    addr->regex_set = ngx_regex_set_create(cf->pool, patterns, regex);
+    if (addr->regex_set == NULL) {
+        return NGX_ERROR;
+    }
+
 #endif
 
     return NGX_OK;
@@ -2126,6 +2161,10 @@ ngx_http_add_listening(ngx_conf_t *cf, ngx_http_conf_addr_t *addr)
     ls->reuseport = addr->opt.reuseport;
 #endif
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+    ls->incoming_cpu = addr->opt.incoming_cpu;
+#endif
+
     return ls;
 }
 
@@ -2191,6 +2230,7 @@ ngx_http_add_addrs(ngx_conf_t *cf, ngx_http_port_t *hport,
 #if (NGX_PCRE)
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
+        vn->regex_set = addr[i].regex_set;
 #endif
     }
 
@@ -2256,6 +2296,7 @@ ngx_http_add_addrs6(ngx_conf_t *cf, ngx_http_port_t *hport,
 #if (NGX_PCRE)
         vn->nregex = addr[i].nregex;
         vn->regex = addr[i].regex;
+        vn->regex_set = addr[i].regex_set;
 #endif
     }
 
@@ -2360,6 +2401,7 @@ ngx_http_merge_types(ngx_conf_t *cf, ngx_array_t **keys, ngx_hash_t *types_hash,
         hash.max_size = 2048;
         hash.bucket_size = 64;
         hash.name = "test_types_hash";
+        hash.perfect = 0;
         hash.pool = cf->pool;
         hash.temp_pool = NULL;
 
@@ -2390,6 +2432,7 @@ ngx_http_merge_types(ngx_conf_t *cf, ngx_array_t **keys, ngx_hash_t *types_hash,
         hash.max_size = 2048;
         hash.bucket_size = 64;
         hash.name = "test_types_hash";
+        hash.perfect = 0;
         hash.pool = cf->pool;
         hash.temp_pool = NULL;
 
@@ -30,6 +30,13 @@ static ngx_int_t ngx_http_core_find_location(ngx_http_request_t *r);
 static ngx_int_t ngx_http_core_find_static_location(ngx_http_request_t *r,
                                                     ngx_http_location_tree_node_t *node);
 
+#if (NGX_THREADS)
+static ngx_int_t ngx_http_open_file_thread_handler(ngx_thread_task_t *task,
+                                                   ngx_open_file_info_t *of);
+
+static void ngx_http_open_file_thread_event_handler(ngx_event_t *ev);
+#endif
+
 static ngx_int_t ngx_http_core_preconfiguration(ngx_conf_t *cf);
 
 static ngx_int_t ngx_http_core_postconfiguration(ngx_conf_t *cf);
@@ -222,7 +229,7 @@ static ngx_command_t ngx_http_core_commands[] = {
          ngx_conf_set_num_slot,
          NGX_HTTP_MAIN_CONF_OFFSET,
          offsetof(ngx_http_core_main_conf_t, variables_hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
         /* server_names_hash_max_size 32 | 64 |128 ,为了提个寻找server_name的能力,nginx使用散列表来存储server name.
        这个是设置每个散列桶咋弄的内存大小,注意和variables_hash_max_size区别
        配置块:http server location*/
@@ -231,21 +238,21 @@ static ngx_command_t ngx_http_core_commands[] = {
          ngx_conf_set_num_slot,
          NGX_HTTP_MAIN_CONF_OFFSET,
          offsetof(ngx_http_core_main_conf_t, variables_hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
         /* server_names_hash_max_size 32 | 64 |128 ,为了提个寻找server_name的能力,nginx使用散列表来存储server name*/
         {ngx_string("server_names_hash_max_size"),
          NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_num_slot,
          NGX_HTTP_MAIN_CONF_OFFSET,
          offsetof(ngx_http_core_main_conf_t, server_names_hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("server_names_hash_bucket_size"),
          NGX_HTTP_MAIN_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_num_slot,
          NGX_HTTP_MAIN_CONF_OFFSET,
          offsetof(ngx_http_core_main_conf_t, server_names_hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("server"),
          NGX_HTTP_MAIN_CONF | NGX_CONF_BLOCK | NGX_CONF_NOARGS,
@@ -424,7 +431,7 @@ static ngx_command_t ngx_http_core_commands[] = {
          ngx_conf_set_num_slot,
          NGX_HTTP_LOC_CONF_OFFSET,
          offsetof(ngx_http_core_loc_conf_t, types_hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
         /*types_hash_bucket_size
         语法:types_hash_bucket_size size;
         默认:types_hash_bucket_size 32|64|128;
@@ -435,7 +442,7 @@ static ngx_command_t ngx_http_core_commands[] = {
          ngx_conf_set_num_slot,
          NGX_HTTP_LOC_CONF_OFFSET,
          offsetof(ngx_http_core_loc_conf_t, types_hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
         /*下面是MIME类型的设置配置项.
         MIME type与文件扩展的映射
         语法:type {...};
@@ -703,6 +710,23 @@ static ngx_command_t ngx_http_core_commands[] = {
          offsetof(ngx_http_core_loc_conf_t, sendfile_max_chunk),
          NULL},
 
+        /*sendzc on | off;
+        不小于sendzc_min_size的内存缓冲区(例如proxy的响应)用MSG_ZEROCOPY发送给客户端,缓冲区在内核的
+        完成通知到达后才释放,只在Linux的epoll下生效,见ngx_linux_sendzc_chain*/
+        {ngx_string("sendzc"),
+         NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+         ngx_conf_set_flag_slot,
+         NGX_HTTP_LOC_CONF_OFFSET,
+         offsetof(ngx_http_core_loc_conf_t, sendzc),
+         NULL},
+
+        {ngx_string("sendzc_min_size"),
+         NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
+         ngx_conf_set_size_slot,
+         NGX_HTTP_LOC_CONF_OFFSET,
+         offsetof(ngx_http_core_loc_conf_t, sendzc_min_size),
+         NULL},
+
         {ngx_string("subrequest_output_buffer_size"),
          NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_size_slot,
@@ -781,6 +805,13 @@ static ngx_command_t ngx_http_core_commands[] = {
          offsetof(ngx_http_core_loc_conf_t, aio_write),
          NULL},
 
+        {ngx_string("aio_open"),
+         NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_FLAG,
+         ngx_conf_set_flag_slot,
+         NGX_HTTP_LOC_CONF_OFFSET,
+         offsetof(ngx_http_core_loc_conf_t, aio_open),
+         NULL},
+
         {ngx_string("read_ahead"),
          NGX_HTTP_MAIN_CONF | NGX_HTTP_SRV_CONF | NGX_HTTP_LOC_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_size_slot,
@@ -2282,6 +2313,19 @@ ngx_http_update_location_config(ngx_http_request_t *r) {
         r->connection->sendfile = 0;
     }
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+    /* 等待完成通知时依赖EPOLLERR触发写事件,只支持边沿触发的epoll */
+
+    if (clcf->sendzc && (ngx_event_flags & NGX_USE_CLEAR_EVENT)) {
+        (void) ngx_linux_sendzc_init(r->connection, clcf->sendzc_min_size);
+
+    } else if (r->connection->sendzc) {
+        (void) ngx_linux_sendzc_init(r->connection, 0);
+    }
+
+#endif
+
     if (clcf->client_body_in_file_only) { //配置client_body_in_file_only on | clean
         r->request_body_in_file_only = 1;
         r->request_body_in_persistent_file = 1;
@@ -2354,6 +2398,7 @@ ngx_http_core_find_location(ngx_http_request_t *r) {
 #if (NGX_PCRE)
     ngx_int_t n;
     ngx_uint_t noregex;
+    uintptr_t *candidates;
     ngx_http_core_loc_conf_t *clcf, **clcfp;
 
     noregex = 0;
@@ -2397,8 +2442,21 @@ ngx_http_core_find_location(ngx_http_request_t *r) {
 
     if (noregex == 0 && pclcf->regex_locations) { //用了正则表达式,而且呢,regex_locations正则表达式列表里面有货,那就匹配之.
 
+        candidates = ngx_regex_set_match(pclcf->regex_set, &r->uri, r->pool);
+        if (candidates == NULL) {
+            return NGX_ERROR;
+        }
+
         for (clcfp = pclcf->regex_locations; *clcfp; clcfp++) { //对每一个正则表达式,匹配之.
 
+            /* uri中不含该正则的必需字面量,不可能匹配 */
+
+            if (!ngx_regex_set_test(candidates,
+                                    clcfp - pclcf->regex_locations))
+            {
+                continue;
+            }
+
             ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                            "test location: ~ \"%V\"", &(*clcfp)->name);
 
@@ -3791,6 +3849,101 @@ ngx_http_set_disable_symlinks(ngx_http_request_t *r,
 }
 
 
+/*
+ngx_open_cached_file的封装,aio threads并且aio_open on时缓存中没有的文件在线程池中open()和stat(),
+返回NGX_AGAIN,任务完成后在ngx_http_open_file_thread_event_handler中重新执行当前阶段,再次调用时取到结果
+*/
+ngx_int_t
+ngx_http_open_cached_file(ngx_http_request_t *r,
+                          ngx_http_core_loc_conf_t *clcf, ngx_str_t *path, ngx_open_file_info_t *of) {
+#if (NGX_THREADS)
+    ngx_int_t rc;
+
+    if (clcf->aio_open && clcf->aio == NGX_HTTP_AIO_THREADS) {
+        of->thread_handler = ngx_http_open_file_thread_handler;
+        of->thread_ctx = r;
+        of->thread_task = r->open_file_task;
+
+        rc = ngx_open_cached_file(clcf->open_file_cache, path, of, r->pool);
+
+        r->open_file_task = of->thread_task;
+
+        return rc;
+    }
+#endif
+
+    return ngx_open_cached_file(clcf->open_file_cache, path, of, r->pool);
+}
+
+
+#if (NGX_THREADS)
+
+static ngx_int_t
+ngx_http_open_file_thread_handler(ngx_thread_task_t *task,
+                                  ngx_open_file_info_t *of) {
+    ngx_str_t name;
+    ngx_thread_pool_t *tp;
+    ngx_http_request_t *r;
+    ngx_http_core_loc_conf_t *clcf;
+
+    r = of->thread_ctx;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+    tp = clcf->thread_pool;
+
+    if (tp == NULL) {
+        if (ngx_http_complex_value(r, clcf->thread_pool_value, &name)
+            != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        tp = ngx_thread_pool_get((ngx_cycle_t *) ngx_cycle, &name);
+
+        if (tp == NULL) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "thread pool \"%V\" not found", &name);
+            return NGX_ERROR;
+        }
+    }
+
+    task->event.data = r;
+    task->event.handler = ngx_http_open_file_thread_event_handler;
+
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    r->main->blocked++;
+    r->aio = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_open_file_thread_event_handler(ngx_event_t *ev) {
+    ngx_connection_t *c;
+    ngx_http_request_t *r;
+
+    r = ev->data;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http open file thread: \"%V?%V\"", &r->uri, &r->args);
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    r->write_event_handler(r);
+
+    ngx_http_run_posted_requests(c);
+}
+
+#endif
+
+
 ngx_int_t
 ngx_http_get_forwarded_addr(ngx_http_request_t *r, ngx_addr_t *addr,
                             ngx_array_t *headers, ngx_str_t *value, ngx_array_t *proxies,
@@ -4662,9 +4815,12 @@ ngx_http_core_create_loc_conf(ngx_conf_t *cf) {
     clcf->internal = NGX_CONF_UNSET;
     clcf->sendfile = NGX_CONF_UNSET;
     clcf->sendfile_max_chunk = NGX_CONF_UNSET_SIZE;
+    clcf->sendzc = NGX_CONF_UNSET;
+    clcf->sendzc_min_size = NGX_CONF_UNSET_SIZE;
     clcf->subrequest_output_buffer_size = NGX_CONF_UNSET_SIZE;
     clcf->aio = NGX_CONF_UNSET;
     clcf->aio_write = NGX_CONF_UNSET;
+    clcf->aio_open = NGX_CONF_UNSET;
 #if (NGX_THREADS)
     clcf->thread_pool = NGX_CONF_UNSET_PTR;
     clcf->thread_pool_value = NGX_CONF_UNSET_PTR;
@@ -4791,6 +4947,7 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
         types_hash.max_size = conf->types_hash_max_size;
         types_hash.bucket_size = conf->types_hash_bucket_size;
         types_hash.name = "types_hash";
+        types_hash.perfect = 1;
         types_hash.pool = cf->pool;
         types_hash.temp_pool = NULL;
 
@@ -4832,6 +4989,7 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
         types_hash.max_size = conf->types_hash_max_size;
         types_hash.bucket_size = conf->types_hash_bucket_size;
         types_hash.name = "types_hash";
+        types_hash.perfect = 1;
         types_hash.pool = cf->pool;
         types_hash.temp_pool = NULL;
 
@@ -4884,11 +5042,15 @@ ngx_http_core_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child) {
     ngx_conf_merge_value(conf->sendfile, prev->sendfile, 0);
     ngx_conf_merge_size_value(conf->sendfile_max_chunk,
                               prev->sendfile_max_chunk, 2 * 1024 * 1024);
+    ngx_conf_merge_value(conf->sendzc, prev->sendzc, 0);
+    ngx_conf_merge_size_value(conf->sendzc_min_size,
+                              prev->sendzc_min_size, 16 * 1024);
     ngx_conf_merge_size_value(conf->subrequest_output_buffer_size,
                               prev->subrequest_output_buffer_size,
                               (size_t) ngx_pagesize);
     ngx_conf_merge_value(conf->aio, prev->aio, NGX_HTTP_AIO_OFF);
     ngx_conf_merge_value(conf->aio_write, prev->aio_write, 0);
+    ngx_conf_merge_value(conf->aio_open, prev->aio_open, 0);
 #if (NGX_THREADS)
     ngx_conf_merge_ptr_value(conf->thread_pool, prev->thread_pool, NULL);
     ngx_conf_merge_ptr_value(conf->thread_pool_value, prev->thread_pool_value,
@@ -5291,6 +5453,18 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 #endif
             continue;
         }
+
+        if (ngx_strcmp(value[n].data, "incoming_cpu") == 0) {
+#if (NGX_HAVE_REUSEPORT_CBPF)
+            lsopt.incoming_cpu = 1;
+            lsopt.set = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "incoming_cpu is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
         //在当前端口上建立的连接必须基于SSL协议
 
         /*被指定这个参数的listen将被允许工作在SSL模式,这将允许服务器同时工作在HTTP和HTTPS两种协议下,例如:
@@ -5421,6 +5595,10 @@ ngx_http_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
         return NGX_CONF_ERROR;
     }
 
+    if (lsopt.incoming_cpu && !lsopt.reuseport) {
+        return "\"incoming_cpu\" parameter requires \"reuseport\"";
+    }
+
     for (n = 0; n < u.naddrs; n++) {
         lsopt.sockaddr = u.addrs[n].sockaddr;
         lsopt.socklen = u.addrs[n].socklen;
@@ -120,6 +120,7 @@ typedef struct {
 #endif
     unsigned deferred_accept: 1;
     unsigned reuseport: 1; //端口复用
+    unsigned incoming_cpu: 1;
     unsigned                   so_keepalive:2; //listen配置项带上so_keepalive参数时置1,见ngx_http_core_listen 打开取值1 off关闭取值2
     unsigned                   proxy_protocol:1; //见ngx_http_core_listen   配置类似listen ip:port  proxy_protocol的时候置1
 
@@ -569,6 +570,9 @@ typedef struct { //创建空间和赋值见ngx_http_add_addrs
 
     ngx_uint_t nregex;
     ngx_http_server_name_t *regex;
+#if (NGX_PCRE)
+    ngx_regex_set_t *regex_set; //regex的字面量预过滤集合
+#endif
 } ngx_http_virtual_names_t;
 
 
@@ -690,6 +694,7 @@ typedef struct { //赋值见ngx_http_add_address    (ngx_http_port_t->ngx_http_i
 #if (NGX_PCRE)
     ngx_uint_t                 nregex;
     ngx_http_server_name_t    *regex; //正则表达式的server_name存入这里面 见ngx_http_server_names
+    ngx_regex_set_t           *regex_set; //regex的字面量预过滤集合
 #endif
 
     /* the default server configuration for this address:port */
@@ -782,6 +787,7 @@ struct ngx_http_core_loc_conf_s {
 
 #if (NGX_PCRE) //ngx_http_init_locations中把name location加入到named_locations,正则表达式location加入到regex_locations  完全匹配和前缀匹配location存入locations
     ngx_http_core_loc_conf_t **regex_locations;  /* 所有的location 正则表达式 {}这种ngx_http_core_loc_conf_t全部指向regex_locations */
+    ngx_regex_set_t *regex_set; //regex_locations的字面量预过滤集合,见ngx_http_init_locations
 #endif
 
     /* pointer to the modules' loc_conf */
@@ -843,6 +849,7 @@ struct ngx_http_core_loc_conf_s {
      */
     //如果没有配置该值,则发送的时候默认一次最多发送NGX_MAX_SIZE_T_VALUE - ngx_pagesize;  见ngx_linux_sendfile_chain
     size_t        sendfile_max_chunk;      /* sendfile_max_chunk */ //最大一次发送给客户端的数据大小
+    size_t        sendzc_min_size;         /* sendzc_min_size */ //不小于该值的内存缓冲区用MSG_ZEROCOPY发送
     size_t        read_ahead;              /* read_ahead配置,默认0 */
     size_t subrequest_output_buffer_size;
     /* subrequest_output_buffer_size */
@@ -887,9 +894,11 @@ struct ngx_http_core_loc_conf_s {
     生效地方见ngx_http_core_find_config_phase*/
     ngx_flag_t    internal;                /* internal */ //见"internal"配置,ngx_http_core_internal置1
     ngx_flag_t    sendfile;                /* sendfile */ //sendfile on | off
+    ngx_flag_t    sendzc;                  /* sendzc */ //sendzc on | off
     //aio解析赋值见ngx_http_core_set_aio
     ngx_flag_t    aio;                     /* aio */ //aio on | off;默认off  aio on | off | threads[=pool];
     ngx_flag_t aio_write;               /* aio_write */
+    ngx_flag_t aio_open;                /* aio_open */ //aio threads时在线程池中open()和stat()文件
     // tcp_nopush on | off;只有开启sendfile,nopush才生效,通过设置TCP_CORK实现
     ngx_flag_t tcp_nopush;              /* tcp_nopush */
     ngx_flag_t tcp_nodelay;             /* tcp_nodelay */
@@ -1109,6 +1118,9 @@ ngx_int_t ngx_http_request_body_save_filter(ngx_http_request_t *r,
 ngx_int_t ngx_http_set_disable_symlinks(ngx_http_request_t *r,
                                         ngx_http_core_loc_conf_t *clcf, ngx_str_t *path, ngx_open_file_info_t *of);
 
+ngx_int_t ngx_http_open_cached_file(ngx_http_request_t *r,
+                                    ngx_http_core_loc_conf_t *clcf, ngx_str_t *path, ngx_open_file_info_t *of);
+
 ngx_int_t ngx_http_get_forwarded_addr(ngx_http_request_t *r, ngx_addr_t *addr,
                                       ngx_array_t *headers, ngx_str_t *value, ngx_array_t *proxies,
                                       int recursive);
@@ -396,7 +396,7 @@ ngx_http_file_cache_open(ngx_http_request_t *r) { //读取缓存文件前面的
     of.valid = clcf->open_file_cache_valid;
     of.min_uses = clcf->open_file_cache_min_uses;
     of.events = clcf->open_file_cache_events;
-    of.is_directio = NGX_OPEN_FILE_DIRECTIO_OFF;
+    of.directio = NGX_OPEN_FILE_DIRECTIO_OFF;
     of.read_ahead = clcf->read_ahead;  /* read_ahead配置,默认0 */
 
     if (ngx_open_cached_file(clcf->open_file_cache, &c->file.name, &of, r->pool)
@@ -2581,6 +2581,7 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) { /
     ngx_msec_t loader_sleep, manager_sleep, loader_threshold,
             manager_threshold;
     ngx_uint_t i, n, use_temp_path; //"use_temp_path= on|off"
+    ngx_uint_t hugepages;
     ngx_array_t *caches;
     ngx_http_file_cache_t *cache, **ce;
 
@@ -2595,6 +2596,7 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) { /
     }
 
     use_temp_path = 1;
+    hugepages = 0;
 
     inactive = 600;
 
@@ -2862,6 +2864,12 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) { /
             continue;
         }
 
+        //keys_zone用大页映射,减少遍历红黑树时的TLB miss
+        if (ngx_strcmp(value[i].data, "hugepages") == 0) {
+            hugepages = 1;
+            continue;
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
@@ -2905,6 +2913,10 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) { /
     cache->shm_zone->init = ngx_http_file_cache_init;
     cache->shm_zone->data = cache;
 
+    if (hugepages) {
+        cache->shm_zone->shm.hugepages = NGX_SHM_HUGEPAGES_ON;
+    }
+
     cache->use_temp_path = use_temp_path;
 
     cache->inactive = inactive;
@@ -2473,10 +2473,17 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
     if (host->len && virtual_names->nregex) {
         ngx_int_t n;
         ngx_uint_t i;
+        uintptr_t *candidates;
         ngx_http_server_name_t *sn;
 
         sn = virtual_names->regex;
 
+        candidates = ngx_regex_set_match(virtual_names->regex_set, host,
+                                         r ? r->pool : c->pool);
+        if (candidates == NULL) {
+            return NGX_ERROR;
+        }
+
 #if (NGX_HTTP_SSL && defined SSL_CTRL_SET_TLSEXT_HOSTNAME)
 
         if (r == NULL) {
@@ -2484,6 +2491,10 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
 
             for (i = 0; i < virtual_names->nregex; i++) {
 
+                if (!ngx_regex_set_test(candidates, i)) {
+                    continue;
+                }
+
                 n = ngx_regex_exec(sn[i].regex->regex, host, NULL, 0);
 
                 if (n == NGX_REGEX_NO_MATCHED) {
@@ -2513,6 +2524,10 @@ ngx_http_find_virtual_server(ngx_connection_t *c,
 
         for (i = 0; i < virtual_names->nregex; i++) {
 
+            if (!ngx_regex_set_test(candidates, i)) {
+                continue;
+            }
+
             n = ngx_http_regex_exec(r, sn[i].regex, host);
 
             if (n == NGX_DECLINED) {
@@ -4123,6 +4138,17 @@ ngx_http_free_request(ngx_http_request_t *r, ngx_int_t rc) { //释放request的
     pool = r->pool;
     r->pool = NULL;
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+    /* 内核可能还在从请求的缓冲区发送数据,见ngx_linux_sendzc_hold */
+
+    if (r->connection->sendzc && r->connection->sendzc->inflight) {
+        ngx_linux_sendzc_hold(r->connection, pool);
+        return;
+    }
+
+#endif
+
     ngx_destroy_pool(pool);  /* 释放request->pool */
 }
 
@@ -4177,6 +4203,16 @@ ngx_http_close_connection(ngx_connection_t *c) {
 
     pool = c->pool;
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+    if (c->sendzc && c->sendzc->inflight) {
+        ngx_linux_sendzc_linger(c);
+        ngx_close_connection(c);
+        return;
+    }
+
+#endif
+
     ngx_close_connection(c);
 
     ngx_destroy_pool(pool);
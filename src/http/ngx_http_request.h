@@ -941,6 +941,11 @@ struct ngx_http_request_s { //当接收到客户端请求数据后,调用ngx_htt
     ngx_http_cache_t *cache; //在客户端请求过来后,在ngx_http_upstream_cache->ngx_http_file_cache_new中赋值r->caceh = ngx_http_cache_t
 #endif
 
+#if (NGX_THREADS || NGX_COMPAT)
+    //aio_open on时在线程池中open()文件的任务,见ngx_http_open_cached_file
+    ngx_thread_task_t *open_file_task;
+#endif
+
     /*如果没有使用upstream机制,那么ngx_http_request_t中的upstream成员是NULL空指针,在ngx_http_upstream_create中创建空间*/
     ngx_http_upstream_t              *upstream; //upstream机制用到的结构体
     ngx_array_t                      *upstream_states; //创建空间和赋值见ngx_http_upstream_init_request
@@ -1710,7 +1710,7 @@ ngx_http_script_file_code(ngx_http_script_engine_t *e) {
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
 
     of.read_ahead = clcf->read_ahead;
-    of.is_directio = clcf->directio;
+    of.directio = clcf->directio;
     of.valid = clcf->open_file_cache_valid;
     of.min_uses = clcf->open_file_cache_min_uses;
     of.test_only = 1;
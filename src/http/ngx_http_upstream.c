@@ -118,6 +118,11 @@ static ngx_int_t ngx_http_upstream_thread_handler(ngx_thread_task_t *task,
     ngx_file_t *file);
 static void ngx_http_upstream_thread_event_handler(ngx_event_t *ev);
 #endif
+#if (NGX_HAVE_FILE_AIO_WRITE)
+static void ngx_http_upstream_aio_handler(ngx_event_pipe_t *p,
+    ngx_event_aio_t *aio);
+static void ngx_http_upstream_aio_event_handler(ngx_event_t *ev);
+#endif
 
 static ngx_int_t ngx_http_upstream_output_filter(void *data,
                                                  ngx_chain_t *chain);
@@ -3662,6 +3667,12 @@ ngx_http_upstream_send_response(ngx_http_request_t *r, ngx_http_upstream_t *u) {
     }
 #endif
 
+#if (NGX_HAVE_FILE_AIO_WRITE)
+    if (ngx_file_aio && clcf->aio == NGX_HTTP_AIO_ON && clcf->aio_write) {
+        p->aio_handler = ngx_http_upstream_aio_handler;
+    }
+#endif
+
     p->preread_bufs = ngx_alloc_chain_link(r->pool);
     if (p->preread_bufs == NULL) {
         ngx_http_upstream_finalize_request(r, u, NGX_ERROR);
@@ -4389,6 +4400,50 @@ ngx_http_upstream_thread_event_handler(ngx_event_t *ev)
 #endif
 
 
+#if (NGX_HAVE_FILE_AIO_WRITE)
+
+static void
+ngx_http_upstream_aio_handler(ngx_event_pipe_t *p, ngx_event_aio_t *aio)
+{
+    ngx_http_request_t  *r;
+
+    r = p->output_ctx;
+
+    aio->data = r;
+    aio->handler = ngx_http_upstream_aio_event_handler;
+
+    r->main->blocked++;
+    r->aio = 1;
+    p->aio = 1;
+}
+
+
+static void
+ngx_http_upstream_aio_event_handler(ngx_event_t *ev)
+{
+    ngx_event_aio_t     *aio;
+    ngx_connection_t    *c;
+    ngx_http_request_t  *r;
+
+    aio = ev->data;
+    r = aio->data;
+    c = r->connection;
+
+    ngx_http_set_log_request(c->log, r);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http upstream aio: \"%V?%V\"", &r->uri, &r->args);
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    r->write_event_handler(r);
+    ngx_http_run_posted_requests(c);
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_upstream_output_filter(void *data, ngx_chain_t *chain) {
     ngx_int_t rc;
@@ -4423,7 +4478,7 @@ ngx_http_upstream_process_downstream(ngx_http_request_t *r) {
 
     c->log->action = "sending to client";
 
-#if (NGX_THREADS)
+#if (NGX_THREADS || NGX_HAVE_FILE_AIO_WRITE)
     p->aio = r->aio;
 #endif
 
@@ -4514,7 +4569,7 @@ ngx_http_upstream_process_request(ngx_http_request_t *r,
 
     p = u->pipe;
 
-#if (NGX_THREADS)
+#if (NGX_THREADS || NGX_HAVE_FILE_AIO_WRITE)
 
     if (p->writing && !p->aio) {
 
@@ -6993,6 +7048,7 @@ ngx_http_upstream_init_main_conf(ngx_conf_t *cf, void *conf) {
     hash.max_size = 512;
     hash.bucket_size = ngx_align(64, ngx_cacheline_size);
     hash.name = "upstream_headers_in_hash";
+    hash.perfect = 1;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
@@ -2558,12 +2558,22 @@ ngx_http_map_find(ngx_http_request_t *r, ngx_http_map_t *map, ngx_str_t *match)
     if (len && map->nregex) {
         ngx_int_t n;
         ngx_uint_t i;
+        uintptr_t *candidates;
         ngx_http_map_regex_t *reg;
 
         reg = map->regex;
 
+        candidates = ngx_regex_set_match(map->regex_set, match, r->pool);
+        if (candidates == NULL) {
+            return NULL;
+        }
+
         for (i = 0; i < map->nregex; i++) {
 
+            if (!ngx_regex_set_test(candidates, i)) {
+                continue;
+            }
+
             n = ngx_http_regex_exec(r, reg[i].regex, match);
 
             if (n == NGX_OK) {
@@ -2911,6 +2921,7 @@ ngx_http_variables_init_vars(ngx_conf_t *cf) {
     hash.max_size = cmcf->variables_hash_max_size;
     hash.bucket_size = cmcf->variables_hash_bucket_size;
     hash.name = "variables_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
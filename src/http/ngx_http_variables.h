@@ -181,6 +181,7 @@ typedef struct {
 #if (NGX_PCRE)
     ngx_http_map_regex_t *regex;
     ngx_uint_t nregex;
+    ngx_regex_set_t *regex_set; //regex的字面量预过滤集合
 #endif
 } ngx_http_map_t;
 
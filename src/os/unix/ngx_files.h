@@ -528,6 +528,11 @@ ngx_int_t ngx_file_aio_init(ngx_file_t *file, ngx_pool_t *pool);
 ssize_t ngx_file_aio_read(ngx_file_t *file, u_char *buf, size_t size,
     off_t offset, ngx_pool_t *pool);
 
+#if (NGX_HAVE_FILE_AIO_WRITE)
+ssize_t ngx_file_aio_write_chain(ngx_file_t *file, ngx_chain_t *cl,
+    off_t offset, ngx_pool_t *pool);
+#endif
+
 extern ngx_uint_t  ngx_file_aio;
 
 #endif
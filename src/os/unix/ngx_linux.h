@@ -13,4 +13,38 @@ ngx_chain_t *ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in,
                                       off_t limit);
 
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+#define NGX_SENDZC_MAX_SENDS  64
+
+/* 一次发送,MSG_ZEROCOPY发送的数据要等内核的完成通知后才能释放 */
+typedef struct {
+    size_t size;
+    uint32_t id;              //内核分配的MSG_ZEROCOPY发送序号
+    unsigned zerocopy: 1;
+    unsigned done: 1;
+} ngx_linux_sendzc_send_t;
+
+/*
+sendzc on时连接的MSG_ZEROCOPY状态,已发送但没有释放的数据仍然留在发送链中,
+这样upstream和ngx_event_pipe的缓冲区在内核完成之前不会被重用;请求或连接提前
+结束时,内存池的销毁推迟到完成之后,见ngx_linux_sendzc_hold和ngx_linux_sendzc_linger
+*/
+typedef struct {
+    size_t min_size;          //sendzc_min_size,为0时不再发起新的MSG_ZEROCOPY发送
+    off_t inflight;           //发送链头部已经发送但还没有释放的字节数
+    uint32_t next;            //下一次MSG_ZEROCOPY发送的序号
+    ngx_uint_t head;          //sends环形队列
+    ngx_uint_t tail;
+    ngx_linux_sendzc_send_t sends[NGX_SENDZC_MAX_SENDS];
+} ngx_linux_sendzc_t;
+
+
+ngx_int_t ngx_linux_sendzc_init(ngx_connection_t *c, size_t min_size);
+void ngx_linux_sendzc_hold(ngx_connection_t *c, ngx_pool_t *pool);
+void ngx_linux_sendzc_linger(ngx_connection_t *c);
+
+#endif
+
+
 #endif /* _NGX_LINUX_H_INCLUDED_ */
@@ -103,9 +103,31 @@ extern ssize_t sendfile(int s, int fd, int32_t *offset, size_t size);
 
 #endif
 
+#if (NGX_HAVE_UDP_SEGMENT || NGX_HAVE_UDP_GRO)
+#include <netinet/udp.h>            /* UDP_SEGMENT, UDP_GRO */
+#endif
+
+#if (NGX_HAVE_MSG_ZEROCOPY)
+#include <linux/errqueue.h>         /* struct sock_extended_err */
+#endif
+
+#if (NGX_HAVE_REUSEPORT_CBPF)
+#include <linux/filter.h>           /* struct sock_fprog, SKF_AD_CPU */
+#endif
+
 #include <sys/syscall.h>
 
-#if (NGX_HAVE_FILE_AIO)
+#if (NGX_HAVE_FUTEX)
+#include <linux/futex.h>            /* FUTEX_WAIT, FUTEX_WAKE */
+#endif
+
+#if (NGX_HAVE_IO_URING)
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <linux/io_uring.h>
+#endif
+
+#if (NGX_HAVE_FILE_AIO && !NGX_HAVE_IO_URING_AIO)
 #include <linux/aio_abi.h>
 typedef struct iocb  ngx_aiocb_t;
 #endif
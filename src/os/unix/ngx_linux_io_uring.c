@@ -0,0 +1,325 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+#include <ngx_linux_io_uring.h>
+
+
+/*
+ * We call io_uring_setup(), io_uring_enter() and io_uring_register()
+ * directly as syscalls instead of liburing usage, as it is done for
+ * the Linux native AIO in ngx_epoll_module.
+ */
+
+static int
+io_uring_setup(u_int entries, struct io_uring_params *p) {
+    return syscall(SYS_io_uring_setup, entries, p);
+}
+
+
+static int
+io_uring_enter(int fd, u_int to_submit, u_int min_complete, u_int flags,
+               void *arg, size_t argsz) {
+    return syscall(SYS_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, argsz);
+}
+
+
+static int
+io_uring_register(int fd, u_int opcode, void *arg, u_int n) {
+    return syscall(SYS_io_uring_register, fd, opcode, arg, n);
+}
+
+
+ngx_int_t
+ngx_io_uring_setup(ngx_io_uring_t *ring, ngx_uint_t entries,
+                   ngx_uint_t cq_entries, ngx_log_t *log) {
+    u_char *sq, *cq;
+    uint32_t i;
+    struct io_uring_params p;
+
+    ngx_memzero(ring, sizeof(ngx_io_uring_t));
+    ngx_memzero(&p, sizeof(struct io_uring_params));
+
+    /*
+     * 完成队列的大小由调用者根据同时未完成的请求数给出,不能小于提交队列;
+     * 超过内核上限时由IORING_SETUP_CLAMP截断(Linux 5.6),实际大小见ring->cq_entries
+     */
+
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = ngx_max(cq_entries, entries);
+
+#ifdef IORING_SETUP_CLAMP
+    p.flags |= IORING_SETUP_CLAMP;
+#endif
+
+    ring->fd = io_uring_setup(entries, &p);
+
+    if (ring->fd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno,
+                      "io_uring_setup(%ui) failed", entries);
+        return NGX_ERROR;
+    }
+
+    ring->features = p.features;
+
+    ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    ring->cq_ring_size = p.cq_off.cqes
+                         + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->sq_ring_size = ngx_max(ring->sq_ring_size, ring->cq_ring_size);
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    sq = mmap(NULL, ring->sq_ring_size, PROT_READ|PROT_WRITE,
+              MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+
+    if (sq == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno,
+                      "mmap(IORING_OFF_SQ_RING) failed");
+        goto failed;
+    }
+
+    ring->sq_ring = sq;
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq = sq;
+
+    } else {
+        cq = mmap(NULL, ring->cq_ring_size, PROT_READ|PROT_WRITE,
+                  MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+
+        if (cq == MAP_FAILED) {
+            ngx_log_error(NGX_LOG_EMERG, log, ngx_errno,
+                          "mmap(IORING_OFF_CQ_RING) failed");
+            goto failed;
+        }
+    }
+
+    ring->cq_ring = cq;
+
+    ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ|PROT_WRITE,
+                      MAP_SHARED|MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+
+    if (ring->sqes == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno,
+                      "mmap(IORING_OFF_SQES) failed");
+        ring->sqes = NULL;
+        goto failed;
+    }
+
+    ring->sq_head = (uint32_t *) (sq + p.sq_off.head);
+    ring->sq_tail = (uint32_t *) (sq + p.sq_off.tail);
+    ring->sq_flags = (uint32_t *) (sq + p.sq_off.flags);
+    ring->sq_mask = *(uint32_t *) (sq + p.sq_off.ring_mask);
+    ring->sq_entries = *(uint32_t *) (sq + p.sq_off.ring_entries);
+    ring->sq_array = (uint32_t *) (sq + p.sq_off.array);
+    ring->sqe_tail = *ring->sq_tail;
+
+    ring->cq_head = (uint32_t *) (cq + p.cq_off.head);
+    ring->cq_tail = (uint32_t *) (cq + p.cq_off.tail);
+    ring->cq_mask = *(uint32_t *) (cq + p.cq_off.ring_mask);
+    ring->cq_entries = *(uint32_t *) (cq + p.cq_off.ring_entries);
+    ring->cqes = (struct io_uring_cqe *) (cq + p.cq_off.cqes);
+
+    /* sqe总是按顺序使用,因此索引数组只需要初始化一次 */
+
+    for (i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+
+    ngx_log_debug4(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "io_uring: fd:%d sq:%uD cq:%uD features:%08XD",
+                   ring->fd, ring->sq_entries, ring->cq_entries, ring->features);
+
+    return NGX_OK;
+
+failed:
+
+    ngx_io_uring_destroy(ring, log);
+
+    return NGX_ERROR;
+}
+
+
+void
+ngx_io_uring_destroy(ngx_io_uring_t *ring, ngx_log_t *log) {
+    if (ring->sqes) {
+        if (munmap(ring->sqes, ring->sqes_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "munmap(IORING_OFF_SQES) failed");
+        }
+    }
+
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+        if (munmap(ring->cq_ring, ring->cq_ring_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "munmap(IORING_OFF_CQ_RING) failed");
+        }
+    }
+
+    if (ring->sq_ring) {
+        if (munmap(ring->sq_ring, ring->sq_ring_size) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "munmap(IORING_OFF_SQ_RING) failed");
+        }
+    }
+
+    if (ring->fd != -1 && close(ring->fd) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      "io_uring close() failed");
+    }
+
+    ngx_memzero(ring, sizeof(ngx_io_uring_t));
+    ring->fd = -1;
+}
+
+
+/*
+ * 获取一个空闲的sqe,填充后在下一次ngx_io_uring_enter()时一并提交给内核;
+ * 如果提交队列已满,则先立即提交已有的请求
+ */
+
+struct io_uring_sqe *
+ngx_io_uring_get_sqe(ngx_io_uring_t *ring, ngx_log_t *log) {
+    struct io_uring_sqe *sqe;
+
+    if (ring->sqe_tail - *ring->sq_head >= ring->sq_entries) {
+
+        if (ngx_io_uring_enter(ring, 0, 0) != NGX_OK) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "io_uring_enter() failed");
+            return NULL;
+        }
+
+        if (ring->sqe_tail - *ring->sq_head >= ring->sq_entries) {
+            ngx_log_error(NGX_LOG_ALERT, log, 0,
+                          "io_uring submission queue is full");
+            return NULL;
+        }
+    }
+
+    sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+    ring->sqe_tail++;
+
+    ngx_memzero(sqe, sizeof(struct io_uring_sqe));
+
+    return sqe;
+}
+
+
+/*
+ * 提交所有已填充的sqe;wait非0时至少等待一个完成事件,timer为等待的
+ * 最长时间(NGX_TIMER_INFINITE表示一直等待).失败时返回NGX_ERROR,
+ * 错误码保存在errno中
+ */
+
+ngx_int_t
+ngx_io_uring_enter(ngx_io_uring_t *ring, ngx_uint_t wait, ngx_msec_t timer) {
+    int n;
+    u_int submit, flags;
+    size_t argsz;
+    void *arg;
+    struct io_uring_sqe *sqe;
+    struct __kernel_timespec ts;
+#ifdef IORING_FEAT_EXT_ARG
+    struct io_uring_getevents_arg ea;
+#endif
+
+    flags = 0;
+    arg = NULL;
+    argsz = 0;
+
+    if (wait) {
+        flags |= IORING_ENTER_GETEVENTS;
+
+        if (timer != NGX_TIMER_INFINITE) {
+            ts.tv_sec = timer / 1000;
+            ts.tv_nsec = (timer % 1000) * 1000000;
+
+#ifdef IORING_FEAT_EXT_ARG
+            if (ring->features & IORING_FEAT_EXT_ARG) {
+                ngx_memzero(&ea, sizeof(struct io_uring_getevents_arg));
+                ea.ts = (uint64_t) (uintptr_t) &ts;
+
+                flags |= IORING_ENTER_EXT_ARG;
+                arg = &ea;
+                argsz = sizeof(struct io_uring_getevents_arg);
+
+            } else
+#endif
+            if (ring->sqe_tail - *ring->sq_head < ring->sq_entries) {
+
+                /*
+                 * 老内核不支持带超时的等待,使用IORING_OP_TIMEOUT:
+                 * 任意一个其他请求完成或者超时后,它都会产生一个完成事件,
+                 * 其user_data为0,由调用者忽略
+                 */
+
+                sqe = &ring->sqes[ring->sqe_tail & ring->sq_mask];
+                ring->sqe_tail++;
+
+                ngx_memzero(sqe, sizeof(struct io_uring_sqe));
+
+                sqe->opcode = IORING_OP_TIMEOUT;
+                sqe->fd = -1;
+                sqe->addr = (uint64_t) (uintptr_t) &ts;
+                sqe->len = 1;
+                sqe->off = 1;
+
+            } else {
+                wait = 0;
+                flags = 0;
+            }
+        }
+    }
+
+    if (!wait && ngx_io_uring_cq_overflow(ring)) {
+
+        /*
+         * 完成队列已满时内核会暂存多出的完成事件,需要带上
+         * IORING_ENTER_GETEVENTS调用io_uring_enter()才会放回完成队列
+         */
+
+        flags |= IORING_ENTER_GETEVENTS;
+    }
+
+    ngx_memory_barrier();
+
+    *ring->sq_tail = ring->sqe_tail;
+
+    ngx_memory_barrier();
+
+    submit = ring->sqe_tail - *ring->sq_head;
+
+    if (submit == 0 && !(flags & IORING_ENTER_GETEVENTS)) {
+        return NGX_OK;
+    }
+
+    n = io_uring_enter(ring->fd, submit, wait ? 1 : 0, flags, arg, argsz);
+
+    if (n == -1 && ngx_errno != ETIME) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+ngx_int_t
+ngx_io_uring_register(ngx_io_uring_t *ring, ngx_uint_t opcode, void *arg,
+                      ngx_uint_t n) {
+    if (io_uring_register(ring->fd, opcode, arg, n) == -1) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
@@ -0,0 +1,86 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_LINUX_IO_URING_H_INCLUDED_
+#define _NGX_LINUX_IO_URING_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+/*
+ * 不依赖liburing,直接通过io_uring_setup()/io_uring_enter()系统调用和mmap()
+ * 操作提交队列(SQ)和完成队列(CQ).ngx_io_uring_module和文件异步I/O共用这里的接口
+ */
+
+typedef struct {
+    int fd;
+    uint32_t features;
+
+    /* 提交队列,sqe_tail是本进程已经填充但还未提交给内核的位置 */
+    volatile uint32_t *sq_head;
+    volatile uint32_t *sq_tail;
+    volatile uint32_t *sq_flags;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sqe_tail;
+    struct io_uring_sqe *sqes;
+
+    /* 完成队列 */
+    volatile uint32_t *cq_head;
+    volatile uint32_t *cq_tail;
+    uint32_t cq_mask;
+    uint32_t cq_entries;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+} ngx_io_uring_t;
+
+
+ngx_int_t ngx_io_uring_setup(ngx_io_uring_t *ring, ngx_uint_t entries,
+                             ngx_uint_t cq_entries, ngx_log_t *log);
+void ngx_io_uring_destroy(ngx_io_uring_t *ring, ngx_log_t *log);
+struct io_uring_sqe *ngx_io_uring_get_sqe(ngx_io_uring_t *ring,
+                                          ngx_log_t *log);
+ngx_int_t ngx_io_uring_enter(ngx_io_uring_t *ring, ngx_uint_t wait,
+                             ngx_msec_t timer);
+ngx_int_t ngx_io_uring_register(ngx_io_uring_t *ring, ngx_uint_t opcode,
+                                void *arg, ngx_uint_t n);
+
+
+/*
+ * 文件异步I/O请求的user_data为ngx_event_aio_t->event的地址,最高位置1,
+ * 用来与ngx_io_uring_module中的poll请求区分
+ */
+#define NGX_IO_URING_AIO        ((uint64_t) 1 << 63)
+
+
+#define ngx_io_uring_sq_pending(ring)                                        \
+    ((ring)->sqe_tail - *(ring)->sq_head)
+
+#define ngx_io_uring_cq_ready(ring)                                          \
+    (*(ring)->cq_tail - *(ring)->cq_head)
+
+#ifdef IORING_SQ_CQ_OVERFLOW
+#define ngx_io_uring_cq_overflow(ring)                                       \
+    (*(ring)->sq_flags & IORING_SQ_CQ_OVERFLOW)
+#else
+#define ngx_io_uring_cq_overflow(ring)  0
+#endif
+
+
+#if (NGX_HAVE_IO_URING_AIO)
+extern ngx_io_uring_t *ngx_io_uring_aio;
+#endif
+
+
+#endif /* _NGX_LINUX_IO_URING_H_INCLUDED_ */
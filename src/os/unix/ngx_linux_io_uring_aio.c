@@ -0,0 +1,231 @@
+
+/*
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+#include <ngx_linux_io_uring.h>
+
+
+/*
+ * 基于io_uring的文件异步I/O,用来替代ngx_linux_aio_read.c中的Linux native AIO:
+ * IORING_OP_READ/IORING_OP_WRITEV不要求文件以O_DIRECT方式打开,对带缓存的普通
+ * 文件同样不会阻塞worker进程,也不再受worker_aio_requests的限制.
+ *
+ * ngx_file_aio_read和ngx_file_aio_write_chain只负责填充sqe,请求在事件模块下一次
+ * 调用io_uring_enter()时提交.完成事件由ngx_io_uring_module(与poll请求在同一个
+ * 完成队列中)或者ngx_epoll_module(通过注册到io_uring的eventfd)放入
+ * ngx_posted_events队列,最终执行ngx_file_aio_event_handler
+ */
+
+ngx_io_uring_t *ngx_io_uring_aio; //事件模块初始化时赋值,为NULL时退化为同步读写
+
+
+static void ngx_file_aio_event_handler(ngx_event_t *ev);
+
+
+ngx_int_t
+ngx_file_aio_init(ngx_file_t *file, ngx_pool_t *pool) {
+    ngx_event_aio_t *aio;
+
+    aio = ngx_pcalloc(pool, sizeof(ngx_event_aio_t));
+    if (aio == NULL) {
+        return NGX_ERROR;
+    }
+
+    aio->file = file;
+    aio->fd = file->fd;
+    aio->event.data = aio;
+    aio->event.ready = 1;
+    aio->event.log = file->log;
+
+    file->aio = aio;
+
+    return NGX_OK;
+}
+
+
+ssize_t
+ngx_file_aio_read(ngx_file_t *file, u_char *buf, size_t size, off_t offset,
+                  ngx_pool_t *pool) {
+    ngx_event_t *ev;
+    ngx_event_aio_t *aio;
+    struct io_uring_sqe *sqe;
+
+    if (!ngx_file_aio || ngx_io_uring_aio == NULL) {
+        return ngx_read_file(file, buf, size, offset);
+    }
+
+    if (file->aio == NULL && ngx_file_aio_init(file, pool) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    aio = file->aio;
+    ev = &aio->event;
+
+    if (!ev->ready) {
+        ngx_log_error(NGX_LOG_ALERT, file->log, 0,
+                      "second aio post for \"%V\"", &file->name);
+        return NGX_AGAIN;
+    }
+
+    ngx_log_debug4(NGX_LOG_DEBUG_CORE, file->log, 0,
+                   "aio complete:%d @%O:%uz %V",
+                   ev->complete, offset, size, &file->name);
+
+    if (ev->complete) {
+        ev->active = 0;
+        ev->complete = 0;
+
+        if (aio->res >= 0) {
+            ngx_set_errno(0);
+            return aio->res;
+        }
+
+        ngx_set_errno(-aio->res);
+
+        ngx_log_error(NGX_LOG_CRIT, file->log, ngx_errno,
+                      "aio read \"%s\" failed", file->name.data);
+
+        return NGX_ERROR;
+    }
+
+    sqe = ngx_io_uring_get_sqe(ngx_io_uring_aio, file->log);
+    if (sqe == NULL) {
+        return ngx_read_file(file, buf, size, offset);
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file->fd;
+    sqe->addr = (uint64_t) (uintptr_t) buf;
+    sqe->len = size;
+    sqe->off = offset;
+    sqe->user_data = (uint64_t) (uintptr_t) ev | NGX_IO_URING_AIO;
+
+    ev->handler = ngx_file_aio_event_handler;
+
+    ev->active = 1;
+    ev->ready = 0;
+    ev->complete = 0;
+
+    return NGX_AGAIN;
+}
+
+/*
+与ngx_thread_write_chain_to_file类似,该函数一般会进来两次:第一次提交写请求,返回NGX_AGAIN;
+写完成后由ngx_file_aio_event_handler->aio->handler触发再次调用,此时cl为NULL,返回写入的字节数
+*/
+ssize_t
+ngx_file_aio_write_chain(ngx_file_t *file, ngx_chain_t *cl, off_t offset,
+                         ngx_pool_t *pool) {
+    ngx_event_t *ev;
+    ngx_chain_t *next;
+    ngx_event_aio_t *aio;
+    struct io_uring_sqe *sqe;
+
+    if (!ngx_file_aio || ngx_io_uring_aio == NULL) {
+        return ngx_write_chain_to_file(file, cl, offset, pool);
+    }
+
+    if (file->aio == NULL && ngx_file_aio_init(file, pool) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    aio = file->aio;
+    ev = &aio->event;
+
+    if (!ev->ready) {
+        ngx_log_error(NGX_LOG_ALERT, file->log, 0,
+                      "second aio post for \"%V\"", &file->name);
+        return NGX_AGAIN;
+    }
+
+    ngx_log_debug3(NGX_LOG_DEBUG_CORE, file->log, 0,
+                   "aio write complete:%d @%O %V",
+                   ev->complete, offset, &file->name);
+
+    if (ev->complete) {
+        ev->active = 0;
+        ev->complete = 0;
+
+        if (aio->res < 0) {
+            ngx_set_errno(-aio->res);
+
+            ngx_log_error(NGX_LOG_CRIT, file->log, ngx_errno,
+                          "aio write \"%s\" failed", file->name.data);
+
+            return NGX_ERROR;
+        }
+
+        if ((size_t) aio->res != aio->vec.size) {
+            ngx_log_error(NGX_LOG_CRIT, file->log, 0,
+                          "aio write \"%s\" has written only %L of %uz",
+                          file->name.data, aio->res, aio->vec.size);
+            return NGX_ERROR;
+        }
+
+        file->offset += aio->res;
+
+        return aio->res;
+    }
+
+    if (aio->vec.iovs == NULL) {
+        aio->vec.iovs = ngx_palloc(pool,
+                                   NGX_IOVS_PREALLOCATE * sizeof(struct iovec));
+        if (aio->vec.iovs == NULL) {
+            return NGX_ERROR;
+        }
+
+        aio->vec.nalloc = NGX_IOVS_PREALLOCATE;
+    }
+
+    /* iovec数组需要保持到请求提交给内核,因此保存在aio中 */
+
+    next = ngx_output_chain_to_iovec(&aio->vec, cl, NGX_MAX_SIZE_T_VALUE,
+                                     file->log);
+
+    if (next == NGX_CHAIN_ERROR) {
+        return NGX_ERROR;
+    }
+
+    if (next) {
+        /* 一次提交不下的长链,直接同步写 */
+        return ngx_write_chain_to_file(file, cl, offset, pool);
+    }
+
+    sqe = ngx_io_uring_get_sqe(ngx_io_uring_aio, file->log);
+    if (sqe == NULL) {
+        return ngx_write_chain_to_file(file, cl, offset, pool);
+    }
+
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = file->fd;
+    sqe->addr = (uint64_t) (uintptr_t) aio->vec.iovs;
+    sqe->len = aio->vec.count;
+    sqe->off = offset;
+    sqe->user_data = (uint64_t) (uintptr_t) ev | NGX_IO_URING_AIO;
+
+    ev->handler = ngx_file_aio_event_handler;
+
+    ev->active = 1;
+    ev->ready = 0;
+    ev->complete = 0;
+
+    return NGX_AGAIN;
+}
+
+
+static void
+ngx_file_aio_event_handler(ngx_event_t *ev) {
+    ngx_event_aio_t *aio;
+
+    aio = ev->data;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_CORE, ev->log, 0,
+                   "aio event handler fd:%d %V", aio->fd, &aio->file->name);
+
+    aio->handler(ev);
+}
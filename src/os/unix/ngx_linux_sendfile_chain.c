@@ -12,6 +12,41 @@
 static ssize_t ngx_linux_sendfile(ngx_connection_t *c, ngx_buf_t *file,
                                   size_t size);
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+static ngx_int_t ngx_linux_sendzc_chain(ngx_connection_t *c, ngx_chain_t **in,
+                                        off_t limit);
+
+static ssize_t ngx_linux_sendzc(ngx_connection_t *c, u_char *buf, size_t size);
+
+static off_t ngx_linux_sendzc_complete(ngx_connection_t *c);
+
+static ngx_int_t ngx_linux_sendzc_recv(ngx_socket_t fd, ngx_linux_sendzc_t *zc,
+                                       ngx_log_t *log);
+
+static off_t ngx_linux_sendzc_release(ngx_linux_sendzc_t *zc, ngx_log_t *log);
+
+static void ngx_linux_sendzc_destroy_pool(void *data);
+
+static void ngx_linux_sendzc_linger_handler(ngx_event_t *ev);
+
+
+#define NGX_SENDZC_LINGER_INTERVAL  100
+#define NGX_SENDZC_LINGER_TIMEOUT   60000
+
+/*
+连接关闭时还有MSG_ZEROCOPY发送没有完成,内核仍然在从这些内存发送数据,
+复制的套接字和连接的内存池交给该结构,完成通知全部到达后才关闭和销毁
+*/
+typedef struct {
+    ngx_socket_t fd;          //dup()得到的描述符,原描述符由ngx_close_connection关闭
+    ngx_msec_t start;
+    ngx_pool_t *pool;         //连接的内存池,请求的内存池见ngx_linux_sendzc_hold
+    ngx_event_t event;
+    ngx_log_t log;
+    ngx_linux_sendzc_t zc;
+} ngx_linux_sendzc_linger_t;
+#endif
+
 #if (NGX_THREADS)
 #include <ngx_thread_pool.h>
 
@@ -71,6 +106,26 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit) { //
         limit = NGX_SENDFILE_MAXSIZE - ngx_pagesize;
     }
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+    if (c->sendzc) {
+
+        switch (ngx_linux_sendzc_chain(c, &in, limit)) {
+
+            case NGX_ERROR:
+                return NGX_CHAIN_ERROR;
+
+            case NGX_DECLINED:
+                /* 没有在途的数据,链头是文件,按原来的方式发送 */
+                break;
+
+            default:
+                return in;
+        }
+    }
+
+#endif
+
 
     send = 0;
 
@@ -227,6 +282,556 @@ ngx_linux_sendfile_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit) { //
     }
 }
 
+#if (NGX_HAVE_MSG_ZEROCOPY)
+
+/*
+sendzc on时发送内存中的数据:不小于sendzc_min_size的内存缓冲区用MSG_ZEROCOPY发送,
+其余的用writev()发送.已经发送的数据在内核的完成通知到达之前不从链中移除,
+*in只会按已经释放的字节数更新,再次调用时跳过在途的部分继续发送
+*/
+static ngx_int_t
+ngx_linux_sendzc_chain(ngx_connection_t *c, ngx_chain_t **in, off_t limit) {
+    off_t send, offset, size, released;
+    u_char *pos;
+    ssize_t n;
+    ngx_uint_t zerocopy;
+    ngx_chain_t *cl;
+    ngx_event_t *wev;
+    ngx_iovec_t vec;
+    ngx_linux_sendzc_t *zc;
+    ngx_linux_sendzc_send_t *s;
+    struct iovec *iov, iovs[NGX_IOVS_PREALLOCATE];
+
+    wev = c->write;
+    zc = c->sendzc;
+
+    if (zc->inflight) {
+        released = ngx_linux_sendzc_complete(c);
+
+        if (released == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        *in = ngx_chain_update_sent(*in, released);
+    }
+
+    if (zc->inflight == 0 && zc->min_size == 0) {
+        return NGX_DECLINED;
+    }
+
+    send = 0;
+
+    for (;;) {
+
+        /* 跳过已经发送但还没有释放的数据 */
+
+        offset = zc->inflight;
+
+        for (cl = *in; cl; cl = cl->next) {
+            if (ngx_buf_special(cl->buf)) {
+                continue;
+            }
+
+            size = ngx_buf_size(cl->buf);
+
+            if (offset < size) {
+                break;
+            }
+
+            offset -= size;
+        }
+
+        if (cl == NULL) {
+
+            if (offset) {
+                ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                              "sendzc: %O bytes in flight beyond the chain",
+                              offset);
+                return NGX_ERROR;
+            }
+
+            if (zc->inflight) {
+                /* 只剩下等待完成通知的数据,由EPOLLERR触发写事件 */
+                wev->ready = 0;
+            }
+
+            return NGX_OK;
+        }
+
+        if (cl->buf->in_file) {
+
+            if (zc->inflight == 0) {
+                return NGX_DECLINED;
+            }
+
+            wev->ready = 0;
+            return NGX_OK;
+        }
+
+        if (send >= limit) {
+            return NGX_OK;
+        }
+
+        if (zc->tail - zc->head == NGX_SENDZC_MAX_SENDS) {
+            wev->ready = 0;
+            return NGX_OK;
+        }
+
+        pos = cl->buf->pos + offset;
+        size = ngx_min(cl->buf->last - pos, limit - send);
+
+        zerocopy = 0;
+        n = NGX_DECLINED;
+
+        if (zc->min_size && (size_t) size >= zc->min_size) {
+            n = ngx_linux_sendzc(c, pos, (size_t) size);
+            zerocopy = 1;
+        }
+
+        if (n == NGX_DECLINED) {
+
+            /* 把后面小的内存缓冲区合并为一次writev() */
+
+            zerocopy = 0;
+
+            vec.iovs = iovs;
+            vec.nalloc = NGX_IOVS_PREALLOCATE;
+
+            iov = &iovs[0];
+            iov->iov_base = (void *) pos;
+            iov->iov_len = (size_t) size;
+
+            vec.count = 1;
+            vec.size = (size_t) size;
+
+            for (cl = cl->next;
+                 cl && vec.count < vec.nalloc && send + (off_t) vec.size < limit;
+                 cl = cl->next) {
+                if (ngx_buf_special(cl->buf)) {
+                    continue;
+                }
+
+                size = cl->buf->last - cl->buf->pos;
+
+                if (cl->buf->in_file
+                    || (zc->min_size && (size_t) size >= zc->min_size)) {
+                    break;
+                }
+
+                size = ngx_min(size, limit - send - (off_t) vec.size);
+
+                if ((u_char *) iov->iov_base + iov->iov_len == cl->buf->pos) {
+                    iov->iov_len += (size_t) size;
+
+                } else {
+                    iov = &iovs[vec.count++];
+                    iov->iov_base = (void *) cl->buf->pos;
+                    iov->iov_len = (size_t) size;
+                }
+
+                vec.size += (size_t) size;
+            }
+
+            n = ngx_writev(c, &vec);
+        }
+
+        if (n == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        if (n == NGX_AGAIN) {
+            wev->ready = 0;
+            return NGX_OK;
+        }
+
+        c->sent += n;
+        send += n;
+
+        if (!zerocopy && zc->head == zc->tail) {
+            *in = ngx_chain_update_sent(*in, n);
+            continue;
+        }
+
+        s = &zc->sends[zc->tail++ % NGX_SENDZC_MAX_SENDS];
+
+        s->size = n;
+        s->id = zerocopy ? zc->next++ : 0;
+        s->zerocopy = zerocopy;
+        s->done = !zerocopy;
+
+        zc->inflight += n;
+    }
+}
+
+
+static ssize_t
+ngx_linux_sendzc(ngx_connection_t *c, u_char *buf, size_t size) {
+    ssize_t n;
+    ngx_err_t err;
+
+    eintr:
+
+    n = send(c->fd, buf, size, MSG_ZEROCOPY);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendzc: %z of %uz, id: %uD", n, size, c->sendzc->next);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+            case NGX_EAGAIN:
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                               "send() not ready");
+                return NGX_AGAIN;
+
+            case NGX_EINTR:
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                               "send() was interrupted");
+                goto eintr;
+
+            case NGX_ENOBUFS:
+                /* 超过了optmem_max,这次改用普通的发送 */
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                               "send() with MSG_ZEROCOPY failed");
+                return NGX_DECLINED;
+
+            default:
+                c->write->error = 1;
+                ngx_connection_error(c, err, "send() failed");
+                return NGX_ERROR;
+        }
+    }
+
+    return n;
+}
+
+
+/*
+从套接字的错误队列中读取MSG_ZEROCOPY的完成通知,返回可以从发送链中释放的字节数;
+完成通知可能不按顺序到达,只释放从队列头开始连续完成的发送
+*/
+static off_t
+ngx_linux_sendzc_complete(ngx_connection_t *c) {
+
+    if (ngx_linux_sendzc_recv(c->fd, c->sendzc, c->log) != NGX_OK) {
+        c->write->error = 1;
+        ngx_connection_error(c, ngx_socket_errno,
+                             "recvmsg(MSG_ERRQUEUE) failed");
+        return NGX_ERROR;
+    }
+
+    return ngx_linux_sendzc_release(c->sendzc, c->log);
+}
+
+
+/* 读出错误队列中所有的完成通知,标记对应的发送已经完成,失败时错误码在errno中 */
+static ngx_int_t
+ngx_linux_sendzc_recv(ngx_socket_t fd, ngx_linux_sendzc_t *zc,
+                      ngx_log_t *log) {
+    uint32_t lo, hi;
+    ngx_err_t err;
+    ngx_uint_t i;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    ngx_linux_sendzc_send_t *s;
+    struct sock_extended_err *serr;
+    u_char control[CMSG_SPACE(sizeof(struct sock_extended_err)
+                              + sizeof(struct sockaddr_in6))];
+
+    for (;;) {
+        ngx_memzero(&msg, sizeof(struct msghdr));
+
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+            err = ngx_socket_errno;
+
+            if (err == NGX_EAGAIN) {
+                return NGX_OK;
+            }
+
+            if (err == NGX_EINTR) {
+                continue;
+            }
+
+            return NGX_ERROR;
+        }
+
+        for (cmsg = CMSG_FIRSTHDR(&msg);
+             cmsg != NULL;
+             cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+
+            if (!(cmsg->cmsg_level == SOL_IP
+                  && cmsg->cmsg_type == IP_RECVERR)
+                && !(cmsg->cmsg_level == SOL_IPV6
+                     && cmsg->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+
+            serr = (struct sock_extended_err *) CMSG_DATA(cmsg);
+
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY
+                || serr->ee_errno != 0) {
+                continue;
+            }
+
+            lo = serr->ee_info;
+            hi = serr->ee_data;
+
+            ngx_log_debug3(NGX_LOG_DEBUG_EVENT, log, 0,
+                           "sendzc completion: %uD-%uD%s", lo, hi,
+                           (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+                           ? " copied" : "");
+
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                /* 内核还是复制了数据,比如发往本机,这个连接不再使用MSG_ZEROCOPY */
+                zc->min_size = 0;
+            }
+
+            for (i = zc->head; i != zc->tail; i++) {
+                s = &zc->sends[i % NGX_SENDZC_MAX_SENDS];
+
+                if (s->zerocopy && (uint32_t) (s->id - lo) <= hi - lo) {
+                    s->done = 1;
+                }
+            }
+        }
+    }
+}
+
+
+static off_t
+ngx_linux_sendzc_release(ngx_linux_sendzc_t *zc, ngx_log_t *log) {
+    off_t released;
+    ngx_linux_sendzc_send_t *s;
+
+    released = 0;
+
+    while (zc->head != zc->tail) {
+        s = &zc->sends[zc->head % NGX_SENDZC_MAX_SENDS];
+
+        if (!s->done) {
+            break;
+        }
+
+        released += s->size;
+        zc->head++;
+    }
+
+    zc->inflight -= released;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "sendzc released: %O, in flight: %O",
+                   released, zc->inflight);
+
+    return released;
+}
+
+
+/*
+请求结束时还有在途数据(超时、客户端断开等),在ngx_http_free_request中调用:
+请求的内存池改为在连接的内存池销毁时销毁,而连接的内存池见ngx_linux_sendzc_linger
+*/
+void
+ngx_linux_sendzc_hold(ngx_connection_t *c, ngx_pool_t *pool) {
+    ngx_pool_cleanup_t *cln;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendzc hold pool, in flight: %O", c->sendzc->inflight);
+
+    cln = ngx_pool_cleanup_add(c->pool, 0);
+    if (cln == NULL) {
+        /* 无法确定内核何时不再使用这些内存,宁可不释放 */
+        ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                      "sendzc: request pool is not released");
+        return;
+    }
+
+    cln->handler = ngx_linux_sendzc_destroy_pool;
+    cln->data = pool;
+}
+
+
+static void
+ngx_linux_sendzc_destroy_pool(void *data) {
+    ngx_destroy_pool(data);
+}
+
+
+/*
+连接关闭时还有在途数据,在ngx_http_close_connection中代替ngx_destroy_pool(c->pool)调用:
+复制一个描述符继续读取完成通知,全部完成后再关闭并销毁内存池;超过
+NGX_SENDZC_LINGER_TIMEOUT(或者连接需要复位)时复位连接,内核丢弃发送队列后再销毁
+*/
+void
+ngx_linux_sendzc_linger(ngx_connection_t *c) {
+    socklen_t len;
+    ngx_socket_t fd;
+    struct linger linger;
+    ngx_linux_sendzc_linger_t *lz;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendzc linger, in flight: %O", c->sendzc->inflight);
+
+    lz = ngx_alloc(sizeof(ngx_linux_sendzc_linger_t), c->log);
+    if (lz == NULL) {
+        goto failed;
+    }
+
+    fd = dup(c->fd);
+
+    if (fd == -1) {
+        ngx_log_error(NGX_LOG_ALERT, c->log, ngx_errno, "dup() failed");
+        ngx_free(lz);
+        goto failed;
+    }
+
+    /*
+     * 还有描述符引用同一个套接字时,关闭原描述符既不会把它从epoll中删除,
+     * 也不会发送FIN
+     */
+
+    if (ngx_del_conn) {
+        (void) ngx_del_conn(c, 0);
+    }
+
+    if (shutdown(fd, SHUT_WR) == -1) {
+        ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, ngx_socket_errno,
+                       "shutdown() failed");
+    }
+
+    ngx_memzero(lz, sizeof(ngx_linux_sendzc_linger_t));
+
+    lz->fd = fd;
+    lz->start = ngx_current_msec;
+    lz->pool = c->pool;
+    lz->zc = *c->sendzc;
+
+    lz->log = *c->log;
+    lz->log.handler = NULL;
+    lz->log.data = NULL;
+
+    /* reset_timedout_connection设置了SO_LINGER,不再等待完成通知 */
+
+    len = sizeof(struct linger);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_LINGER, (void *) &linger, &len) == 0
+        && linger.l_onoff && linger.l_linger == 0) {
+        lz->start -= NGX_SENDZC_LINGER_TIMEOUT;
+    }
+
+    lz->event.handler = ngx_linux_sendzc_linger_handler;
+    lz->event.data = lz;
+    lz->event.log = &lz->log;
+    lz->event.cancelable = 1;
+
+    ngx_add_timer(&lz->event, NGX_SENDZC_LINGER_INTERVAL);
+
+    return;
+
+failed:
+
+    ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                  "sendzc: %O bytes in flight, connection pool is not released",
+                  c->sendzc->inflight);
+}
+
+
+static void
+ngx_linux_sendzc_linger_handler(ngx_event_t *ev) {
+    struct linger linger;
+    ngx_linux_sendzc_linger_t *lz;
+
+    lz = ev->data;
+
+    if (lz->fd != (ngx_socket_t) -1) {
+
+        if (ngx_linux_sendzc_recv(lz->fd, &lz->zc, ev->log) == NGX_OK) {
+            (void) ngx_linux_sendzc_release(&lz->zc, ev->log);
+
+            if (lz->zc.inflight
+                && ngx_current_msec - lz->start < NGX_SENDZC_LINGER_TIMEOUT) {
+                ngx_add_timer(ev, NGX_SENDZC_LINGER_INTERVAL);
+                return;
+            }
+
+        } else {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_socket_errno,
+                          "recvmsg(MSG_ERRQUEUE) failed");
+        }
+
+        if (lz->zc.inflight) {
+            ngx_log_error(NGX_LOG_INFO, ev->log, 0,
+                          "sendzc: %O bytes still in flight, "
+                          "resetting connection", lz->zc.inflight);
+
+            linger.l_onoff = 1;
+            linger.l_linger = 0;
+
+            if (setsockopt(lz->fd, SOL_SOCKET, SO_LINGER,
+                           (const void *) &linger, sizeof(struct linger)) == -1) {
+                ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_socket_errno,
+                              "setsockopt(SO_LINGER) failed");
+            }
+        }
+
+        if (ngx_close_socket(lz->fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_socket_errno,
+                          ngx_close_socket_n " failed");
+        }
+
+        lz->fd = (ngx_socket_t) -1;
+
+        if (lz->zc.inflight) {
+            /* 复位后内核丢弃了发送队列,已经交给网卡的数据再等待一段时间 */
+            ngx_add_timer(ev, NGX_SENDZC_LINGER_INTERVAL * 10);
+            return;
+        }
+    }
+
+    ngx_log_debug0(NGX_LOG_DEBUG_EVENT, ev->log, 0, "sendzc linger done");
+
+    ngx_destroy_pool(lz->pool);
+    ngx_free(lz);
+}
+
+
+/* sendzc on时在ngx_http_update_location_config中调用,min_size为0表示关闭 */
+ngx_int_t
+ngx_linux_sendzc_init(ngx_connection_t *c, size_t min_size) {
+    int zerocopy;
+
+    if (c->sendzc == NULL) {
+
+        if (min_size == 0) {
+            return NGX_OK;
+        }
+
+        zerocopy = 1;
+
+        if (setsockopt(c->fd, SOL_SOCKET, SO_ZEROCOPY,
+                       (const void *) &zerocopy, sizeof(int)) == -1) {
+            ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, ngx_socket_errno,
+                           "setsockopt(SO_ZEROCOPY) failed");
+            return NGX_DECLINED;
+        }
+
+        c->sendzc = ngx_pcalloc(c->pool, sizeof(ngx_linux_sendzc_t));
+        if (c->sendzc == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    c->sendzc->min_size = min_size;
+
+    return NGX_OK;
+}
+
+#endif
+
+
 /* mmap小块数据传输的效果比sendfile方式好,因此:
     a )使用mmap+write方式(mmap将一个文件或者其它对象映射进内存)
      优点:即使频繁调用,使用小文件块传输,效率也很高
@@ -646,6 +646,12 @@ ngx_unlock_mutexes(ngx_pid_t pid) {
                           "shared memory zone \"%V\" was locked by %P",
                           &shm_zone[i].shm.name, pid);
         }
+
+        if (ngx_slab_force_unlock(sp, pid)) {
+            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+                          "shared memory zone \"%V\" slab lock was held by %P",
+                          &shm_zone[i].shm.name, pid);
+        }
     }
 }
 
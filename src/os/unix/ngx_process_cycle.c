@@ -344,12 +344,17 @@ ngx_master_process_cycle(ngx_cycle_t *cycle) {
 void
 ngx_single_process_cycle(ngx_cycle_t *cycle) {
     ngx_uint_t i;
+    ngx_core_conf_t *ccf;
 
     if (ngx_set_environment(cycle, NULL) == NULL) {
         /* fatal */
         exit(2);
     }
 
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    ngx_pool_cache_init(ccf->pool_cache);
+
     for (i = 0; cycle->modules[i]; i++) {
         if (cycle->modules[i]->init_process) {
             if (cycle->modules[i]->init_process(cycle) == NGX_ERROR) {
@@ -846,6 +851,8 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker) { //主要工作
 
     ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
 
+    ngx_pool_cache_init(ccf->pool_cache); //master中不缓存,fork出的进程才开启
+
     if (worker >= 0 && ccf->priority != 0) {
         if (setpriority(PRIO_PROCESS, 0, ccf->priority) == -1) {
             ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
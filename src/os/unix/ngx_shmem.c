@@ -64,8 +64,42 @@ Nginx的跨平台特性考虑得很周到.下面以一个统计HTTP框架连接
  * 2.以/dev/zero文件使用mmap映射共享内存
  * 3.用shmget(system V标准)调用来分配共享内存)
 */
+#if (NGX_HAVE_MAP_HUGETLB)
+static size_t ngx_shm_hugepage_size(void);
+#endif
+
+
 ngx_int_t
 ngx_shm_alloc(ngx_shm_t *shm) {
+#if (NGX_HAVE_MAP_HUGETLB)
+    size_t size;
+#endif
+
+    shm->hugetlb = 0;
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+    if (shm->hugepages == NGX_SHM_HUGEPAGES_ON) {
+        size = ngx_align(shm->size, ngx_shm_hugepage_size());
+
+        shm->addr = (u_char *) mmap(NULL, size,
+                                    PROT_READ | PROT_WRITE,
+                                    MAP_ANON | MAP_SHARED | MAP_HUGETLB,
+                                    -1, 0);
+
+        if (shm->addr != MAP_FAILED) {
+            shm->hugetlb = 1;
+            return NGX_OK;
+        }
+
+        //大页不够或者内核不支持时退回到普通页
+        ngx_log_error(NGX_LOG_WARN, shm->log, ngx_errno,
+                      "mmap(MAP_HUGETLB, %uz) failed for \"%V\", "
+                      "using regular pages", size, &shm->name);
+    }
+
+#endif
+
     shm->addr = (u_char *) mmap(NULL, shm->size,
                                 PROT_READ | PROT_WRITE,
                                 MAP_ANON | MAP_SHARED, -1, 0);
@@ -76,18 +110,103 @@ ngx_shm_alloc(ngx_shm_t *shm) {
         return NGX_ERROR;
     }
 
+#if (NGX_HAVE_MADV_HUGEPAGE)
+
+    /* 共享内存要/sys/kernel/mm/transparent_hugepage/shmem_enabled为advise才有效 */
+
+    if (shm->hugepages != NGX_SHM_HUGEPAGES_OFF
+        && madvise(shm->addr, shm->size, MADV_HUGEPAGE) == -1) {
+        ngx_log_error(NGX_LOG_INFO, shm->log, ngx_errno,
+                      "madvise(MADV_HUGEPAGE) failed for \"%V\"",
+                      &shm->name);
+    }
+
+#endif
+
     return NGX_OK;
 }
 
 
 void
 ngx_shm_free(ngx_shm_t *shm) {
-    if (munmap((void *) shm->addr, shm->size) == -1) {
+    size_t size;
+
+    size = shm->size;
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+    //大页映射的长度必须是大页大小的整数倍
+    if (shm->hugetlb) {
+        size = ngx_align(size, ngx_shm_hugepage_size());
+    }
+
+#endif
+
+    if (munmap((void *) shm->addr, size) == -1) {
         ngx_log_error(NGX_LOG_ALERT, shm->log, ngx_errno,
-                      "munmap(%p, %uz) failed", shm->addr, shm->size);
+                      "munmap(%p, %uz) failed", shm->addr, size);
+    }
+}
+
+
+#if (NGX_HAVE_MAP_HUGETLB)
+
+//默认大页大小,取自/proc/meminfo的Hugepagesize
+static size_t
+ngx_shm_hugepage_size(void) {
+    u_char *p, *last;
+    ssize_t n;
+    ngx_fd_t fd;
+    ngx_int_t kb;
+    u_char buf[8192];
+
+    static size_t size;
+
+    if (size) {
+        return size;
+    }
+
+    size = 2 * 1024 * 1024;
+
+    fd = ngx_open_file("/proc/meminfo", NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+    if (fd == NGX_INVALID_FILE) {
+        return size;
+    }
+
+    n = ngx_read_fd(fd, buf, sizeof(buf) - 1);
+
+    (void) ngx_close_file(fd);
+
+    if (n <= 0) {
+        return size;
+    }
+
+    buf[n] = '\0';
+
+    p = (u_char *) ngx_strstr(buf, "Hugepagesize:");
+    if (p == NULL) {
+        return size;
+    }
+
+    p += sizeof("Hugepagesize:") - 1;
+
+    while (*p == ' ') {
+        p++;
     }
+
+    for (last = p; *last >= '0' && *last <= '9'; last++) { /* void */ }
+
+    kb = ngx_atoi(p, last - p);
+
+    if (kb > 0) {
+        size = (size_t) kb * 1024;
+    }
+
+    return size;
 }
 
+#endif
+
 #elif (NGX_HAVE_MAP_DEVZERO)
 
 ngx_int_t
@@ -23,9 +23,16 @@ typedef struct {
     ngx_str_t    name; //这块共享内存的名称
     ngx_log_t   *log;  //shm.log = cycle->log; 记录日志的ngx_log_t对象
     ngx_uint_t   exists;   /* unsigned  exists:1;  */ //表示共享内存是否已经分配过的标志位,为1时表示已经存在
+    ngx_uint_t   hugepages; //NGX_SHM_HUGEPAGES_*,共享内存区的hugepages参数或shared_memory_hugepages
+    ngx_uint_t   hugetlb;   /* unsigned  hugetlb:1;  */ //实际用MAP_HUGETLB映射成功,释放时长度要按大页对齐
 } ngx_shm_t;
 
 
+#define NGX_SHM_HUGEPAGES_OFF     0
+#define NGX_SHM_HUGEPAGES_ADVISE  1    /* madvise(MADV_HUGEPAGE) */
+#define NGX_SHM_HUGEPAGES_ON      2    /* MAP_HUGETLB,失败时退回到advise */
+
+
 ngx_int_t ngx_shm_alloc(ngx_shm_t *shm);
 
 void ngx_shm_free(ngx_shm_t *shm);
@@ -10,20 +10,72 @@
 #include <ngx_event.h>
 
 
+#if (NGX_HAVE_UDP_SEGMENT)
+#define NGX_UDP_GSO_MAX_SEGMENTS  64        //内核UDP_MAX_SEGMENTS
+#define NGX_UDP_GSO_MAX_SIZE      65507
+#endif
+
+
+/* 指定数据报源地址以及UDP_SEGMENT段大小的控制消息 */
+typedef union {
+#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
+#if (NGX_HAVE_IP_SENDSRCADDR)
+    u_char addr[CMSG_SPACE(sizeof(struct in_addr))];
+#elif (NGX_HAVE_IP_PKTINFO)
+    u_char pkt[CMSG_SPACE(sizeof(struct in_pktinfo))];
+#endif
+#if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
+    u_char pkt6[CMSG_SPACE(sizeof(struct in6_pktinfo))];
+#endif
+#if (NGX_HAVE_UDP_SEGMENT)
+    u_char gso[CMSG_SPACE(sizeof(struct in6_pktinfo))
+               + CMSG_SPACE(sizeof(uint16_t))];
+#endif
+    struct cmsghdr cmsg;
+#else
+    u_char dummy;
+#endif
+} ngx_udp_msg_control_t;
+
+
 static ngx_chain_t *ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec,
                                                   ngx_chain_t *in, ngx_log_t *log);
 
-static ssize_t ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec);
+static ngx_uint_t ngx_udp_chain_parts(ngx_chain_t *in);
+
+#if (NGX_HAVE_UDP_SEGMENT)
+static ngx_chain_t *ngx_udp_output_chain_to_segments(ngx_iovec_t *vec,
+                                                     ngx_chain_t *in, ngx_log_t *log);
+#endif
+
+static void ngx_udp_sendmsg_addr(ngx_connection_t *c, struct msghdr *msg,
+                                 void *control);
+
+static ssize_t ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec,
+                           size_t segment);
+
+#if (NGX_HAVE_MMSG)
+static ngx_chain_t *ngx_udp_sendmmsg_chain(ngx_connection_t *c,
+                                           ngx_chain_t *in, off_t limit);
+
+static ngx_int_t ngx_sendmmsg(ngx_connection_t *c, ngx_iovec_t *vecs,
+                              ngx_uint_t nvecs);
+#endif
 
 
 ngx_chain_t *
 ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit) {
     ssize_t n;
     off_t send;
+    size_t segment;
     ngx_chain_t *cl;
     ngx_event_t *wev;
     ngx_iovec_t vec;
     struct iovec iovs[NGX_IOVS_PREALLOCATE];
+#if (NGX_HAVE_UDP_SEGMENT)
+    size_t size;
+    ngx_uint_t count;
+#endif
 
     wev = c->write;
 
@@ -48,6 +100,14 @@ ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit) {
         limit = NGX_MAX_SIZE_T_VALUE - ngx_pagesize;
     }
 
+#if (NGX_HAVE_MMSG)
+
+    if (c->listening && c->listening->batch > 1 && !c->listening->gso) {
+        return ngx_udp_sendmmsg_chain(c, in, limit);
+    }
+
+#endif
+
     send = 0;
 
     vec.iovs = iovs;
@@ -86,9 +146,48 @@ ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit) {
             return in;
         }
 
+        segment = 0;
+
+#if (NGX_HAVE_UDP_SEGMENT)
+
+        size = vec.size;
+        count = vec.count;
+
+        if (c->listening && c->listening->gso && cl) {
+
+            /* 后面同样大小的数据报作为同一个UDP_SEGMENT的段一起发送 */
+
+            if (ngx_udp_output_chain_to_segments(&vec, cl, c->log)
+                == NGX_CHAIN_ERROR) {
+                return NGX_CHAIN_ERROR;
+            }
+
+            if (vec.size > size) {
+                segment = size;
+            }
+        }
+
+#endif
+
         send += vec.size;
 
-        n = ngx_sendmsg(c, &vec);
+        n = ngx_sendmsg(c, &vec, segment);
+
+#if (NGX_HAVE_UDP_SEGMENT)
+
+        if (n == NGX_DECLINED) {
+
+            /* 内核不接受UDP_SEGMENT,只发送第一个数据报 */
+
+            send -= vec.size - size;
+
+            vec.size = size;
+            vec.count = count;
+
+            n = ngx_sendmsg(c, &vec, 0);
+        }
+
+#endif
 
         if (n == NGX_ERROR) {
             return NGX_CHAIN_ERROR;
@@ -110,6 +209,121 @@ ngx_udp_unix_sendmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit) {
 }
 
 
+#if (NGX_HAVE_MMSG)
+
+/*
+listen ... udp batch=N时使用:链中有多个完整的数据报时,一次sendmmsg()最多发送N个,
+所有数据报共用一个iovec数组
+*/
+static ngx_chain_t *
+ngx_udp_sendmmsg_chain(ngx_connection_t *c, ngx_chain_t *in, off_t limit) {
+    off_t send, sent;
+    ngx_int_t n;
+    ngx_uint_t i, nvecs, niovs, parts;
+    ngx_chain_t *cl, *ln;
+    ngx_event_t *wev;
+    ngx_iovec_t *vec, vecs[NGX_UDP_BATCH_MAX];
+    struct iovec iovs[NGX_IOVS_PREALLOCATE];
+
+    wev = c->write;
+
+    send = 0;
+
+    for (;;) {
+
+        cl = in;
+        nvecs = 0;
+        niovs = 0;
+
+        while (cl && nvecs < c->listening->batch && send < limit) {
+
+            if (nvecs) {
+
+                /* 剩余的iovec可能放不下下一个数据报,留到下一次发送 */
+
+                parts = ngx_udp_chain_parts(cl);
+
+                if (parts >= NGX_IOVS_PREALLOCATE - niovs) {
+                    break;
+                }
+            }
+
+            vec = &vecs[nvecs];
+
+            vec->iovs = &iovs[niovs];
+            vec->nalloc = NGX_IOVS_PREALLOCATE - niovs;
+
+            ln = ngx_udp_output_chain_to_iovec(vec, cl, c->log);
+
+            if (ln == NGX_CHAIN_ERROR) {
+                return NGX_CHAIN_ERROR;
+            }
+
+            if (ln && ln->buf->in_file) {
+                ngx_log_error(NGX_LOG_ALERT, c->log, 0,
+                              "file buf in sendmmsg "
+                              "t:%d r:%d f:%d %p %p-%p %p %O-%O",
+                              ln->buf->temporary,
+                              ln->buf->recycled,
+                              ln->buf->in_file,
+                              ln->buf->start,
+                              ln->buf->pos,
+                              ln->buf->last,
+                              ln->buf->file,
+                              ln->buf->file_pos,
+                              ln->buf->file_last);
+
+                ngx_debug_point();
+
+                return NGX_CHAIN_ERROR;
+            }
+
+            if (ln == cl) {
+                /* 剩下的不是一个完整的数据报 */
+                break;
+            }
+
+            send += vec->size;
+            niovs += vec->count;
+            nvecs++;
+
+            cl = ln;
+        }
+
+        if (nvecs == 0) {
+            return in;
+        }
+
+        n = ngx_sendmmsg(c, vecs, nvecs);
+
+        if (n == NGX_ERROR) {
+            return NGX_CHAIN_ERROR;
+        }
+
+        if (n == NGX_AGAIN) {
+            wev->ready = 0;
+            return in;
+        }
+
+        sent = 0;
+
+        for (i = 0; i < (ngx_uint_t) n; i++) {
+            sent += vecs[i].size;
+        }
+
+        c->sent += sent;
+
+        in = ngx_chain_update_sent(in, sent);
+
+        if (send >= limit || in == NULL) {
+            return in;
+        }
+    }
+}
+
+#endif
+
+
 static ngx_chain_t *
 ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec, ngx_chain_t *in, ngx_log_t *log) {
     size_t total, size;
@@ -202,36 +416,98 @@ ngx_udp_output_chain_to_iovec(ngx_iovec_t *vec, ngx_chain_t *in, ngx_log_t *log)
 }
 
 
-static ssize_t
-ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec) {
-    ssize_t n;
-    ngx_err_t err;
-    struct msghdr msg;
+/* 链中第一个数据报最多需要的iovec个数 */
+static ngx_uint_t
+ngx_udp_chain_parts(ngx_chain_t *in) {
+    ngx_uint_t parts;
 
-#if (NGX_HAVE_MSGHDR_MSG_CONTROL)
+    parts = 0;
 
-#if (NGX_HAVE_IP_SENDSRCADDR)
-    u_char         msg_control[CMSG_SPACE(sizeof(struct in_addr))];
-#elif (NGX_HAVE_IP_PKTINFO)
-    u_char msg_control[CMSG_SPACE(sizeof(struct in_pktinfo))];
-#endif
+    for ( /* void */ ; in; in = in->next) {
+        if (!ngx_buf_special(in->buf)) {
+            parts++;
+        }
 
-#if (NGX_HAVE_INET6 && NGX_HAVE_IPV6_RECVPKTINFO)
-    u_char msg_control6[CMSG_SPACE(sizeof(struct in6_pktinfo))];
-#endif
+        if (in->buf->flush || in->buf->last_buf) {
+            break;
+        }
+    }
+
+    return parts;
+}
+
+
+#if (NGX_HAVE_UDP_SEGMENT)
+
+/*
+vec中已经是第一个数据报,把链中后面大小相同的完整数据报追加到vec中,最后一个可以更小,
+返回第一个没有追加的链节点
+*/
+static ngx_chain_t *
+ngx_udp_output_chain_to_segments(ngx_iovec_t *vec, ngx_chain_t *in,
+                                 ngx_log_t *log) {
+    size_t segment;
+    ngx_uint_t nsegs;
+    ngx_chain_t *cl;
+    ngx_iovec_t next;
+
+    segment = vec->size;
+
+    if (segment == 0) {
+        return in;
+    }
+
+    for (nsegs = 1; in && nsegs < NGX_UDP_GSO_MAX_SEGMENTS; nsegs++) {
+
+        if (ngx_udp_chain_parts(in) > vec->nalloc - vec->count) {
+            break;
+        }
+
+        next.iovs = vec->iovs + vec->count;
+        next.nalloc = vec->nalloc - vec->count;
+
+        cl = ngx_udp_output_chain_to_iovec(&next, in, log);
+
+        if (cl == NGX_CHAIN_ERROR) {
+            return NGX_CHAIN_ERROR;
+        }
+
+        if (cl == in
+            || next.size == 0
+            || next.size > segment
+            || vec->size + next.size > NGX_UDP_GSO_MAX_SIZE
+            || (cl && cl->buf->in_file))
+        {
+            break;
+        }
+
+        vec->count += next.count;
+        vec->size += next.size;
+
+        in = cl;
+
+        if (next.size < segment) {
+            break;
+        }
+    }
+
+    return in;
+}
 
 #endif
 
-    ngx_memzero(&msg, sizeof(struct msghdr));
 
+/*
+设置数据报的目的地址;监听通配地址时还要通过控制消息指定源地址,
+control至少需要ngx_udp_msg_control_t大小的空间
+*/
+static void
+ngx_udp_sendmsg_addr(ngx_connection_t *c, struct msghdr *msg, void *control) {
     if (c->socklen) {
-        msg.msg_name = c->sockaddr;
-        msg.msg_namelen = c->socklen;
+        msg->msg_name = c->sockaddr;
+        msg->msg_namelen = c->socklen;
     }
 
-    msg.msg_iov = vec->iovs;
-    msg.msg_iovlen = vec->count;
-
 #if (NGX_HAVE_MSGHDR_MSG_CONTROL)
 
     if (c->listening && c->listening->wildcard && c->local_sockaddr) {
@@ -243,10 +519,10 @@ ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec) {
             struct in_addr      *addr;
             struct sockaddr_in  *sin;
 
-            msg.msg_control = &msg_control;
-            msg.msg_controllen = sizeof(msg_control);
+            msg->msg_control = control;
+            msg->msg_controllen = CMSG_SPACE(sizeof(struct in_addr));
 
-            cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg = CMSG_FIRSTHDR(msg);
             cmsg->cmsg_level = IPPROTO_IP;
             cmsg->cmsg_type = IP_SENDSRCADDR;
             cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
@@ -264,10 +540,10 @@ ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec) {
             struct in_pktinfo *pkt;
             struct sockaddr_in *sin;
 
-            msg.msg_control = &msg_control;
-            msg.msg_controllen = sizeof(msg_control);
+            msg->msg_control = control;
+            msg->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
 
-            cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg = CMSG_FIRSTHDR(msg);
             cmsg->cmsg_level = IPPROTO_IP;
             cmsg->cmsg_type = IP_PKTINFO;
             cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
@@ -288,10 +564,10 @@ ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec) {
             struct in6_pktinfo *pkt6;
             struct sockaddr_in6 *sin6;
 
-            msg.msg_control = &msg_control6;
-            msg.msg_controllen = sizeof(msg_control6);
+            msg->msg_control = control;
+            msg->msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
 
-            cmsg = CMSG_FIRSTHDR(&msg);
+            cmsg = CMSG_FIRSTHDR(msg);
             cmsg->cmsg_level = IPPROTO_IPV6;
             cmsg->cmsg_type = IPV6_PKTINFO;
             cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
@@ -307,17 +583,73 @@ ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec) {
     }
 
 #endif
+}
+
+
+/*
+segment不为0时vec中是多个segment大小的数据报(最后一个可以更小),通过UDP_SEGMENT
+由内核分段;内核不支持时返回NGX_DECLINED
+*/
+static ssize_t
+ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec, size_t segment) {
+    ssize_t n;
+    ngx_err_t err;
+    struct msghdr msg;
+    ngx_udp_msg_control_t control;
+
+    ngx_memzero(&msg, sizeof(struct msghdr));
+
+    ngx_udp_sendmsg_addr(c, &msg, &control);
+
+#if (NGX_HAVE_UDP_SEGMENT)
+
+    if (segment) {
+        struct cmsghdr *cmsg;
+
+        cmsg = (struct cmsghdr *) ((u_char *) &control + msg.msg_controllen);
+
+        msg.msg_control = &control;
+        msg.msg_controllen += CMSG_SPACE(sizeof(uint16_t));
+
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+
+        *(uint16_t *) CMSG_DATA(cmsg) = (uint16_t) segment;
+    }
+
+#endif
+
+    msg.msg_iov = vec->iovs;
+    msg.msg_iovlen = vec->count;
 
     eintr:
 
     n = sendmsg(c->fd, &msg, 0);
 
-    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
-                   "sendmsg: %z of %uz", n, vec->size);
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmsg: %z of %uz, segment: %uz", n, vec->size, segment);
 
     if (n == -1) {
         err = ngx_errno;
 
+#if (NGX_HAVE_UDP_SEGMENT)
+
+        if (segment && (err == NGX_EIO || err == NGX_EINVAL)) {
+
+            if (err == NGX_EIO) {
+                /* 网卡不支持校验和卸载,这个监听以后不再使用GSO */
+                c->listening->gso = 0;
+            }
+
+            ngx_log_error(NGX_LOG_INFO, c->log, err,
+                          "sendmsg() with UDP_SEGMENT failed, "
+                          "sending without GSO");
+            return NGX_DECLINED;
+        }
+
+#endif
+
         switch (err) {
             case NGX_EAGAIN:
                 ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
@@ -338,3 +670,62 @@ ngx_sendmsg(ngx_connection_t *c, ngx_iovec_t *vec) {
 
     return n;
 }
+
+
+#if (NGX_HAVE_MMSG)
+
+/* 返回实际发送的数据报个数 */
+static ngx_int_t
+ngx_sendmmsg(ngx_connection_t *c, ngx_iovec_t *vecs, ngx_uint_t nvecs) {
+    int n;
+    ngx_err_t err;
+    ngx_uint_t i;
+    struct msghdr msg;
+    struct mmsghdr msgs[NGX_UDP_BATCH_MAX];
+    ngx_udp_msg_control_t control;
+
+    ngx_memzero(&msg, sizeof(struct msghdr));
+
+    /* 同一个连接的数据报目的地址和源地址都相同,控制消息可以共用 */
+
+    ngx_udp_sendmsg_addr(c, &msg, &control);
+
+    for (i = 0; i < nvecs; i++) {
+        msgs[i].msg_hdr = msg;
+        msgs[i].msg_hdr.msg_iov = vecs[i].iovs;
+        msgs[i].msg_hdr.msg_iovlen = vecs[i].count;
+        msgs[i].msg_len = 0;
+    }
+
+    eintr:
+
+    n = sendmmsg(c->fd, msgs, nvecs, 0);
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, c->log, 0,
+                   "sendmmsg: %d of %ui", n, nvecs);
+
+    if (n == -1) {
+        err = ngx_errno;
+
+        switch (err) {
+            case NGX_EAGAIN:
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                               "sendmmsg() not ready");
+                return NGX_AGAIN;
+
+            case NGX_EINTR:
+                ngx_log_debug0(NGX_LOG_DEBUG_EVENT, c->log, err,
+                               "sendmmsg() was interrupted");
+                goto eintr;
+
+            default:
+                c->write->error = 1;
+                ngx_connection_error(c, err, "sendmmsg() failed");
+                return NGX_ERROR;
+        }
+    }
+
+    return n;
+}
+
+#endif
@@ -494,6 +494,10 @@ ngx_stream_optimize_servers(ngx_conf_t *cf, ngx_array_t *ports) {
 
             ls->wildcard = addr[i].opt.wildcard;
 
+            ls->batch = addr[i].opt.batch;
+            ls->gso = addr[i].opt.gso;
+            ls->gro = addr[i].opt.gro;
+
             ls->keepalive = addr[i].opt.so_keepalive;
 #if (NGX_HAVE_KEEPALIVE_TUNABLE)
             ls->keepidle = addr[i].opt.tcp_keepidle;
@@ -513,6 +517,10 @@ ngx_stream_optimize_servers(ngx_conf_t *cf, ngx_array_t *ports) {
             ls->reuseport = addr[i].opt.reuseport;
 #endif
 
+#if (NGX_HAVE_REUSEPORT_CBPF)
+            ls->incoming_cpu = addr[i].opt.incoming_cpu;
+#endif
+
             stport = ngx_palloc(cf->pool, sizeof(ngx_stream_port_t));
             if (stport == NULL) {
                 return NGX_CONF_ERROR;
@@ -55,8 +55,11 @@ typedef struct {
     unsigned ipv6only: 1;
 #endif
     unsigned reuseport: 1;
+    unsigned incoming_cpu: 1;
     unsigned so_keepalive: 2;
     unsigned proxy_protocol: 1;
+    unsigned gso: 1;
+    unsigned gro: 1;
 #if (NGX_HAVE_KEEPALIVE_TUNABLE)
     int tcp_keepidle;
     int tcp_keepintvl;
@@ -69,6 +72,7 @@ typedef struct {
     int fastopen;
 #endif
     int type;
+    ngx_uint_t batch;
 } ngx_stream_listen_t;
 
 
@@ -285,7 +289,8 @@ typedef struct {
         NULL)
 
 
-#define NGX_STREAM_WRITE_BUFFERED  0x10
+#define NGX_STREAM_WRITE_BUFFERED   0x10
+#define NGX_STREAM_SPLICE_BUFFERED  0x20
 
 
 void ngx_stream_core_run_phases(ngx_stream_session_t *s);
@@ -316,6 +321,10 @@ typedef ngx_int_t (*ngx_stream_filter_pt)(ngx_stream_session_t *s,
                                           ngx_chain_t *chain, ngx_uint_t from_upstream);
 
 
+ngx_int_t ngx_stream_write_filter(ngx_stream_session_t *s, ngx_chain_t *in,
+                                  ngx_uint_t from_upstream);
+
+
 extern ngx_stream_filter_pt ngx_stream_top_filter;
 
 
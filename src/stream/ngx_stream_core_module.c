@@ -41,14 +41,14 @@ static ngx_command_t ngx_stream_core_commands[] = {
          ngx_conf_set_num_slot,
          NGX_STREAM_MAIN_CONF_OFFSET,
          offsetof(ngx_stream_core_main_conf_t, variables_hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("variables_hash_bucket_size"),
          NGX_STREAM_MAIN_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_num_slot,
          NGX_STREAM_MAIN_CONF_OFFSET,
          offsetof(ngx_stream_core_main_conf_t, variables_hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("server"),
          NGX_STREAM_MAIN_CONF | NGX_CONF_BLOCK | NGX_CONF_NOARGS,
@@ -573,6 +573,9 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     ngx_uint_t i, n, backlog;
     ngx_stream_listen_t *ls, *als;
     ngx_stream_core_main_conf_t *cmcf;
+#if (NGX_HAVE_MMSG)
+    ngx_int_t batch;
+#endif
 
     cscf->listen = 1;
 
@@ -719,6 +722,51 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 #endif
         }
 
+        if (ngx_strncmp(value[i].data, "batch=", 6) == 0) {
+#if (NGX_HAVE_MMSG)
+            batch = ngx_atoi(value[i].data + 6, value[i].len - 6);
+
+            if (batch == NGX_ERROR || batch == 0
+                || batch > NGX_UDP_BATCH_MAX) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid batch \"%V\", it must be "
+                                   "between 1 and %d",
+                                   &value[i], NGX_UDP_BATCH_MAX);
+                return NGX_CONF_ERROR;
+            }
+
+            ls->batch = batch;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "batch is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "gso") == 0) {
+#if (NGX_HAVE_UDP_SEGMENT)
+            ls->gso = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "gso is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "gro") == 0) {
+#if (NGX_HAVE_UDP_GRO)
+            ls->gro = 1;
+            ls->bind = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "gro is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
         if (ngx_strcmp(value[i].data, "reuseport") == 0) {
 #if (NGX_HAVE_REUSEPORT)
             ls->reuseport = 1;
@@ -731,6 +779,17 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             continue;
         }
 
+        if (ngx_strcmp(value[i].data, "incoming_cpu") == 0) {
+#if (NGX_HAVE_REUSEPORT_CBPF)
+            ls->incoming_cpu = 1;
+#else
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "incoming_cpu is not supported "
+                               "on this platform, ignored");
+#endif
+            continue;
+        }
+
         if (ngx_strcmp(value[i].data, "ssl") == 0) {
 #if (NGX_STREAM_SSL)
             ngx_stream_ssl_conf_t  *sslcf;
@@ -876,6 +935,23 @@ ngx_stream_core_listen(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             return "\"fastopen\" parameter is incompatible with \"udp\"";
         }
 #endif
+
+    } else {
+        if (ls->batch) {
+            return "\"batch\" parameter requires \"udp\"";
+        }
+
+        if (ls->gso) {
+            return "\"gso\" parameter requires \"udp\"";
+        }
+
+        if (ls->gro) {
+            return "\"gro\" parameter requires \"udp\"";
+        }
+    }
+
+    if (ls->incoming_cpu && !ls->reuseport) {
+        return "\"incoming_cpu\" parameter requires \"reuseport\"";
     }
 
     als = cmcf->listen.elts;
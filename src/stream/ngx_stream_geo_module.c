@@ -537,7 +537,15 @@ ngx_stream_geo_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             == NGX_ERROR) {
             goto failed;
         }
+
+        if (ngx_radix128tree_compile(ctx.tree6) != NGX_OK) {
+            goto failed;
+        }
 #endif
+
+        if (ngx_radix32tree_compile(ctx.tree) != NGX_OK) {
+            goto failed;
+        }
     }
 
     ngx_destroy_pool(ctx.temp_pool);
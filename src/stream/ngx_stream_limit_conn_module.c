@@ -93,7 +93,7 @@ static ngx_conf_enum_t ngx_stream_limit_conn_log_levels[] = {
 static ngx_command_t ngx_stream_limit_conn_commands[] = {
 
         {ngx_string("limit_conn_zone"),
-         NGX_STREAM_MAIN_CONF | NGX_CONF_TAKE2,
+         NGX_STREAM_MAIN_CONF | NGX_CONF_TAKE23,
          ngx_stream_limit_conn_zone,
          0,
          0,
@@ -540,7 +540,7 @@ ngx_stream_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     u_char *p;
     ssize_t size;
     ngx_str_t *value, name, s;
-    ngx_uint_t i;
+    ngx_uint_t i, hugepages;
     ngx_shm_zone_t *shm_zone;
     ngx_stream_limit_conn_ctx_t *ctx;
     ngx_stream_compile_complex_value_t ccv;
@@ -564,6 +564,7 @@ ngx_stream_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
 
     size = 0;
     name.len = 0;
+    hugepages = 0;
 
     for (i = 2; i < cf->args->nelts; i++) {
 
@@ -601,6 +602,11 @@ ngx_stream_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
             continue;
         }
 
+        if (ngx_strcmp(value[i].data, "hugepages") == 0) {
+            hugepages = 1;
+            continue;
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
@@ -631,6 +637,10 @@ ngx_stream_limit_conn_zone(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     shm_zone->init = ngx_stream_limit_conn_init_zone;
     shm_zone->data = ctx;
 
+    if (hugepages) {
+        shm_zone->shm.hugepages = NGX_SHM_HUGEPAGES_ON;
+    }
+
     return NGX_CONF_OK;
 }
 
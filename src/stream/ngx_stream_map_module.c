@@ -64,14 +64,14 @@ static ngx_command_t ngx_stream_map_commands[] = {
          ngx_conf_set_num_slot,
          NGX_STREAM_MAIN_CONF_OFFSET,
          offsetof(ngx_stream_map_conf_t, hash_max_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         {ngx_string("map_hash_bucket_size"),
          NGX_STREAM_MAIN_CONF | NGX_CONF_TAKE1,
          ngx_conf_set_num_slot,
          NGX_STREAM_MAIN_CONF_OFFSET,
          offsetof(ngx_stream_map_conf_t, hash_bucket_size),
-         NULL},
+         &ngx_conf_hash_size_post},
 
         ngx_null_command
 };
@@ -184,6 +184,10 @@ ngx_stream_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     ngx_stream_variable_t *var;
     ngx_stream_map_conf_ctx_t ctx;
     ngx_stream_compile_complex_value_t ccv;
+#if (NGX_PCRE)
+    ngx_uint_t i;
+    ngx_str_t *patterns;
+#endif
 
     if (mcf->hash_max_size == NGX_CONF_UNSET_UINT) {
         mcf->hash_max_size = 2048;
@@ -294,6 +298,7 @@ ngx_stream_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     hash.max_size = mcf->hash_max_size;
     hash.bucket_size = mcf->hash_bucket_size;
     hash.name = "map_hash";
+    hash.perfect = 1;
     hash.pool = cf->pool;
 
     if (ctx.keys.keys.nelts) {
@@ -350,6 +355,23 @@ ngx_stream_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf) {
     if (ctx.regexes.nelts) {
         map->map.regex = ctx.regexes.elts;
         map->map.nregex = ctx.regexes.nelts;
+
+        patterns = ngx_palloc(pool, ctx.regexes.nelts * sizeof(ngx_str_t));
+        if (patterns == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
+
+        for (i = 0; i < ctx.regexes.nelts; i++) {
+            patterns[i] = map->map.regex[i].regex->name;
+        }
+
+        map->map.regex_set = ngx_regex_set_create(cf->pool, patterns,
+                                                  ctx.regexes.nelts);
+        if (map->map.regex_set == NULL) {
+            ngx_destroy_pool(pool);
+            return NGX_CONF_ERROR;
+        }
     }
 
 #endif
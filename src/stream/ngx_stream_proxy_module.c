@@ -32,6 +32,7 @@ typedef struct {
     ngx_flag_t next_upstream;
     ngx_flag_t proxy_protocol;
     ngx_flag_t half_close;
+    ngx_flag_t splice;
     ngx_stream_upstream_local_t *local;
     ngx_flag_t socket_keepalive;
 
@@ -91,6 +92,15 @@ static void ngx_stream_proxy_process(ngx_stream_session_t *s,
 static ngx_int_t ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
                                                 ngx_uint_t from_upstream);
 
+#if (NGX_HAVE_SPLICE)
+static ngx_int_t ngx_stream_proxy_splice_init(ngx_stream_session_t *s);
+
+static ngx_int_t ngx_stream_proxy_splice(ngx_stream_session_t *s,
+                                         ngx_uint_t from_upstream);
+
+static void ngx_stream_proxy_splice_cleanup(void *data);
+#endif
+
 static void ngx_stream_proxy_next_upstream(ngx_stream_session_t *s);
 
 static void ngx_stream_proxy_finalize(ngx_stream_session_t *s, ngx_uint_t rc);
@@ -292,6 +302,16 @@ proxy_set_header Host $host;
          offsetof(ngx_stream_proxy_srv_conf_t, half_close),
          NULL},
 
+        /*proxy_splice on | off;
+        没有SSL、没有限速和其他过滤模块时,数据通过每个连接的管道用splice()在两个套接字之间转发,
+        不再复制到proxy_buffer_size的用户空间缓冲区,见ngx_stream_proxy_splice*/
+        {ngx_string("proxy_splice"),
+         NGX_STREAM_MAIN_CONF | NGX_STREAM_SRV_CONF | NGX_CONF_FLAG,
+         ngx_conf_set_flag_slot,
+         NGX_STREAM_SRV_CONF_OFFSET,
+         offsetof(ngx_stream_proxy_srv_conf_t, splice),
+         NULL},
+
 #if (NGX_STREAM_SSL)
 
         { ngx_string("proxy_ssl"),
@@ -950,6 +970,26 @@ ngx_stream_proxy_init_upstream(ngx_stream_session_t *s) {
     u->upload_rate = ngx_stream_complex_value_size(s, pscf->upload_rate, 0);
     u->download_rate = ngx_stream_complex_value_size(s, pscf->download_rate, 0);
 
+#if (NGX_HAVE_SPLICE)
+
+    if (pscf->splice
+        && u->upstream_splice == NULL
+        && pc->type == SOCK_STREAM
+#if (NGX_STREAM_SSL)
+        && c->ssl == NULL
+        && pc->ssl == NULL
+#endif
+        && u->upload_rate == 0
+        && u->download_rate == 0
+        && ngx_stream_top_filter == ngx_stream_write_filter) {
+        if (ngx_stream_proxy_splice_init(s) == NGX_ERROR) {
+            ngx_stream_proxy_finalize(s, NGX_STREAM_INTERNAL_SERVER_ERROR);
+            return;
+        }
+    }
+
+#endif
+
     u->connected = 1;
 
     pc->read->handler = ngx_stream_proxy_upstream_handler;
@@ -1666,7 +1706,8 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 
         if (do_write && dst) {
 
-            if (*out || *busy || dst->buffered) {
+            if (*out || *busy
+                || (dst->buffered & ~NGX_STREAM_SPLICE_BUFFERED)) {
                 c->log->action = send_action;
 
                 rc = ngx_stream_top_filter(s, *out, from_upstream);
@@ -1686,6 +1727,23 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
             }
         }
 
+#if (NGX_HAVE_SPLICE)
+
+        if (u->splice && dst) {
+
+            /* 用户空间缓冲区中还有数据(预读的数据、PROXY协议头)时先发送完 */
+
+            if (*out == NULL && *busy == NULL
+                && ngx_stream_proxy_splice(s, from_upstream) != NGX_OK) {
+                ngx_stream_proxy_finalize(s, NGX_STREAM_OK);
+                return;
+            }
+
+            break;
+        }
+
+#endif
+
         size = b->end - b->last;
 
         if (size && src->read->ready && !src->read->delayed
@@ -1813,6 +1871,222 @@ ngx_stream_proxy_process(ngx_stream_session_t *s, ngx_uint_t from_upstream,
 }
 
 
+#if (NGX_HAVE_SPLICE)
+
+static ngx_int_t
+ngx_stream_proxy_splice_init(ngx_stream_session_t *s) {
+    int size, n;
+    ngx_uint_t i;
+    ngx_connection_t *c;
+    ngx_pool_cleanup_t *cln;
+    ngx_stream_upstream_t *u;
+    ngx_stream_proxy_srv_conf_t *pscf;
+    ngx_stream_upstream_splice_t *sp;
+
+    c = s->connection;
+    u = s->upstream;
+
+    pscf = ngx_stream_get_module_srv_conf(s, ngx_stream_proxy_module);
+
+    sp = ngx_pcalloc(c->pool, 2 * sizeof(ngx_stream_upstream_splice_t));
+    if (sp == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < 2; i++) {
+        sp[i].fd[0] = NGX_INVALID_FILE;
+        sp[i].fd[1] = NGX_INVALID_FILE;
+    }
+
+    cln = ngx_pool_cleanup_add(c->pool, 0);
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_stream_proxy_splice_cleanup;
+    cln->data = sp;
+
+    for (i = 0; i < 2; i++) {
+
+        if (pipe2(sp[i].fd, O_NONBLOCK | O_CLOEXEC) == -1) {
+            ngx_log_error(NGX_LOG_ERR, c->log, ngx_errno,
+                          "pipe2() failed, proxy_splice ignored");
+            return NGX_DECLINED;
+        }
+
+        size = fcntl(sp[i].fd[1], F_GETPIPE_SZ);
+
+        if (size == -1) {
+            ngx_log_error(NGX_LOG_ERR, c->log, ngx_errno,
+                          "fcntl(F_GETPIPE_SZ) failed, proxy_splice ignored");
+            return NGX_DECLINED;
+        }
+
+        /* 管道不小于proxy_buffer_size,超过pipe-max-size时使用默认大小 */
+
+        if (pscf->buffer_size > (size_t) size) {
+            n = fcntl(sp[i].fd[1], F_SETPIPE_SZ, (int) pscf->buffer_size);
+
+            if (n == -1) {
+                ngx_log_debug0(NGX_LOG_DEBUG_STREAM, c->log, ngx_errno,
+                               "fcntl(F_SETPIPE_SZ) failed");
+
+            } else {
+                size = n;
+            }
+        }
+
+        sp[i].capacity = size;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                   "stream proxy splice, pipe size: %uz", sp[0].capacity);
+
+    u->upstream_splice = &sp[0];
+    u->downstream_splice = &sp[1];
+    u->splice = 1;
+
+    return NGX_OK;
+}
+
+
+/*
+src -> 管道 -> dst,直到两边都不能再继续:dst不可写,或者src没有数据并且管道已空.
+管道满时splice()也返回EAGAIN,这时不能清除src的ready标志,管道排空后再继续读
+*/
+static ngx_int_t
+ngx_stream_proxy_splice(ngx_stream_session_t *s, ngx_uint_t from_upstream) {
+    off_t *received;
+    ssize_t n;
+    ngx_err_t err;
+    ngx_uint_t moved;
+    ngx_connection_t *c, *src, *dst;
+    ngx_stream_upstream_t *u;
+    ngx_stream_upstream_splice_t *sp;
+
+    c = s->connection;
+    u = s->upstream;
+
+    if (from_upstream) {
+        src = u->peer.connection;
+        dst = c;
+        sp = u->downstream_splice;
+        received = &u->received;
+
+    } else {
+        src = c;
+        dst = u->peer.connection;
+        sp = u->upstream_splice;
+        received = &s->received;
+    }
+
+    do {
+        moved = 0;
+
+        if (sp->size && dst->write->ready) {
+
+            n = splice(sp->fd[0], NULL, dst->fd, NULL, sp->size,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+            ngx_log_debug3(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                           "splice to %s: %z of %uz",
+                           from_upstream ? "client" : "upstream", n, sp->size);
+
+            if (n == -1) {
+                err = ngx_errno;
+
+                if (err == NGX_EAGAIN) {
+                    dst->write->ready = 0;
+
+                } else if (err != NGX_EINTR) {
+                    dst->write->error = 1;
+                    ngx_connection_error(dst, err, "splice() failed");
+                    return NGX_ERROR;
+                }
+
+            } else {
+                sp->size -= n;
+                dst->sent += n;
+                moved = 1;
+            }
+        }
+
+        if (sp->size < sp->capacity
+            && src->read->ready
+            && !src->read->eof
+            && !src->read->error) {
+
+            n = splice(src->fd, NULL, sp->fd[1], NULL, sp->capacity - sp->size,
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+            ngx_log_debug3(NGX_LOG_DEBUG_STREAM, c->log, 0,
+                           "splice from %s: %z of %uz",
+                           from_upstream ? "upstream" : "client", n,
+                           sp->capacity - sp->size);
+
+            if (n == -1) {
+                err = ngx_errno;
+
+                if (err == NGX_EAGAIN) {
+                    if (sp->size == 0) {
+                        src->read->ready = 0;
+                    }
+
+                } else if (err != NGX_EINTR) {
+                    src->read->error = 1;
+                    src->read->eof = 1;
+                    src->read->ready = 0;
+                    ngx_connection_error(src, err, "splice() failed");
+                }
+
+            } else if (n == 0) {
+                src->read->eof = 1;
+                src->read->ready = 0;
+
+            } else {
+                if (from_upstream
+                    && u->state->first_byte_time == (ngx_msec_t) -1) {
+                    u->state->first_byte_time = ngx_current_msec
+                                                - u->start_time;
+                }
+
+                sp->size += n;
+                *received += n;
+                moved = 1;
+            }
+        }
+
+    } while (moved);
+
+    if (sp->size) {
+        dst->buffered |= NGX_STREAM_SPLICE_BUFFERED;
+
+    } else {
+        dst->buffered &= ~NGX_STREAM_SPLICE_BUFFERED;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_stream_proxy_splice_cleanup(void *data) {
+    ngx_stream_upstream_splice_t *sp = data;
+
+    ngx_uint_t i, j;
+
+    for (i = 0; i < 2; i++) {
+        for (j = 0; j < 2; j++) {
+            if (sp[i].fd[j] != NGX_INVALID_FILE) {
+                (void) close(sp[i].fd[j]);
+            }
+        }
+    }
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_stream_proxy_test_finalize(ngx_stream_session_t *s,
                                ngx_uint_t from_upstream) {
@@ -2094,6 +2368,7 @@ ngx_stream_proxy_create_srv_conf(ngx_conf_t *cf) {
     conf->local = NGX_CONF_UNSET_PTR;
     conf->socket_keepalive = NGX_CONF_UNSET;
     conf->half_close = NGX_CONF_UNSET;
+    conf->splice = NGX_CONF_UNSET;
 
 #if (NGX_STREAM_SSL)
     conf->ssl_enable = NGX_CONF_UNSET;
@@ -2153,6 +2428,19 @@ ngx_stream_proxy_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child) {
 
     ngx_conf_merge_value(conf->half_close, prev->half_close, 0);
 
+    ngx_conf_merge_value(conf->splice, prev->splice, 0);
+
+#if !(NGX_HAVE_SPLICE)
+
+    if (conf->splice) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "\"proxy_splice\" is not supported "
+                           "on this platform, ignored");
+        conf->splice = 0;
+    }
+
+#endif
+
 #if (NGX_STREAM_SSL)
 
     ngx_conf_merge_value(conf->ssl_enable, prev->ssl_enable, 0);
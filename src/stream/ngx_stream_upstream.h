@@ -115,6 +115,18 @@ typedef struct {
 } ngx_stream_upstream_resolved_t;
 
 
+#if (NGX_HAVE_SPLICE)
+
+/* proxy_splice on时一个方向上使用的管道,数据从一个套接字splice()到管道再到另一个套接字 */
+typedef struct {
+    ngx_fd_t fd[2];
+    size_t size;               //管道中还没有发送出去的字节数
+    size_t capacity;
+} ngx_stream_upstream_splice_t;
+
+#endif
+
+
 typedef struct {
     ngx_peer_connection_t peer;
 
@@ -141,9 +153,16 @@ typedef struct {
     ngx_stream_upstream_srv_conf_t *upstream;
     ngx_stream_upstream_resolved_t *resolved;
     ngx_stream_upstream_state_t *state;
+
+#if (NGX_HAVE_SPLICE)
+    ngx_stream_upstream_splice_t *upstream_splice;   //客户端到上游
+    ngx_stream_upstream_splice_t *downstream_splice; //上游到客户端
+#endif
+
     unsigned connected: 1;
     unsigned proxy_protocol: 1;
     unsigned half_closed: 1;
+    unsigned splice: 1;
 } ngx_stream_upstream_t;
 
 
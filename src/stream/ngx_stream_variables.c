@@ -929,12 +929,22 @@ ngx_stream_map_find(ngx_stream_session_t *s, ngx_stream_map_t *map,
     if (len && map->nregex) {
         ngx_int_t n;
         ngx_uint_t i;
+        uintptr_t *candidates;
         ngx_stream_map_regex_t *reg;
 
         reg = map->regex;
 
+        candidates = ngx_regex_set_match(map->regex_set, match, s->connection->pool);
+        if (candidates == NULL) {
+            return NULL;
+        }
+
         for (i = 0; i < map->nregex; i++) {
 
+            if (!ngx_regex_set_test(candidates, i)) {
+                continue;
+            }
+
             n = ngx_stream_regex_exec(s, reg[i].regex, match);
 
             if (n == NGX_OK) {
@@ -1237,6 +1247,7 @@ ngx_stream_variables_init_vars(ngx_conf_t *cf) {
     hash.max_size = cmcf->variables_hash_max_size;
     hash.bucket_size = cmcf->variables_hash_bucket_size;
     hash.name = "variables_hash";
+    hash.perfect = 0;
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
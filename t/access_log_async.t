@@ -0,0 +1,93 @@
+#!/usr/bin/perl
+
+# Tests for access_log: buffers written and compressed in a thread pool.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Uncompress::Gunzip qw/ gunzip $GunzipError /;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ http_get /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has_daemon()->has_module('threads');
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+daemon off;
+worker_processes 1;
+
+thread_pool logs threads=2;
+
+events {
+}
+
+http {
+    access_log off;
+
+    log_format test $request_uri;
+
+    server {
+        listen 127.0.0.1:%%PORT_0%%;
+        server_name localhost;
+
+        location /gzip {
+            access_log %%TESTDIR%%/gzip.log.gz test
+                       gzip=1 buffer=4k async=logs;
+            return 200 ok;
+        }
+
+        location /plain {
+            access_log %%TESTDIR%%/plain.log test buffer=4k async=logs;
+            return 200 ok;
+        }
+    }
+}
+
+EOF
+
+$t->run();
+
+plan(tests => 5);
+
+###############################################################################
+
+my $n = 2000;
+
+# many buffers are compressed in the threads while the event loop
+# keeps creating and destroying request pools
+
+for my $i (1 .. $n) {
+	http_get("/gzip/$i/" . ('x' x 64));
+	http_get("/plain/$i/" . ('x' x 64));
+}
+
+$t->stop();
+
+my ($gzip, @lines);
+
+gunzip(\$t->read_file('gzip.log.gz') => \$gzip, MultiStream => 1)
+	or diag("gunzip failed: $GunzipError");
+
+@lines = split(/\n/, $gzip // '');
+is(scalar @lines, $n, 'gzip entries');
+is(scalar(grep { m!^/gzip/\d+/x{64}$! } @lines), $n, 'gzip entries intact');
+
+@lines = split(/\n/, $t->read_file('plain.log'));
+is(scalar @lines, $n, 'plain entries');
+is(scalar(grep { m!^/plain/\d+/x{64}$! } @lines), $n, 'plain entries intact');
+
+unlike($t->read_file('error.log'), qr/\[(alert|crit|emerg)\]/, 'no errors');
+
+###############################################################################
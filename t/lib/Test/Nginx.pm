@@ -0,0 +1,193 @@
+package Test::Nginx;
+
+# (C) Nginx, Inc.
+
+# Minimal helpers to run nginx from the build tree in tests.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use base qw/ Exporter /;
+our @EXPORT_OK = qw/ http_get /;
+
+use File::Path qw/ rmtree /;
+use File::Temp qw/ tempdir /;
+use IO::Socket::INET;
+use POSIX qw/ waitpid WNOHANG /;
+use Time::HiRes qw/ sleep /;
+
+our $NGINX = defined $ENV{TEST_NGINX_BINARY} ? $ENV{TEST_NGINX_BINARY}
+	: '../objs/nginx';
+
+###############################################################################
+
+sub new {
+	my $self = bless {}, shift;
+
+	$self->{_testdir} = tempdir('nginx-test-XXXXXXXXXX', TMPDIR => 1);
+	chmod(0755, $self->{_testdir});
+
+	return $self;
+}
+
+sub DESTROY {
+	my ($self) = @_;
+
+	$self->stop();
+
+	if (!$ENV{TEST_NGINX_LEAVE}) {
+		rmtree($self->{_testdir});
+	}
+}
+
+sub testdir {
+	my ($self) = @_;
+	return $self->{_testdir};
+}
+
+sub has_daemon {
+	my ($self, $daemon) = @_;
+
+	Test::More::plan(skip_all => "$NGINX not found") unless -x $NGINX;
+
+	return $self;
+}
+
+sub has_module {
+	my ($self, $module) = @_;
+
+	my $v = `$NGINX -V 2>&1`;
+
+	Test::More::plan(skip_all => "no $module")
+		unless $v =~ /--with-$module\b/;
+
+	return $self;
+}
+
+sub write_file {
+	my ($self, $name, $content) = @_;
+
+	open my $fh, '>', $self->{_testdir} . '/' . $name
+		or die "Can't create $name: $!";
+	binmode $fh;
+	print $fh $content;
+	close $fh;
+
+	return $self;
+}
+
+sub write_file_expand {
+	my ($self, $name, $content) = @_;
+
+	$content =~ s/%%TESTDIR%%/$self->{_testdir}/gms;
+	$content =~ s/%%PORT_(\d+)%%/port($1)/gmse;
+
+	return $self->write_file($name, $content);
+}
+
+# ports depend on the test's pid, not on the pid of a forked helper
+
+my $port_base = 8000 + ($$ % 1000) * 10;
+
+sub port {
+	my ($num) = @_;
+	return $port_base + $num;
+}
+
+sub run {
+	my ($self) = @_;
+
+	my $testdir = $self->{_testdir};
+
+	my $pid = fork();
+	die "Unable to fork(): $!\n" unless defined $pid;
+
+	if ($pid == 0) {
+		my @globals = ('-g', "pid $testdir/nginx.pid; "
+			. "error_log $testdir/error.log debug;");
+		exec($NGINX, '-p', "$testdir/", '-c', 'nginx.conf',
+			'-e', "$testdir/error.log", @globals)
+			or die "Unable to exec(): $!\n";
+	}
+
+	$self->{_pid} = $pid;
+
+	for (1 .. 50) {
+		last if -e "$testdir/nginx.pid";
+		sleep(0.1);
+	}
+
+	die "Can't start nginx" unless -e "$testdir/nginx.pid";
+
+	return $self;
+}
+
+sub test_config {
+	my ($self) = @_;
+
+	my $testdir = $self->{_testdir};
+
+	return system($NGINX, '-t', '-q', '-p', "$testdir/", '-c', 'nginx.conf',
+		'-e', "$testdir/error.log",
+		'-g', "pid $testdir/test.pid; error_log $testdir/error.log;") == 0;
+}
+
+sub stop {
+	my ($self) = @_;
+
+	return $self unless $self->{_pid};
+
+	kill 'QUIT', $self->{_pid};
+
+	for (1 .. 50) {
+		last if waitpid($self->{_pid}, WNOHANG) != 0;
+		sleep(0.1);
+	}
+
+	kill 'KILL', $self->{_pid};
+	waitpid($self->{_pid}, 0);
+
+	delete $self->{_pid};
+
+	return $self;
+}
+
+sub read_file {
+	my ($self, $name) = @_;
+
+	open my $fh, '<', $self->{_testdir} . '/' . $name or return '';
+	local $/;
+	my $content = <$fh>;
+	close $fh;
+
+	return $content;
+}
+
+###############################################################################
+
+sub http_get {
+	my ($url, $port) = @_;
+
+	my $s = IO::Socket::INET->new(
+		Proto => 'tcp',
+		PeerAddr => '127.0.0.1:' . port($port || 0)
+	) or return undef;
+
+	$s->print("GET $url HTTP/1.0\r\nHost: localhost\r\n\r\n");
+
+	local $/;
+	local $SIG{ALRM} = sub { die "timeout\n" };
+	alarm(5);
+	my $reply = eval { $s->getline() };
+	alarm(0);
+
+	return $reply;
+}
+
+###############################################################################
+
+1;
+
+###############################################################################
@@ -0,0 +1,96 @@
+#!/usr/bin/perl
+
+# Tests for map: a large include is saved as a binary base and reused.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ http_get /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has_daemon();
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+daemon off;
+worker_processes 1;
+
+events {
+}
+
+http {
+    access_log off;
+
+    map $arg_k $plain {
+        include keys.conf;
+    }
+
+    map $arg_k $hostnames {
+        hostnames;
+        include keys.conf;
+    }
+
+    server {
+        listen 127.0.0.1:%%PORT_0%%;
+        server_name localhost;
+
+        location / {
+            return 200 "plain:$plain hostnames:$hostnames\n";
+        }
+    }
+}
+
+EOF
+
+$t->write_file('keys.conf',
+	join('', map { "k$_.example v$_;\n" } (1 .. 10001)));
+
+my $d = $t->testdir();
+
+plan(tests => 10);
+
+###############################################################################
+
+ok($t->test_config(), 'config test');
+ok(!-e "$d/keys.conf.bin" && !-e "$d/keys.conf.hostnames.bin",
+	'no binary base written by config test');
+
+$t->run();
+
+ok(-e "$d/keys.conf.bin" && -e "$d/keys.conf.hostnames.bin",
+	'binary base per map parameters');
+is(scalar(() = glob("$d/keys.conf*.bin.*")), 0, 'no temporary files left');
+
+like(http_get('/?k=k5.example'), qr/plain:v5 hostnames:v5$/m, 'lookup');
+like(http_get('/?k=k5.example.'), qr/plain: hostnames:v5$/m,
+	'hostnames trailing dot');
+
+$t->stop();
+
+$t->run();
+
+my $log = $t->read_file('error.log');
+
+like($log, qr/using binary map base ".*keys.conf.bin"/, 'plain base used');
+like($log, qr/using binary map base ".*keys.conf.hostnames.bin"/,
+	'hostnames base used');
+
+like(http_get('/?k=k10001.example.'), qr/plain: hostnames:v10001$/m,
+	'lookup from binary base');
+
+$t->stop();
+
+unlike($t->read_file('error.log'), qr/\[(alert|crit|emerg)\]/, 'no errors');
+
+###############################################################################
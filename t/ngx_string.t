@@ -0,0 +1,28 @@
+#!/usr/bin/perl
+
+# Differential test of ngx_string.c against byte-at-a-time versions,
+# see ngx_string_test.c.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir("$FindBin::Bin/.."); }
+
+###############################################################################
+
+plan(skip_all => 'no objs/Makefile, run ./configure') unless -f 'objs/Makefile';
+
+plan(tests => 2);
+
+###############################################################################
+
+my $out = `make -s -f misc/GNUmakefile string-test 2>/dev/null`;
+
+like($out, qr/ngx_string_test: \d+ iterations, 0 failures/, 'sse2');
+like($out, qr/ngx_string_test_swar: \d+ iterations, 0 failures/, 'swar');
+
+###############################################################################
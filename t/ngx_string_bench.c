@@ -0,0 +1,160 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Micro-benchmark of the scanning string functions in ngx_string.c
+ * against the byte-at-a-time reference versions in ngx_string_ref.c,
+ * on typical header names, URIs and user agents.  Prints ns per call.
+ *
+ *     make -f misc/GNUmakefile string-bench
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include "ngx_string_ref.h"
+
+#include <time.h>
+
+
+#define NGX_BENCH_CALLS  2000000
+
+
+typedef struct {
+    const char  *name;
+    ngx_uint_t   func;
+    const char  *input;
+} ngx_bench_t;
+
+
+static double ngx_bench_run(ngx_bench_t *b, ngx_uint_t ref);
+
+
+static u_char  ngx_bench_out[4096];
+
+/* keeps the compiler from dropping the calls */
+static volatile uintptr_t  ngx_bench_sink;
+
+
+static ngx_bench_t  ngx_benches[] = {
+
+    { "strlow, 15B header name", 0,
+      "Accept-Encoding" },
+
+    { "strlow, 64B uri", 0,
+      "/static/js/vendor/Jquery-3.6.0.MIN.js?v=20220301&Cache=Bust12345" },
+
+    { "escape_uri, 64B uri, copy", 1,
+      "/static/js/vendor/jquery-3.6.0/dist/images/icons/logo_large1.svg" },
+
+    { "escape_html, 107B user-agent", 2,
+      "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 "
+      "(KHTML, like Gecko) Chrome/99.0 Safari/537.36" },
+
+    { "escape_json, 107B user-agent", 3,
+      "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 "
+      "(KHTML, like Gecko) Chrome/99.0 Safari/537.36" },
+
+    { "unescape_uri, 43B", 4,
+      "/search/results/page%20two/index.html?q=a%2F" },
+
+    { "strnstr, 107B, \"Safari\"", 5,
+      "Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 "
+      "(KHTML, like Gecko) Chrome/99.0 Safari/537.36" },
+
+    { NULL, 0, NULL }
+};
+
+
+int
+main(int argc, char *const *argv) {
+    double old, new;
+    ngx_bench_t *b;
+
+    printf("%-32s %8s %8s\n", "ns per call", "old", "new");
+
+    for (b = ngx_benches; b->name; b++) {
+        old = ngx_bench_run(b, 1);
+        new = ngx_bench_run(b, 0);
+
+        printf("%-32s %8.1f %8.1f\n", b->name, old, new);
+    }
+
+    return 0;
+}
+
+
+static double
+ngx_bench_run(ngx_bench_t *b, ngx_uint_t ref) {
+    u_char *src, *dst, *s, *d;
+    size_t len;
+    ngx_uint_t i;
+    struct timespec start, end;
+    u_char in[256];
+
+    len = ngx_strlen(b->input);
+    src = in;
+    ngx_memcpy(src, b->input, len + 1);
+
+    dst = ngx_bench_out;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < NGX_BENCH_CALLS; i++) {
+
+        switch (b->func) {
+
+        case 0:
+            if (ref) {
+                ngx_ref_strlow(dst, src, len);
+            } else {
+                ngx_strlow(dst, src, len);
+            }
+            ngx_bench_sink += dst[0];
+            break;
+
+        case 1:
+            ngx_bench_sink += ref
+                ? ngx_ref_escape_uri(dst, src, len, NGX_ESCAPE_URI)
+                : ngx_escape_uri(dst, src, len, NGX_ESCAPE_URI);
+            break;
+
+        case 2:
+            ngx_bench_sink += ref ? ngx_ref_escape_html(dst, src, len)
+                                  : ngx_escape_html(dst, src, len);
+            break;
+
+        case 3:
+            ngx_bench_sink += ref ? ngx_ref_escape_json(dst, src, len)
+                                  : ngx_escape_json(dst, src, len);
+            break;
+
+        case 4:
+            d = dst;
+            s = src;
+
+            if (ref) {
+                ngx_ref_unescape_uri(&d, &s, len, NGX_UNESCAPE_URI);
+            } else {
+                ngx_unescape_uri(&d, &s, len, NGX_UNESCAPE_URI);
+            }
+
+            ngx_bench_sink += (uintptr_t) d;
+            break;
+
+        default:
+            ngx_bench_sink += (uintptr_t) (ref
+                ? ngx_ref_strnstr(src, "Safari", len)
+                : ngx_strnstr(src, "Safari", len));
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return ((end.tv_sec - start.tv_sec) * 1e9
+            + (end.tv_nsec - start.tv_nsec)) / NGX_BENCH_CALLS;
+}
@@ -0,0 +1,564 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Byte-at-a-time versions of the string functions as they were before
+ * the SSE2/SWAR scanning was added, used as the reference by
+ * ngx_string_test.c and ngx_string_bench.c.  Also provides the few
+ * symbols ngx_string.c needs from the rest of nginx.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include "ngx_string_ref.h"
+
+
+volatile ngx_cycle_t  *ngx_cycle;
+
+
+void *
+ngx_alloc(size_t size, ngx_log_t *log) {
+    return malloc(size);
+}
+
+
+void *
+ngx_pnalloc_from(ngx_pool_t *pool, size_t size, const char *file) {
+    return malloc(size);
+}
+
+
+void
+ngx_ref_strlow(u_char *dst, u_char *src, size_t n) {
+    while (n) {
+        *dst = ngx_tolower(*src);
+        dst++;
+        src++;
+        n--;
+    }
+}
+
+
+u_char *
+ngx_ref_strnstr(u_char *s1, char *s2, size_t len) {
+    u_char c1, c2;
+    size_t n;
+
+    c2 = *(u_char *) s2++;
+
+    n = ngx_strlen(s2);
+
+    do {
+        do {
+            if (len-- == 0) {
+                return NULL;
+            }
+
+            c1 = *s1++;
+
+            if (c1 == 0) {
+                return NULL;
+            }
+
+        } while (c1 != c2);
+
+        if (n > len) {
+            return NULL;
+        }
+
+    } while (ngx_strncmp(s1, (u_char *) s2, n) != 0);
+
+    return --s1;
+}
+
+
+uintptr_t
+ngx_ref_escape_uri(u_char *dst, u_char *src, size_t size, ngx_uint_t type) { //如果dst为空,则返回需要转义的字符有多少个.否则将字符串转义了,存放在dst里面.
+    ngx_uint_t n;
+    uint32_t *escape;
+    static u_char hex[] = "0123456789ABCDEF";
+
+    /*
+     * Per RFC 3986 only the following chars are allowed in URIs unescaped:
+     *
+     * unreserved    = ALPHA / DIGIT / "-" / "." / "_" / "~"
+     * gen-delims    = ":" / "/" / "?" / "#" / "[" / "]" / "@"
+     * sub-delims    = "!" / "$" / "&" / "'" / "(" / ")"
+     *               / "*" / "+" / "," / ";" / "="
+     *
+     * And "%" can appear as a part of escaping itself.  The following
+     * characters are not allowed and need to be escaped: %00-%1F, %7F-%FF,
+     * " ", """, "<", ">", "\", "^", "`", "{", "|", "}".
+     */
+
+    /* " ", "#", "%", "?", not allowed */
+
+    static uint32_t uri[] = {
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+
+            /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
+            0xd000002d, /* 1101 0000 0000 0000  0000 0000 0010 1101 */
+
+            /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
+            0x50000000, /* 0101 0000 0000 0000  0000 0000 0000 0000 */
+
+            /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
+            0xb8000001, /* 1011 1000 0000 0000  0000 0000 0000 0001 */
+
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff  /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+    };
+
+    /* " ", "#", "%", "&", "+", ";", "?", not allowed */
+
+    static uint32_t args[] = {
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+
+            /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
+            0xd800086d, /* 1101 1000 0000 0000  0000 1000 0110 1101 */
+
+            /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
+            0x50000000, /* 0101 0000 0000 0000  0000 0000 0000 0000 */
+
+            /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
+            0xb8000001, /* 1011 1000 0000 0000  0000 0000 0000 0001 */
+
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff  /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+    };
+
+    /* not ALPHA, DIGIT, "-", ".", "_", "~" */
+
+    static uint32_t uri_component[] = {
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+
+            /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
+            0xfc009fff, /* 1111 1100 0000 0000  1001 1111 1111 1111 */
+
+            /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
+            0x78000001, /* 0111 1000 0000 0000  0000 0000 0000 0001 */
+
+            /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
+            0xb8000001, /* 1011 1000 0000 0000  0000 0000 0000 0001 */
+
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff  /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+    };
+
+    /* " ", "#", """, "%", "'", not allowed */
+
+    static uint32_t html[] = {
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+
+            /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
+            0x500000ad, /* 0101 0000 0000 0000  0000 0000 1010 1101 */
+
+            /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
+            0x50000000, /* 0101 0000 0000 0000  0000 0000 0000 0000 */
+
+            /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
+            0xb8000001, /* 1011 1000 0000 0000  0000 0000 0000 0001 */
+
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff  /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+    };
+
+    /* " ", """, "'", not allowed */
+
+    static uint32_t refresh[] = {
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+
+            /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
+            0x50000085, /* 0101 0000 0000 0000  0000 0000 1000 0101 */
+
+            /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
+            0x50000000, /* 0101 0000 0000 0000  0000 0000 0000 0000 */
+
+            /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
+            0xd8000001, /* 1011 1000 0000 0000  0000 0000 0000 0001 */
+
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+            0xffffffff  /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+    };
+
+    /* " ", "%", %00-%1F */
+
+    static uint32_t memcached[] = {
+            0xffffffff, /* 1111 1111 1111 1111  1111 1111 1111 1111 */
+
+            /* ?>=< ;:98 7654 3210  /.-, +*)( '&%$ #"!  */
+            0x00000021, /* 0000 0000 0000 0000  0000 0000 0010 0001 */
+
+            /* _^]\ [ZYX WVUT SRQP  ONML KJIH GFED CBA@ */
+            0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+
+            /*  ~}| {zyx wvut srqp  onml kjih gfed cba` */
+            0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+
+            0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+            0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+            0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+            0x00000000, /* 0000 0000 0000 0000  0000 0000 0000 0000 */
+    };
+
+    /* mail_auth is the same as memcached */
+
+    static uint32_t *map[] =
+            {uri, args, uri_component, html, refresh, memcached, memcached};
+
+
+    escape = map[type];
+
+    if (dst == NULL) {
+
+        /* find the number of the characters to be escaped */
+
+        n = 0;
+
+        while (size) {
+            if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
+                n++;
+            }
+            src++;
+            size--;
+        }
+
+        return (uintptr_t) n;
+    }
+
+    while (size) {
+        if (escape[*src >> 5] & (1U << (*src & 0x1f))) {
+            *dst++ = '%';
+            *dst++ = hex[*src >> 4];
+            *dst++ = hex[*src & 0xf];
+            src++;
+
+        } else {
+            *dst++ = *src++;
+        }
+        size--;
+    }
+
+    return (uintptr_t) dst;
+}
+
+
+void
+ngx_ref_unescape_uri(u_char **dst, u_char **src, size_t size, ngx_uint_t type) {
+    u_char *d, *s, ch, c, decoded;
+    enum {
+        sw_usual = 0,
+        sw_quoted,
+        sw_quoted_second
+    } state;
+
+    d = *dst;
+    s = *src;
+
+    state = 0;
+    decoded = 0;
+
+    while (size--) {
+
+        ch = *s++;
+
+        switch (state) {
+            case sw_usual:
+                if (ch == '?'
+                    && (type & (NGX_UNESCAPE_URI | NGX_UNESCAPE_REDIRECT))) {
+                    *d++ = ch;
+                    goto done;
+                }
+
+                if (ch == '%') {
+                    state = sw_quoted;
+                    break;
+                }
+
+                *d++ = ch;
+                break;
+
+            case sw_quoted:
+
+                if (ch >= '0' && ch <= '9') {
+                    decoded = (u_char) (ch - '0');
+                    state = sw_quoted_second;
+                    break;
+                }
+
+                c = (u_char) (ch | 0x20);
+                if (c >= 'a' && c <= 'f') {
+                    decoded = (u_char) (c - 'a' + 10);
+                    state = sw_quoted_second;
+                    break;
+                }
+
+                /* the invalid quoted character */
+
+                state = sw_usual;
+
+                *d++ = ch;
+
+                break;
+
+            case sw_quoted_second:
+
+                state = sw_usual;
+
+                if (ch >= '0' && ch <= '9') {
+                    ch = (u_char) ((decoded << 4) + (ch - '0'));
+
+                    if (type & NGX_UNESCAPE_REDIRECT) {
+                        if (ch > '%' && ch < 0x7f) {
+                            *d++ = ch;
+                            break;
+                        }
+
+                        *d++ = '%';
+                        *d++ = *(s - 2);
+                        *d++ = *(s - 1);
+
+                        break;
+                    }
+
+                    *d++ = ch;
+
+                    break;
+                }
+
+                c = (u_char) (ch | 0x20);
+                if (c >= 'a' && c <= 'f') {
+                    ch = (u_char) ((decoded << 4) + (c - 'a') + 10);
+
+                    if (type & NGX_UNESCAPE_URI) {
+                        if (ch == '?') {
+                            *d++ = ch;
+                            goto done;
+                        }
+
+                        *d++ = ch;
+                        break;
+                    }
+
+                    if (type & NGX_UNESCAPE_REDIRECT) {
+                        if (ch == '?') {
+                            *d++ = ch;
+                            goto done;
+                        }
+
+                        if (ch > '%' && ch < 0x7f) {
+                            *d++ = ch;
+                            break;
+                        }
+
+                        *d++ = '%';
+                        *d++ = *(s - 2);
+                        *d++ = *(s - 1);
+                        break;
+                    }
+
+                    *d++ = ch;
+
+                    break;
+                }
+
+                /* the invalid quoted character */
+
+                break;
+        }
+    }
+
+    done:
+
+    *dst = d;
+    *src = s;
+}
+
+
+uintptr_t
+ngx_ref_escape_html(u_char *dst, u_char *src, size_t size) {
+    u_char ch;
+    ngx_uint_t len;
+
+    if (dst == NULL) {
+
+        len = 0;
+
+        while (size) {
+            switch (*src++) {
+
+                case '<':
+                    len += sizeof("&lt;") - 2;
+                    break;
+
+                case '>':
+                    len += sizeof("&gt;") - 2;
+                    break;
+
+                case '&':
+                    len += sizeof("&amp;") - 2;
+                    break;
+
+                case '"':
+                    len += sizeof("&quot;") - 2;
+                    break;
+
+                default:
+                    break;
+            }
+            size--;
+        }
+
+        return (uintptr_t) len;
+    }
+
+    while (size) {
+        ch = *src++;
+
+        switch (ch) {
+
+            case '<':
+                *dst++ = '&';
+                *dst++ = 'l';
+                *dst++ = 't';
+                *dst++ = ';';
+                break;
+
+            case '>':
+                *dst++ = '&';
+                *dst++ = 'g';
+                *dst++ = 't';
+                *dst++ = ';';
+                break;
+
+            case '&':
+                *dst++ = '&';
+                *dst++ = 'a';
+                *dst++ = 'm';
+                *dst++ = 'p';
+                *dst++ = ';';
+                break;
+
+            case '"':
+                *dst++ = '&';
+                *dst++ = 'q';
+                *dst++ = 'u';
+                *dst++ = 'o';
+                *dst++ = 't';
+                *dst++ = ';';
+                break;
+
+            default:
+                *dst++ = ch;
+                break;
+        }
+        size--;
+    }
+
+    return (uintptr_t) dst;
+}
+
+
+uintptr_t
+ngx_ref_escape_json(u_char *dst, u_char *src, size_t size) {
+    u_char ch;
+    ngx_uint_t len;
+
+    if (dst == NULL) {
+        len = 0;
+
+        while (size) {
+            ch = *src++;
+
+            if (ch == '\\' || ch == '"') {
+                len++;
+
+            } else if (ch <= 0x1f) {
+
+                switch (ch) {
+                    case '\n':
+                    case '\r':
+                    case '\t':
+                    case '\b':
+                    case '\f':
+                        len++;
+                        break;
+
+                    default:
+                        len += sizeof("\\u001F") - 2;
+                }
+            }
+
+            size--;
+        }
+
+        return (uintptr_t) len;
+    }
+
+    while (size) {
+        ch = *src++;
+
+        if (ch > 0x1f) {
+
+            if (ch == '\\' || ch == '"') {
+                *dst++ = '\\';
+            }
+
+            *dst++ = ch;
+
+        } else {
+            *dst++ = '\\';
+
+            switch (ch) {
+                case '\n':
+                    *dst++ = 'n';
+                    break;
+
+                case '\r':
+                    *dst++ = 'r';
+                    break;
+
+                case '\t':
+                    *dst++ = 't';
+                    break;
+
+                case '\b':
+                    *dst++ = 'b';
+                    break;
+
+                case '\f':
+                    *dst++ = 'f';
+                    break;
+
+                default:
+                    *dst++ = 'u';
+                    *dst++ = '0';
+                    *dst++ = '0';
+                    *dst++ = '0' + (ch >> 4);
+
+                    ch &= 0xf;
+
+                    *dst++ = (ch < 10) ? ('0' + ch) : ('A' + ch - 10);
+            }
+        }
+
+        size--;
+    }
+
+    return (uintptr_t) dst;
+}
@@ -0,0 +1,26 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#ifndef _NGX_STRING_REF_H_INCLUDED_
+#define _NGX_STRING_REF_H_INCLUDED_
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+
+void ngx_ref_strlow(u_char *dst, u_char *src, size_t n);
+u_char *ngx_ref_strnstr(u_char *s1, char *s2, size_t len);
+uintptr_t ngx_ref_escape_uri(u_char *dst, u_char *src, size_t size,
+    ngx_uint_t type);
+void ngx_ref_unescape_uri(u_char **dst, u_char **src, size_t size,
+    ngx_uint_t type);
+uintptr_t ngx_ref_escape_html(u_char *dst, u_char *src, size_t size);
+uintptr_t ngx_ref_escape_json(u_char *dst, u_char *src, size_t size);
+
+
+#endif /* _NGX_STRING_REF_H_INCLUDED_ */
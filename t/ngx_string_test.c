@@ -0,0 +1,238 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * Differential test of the scanning string functions in ngx_string.c
+ * against the byte-at-a-time reference versions in ngx_string_ref.c.
+ *
+ * Build ngx_string.c once as is (SSE2 on x86-64) and once with
+ * -DNGX_HAVE_SSE2=0 (SWAR), link each with this file and
+ * ngx_string_ref.c, and run: see t/ngx_string.t.
+ *
+ *     ngx_string_test [iterations] [seed]
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include "ngx_string_ref.h"
+
+
+#define NGX_TEST_MAX_LEN  300
+#define NGX_TEST_PAD      16
+
+
+static ngx_uint_t ngx_test_failed;
+
+
+static void ngx_test_fill(u_char *p, size_t len);
+static void ngx_test_fail(const char *func, ngx_uint_t iter, ngx_uint_t arg,
+    u_char *src, size_t len);
+
+
+int
+main(int argc, char *const *argv) {
+    u_char *src, *d1, *d2, *s1, *s2, *r1, *r2;
+    u_char in1[NGX_TEST_MAX_LEN + NGX_TEST_PAD];
+    u_char in2[NGX_TEST_MAX_LEN + NGX_TEST_PAD];
+    u_char out1[NGX_TEST_MAX_LEN * 6 + NGX_TEST_PAD];
+    u_char out2[NGX_TEST_MAX_LEN * 6 + NGX_TEST_PAD];
+    u_char buf[NGX_TEST_MAX_LEN + NGX_TEST_PAD + 1];
+    u_char needle[8];
+    size_t len, off, nlen;
+    uintptr_t n1, n2;
+    ngx_uint_t i, type, iterations;
+
+    iterations = (argc > 1) ? (ngx_uint_t) atoi(argv[1]) : 200000;
+    srandom((argc > 2) ? (unsigned) atoi(argv[2]) : 1);
+
+    for (i = 0; i < iterations; i++) {
+
+        len = random() % NGX_TEST_MAX_LEN;
+        off = random() % NGX_TEST_PAD;
+
+        src = buf + off;
+        ngx_test_fill(src, len);
+        src[len] = '\0';
+
+        /* ngx_strlow() */
+
+        ngx_memset(out1, 0, len + off + 1);
+        ngx_memset(out2, 0, len + off + 1);
+
+        ngx_strlow(out1 + off, src, len);
+        ngx_ref_strlow(out2 + off, src, len);
+
+        if (ngx_memcmp(out1, out2, len + off + 1) != 0) {
+            ngx_test_fail("ngx_strlow", i, 0, src, len);
+        }
+
+        /* ngx_strnstr(), needle taken from the input or random */
+
+        nlen = 1 + random() % (sizeof(needle) - 1);
+
+        if (len > nlen && random() % 2) {
+            ngx_memcpy(needle, src + random() % (len - nlen), nlen);
+
+        } else {
+            ngx_test_fill(needle, nlen);
+        }
+
+        needle[nlen] = '\0';
+
+        if (ngx_strlen(needle) > 0) {
+            r1 = ngx_strnstr(src, (char *) needle, len);
+            r2 = ngx_ref_strnstr(src, (char *) needle, len);
+
+            if (r1 != r2) {
+                ngx_test_fail("ngx_strnstr", i, 0, src, len);
+            }
+        }
+
+        /* ngx_escape_uri(), counting and copying */
+
+        for (type = NGX_ESCAPE_URI; type <= NGX_ESCAPE_MAIL_AUTH; type++) {
+
+            n1 = ngx_escape_uri(NULL, src, len, type);
+            n2 = ngx_ref_escape_uri(NULL, src, len, type);
+
+            if (n1 != n2) {
+                ngx_test_fail("ngx_escape_uri count", i, type, src, len);
+            }
+
+            d1 = (u_char *) ngx_escape_uri(out1, src, len, type);
+            d2 = (u_char *) ngx_ref_escape_uri(out2, src, len, type);
+
+            if (d1 - out1 != d2 - out2
+                || ngx_memcmp(out1, out2, d1 - out1) != 0)
+            {
+                ngx_test_fail("ngx_escape_uri", i, type, src, len);
+            }
+        }
+
+        /* ngx_unescape_uri(), separate and in place */
+
+        for (type = 0; type <= NGX_UNESCAPE_REDIRECT; type++) {
+
+            d1 = out1;
+            s1 = src;
+            d2 = out2;
+            s2 = src;
+
+            ngx_unescape_uri(&d1, &s1, len, type);
+            ngx_ref_unescape_uri(&d2, &s2, len, type);
+
+            if (d1 - out1 != d2 - out2 || s1 != s2
+                || ngx_memcmp(out1, out2, d1 - out1) != 0)
+            {
+                ngx_test_fail("ngx_unescape_uri", i, type, src, len);
+            }
+
+            ngx_memcpy(in1 + off, src, len);
+            ngx_memcpy(in2 + off, src, len);
+
+            d1 = in1 + off;
+            s1 = in1 + off;
+            d2 = in2 + off;
+            s2 = in2 + off;
+
+            ngx_unescape_uri(&d1, &s1, len, type);
+            ngx_ref_unescape_uri(&d2, &s2, len, type);
+
+            if (d1 - in1 != d2 - in2 || s1 - in1 != s2 - in2
+                || ngx_memcmp(in1 + off, in2 + off, len) != 0)
+            {
+                ngx_test_fail("ngx_unescape_uri in place", i, type, src, len);
+            }
+        }
+
+        /* ngx_escape_html() and ngx_escape_json() */
+
+        n1 = ngx_escape_html(NULL, src, len);
+        n2 = ngx_ref_escape_html(NULL, src, len);
+
+        d1 = (u_char *) ngx_escape_html(out1, src, len);
+        d2 = (u_char *) ngx_ref_escape_html(out2, src, len);
+
+        if (n1 != n2 || d1 - out1 != d2 - out2
+            || ngx_memcmp(out1, out2, d1 - out1) != 0)
+        {
+            ngx_test_fail("ngx_escape_html", i, 0, src, len);
+        }
+
+        n1 = ngx_escape_json(NULL, src, len);
+        n2 = ngx_ref_escape_json(NULL, src, len);
+
+        d1 = (u_char *) ngx_escape_json(out1, src, len);
+        d2 = (u_char *) ngx_ref_escape_json(out2, src, len);
+
+        if (n1 != n2 || d1 - out1 != d2 - out2
+            || ngx_memcmp(out1, out2, d1 - out1) != 0)
+        {
+            ngx_test_fail("ngx_escape_json", i, 0, src, len);
+        }
+
+        if (ngx_test_failed > 10) {
+            break;
+        }
+    }
+
+    printf("%s: %lu iterations, %lu failures\n", argv[0],
+           (unsigned long) i, (unsigned long) ngx_test_failed);
+
+    return ngx_test_failed ? 1 : 0;
+}
+
+
+/*
+ * mostly bytes the scanners skip, with runs of bytes that stop them:
+ * escapes, hex digits, upper case, controls, NUL and 8-bit bytes
+ */
+
+static void
+ngx_test_fill(u_char *p, size_t len) {
+    size_t i;
+    static u_char special[] = "%%%/?#&<>\"'\\ +=;:~AZaf09\r\n\t\x7f\x80\xff";
+
+    for (i = 0; i < len; i++) {
+        switch (random() % 8) {
+
+        case 0:
+            p[i] = special[random() % (sizeof(special) - 1)];
+            break;
+
+        case 1:
+            p[i] = (u_char) random();
+            break;
+
+        case 2:
+            p[i] = 'A' + random() % 26;
+            break;
+
+        default:
+            p[i] = 'a' + random() % 26;
+        }
+    }
+}
+
+
+static void
+ngx_test_fail(const char *func, ngx_uint_t iter, ngx_uint_t arg, u_char *src,
+    size_t len) {
+    size_t i;
+
+    ngx_test_failed++;
+
+    printf("%s(%lu) differs, iteration %lu, input:", func,
+           (unsigned long) arg, (unsigned long) iter);
+
+    for (i = 0; i < len; i++) {
+        printf(" %02x", src[i]);
+    }
+
+    printf("\n");
+}
@@ -0,0 +1,98 @@
+#!/usr/bin/perl
+
+# Tests for proxy_cache: a cached response is served from the cache file.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ http_get /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has_daemon();
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+daemon off;
+worker_processes 1;
+
+events {
+}
+
+http {
+    access_log off;
+
+    proxy_cache_path %%TESTDIR%%/cache levels=1:2 keys_zone=one:1m;
+
+    server {
+        listen 127.0.0.1:%%PORT_0%%;
+        server_name localhost;
+
+        location / {
+            proxy_pass http://127.0.0.1:%%PORT_1%%;
+            proxy_cache one;
+            proxy_cache_valid 200 1m;
+            add_header X-Cache-Status $upstream_cache_status;
+        }
+
+        location /open/ {
+            proxy_pass http://127.0.0.1:%%PORT_1%%/;
+            proxy_cache one;
+            proxy_cache_valid 200 1m;
+            add_header X-Cache-Status $upstream_cache_status;
+
+            open_file_cache max=16;
+        }
+    }
+
+    server {
+        listen 127.0.0.1:%%PORT_1%%;
+        server_name localhost;
+
+        location / {
+            root %%TESTDIR%%/html;
+        }
+    }
+}
+
+EOF
+
+mkdir($t->testdir() . '/html');
+$t->write_file('html/t.html', 'SEE-THIS' x 1024);
+$t->write_file('html/u.html', 'SEE-THAT' x 1024);
+
+$t->run();
+
+plan(tests => 6);
+
+###############################################################################
+
+like(http_get('/t.html'), qr/X-Cache-Status: MISS.*SEE-THIS/ms, 'miss');
+like(http_get('/t.html'), qr/200 OK.*X-Cache-Status: HIT.*SEE-THIS/ms, 'hit');
+
+unlink($t->testdir() . '/html/t.html');
+
+like(http_get('/t.html'), qr/X-Cache-Status: HIT.*SEE-THIS/ms,
+	'hit without backend file');
+
+like(http_get('/open/u.html'), qr/X-Cache-Status: MISS.*SEE-THAT/ms,
+	'open file cache miss');
+like(http_get('/open/u.html'), qr/200 OK.*X-Cache-Status: HIT.*SEE-THAT/ms,
+	'open file cache hit');
+
+$t->stop();
+
+unlike($t->read_file('error.log'), qr/\[(alert|crit|emerg)\]|pread\(\)/,
+	'no errors');
+
+###############################################################################
@@ -0,0 +1,137 @@
+#!/usr/bin/perl
+
+# Tests for the shared resolver cache: a failed prefetch keeps the answer.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Socket::INET;
+use Time::HiRes qw/ sleep /;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ http_get /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has_daemon();
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+daemon off;
+worker_processes 1;
+
+events {
+}
+
+http {
+    access_log off;
+
+    resolver 127.0.0.1:%%PORT_2%% valid=2s zone=rz:1m;
+    resolver_timeout 1s;
+
+    server {
+        listen 127.0.0.1:%%PORT_0%%;
+        server_name localhost;
+
+        location / {
+            set $backend backend.example;
+            proxy_pass http://$backend:%%PORT_1%%/t;
+        }
+    }
+
+    server {
+        listen 127.0.0.1:%%PORT_1%%;
+        server_name localhost;
+
+        location /t {
+            return 200 "SEE-THIS";
+        }
+    }
+}
+
+EOF
+
+my $dns = fork();
+die "Unable to fork(): $!\n" unless defined $dns;
+
+if ($dns == 0) {
+	dns_daemon(Test::Nginx::port(2), $t);
+	exit 0;
+}
+
+$t->run();
+
+plan(tests => 4);
+
+###############################################################################
+
+like(http_get('/'), qr/SEE-THIS/, 'resolved');
+
+# the answer is in its last second, the request triggers a prefetch
+# which gets SERVFAIL
+
+sleep(1.2);
+like(http_get('/'), qr/SEE-THIS/, 'prefetch');
+
+sleep(0.3);
+like(http_get('/'), qr/SEE-THIS/, 'answer kept after failed prefetch');
+
+$t->stop();
+
+kill 'TERM', $dns;
+waitpid($dns, 0);
+
+unlike($t->read_file('error.log'), qr/\[(alert|crit|emerg)\]/, 'no errors');
+
+###############################################################################
+
+# answers the first A query with 127.0.0.1, everything else with SERVFAIL
+
+sub dns_daemon {
+	my ($port, $t) = @_;
+
+	my $socket = IO::Socket::INET->new(
+		LocalAddr => '127.0.0.1',
+		LocalPort => $port,
+		Proto => 'udp',
+	)
+		or die "Can't create listening socket: $!\n";
+
+	my $count = 0;
+
+	while (1) {
+		my $recv_data;
+		$socket->recv($recv_data, 65536) or next;
+
+		my ($id, $flags, $qd) = unpack('nnn', $recv_data);
+		my $question = substr($recv_data, 12);
+		my $type = unpack('n', substr($question, index($question, "\0") + 1));
+
+		if ($type == 1 && $count++ == 0) {
+			$socket->send(pack('n6', $id, 0x8180, 1, 1, 0, 0)
+				. $question
+				. pack('n3Nn', 0xc00c, 1, 1, 60, 4)
+				. pack('C4', 127, 0, 0, 1));
+
+		} elsif ($type == 1) {
+			$socket->send(pack('n6', $id, 0x8182, 1, 0, 0, 0)
+				. $question);
+
+		} else {
+			# no AAAA records
+			$socket->send(pack('n6', $id, 0x8180, 1, 0, 0, 0)
+				. $question);
+		}
+	}
+}
+
+###############################################################################
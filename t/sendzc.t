@@ -0,0 +1,121 @@
+#!/usr/bin/perl
+
+# Tests for sendzc: the memory of a connection closed with zerocopy sends
+# in flight is released only after the kernel is done with it.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+use IO::Socket::INET;
+use Socket qw/ SOL_SOCKET SO_RCVBUF /;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ http_get /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+plan(skip_all => 'MSG_ZEROCOPY is Linux only') unless $^O eq 'linux';
+
+my $t = Test::Nginx->new()->has_daemon();
+
+$t->write_file_expand('nginx.conf', <<'EOF');
+
+daemon off;
+worker_processes 1;
+
+events {
+}
+
+http {
+    access_log off;
+
+    server {
+        listen 127.0.0.1:%%PORT_0%%;
+        server_name localhost;
+
+        sendzc on;
+        send_timeout 1s;
+        reset_timedout_connection on;
+
+        location / {
+            proxy_pass http://127.0.0.1:%%PORT_1%%;
+            proxy_buffers 64 64k;
+            proxy_max_temp_file_size 0;
+        }
+    }
+
+    server {
+        listen 127.0.0.1:%%PORT_1%%;
+        server_name localhost;
+
+        location / {
+            root %%TESTDIR%%/html;
+        }
+    }
+}
+
+EOF
+
+my $body = join('', map { sprintf('%07d ', $_) } (1 .. 500000));
+
+mkdir($t->testdir() . '/html');
+$t->write_file('html/big.txt', $body);
+
+$t->run();
+
+plan(tests => 4);
+
+###############################################################################
+
+is(get_body('/big.txt'), $body, 'response');
+
+# clients which stop reading, the connections are closed by send_timeout
+
+my @stalled = map { stalled('/big.txt') } (1 .. 3);
+
+sleep(3);
+
+like($t->read_file('error.log'),
+	qr/sendzc: \d+ bytes still in flight, resetting connection/,
+	'closed with sends in flight');
+
+is(get_body('/big.txt'), $body, 'response after stalled clients');
+
+$t->stop();
+
+unlike($t->read_file('error.log'), qr/\[(alert|crit|emerg)\]/, 'no errors');
+
+###############################################################################
+
+sub get_body {
+	my ($uri) = @_;
+
+	my $r = http_get($uri) or return undef;
+	$r =~ s/.*?\r\n\r\n//s;
+
+	return $r;
+}
+
+sub stalled {
+	my ($uri) = @_;
+
+	my $s = IO::Socket::INET->new(Proto => 'tcp') or return undef;
+	$s->setsockopt(SOL_SOCKET, SO_RCVBUF, 4096);
+	$s->connect(pack_sockaddr_in(Test::Nginx::port(0), inet_aton('127.0.0.1')))
+		or return undef;
+
+	$s->print("GET $uri HTTP/1.0\r\nHost: localhost\r\n\r\n");
+
+	return $s;
+}
+
+###############################################################################
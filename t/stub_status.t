@@ -0,0 +1,131 @@
+#!/usr/bin/perl
+
+# Tests for stub_status: optional large allocation, zone, thread pool
+# and accept mutex statistics.
+
+###############################################################################
+
+use warnings;
+use strict;
+
+use Test::More;
+
+BEGIN { use FindBin; chdir($FindBin::Bin); }
+
+use lib 'lib';
+use Test::Nginx qw/ http_get /;
+
+###############################################################################
+
+select STDERR; $| = 1;
+select STDOUT; $| = 1;
+
+my $t = Test::Nginx->new()->has_daemon()
+	->has_module('http_stub_status_module');
+
+# thread pools exist only in a build with threads
+
+my $threads = `$Test::Nginx::NGINX -V 2>&1` =~ /--with-threads\b/;
+
+(my $conf = <<'EOF') =~ s/%%THREAD_POOL%%/$threads ? 'thread_pool one threads=2;' : ''/e;
+
+daemon off;
+worker_processes 1;
+
+%%THREAD_POOL%%
+
+events {
+}
+
+http {
+    access_log off;
+
+    proxy_cache_path %%TESTDIR%%/cache keys_zone=one:1m;
+
+    server {
+        listen 127.0.0.1:%%PORT_0%%;
+        server_name localhost;
+
+        location /status {
+            stub_status;
+        }
+
+        location /legacy {
+            stub_status on;
+        }
+
+        location /large {
+            stub_status large_allocs;
+        }
+
+        location /zones {
+            stub_status zones;
+        }
+
+        location /threads {
+            stub_status threads;
+        }
+
+        location /locks {
+            stub_status locks;
+        }
+
+        location /big {
+            root %%TESTDIR%%;
+        }
+    }
+}
+
+EOF
+
+$t->write_file_expand('nginx.conf', $conf);
+$t->write_file('big', 'X' x 100000);
+
+$t->run();
+
+plan(tests => 14);
+
+###############################################################################
+
+http_get('/big');
+
+my $r = http_get('/status');
+like($r, qr/Active connections: \d+/, 'basic');
+unlike($r, qr/Large alloc/, 'no large allocs by default');
+unlike($r, qr/^Zone /m, 'no zones by default');
+unlike($r, qr/^Thread pool /m, 'no thread pools by default');
+unlike($r, qr/^Accept mutex/m, 'no accept mutex by default');
+like($r, qr/\x0d\x0a\x0d\x0aActive\ connections:\ \d+\ \n
+	server\ accepts\ handled\ requests\n
+	\ \d+\ \d+\ \d+\ \n
+	Reading:\ \d+\ Writing:\ \d+\ Waiting:\ \d+\ \n\z/x,
+	'default format');
+
+like(http_get('/legacy'), qr/Active connections: \d+/, 'legacy "on"');
+
+$r = http_get('/large');
+like($r, qr/^Large alloc ngx_\w+: allocs \d+ bytes \d+ current \d+ $/m,
+	'large allocs by source file');
+unlike($r, qr/0x[0-9a-f]|\+/, 'no addresses');
+
+$r = http_get('/zones');
+like($r, qr/^Zone one: pages \d+ free \d+ runs \d+ largest \d+ /m, 'zone');
+like($r, qr/^Zone one lock: acquisitions \d+ /m, 'zone lock');
+
+SKIP: {
+skip 'no threads', 1 unless $threads;
+
+like(http_get('/threads'),
+	qr/^Thread pool one: threads \d+ queued \d+ tasks \d+ /m, 'thread pool');
+
+}
+
+like(http_get('/locks'),
+	qr/^Accept mutex: acquisitions \d+ contended \d+ spins \d+ /m,
+	'accept mutex');
+
+$t->stop();
+
+unlike($t->read_file('error.log'), qr/\[(alert|crit|emerg)\]/, 'no errors');
+
+###############################################################################